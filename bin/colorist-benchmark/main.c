@@ -80,7 +80,7 @@ int main(int argc, char * argv[])
     clContext * C = clContextCreate(&silentSystem);
     struct clImage * image = NULL;
 
-    C->params.readCodec = readCodec;
+    C->params.readParams.codec = readCodec;
 
     int width = 0;
     int height = 0;
@@ -95,7 +95,7 @@ int main(int argc, char * argv[])
     for (int attempt = 0; attempt < attempts; ++attempt) {
         Timer t;
         timerStart(&t);
-        image = clContextRead(C, inputFilename, NULL, NULL);
+        image = clContextRead(C, inputFilename, NULL, &C->params.readParams, NULL);
         elapsedTotal += timerElapsedSeconds(&t);
         elapsedCodec += C->readExtraInfo.decodeCodecSeconds;
         elapsedYUV += C->readExtraInfo.decodeYUVtoRGBSeconds;
@@ -92,11 +92,11 @@ int suiteTearDown(int num_failures)
 // --------------------------------------------------------------------------------------
 // Main / List of active tests
 
-static clBool shouldRun(const char * cmdlineName, int argc, char * argv[])
+static clBool shouldRun(const char * cmdlineName, clBool runByDefault, int argc, char * argv[])
 {
     if (argc < 2) {
-        // run everything
-        return clTrue;
+        // run everything (that isn't too slow to run every time)
+        return runByDefault;
     }
 
     // Only run names on the cmdline
@@ -108,17 +108,19 @@ static clBool shouldRun(const char * cmdlineName, int argc, char * argv[])
     return clFalse;
 }
 
-#define RUN_TESTS(TESTS, CMDLINENAME, TITLE)      \
-    do {                                          \
-        if (shouldRun(CMDLINENAME, argc, argv)) { \
-            printf("_______________________\n");  \
-            printf("%s\n", TITLE);                \
-            printf("-----------------------\n");  \
-            int ret = TESTS();                    \
-            if (ret != 0)                         \
-                return ret;                       \
-        }                                         \
+#define RUN_TESTS_IMPL(TESTS, CMDLINENAME, TITLE, RUNBYDEFAULT) \
+    do {                                                        \
+        if (shouldRun(CMDLINENAME, RUNBYDEFAULT, argc, argv)) { \
+            printf("_______________________\n");                \
+            printf("%s\n", TITLE);                              \
+            printf("-----------------------\n");                \
+            int ret = TESTS();                                  \
+            if (ret != 0)                                       \
+                return ret;                                     \
+        }                                                       \
     } while (0)
+#define RUN_TESTS(TESTS, CMDLINENAME, TITLE) RUN_TESTS_IMPL(TESTS, CMDLINENAME, TITLE, clTrue)
+#define RUN_EXPLICIT_TESTS(TESTS, CMDLINENAME, TITLE) RUN_TESTS_IMPL(TESTS, CMDLINENAME, TITLE, clFalse)
 
 int main(int argc, char * argv[])
 {
@@ -135,8 +137,10 @@ int main(int argc, char * argv[])
     silentSystem.error = clContextSilentLogError;
 
     RUN_TESTS(test_coverage, "coverage", "Coverage");
+    RUN_TESTS(test_curves, "curves", "Transfer Functions");
     RUN_TESTS(test_io, "io", "I/O");
     RUN_TESTS(test_strings, "strings", "Image Strings");
+    RUN_EXPLICIT_TESTS(test_curvereport, "curvereport", "Transfer Function Accuracy Report");
 
     return 0;
 }
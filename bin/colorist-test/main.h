@@ -25,5 +25,7 @@ extern clContextSystem silentSystem;
 
 // Test suites, named after their associated .c file
 int test_coverage(void);
+int test_curves(void);
+int test_curvereport(void); // exhaustive; only runs when named on the command line
 int test_io(void);
 int test_strings(void);
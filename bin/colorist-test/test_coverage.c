@@ -7,6 +7,11 @@
 
 #include "main.h"
 
+#include "colorist/pixelmath.h"
+#include "colorist/transform.h"
+
+#include <math.h>
+
 // ------------------------------------------------------------------------------------------------
 // The tests in here are to attempt to hit 100% code coverage (when running scripts/coverage.sh).
 // colorist-test shouldn't have to run any other test suites but test_coverage() to achieve this.
@@ -46,6 +51,7 @@ static void test_clAction(void)
     TEST_ASSERT_EQUAL_INT(CL_ACTION_CALC, clActionFromString(C, "calc"));
     TEST_ASSERT_EQUAL_INT(CL_ACTION_CONVERT, clActionFromString(C, "convert"));
     TEST_ASSERT_EQUAL_INT(CL_ACTION_MODIFY, clActionFromString(C, "modify"));
+    TEST_ASSERT_EQUAL_INT(CL_ACTION_BATCH, clActionFromString(C, "batch"));
     TEST_ASSERT_EQUAL_INT(CL_ACTION_ERROR, clActionFromString(C, "derp"));
 
     TEST_ASSERT_EQUAL_STRING("--", clActionToString(C, CL_ACTION_NONE));
@@ -53,6 +59,7 @@ static void test_clAction(void)
     TEST_ASSERT_EQUAL_STRING("generate", clActionToString(C, CL_ACTION_GENERATE));
     TEST_ASSERT_EQUAL_STRING("calc", clActionToString(C, CL_ACTION_CALC));
     TEST_ASSERT_EQUAL_STRING("convert", clActionToString(C, CL_ACTION_CONVERT));
+    TEST_ASSERT_EQUAL_STRING("batch", clActionToString(C, CL_ACTION_BATCH));
     TEST_ASSERT_EQUAL_STRING("modify", clActionToString(C, CL_ACTION_MODIFY));
     TEST_ASSERT_EQUAL_STRING("unknown", clActionToString(C, CL_ACTION_ERROR));
     TEST_ASSERT_EQUAL_STRING("unknown", clActionToString(C, (clAction)555));
@@ -272,9 +279,28 @@ static void test_clContextParseArgs(void)
                                 "iccin.icc",   "-j",        "4",         "-j",          "0",          "--json",   "-l",
                                 "1000",        "-l",        "s",         "--iccout",    "iccout.icc", "-q",       "50",
                                 "--striptags", "lumi",      "-t",        "on",          "-v",         "--cmm",    "lcms",
-                                "--cmm",       "ccmm",      "--rect",    "0,0,1,1",     "--crop",     "0,0,1,1",  "--rate",
-                                "50" };
+                                "--cmm",       "ccmm",      "--simd",    "off",         "--simd",     "on",       "--rect",
+                                "0,0,1,1",     "--crop",    "0,0,1,1",   "--rate",      "50",         "--precision", "fast" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    {
+        // autograde search options
+        const char * argv[] = { "colorist",         "convert", "input.png",     "output.png", "-a", "--grade-search", "sweep",
+                                "--grade-precision", "0.05",    "--grade-iterations", "8",     "--grade-sample", "4" };
         TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+        TEST_ASSERT_EQUAL_INT(CL_GRADESEARCH_SWEEP, C->params.gradeParams.search);
+        TEST_ASSERT_EQUAL_FLOAT(0.05f, C->params.gradeParams.precision);
+        TEST_ASSERT_EQUAL_INT(8, C->params.gradeParams.maxIterations);
+        TEST_ASSERT_EQUAL_INT(4, C->params.gradeParams.sampleStep);
+    }
+
+    {
+        // unknown grade search, and a precision too fine to be useful
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--grade-search", "derp" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+        const char * argv2[] = { "colorist", "convert", "input.png", "output.png", "--grade-precision", "0" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv2)));
     }
 
     {
@@ -319,6 +345,18 @@ static void test_clContextParseArgs(void)
         TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
     }
 
+    {
+        // unknown SIMD mode
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--simd", "derp" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    {
+        // unknown curve precision
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--precision", "derp" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
     {
         // unknown parameter
         const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--derp" };
@@ -425,10 +463,402 @@ static void test_clContextParseArgs(void)
         TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
     }
 
+    {
+        // batch requires a manifest or glob
+        const char * argv[] = { "colorist", "batch" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    {
+        const char * argv[] = { "colorist", "batch", "*.jxr", "out", "-f", "avif", "--batch-memory", "512" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+        TEST_ASSERT_EQUAL_STRING("*.jxr", C->batchSource);
+        TEST_ASSERT_EQUAL_STRING("out", C->batchOutputDir);
+        TEST_ASSERT_EQUAL_INT(512, C->batchMemoryMB);
+    }
+
+    {
+        const char * argv[] = { "colorist", "batch", "jobs.txt", "--batch-memory", "0" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
     clContextPrintSyntax(C);
     clContextDestroy(C);
 }
 
+static void test_batchJobArgs(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    const char * argv[] = { "colorist", "batch", "jobs.txt", "-f", "avif", "-q", "70" };
+    TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+
+    // A job's options layer on top of the batch's, without touching C->params
+    clConversionParams params;
+    memcpy(&params, &C->params, sizeof(params));
+    const char * filenames[2] = { NULL, NULL };
+    const char * jobArgv[] = { "batch", "a.jxr", "a.avif", "-q", "40", "--resize", "100,0", "--frameindex", "2" };
+    TEST_ASSERT_TRUE(clContextParseJobArgs(C, &params, ARGS(jobArgv), filenames));
+    TEST_ASSERT_EQUAL_STRING("a.jxr", filenames[0]);
+    TEST_ASSERT_EQUAL_STRING("a.avif", filenames[1]);
+    TEST_ASSERT_EQUAL_STRING("avif", params.formatName);
+    TEST_ASSERT_EQUAL_INT(40, params.writeParams.quality);
+    TEST_ASSERT_EQUAL_INT(100, params.resizeW);
+    TEST_ASSERT_EQUAL_UINT32(2, params.readParams.frameIndex);
+    TEST_ASSERT_EQUAL_INT(70, C->params.writeParams.quality);
+    TEST_ASSERT_EQUAL_INT(0, C->params.resizeW);
+    TEST_ASSERT_EQUAL_UINT32(0, C->params.readParams.frameIndex);
+    TEST_ASSERT_EQUAL_INT(CL_ACTION_BATCH, C->action);
+
+    const char * badArgv[] = { "batch", "b.jxr", "b.avif", "-f", "nope" };
+    filenames[0] = filenames[1] = NULL;
+    TEST_ASSERT_FALSE(clContextParseJobArgs(C, &params, ARGS(badArgv), filenames));
+
+    clContextDestroy(C);
+}
+
+static void test_convertMemory(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    clImage * image = clImageParseString(C, "64x32,(255,0,0)..(0,0,255)", 8, NULL);
+    TEST_ASSERT_NOT_NULL(image);
+    clRaw input = CL_RAW_EMPTY;
+    clWriteParams writeParams;
+    clWriteParamsSetDefaults(C, &writeParams);
+    TEST_ASSERT_TRUE(clContextWriteMemory(C, image, "png", &writeParams, &input));
+    TEST_ASSERT_EQUAL_STRING("png", clFormatDetectRaw(C, &input));
+    clImageDestroy(C, image);
+
+    clConversionParams params;
+    clConversionParamsSetDefaults(C, &params);
+    params.formatName = "png";
+    params.bpc = 16;
+    params.resizeW = 16;
+    params.resizeH = 8;
+    params.resizeFilter = CL_FILTER_NEAREST;
+
+    clConversionParams halfParams;
+    memcpy(&halfParams, &params, sizeof(halfParams));
+    halfParams.bpc = 8;
+    halfParams.resizeW = 32;
+    halfParams.resizeH = 16;
+
+    clConversionParams contextParams;
+    memcpy(&contextParams, &C->params, sizeof(contextParams));
+
+    // Different params through the same context, interleaved
+    for (int pass = 0; pass < 2; ++pass) {
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(C, &input, &params, &output));
+        clImage * converted = clContextReadMemory(C, &output, NULL, NULL, NULL);
+        TEST_ASSERT_NOT_NULL(converted);
+        TEST_ASSERT_EQUAL_INT(16, converted->width);
+        TEST_ASSERT_EQUAL_INT(8, converted->height);
+        TEST_ASSERT_EQUAL_INT(16, converted->depth);
+        clImageDestroy(C, converted);
+        clRawFree(C, &output);
+
+        TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(C, &input, &halfParams, &output));
+        converted = clContextReadMemory(C, &output, "png", NULL, NULL);
+        TEST_ASSERT_NOT_NULL(converted);
+        TEST_ASSERT_EQUAL_INT(32, converted->width);
+        TEST_ASSERT_EQUAL_INT(8, converted->depth);
+        clImageDestroy(C, converted);
+        clRawFree(C, &output);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(&contextParams, &C->params, sizeof(contextParams));
+    TEST_ASSERT_NULL(C->inputFilename);
+    TEST_ASSERT_NULL(C->outputFilename);
+
+    // Profile extraction
+    {
+        clConversionParams iccParams;
+        clConversionParamsSetDefaults(C, &iccParams);
+        iccParams.formatName = "icc";
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(C, &input, &iccParams, &output));
+        TEST_ASSERT_TRUE(output.size > 0);
+        clRawFree(C, &output);
+    }
+
+    // Failures leave output empty
+    {
+        clRaw garbage = CL_RAW_EMPTY;
+        clRawSet(C, &garbage, (const uint8_t *)"not an image", 12);
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_EQUAL_INT(1, clContextConvertMemory(C, &garbage, &params, &output));
+        TEST_ASSERT_NULL(output.ptr);
+        clRawFree(C, &garbage);
+    }
+
+    clRawFree(C, &input);
+    clContextDestroy(C);
+}
+
+// A stand-in image sequence for the read params tests: "CLSEQ" followed by one byte per frame. Each frame
+// decodes to a 4x4 8-bit gray image of that byte's level.
+#define SEQUENCE_SIGNATURE "CLSEQ"
+#define SEQUENCE_SIGNATURE_SIZE 5
+
+static clBool sequenceDetect(struct clContext * C, struct clFormat * format, struct clRaw * input)
+{
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(format);
+
+    return (input->size > SEQUENCE_SIGNATURE_SIZE) && !memcmp(input->ptr, SEQUENCE_SIGNATURE, SEQUENCE_SIGNATURE_SIZE);
+}
+
+static clImage * sequenceRead(struct clContext * C,
+                              const char * formatName,
+                              struct clProfile * overrideProfile,
+                              struct clRaw * input,
+                              const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+
+    if (!sequenceDetect(C, NULL, input)) {
+        return NULL;
+    }
+    uint32_t frameCount = (uint32_t)input->size - SEQUENCE_SIGNATURE_SIZE;
+    if (readParams->frameIndex >= frameCount) {
+        return NULL;
+    }
+    uint8_t level = input->ptr[SEQUENCE_SIGNATURE_SIZE + readParams->frameIndex];
+
+    clImage * image = clImageCreate(C, 4, 4, 8, overrideProfile);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
+    for (int i = 0; i < 4 * 4; ++i) {
+        uint8_t * pixel = &image->pixelsU8[i * CL_CHANNELS_PER_PIXEL];
+        pixel[0] = pixel[1] = pixel[2] = level;
+        pixel[3] = 255;
+    }
+    C->readExtraInfo.frameIndex = (int)readParams->frameIndex;
+    C->readExtraInfo.frameCount = (int)frameCount;
+    return image;
+}
+
+static void registerSequenceFormat(clContext * C)
+{
+    clFormat format;
+    memset(&format, 0, sizeof(format));
+    format.name = "clseq";
+    format.description = "Test image sequence";
+    format.mimeType = "image/x-clseq";
+    format.extensions[0] = "clseq";
+    format.depth = CL_FORMAT_DEPTH_8;
+    format.detectFunc = sequenceDetect;
+    format.readFunc = sequenceRead;
+    clContextRegisterFormat(C, &format);
+}
+
+// Decodes a converted PNG and returns its first pixel's red channel
+static int convertedLevel(clContext * C, clRaw * output)
+{
+    clImage * converted = clContextReadMemory(C, output, "png", NULL, NULL);
+    TEST_ASSERT_NOT_NULL(converted);
+    clImagePrepareReadPixels(C, converted, CL_PIXELFORMAT_U8);
+    int level = converted->pixelsU8[0];
+    clImageDestroy(C, converted);
+    return level;
+}
+
+static void test_convertMemoryFrames(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    registerSequenceFormat(C);
+
+    static const uint8_t sequence[] = { 'C', 'L', 'S', 'E', 'Q', 10, 80, 150, 220 };
+    clRaw input = CL_RAW_EMPTY;
+    clRawSet(C, &input, sequence, sizeof(sequence));
+    TEST_ASSERT_EQUAL_STRING("clseq", clFormatDetectRaw(C, &input));
+
+    // The context's own frame index must not leak into clContextConvertMemory()
+    C->params.readParams.frameIndex = 3;
+
+    clConversionParams params[2];
+    clConversionParamsSetDefaults(C, &params[0]);
+    params[0].formatName = "png";
+    params[0].bpc = 8;
+    memcpy(&params[1], &params[0], sizeof(clConversionParams));
+    params[1].readParams.frameIndex = 2;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(C, &input, &params[0], &output));
+        TEST_ASSERT_EQUAL_INT(10, convertedLevel(C, &output));
+        clRawFree(C, &output);
+
+        TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(C, &input, &params[1], &output));
+        TEST_ASSERT_EQUAL_INT(150, convertedLevel(C, &output));
+        clRawFree(C, &output);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, C->params.readParams.frameIndex);
+
+    // A frame the sequence doesn't have fails cleanly
+    {
+        clConversionParams outOfRange;
+        memcpy(&outOfRange, &params[0], sizeof(clConversionParams));
+        outOfRange.readParams.frameIndex = 4;
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_EQUAL_INT(1, clContextConvertMemory(C, &input, &outOfRange, &output));
+        TEST_ASSERT_NULL(output.ptr);
+    }
+
+    clRawFree(C, &input);
+    clContextDestroy(C);
+}
+
+static void test_batchFrames(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    // clContextRead() hands every file to the jxr reader, so stand the sequence reader in for it
+    clContextFindFormat(C, "jxr")->readFunc = sequenceRead;
+
+    static const uint8_t sequence[] = { 'C', 'L', 'S', 'E', 'Q', 10, 80, 150, 220 };
+    clRaw input = CL_RAW_EMPTY;
+    clRawSet(C, &input, sequence, sizeof(sequence));
+    TEST_ASSERT_TRUE(clRawWriteFile(C, &input, L"test_batch_frames.jxr"));
+    clRawFree(C, &input);
+
+    // Only the second line picks a frame; the third overrides the batch's own --frameindex
+    FILE * manifest = fopen("test_batch_frames.txt", "wb");
+    TEST_ASSERT_NOT_NULL(manifest);
+    fputs("test_batch_frames.jxr test_batch_frames_a.png\n", manifest);
+    fputs("test_batch_frames.jxr test_batch_frames_b.png --frameindex 3\n", manifest);
+    fputs("test_batch_frames.jxr test_batch_frames_c.png --frameindex 0\n", manifest);
+    fclose(manifest);
+
+    const char * argv[] = { "colorist", "batch", "test_batch_frames.txt", "-f", "png", "-b", "8", "--frameindex", "1" };
+    TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+    cJSON * jsonOutput = cJSON_CreateObject();
+    TEST_ASSERT_EQUAL_INT(0, clContextBatch(C, jsonOutput));
+    cJSON_Delete(jsonOutput);
+
+    static const wchar_t * outputs[3] = { L"test_batch_frames_a.png", L"test_batch_frames_b.png", L"test_batch_frames_c.png" };
+    static const int expectedLevels[3] = { 80, 220, 10 };
+    for (int i = 0; i < 3; ++i) {
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_TRUE(clRawReadFile(C, &output, outputs[i]));
+        TEST_ASSERT_EQUAL_INT(expectedLevels[i], convertedLevel(C, &output));
+        clRawFree(C, &output);
+    }
+
+    remove("test_batch_frames.jxr");
+    remove("test_batch_frames.txt");
+    remove("test_batch_frames_a.png");
+    remove("test_batch_frames_b.png");
+    remove("test_batch_frames_c.png");
+    clContextDestroy(C);
+}
+
+typedef struct jobContextTask
+{
+    clContext * C;
+    clRaw * input;
+    const clConversionParams * params;
+    clRaw output;
+    int result;
+} jobContextTask;
+
+static void jobContextTaskFunc(jobContextTask * task)
+{
+    task->result = clContextConvertMemory(task->C, task->input, task->params, &task->output);
+}
+
+static void test_jobContexts(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    C->jobs = 2;
+
+    clImage * image = clImageParseString(C, "256x128,(255,0,0)..(0,0,255)", 16, NULL);
+    TEST_ASSERT_NOT_NULL(image);
+    clRaw input = CL_RAW_EMPTY;
+    clWriteParams writeParams;
+    clWriteParamsSetDefaults(C, &writeParams);
+    TEST_ASSERT_TRUE(clContextWriteMemory(C, image, "png", &writeParams, &input));
+    clImageDestroy(C, image);
+
+    clConversionParams params[2];
+    clConversionParamsSetDefaults(C, &params[0]);
+    params[0].formatName = "png";
+    params[0].bpc = 8;
+    params[0].primaries[0] = 0.708f; // BT.2020
+    params[0].primaries[1] = 0.292f;
+    params[0].primaries[2] = 0.170f;
+    params[0].primaries[3] = 0.797f;
+    params[0].primaries[4] = 0.131f;
+    params[0].primaries[5] = 0.046f;
+    params[0].primaries[6] = 0.3127f;
+    params[0].primaries[7] = 0.3290f;
+    memcpy(&params[1], &params[0], sizeof(clConversionParams));
+    params[1].bpc = 16;
+    params[1].gamma = 1.0f;
+
+    // Expected pixels, one conversion at a time on a context of its own (the encoded bytes aren't compared, as
+    // generated profiles are timestamped)
+    clImage * expected[2];
+    {
+        clContext * serial = clContextCreate(&silentSystem);
+        for (int i = 0; i < 2; ++i) {
+            clRaw output = CL_RAW_EMPTY;
+            TEST_ASSERT_EQUAL_INT(0, clContextConvertMemory(serial, &input, &params[i], &output));
+            expected[i] = clContextReadMemory(C, &output, "png", NULL, NULL);
+            TEST_ASSERT_NOT_NULL(expected[i]);
+            clImagePrepareReadPixels(C, expected[i], CL_PIXELFORMAT_U16);
+            clRawFree(serial, &output);
+        }
+        clContextDestroy(serial);
+    }
+
+    // Six jobs (three per params) on three threads, all sharing C's pool and transform cache
+    enum { JOB_COUNT = 6 };
+    jobContextTask jobs[JOB_COUNT];
+    clTask * tasks[JOB_COUNT];
+    struct clTaskPool * jobPool = clTaskPoolCreate(C, 3);
+    for (int i = 0; i < JOB_COUNT; ++i) {
+        jobs[i].C = clContextCreateJob(C);
+        TEST_ASSERT_TRUE(jobs[i].C->parent == C);
+        jobs[i].input = &input;
+        jobs[i].params = &params[i % 2];
+        jobs[i].output = (clRaw)CL_RAW_EMPTY;
+        jobs[i].result = -1;
+    }
+    TEST_ASSERT_EQUAL_INT(JOB_COUNT, C->jobCount);
+    for (int i = 0; i < JOB_COUNT; ++i) {
+        tasks[i] = clTaskCreateInPool(C, jobPool, (clTaskFunc)jobContextTaskFunc, &jobs[i]);
+    }
+    for (int i = 0; i < JOB_COUNT; ++i) {
+        clTaskJoin(C, tasks[i]);
+        clTaskDestroy(C, tasks[i]);
+    }
+    clTaskPoolDestroy(C, jobPool);
+
+    for (int i = 0; i < JOB_COUNT; ++i) {
+        TEST_ASSERT_EQUAL_INT(0, jobs[i].result);
+        clImage * converted = clContextReadMemory(C, &jobs[i].output, "png", NULL, NULL);
+        TEST_ASSERT_NOT_NULL(converted);
+        clImagePrepareReadPixels(C, converted, CL_PIXELFORMAT_U16);
+        TEST_ASSERT_EQUAL_INT(expected[i % 2]->depth, converted->depth);
+        TEST_ASSERT_EQUAL_MEMORY(expected[i % 2]->pixelsU16, converted->pixelsU16, sizeof(uint16_t) * 4 * 256 * 128);
+        clImageDestroy(C, converted);
+        TEST_ASSERT_NULL(jobs[i].C->taskPool);
+        TEST_ASSERT_NULL(jobs[i].C->transformCache);
+        clRawFree(jobs[i].C, &jobs[i].output);
+        clContextDestroy(jobs[i].C);
+    }
+    TEST_ASSERT_EQUAL_INT(0, C->jobCount);
+    TEST_ASSERT_NOT_NULL(C->transformCache);
+    TEST_ASSERT_TRUE(C->transformCache->hits > 0);
+
+    for (int i = 0; i < 2; ++i) {
+        clImageDestroy(C, expected[i]);
+    }
+    clRawFree(C, &input);
+    clContextDestroy(C);
+}
+
 static void test_debugDump(void)
 {
     clContext * C = clContextCreate(&silentSystem);
@@ -505,6 +935,32 @@ static void test_resize(void)
     clContextDestroy(C);
 }
 
+// Autograde's original per-pixel scoring: every gamma on the precision grid against every channel
+static float bruteForceGamma(const float * pixels, int pixelCount, float luminanceScale, int dstColorDepth, float precision)
+{
+    float maxChannel = (float)((1 << dstColorDepth) - 1);
+    float bestGamma = 0.0f;
+    double bestErrorTerm = -1.0;
+    int count = (int)((3.0f / precision) + 0.5f) + 1;
+    for (int candidate = 0; candidate < count; ++candidate) {
+        float gamma = 1.0f + (candidate * precision);
+        double errorTerm = 0.0;
+        for (int i = 0; i < pixelCount * 4; ++i) {
+            if ((i % 4) == 3) {
+                continue;
+            }
+            float scaledChannel = CL_CLAMP(pixels[i] * luminanceScale, 0.0f, 1.0f);
+            float quantized = clPixelMathRoundf(powf(scaledChannel, 1.0f / gamma) * maxChannel) / maxChannel;
+            errorTerm += fabsf(scaledChannel - powf(quantized, gamma));
+        }
+        if ((bestErrorTerm < 0.0) || (errorTerm < bestErrorTerm)) {
+            bestErrorTerm = errorTerm;
+            bestGamma = gamma;
+        }
+    }
+    return bestGamma;
+}
+
 static void test_clTask(void)
 {
     clContext * C = clContextCreate(&silentSystem);
@@ -526,11 +982,92 @@ static void test_clTask(void)
 
     int luminance = 300;
     float gamma = 2.2f;
-    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, 300, 16, &luminance, &gamma, clFalse);
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 16, NULL, &luminance, &gamma, clFalse);
 
     luminance = 0;
     gamma = 0.0f;
-    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, 300, 16, &luminance, &gamma, clTrue);
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 16, NULL, &luminance, &gamma, clTrue);
+    TEST_ASSERT_TRUE(luminance > 0);
+    TEST_ASSERT_TRUE((gamma >= 1.0f) && (gamma <= 4.0f));
+
+    // The histogram scores gammas the same way the per-pixel search did: a 10-bit gamma 1.8 ramp at 250 of its 300
+    // nits, graded for 10-bit and 8-bit destinations
+    for (int i = 0; i < pixelCount; ++i) {
+        float value = powf((float)(i % 1024) / 1023.0f, 1.8f) * (250.0f / 300.0f);
+        srcPixels[(i * 4) + 0] = value;
+        srcPixels[(i * 4) + 1] = value * 0.5f;
+        srcPixels[(i * 4) + 2] = value * value;
+        srcPixels[(i * 4) + 3] = 1.0f;
+    }
+    clGradeParams bruteParams;
+    clGradeParamsSetDefaults(C, &bruteParams);
+    bruteParams.search = CL_GRADESEARCH_SWEEP;
+    bruteParams.precision = 0.05f;
+    for (int depth = 8; depth <= 10; depth += 2) {
+        luminance = 250;
+        gamma = 0.0f;
+        clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, depth, &bruteParams, &luminance, &gamma, clFalse);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, bruteForceGamma(srcPixels, pixelCount, 300.0f / 250.0f, depth, 0.05f), gamma);
+    }
+
+    // An 8-bit gamma 2.2 ramp: the golden search (which sweeps discrete levels like these) agrees with the sweep
+    for (int i = 0; i < pixelCount; ++i) {
+        float value = powf((float)(i % 256) / 255.0f, 2.2f);
+        srcPixels[(i * 4) + 0] = value;
+        srcPixels[(i * 4) + 1] = value;
+        srcPixels[(i * 4) + 2] = value;
+        srcPixels[(i * 4) + 3] = 1.0f;
+    }
+    clGradeParams gradeParams;
+    clGradeParamsSetDefaults(C, &gradeParams);
+    gradeParams.search = CL_GRADESEARCH_SWEEP;
+    gradeParams.precision = 0.05f;
+    float sweepGamma = 0.0f;
+    luminance = 300;
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 8, &gradeParams, &luminance, &sweepGamma, clFalse);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.2f, sweepGamma);
+    gradeParams.search = CL_GRADESEARCH_GOLDEN;
+    for (int sampleStep = 1; sampleStep <= 3; sampleStep += 2) {
+        gradeParams.sampleStep = sampleStep;
+        gamma = 0.0f;
+        clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 8, &gradeParams, &luminance, &gamma, clFalse);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, sweepGamma, gamma);
+    }
+
+    // A 12-bit gray gamma 1.8 ramp is 4096 discrete levels, so even at the default precision every candidate gets
+    // scored and the exact roundtrip is found
+    for (int i = 0; i < pixelCount; ++i) {
+        float value = powf((float)(i % 4096) / 4095.0f, 1.8f);
+        srcPixels[(i * 4) + 0] = value;
+        srcPixels[(i * 4) + 1] = value;
+        srcPixels[(i * 4) + 2] = value;
+    }
+    gradeParams.precision = CL_GRADE_DEFAULT_PRECISION;
+    gradeParams.sampleStep = 1;
+    gamma = 0.0f;
+    luminance = 300;
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 12, &gradeParams, &luminance, &gamma, clFalse);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, bruteForceGamma(srcPixels, pixelCount, 1.0f, 12, gradeParams.precision), gamma);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.8f, gamma);
+    gradeParams.precision = 0.05f;
+
+    // A continuous ramp takes the golden-section path, and still lands on the sweep's grid within a step of its answer
+    for (int i = 0; i < pixelCount; ++i) {
+        float value = (float)i / (float)pixelCount;
+        srcPixels[(i * 4) + 0] = value * 0.9f;
+        srcPixels[(i * 4) + 1] = value * value;
+        srcPixels[(i * 4) + 2] = value;
+    }
+    gradeParams.search = CL_GRADESEARCH_SWEEP;
+    gradeParams.sampleStep = 1;
+    sweepGamma = 0.0f;
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 10, &gradeParams, &luminance, &sweepGamma, clFalse);
+    gradeParams.search = CL_GRADESEARCH_GOLDEN;
+    gamma = 0.0f;
+    clPixelMathColorGrade(C, profile, srcPixels, pixelCount, width, -1, 300, 10, &gradeParams, &luminance, &gamma, clFalse);
+    TEST_ASSERT_FLOAT_WITHIN(gradeParams.precision + 0.001f, sweepGamma, gamma);
+    float gridSteps = (gamma - 1.0f) / gradeParams.precision;
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, clPixelMathRoundf(gridSteps), gridSteps);
 
     clFree(srcPixels);
     clProfileDestroy(C, profile);
@@ -538,6 +1075,686 @@ static void test_clTask(void)
     clContextDestroy(C);
 }
 
+static void taskPoolIncrement(int * counter)
+{
+    ++(*counter);
+}
+
+static void taskPoolSquare(int * values, int index)
+{
+    values[index] = index * index;
+}
+
+static void test_clTaskPool(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    int values[100];
+    for (int jobs = 1; jobs <= 4; jobs += 3) {
+        C->jobs = jobs;
+
+        int counters[8];
+        clTask * tasks[8];
+        for (int i = 0; i < 8; ++i) {
+            counters[i] = 0;
+            tasks[i] = clTaskCreate(C, (clTaskFunc)taskPoolIncrement, &counters[i]);
+        }
+        clTaskJoin(C, tasks[0]);
+        clTaskJoin(C, tasks[0]); // joining twice is harmless
+        for (int i = 0; i < 8; ++i) {
+            clTaskDestroy(C, tasks[i]);
+            TEST_ASSERT_EQUAL_INT(1, counters[i]);
+        }
+
+        memset(values, 0, sizeof(values));
+        clTaskParallelFor(C, 100, (clTaskIndexFunc)taskPoolSquare, values);
+        for (int i = 0; i < 100; ++i) {
+            TEST_ASSERT_EQUAL_INT(i * i, values[i]);
+        }
+        clTaskParallelFor(C, 0, (clTaskIndexFunc)taskPoolSquare, values);
+    }
+
+    clContextDestroy(C);
+}
+
+static void test_simdTransform(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries primaries;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &primaries, NULL, NULL);
+    clProfileDestroy(C, stock);
+
+    // Every curve against a linear profile in both directions, with differing luminances so that
+    // luminance scaling (and tonemapping, when enabled) runs. HLG uses the implicit (--deflum) luminance.
+    clProfileCurve curves[4];
+    curves[0].type = CL_PCT_GAMMA;
+    curves[0].gamma = 2.2f;
+    curves[1].type = CL_PCT_SRGB;
+    curves[2].type = CL_PCT_PQ;
+    curves[3].type = CL_PCT_HLG;
+    int luminances[4] = { 80, 300, 10000, CL_LUMINANCE_UNSPECIFIED };
+    clProfile * profiles[4];
+    for (int i = 0; i < 4; ++i) {
+        curves[i].implicitScale = 1.0f;
+        if (curves[i].type != CL_PCT_GAMMA)
+            curves[i].gamma = 1.0f;
+        profiles[i] = clProfileCreate(C, &primaries, &curves[i], luminances[i], NULL);
+    }
+    clProfileCurve linearCurve;
+    linearCurve.type = CL_PCT_GAMMA;
+    linearCurve.gamma = 1.0f;
+    linearCurve.implicitScale = 1.0f;
+    clProfile * linear = clProfileCreate(C, &primaries, &linearCurve, 1000, NULL);
+
+    // Odd count so the scalar tail after the last full batch is exercised too
+    const int pixelCount = 1001;
+    float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * simdPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * scalarPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < 4 * pixelCount; ++i) {
+        srcPixels[i] = (float)((i * 7919) % 1000) / 999.0f;
+    }
+
+    for (int curveIndex = 0; curveIndex < 4; ++curveIndex) {
+        for (int toLinear = 0; toLinear < 2; ++toLinear) {
+            for (int tonemap = CL_TONEMAP_ON; tonemap <= CL_TONEMAP_OFF; ++tonemap) {
+                clProfile * srcProfile = toLinear ? profiles[curveIndex] : linear;
+                clProfile * dstProfile = toLinear ? linear : profiles[curveIndex];
+                clTransform * transform = clTransformCreate(C, srcProfile, CL_XF_RGBA, dstProfile, CL_XF_RGBA, (clTonemap)tonemap);
+
+                C->simdAllowed = clTrue;
+                clTransformRun(C, transform, srcPixels, simdPixels, pixelCount);
+                C->simdAllowed = clFalse;
+                clTransformRun(C, transform, srcPixels, scalarPixels, pixelCount);
+
+                char description[128];
+                sprintf(description, "SIMD mismatch: curve %d, toLinear %d, tonemap %d", curveIndex, toLinear, tonemap);
+                for (int i = 0; i < 4 * pixelCount; ++i) {
+                    float tolerance = CL_TRANSFORM_SIMD_TOLERANCE * CL_MAX(1.0f, fabsf(scalarPixels[i]));
+                    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(tolerance, scalarPixels[i], simdPixels[i], description);
+                }
+                clTransformDestroy(C, transform);
+            }
+        }
+    }
+
+    clFree(srcPixels);
+    clFree(simdPixels);
+    clFree(scalarPixels);
+    for (int i = 0; i < 4; ++i) {
+        clProfileDestroy(C, profiles[i]);
+    }
+    clProfileDestroy(C, linear);
+    clContextDestroy(C);
+}
+
+static clProfile * createPlanProfile(clContext * C,
+                                     const clProfilePrimaries * primaries,
+                                     clProfileCurveType type,
+                                     float gamma,
+                                     int luminance)
+{
+    clProfileCurve curve;
+    curve.type = type;
+    curve.gamma = gamma;
+    curve.implicitScale = 1.0f;
+    return clProfileCreate(C, (clProfilePrimaries *)primaries, &curve, luminance, NULL);
+}
+
+static void assertPlan(clContext * C, clProfile * srcProfile, clProfile * dstProfile, clTonemap tonemap, const char * expected)
+{
+    clTransform * transform = clTransformCreate(C, srcProfile, CL_XF_RGBA, dstProfile, CL_XF_RGBA, tonemap);
+    char description[128];
+    clTransformDescribePlan(C, transform, description, sizeof(description));
+    TEST_ASSERT_EQUAL_STRING(expected, description);
+    clTransformDestroy(C, transform);
+}
+
+static void test_transformPlan(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt709;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &bt709, NULL, NULL);
+    clProfileDestroy(C, stock);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+
+    clProfile * srgb300 = createPlanProfile(C, &bt709, CL_PCT_SRGB, 1.0f, 300);
+    clProfile * gamma300 = createPlanProfile(C, &bt709, CL_PCT_GAMMA, 2.2f, 300);
+    clProfile * linear709 = createPlanProfile(C, &bt709, CL_PCT_GAMMA, 1.0f, 300);
+    clProfile * linear2020 = createPlanProfile(C, &bt2020, CL_PCT_GAMMA, 1.0f, 300);
+    clProfile * pq2020 = createPlanProfile(C, &bt2020, CL_PCT_PQ, 1.0f, 10000);
+
+    assertPlan(C, srgb300, srgb300, CL_TONEMAP_AUTO, "CCMM: copy");
+    assertPlan(C, linear709, linear2020, CL_TONEMAP_AUTO, "CCMM: clamp > matrix > clamp");
+    assertPlan(C, srgb300, gamma300, CL_TONEMAP_AUTO, "CCMM: EOTF > clamp > OETF");
+    assertPlan(C, srgb300, pq2020, CL_TONEMAP_OFF, "CCMM: EOTF > matrix > clamp > OETF");
+    assertPlan(C, pq2020, srgb300, CL_TONEMAP_ON, "CCMM: EOTF > toXYZ > luminance > fromXYZ > clamp > OETF");
+    assertPlan(C, srgb300, NULL, CL_TONEMAP_OFF, "CCMM: EOTF > matrix");
+    C->ccmmAllowed = clFalse;
+    assertPlan(C, srgb300, pq2020, CL_TONEMAP_OFF, "LCMS: toXYZ > luminance > fromXYZ > clamp");
+    C->ccmmAllowed = clTrue;
+
+    // The fused plans must match the unfused XYZ round trip they replace
+    const int pixelCount = 1001;
+    float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * fusedPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * fullPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < 4 * pixelCount; ++i) {
+        srcPixels[i] = (float)((i * 7919) % 1000) / 999.0f;
+    }
+
+    clProfile * pairs[][2] = { { linear709, linear2020 }, { srgb300, gamma300 }, { srgb300, pq2020 }, { pq2020, srgb300 } };
+    for (int pairIndex = 0; pairIndex < 4; ++pairIndex) {
+        for (int simd = 0; simd < 2; ++simd) {
+            C->simdAllowed = simd ? clTrue : clFalse;
+
+            clProfile * srcProfile = pairs[pairIndex][0];
+            clProfile * dstProfile = pairs[pairIndex][1];
+            clTransform * transform = clTransformCreate(C, srcProfile, CL_XF_RGBA, dstProfile, CL_XF_RGBA, CL_TONEMAP_OFF);
+            clTransformRun(C, transform, srcPixels, fusedPixels, pixelCount);
+
+            clTransformPlan * plan = &transform->ccmmPlan;
+            plan->count = 0;
+            plan->ops[plan->count++] = CL_XOP_EOTF;
+            plan->ops[plan->count++] = CL_XOP_TO_XYZ;
+            plan->ops[plan->count++] = CL_XOP_LUMINANCE;
+            plan->ops[plan->count++] = CL_XOP_FROM_XYZ;
+            plan->ops[plan->count++] = CL_XOP_CLAMP_DST;
+            plan->ops[plan->count++] = CL_XOP_OETF;
+            clTransformRun(C, transform, srcPixels, fullPixels, pixelCount);
+
+            char description[128];
+            sprintf(description, "plan mismatch: pair %d, simd %d", pairIndex, simd);
+            for (int i = 0; i < 4 * pixelCount; ++i) {
+                float tolerance = CL_TRANSFORM_SIMD_TOLERANCE * CL_MAX(1.0f, fabsf(fullPixels[i]));
+                TEST_ASSERT_FLOAT_WITHIN_MESSAGE(tolerance, fullPixels[i], fusedPixels[i], description);
+            }
+            clTransformDestroy(C, transform);
+        }
+    }
+
+    clFree(srcPixels);
+    clFree(fusedPixels);
+    clFree(fullPixels);
+    clProfileDestroy(C, srgb300);
+    clProfileDestroy(C, gamma300);
+    clProfileDestroy(C, linear709);
+    clProfileDestroy(C, linear2020);
+    clProfileDestroy(C, pq2020);
+    clContextDestroy(C);
+}
+
+static void test_lcmsTransform(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt709;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &bt709, NULL, NULL);
+    clProfileDestroy(C, stock);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * srgb300 = createPlanProfile(C, &bt709, CL_PCT_SRGB, 1.0f, 300);
+    clProfile * gamma2020 = createPlanProfile(C, &bt2020, CL_PCT_GAMMA, 2.4f, 300);
+
+    // More than one split-path batch, RGB in and RGBA out so alpha gets filled in
+    const int pixelCount = 2500;
+    float * srcPixels = clAllocate(sizeof(float) * 3 * pixelCount);
+    float * ccmmPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * combinedPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * splitPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < 3 * pixelCount; ++i) {
+        srcPixels[i] = (float)((i * 7919) % 1000) / 999.0f;
+    }
+
+    clTransform * transform = clTransformCreate(C, srgb300, CL_XF_RGB, gamma2020, CL_XF_RGBA, CL_TONEMAP_AUTO);
+    clTransformRun(C, transform, srcPixels, ccmmPixels, pixelCount);
+
+    // Matching luminances, so LittleCMS gets to run the whole conversion as one optimized transform
+    C->ccmmAllowed = clFalse;
+    assertPlan(C, srgb300, gamma2020, CL_TONEMAP_AUTO, "LCMS: combined > clamp");
+    clTransformRun(C, transform, srcPixels, combinedPixels, pixelCount);
+
+    // Force the split path through XYZ
+    cmsDeleteTransform(transform->lcmsCombined);
+    transform->lcmsCombined = NULL;
+    clTransformRun(C, transform, srcPixels, splitPixels, pixelCount);
+
+    for (int i = 0; i < 4 * pixelCount; ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(0.0001f, splitPixels[i], combinedPixels[i]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, ccmmPixels[i], combinedPixels[i]);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, combinedPixels[4 * pixelCount - 1]);
+
+    clTransformDestroy(C, transform);
+    clFree(srcPixels);
+    clFree(ccmmPixels);
+    clFree(combinedPixels);
+    clFree(splitPixels);
+    clProfileDestroy(C, srgb300);
+    clProfileDestroy(C, gamma2020);
+    clContextDestroy(C);
+}
+
+static void test_lutTransform(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+    C->ccmmAllowed = clFalse;
+    C->lutSize = 33;
+
+    clProfilePrimaries bt709;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &bt709, NULL, NULL);
+    clProfileDestroy(C, stock);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * srgb1000 = createPlanProfile(C, &bt709, CL_PCT_SRGB, 1.0f, 1000);
+    clProfile * srgb2020 = createPlanProfile(C, &bt2020, CL_PCT_SRGB, 1.0f, 300);
+
+    // Enough pixels to bake a 33^3 grid, a few of them outside of its domain
+    const int pixelCount = 80000;
+    float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * directPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * lutPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * scalarPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < 4 * pixelCount; ++i) {
+        srcPixels[i] = (float)(((unsigned int)i * 7919u) % 1000u) / 999.0f;
+    }
+    srcPixels[0] = 1.5f;
+    srcPixels[5] = -0.25f;
+    for (int i = 97; i < pixelCount; i += 97) {
+        srcPixels[(i * 4) + 2] = 1.25f; // several batches of LittleCMS fallback
+    }
+
+    // Small images aren't worth a bake
+    clTransform * transform = clTransformCreate(C, srgb1000, CL_XF_RGBA, srgb2020, CL_XF_RGBA, CL_TONEMAP_ON);
+    clTransformRun(C, transform, srcPixels, directPixels, 100);
+    TEST_ASSERT_NULL(transform->lut);
+
+    C->lutSize = 0;
+    clTransformRun(C, transform, srcPixels, directPixels, pixelCount);
+    TEST_ASSERT_NULL(transform->lut);
+
+    C->lutSize = 33;
+    clTransformRun(C, transform, srcPixels, lutPixels, pixelCount);
+    TEST_ASSERT_NOT_NULL(transform->lut);
+    TEST_ASSERT_EQUAL_INT(33, transform->lutSize);
+    char description[128];
+    clTransformDescribePlan(C, transform, description, sizeof(description));
+    TEST_ASSERT_EQUAL_STRING("LCMS: toXYZ > luminance > fromXYZ > clamp (baked 33^3 LUT)", description);
+
+    C->simdAllowed = clFalse;
+    clTransformRun(C, transform, srcPixels, scalarPixels, pixelCount);
+
+    // Interpolation error peaks in the darks of the tonemapped blues (about 0.0045 here)
+    for (int i = 0; i < 4 * pixelCount; ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(0.006f, directPixels[i], lutPixels[i]);
+        TEST_ASSERT_FLOAT_WITHIN(0.00001f, scalarPixels[i], lutPixels[i]);
+    }
+    // Out of domain pixels went through LittleCMS
+    TEST_ASSERT_EQUAL_FLOAT(directPixels[0], lutPixels[0]);
+    TEST_ASSERT_EQUAL_FLOAT(directPixels[5], lutPixels[5]);
+    for (int i = 97; i < pixelCount; i += 97) {
+        TEST_ASSERT_EQUAL_FLOAT_ARRAY(&directPixels[i * 4], &lutPixels[i * 4], 4);
+    }
+
+    clTransformDestroy(C, transform);
+    clFree(srcPixels);
+    clFree(directPixels);
+    clFree(lutPixels);
+    clFree(scalarPixels);
+    clProfileDestroy(C, srgb1000);
+    clProfileDestroy(C, srgb2020);
+    clContextDestroy(C);
+}
+
+static void test_quantizedTransform(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt709;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &bt709, NULL, NULL);
+    clProfileDestroy(C, stock);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * srgb300 = createPlanProfile(C, &bt709, CL_PCT_SRGB, 1.0f, 300);
+    clProfile * gamma2020 = createPlanProfile(C, &bt2020, CL_PCT_GAMMA, 2.4f, 300);
+    clTransform * transform = clTransformCreate(C, srgb300, CL_XF_RGBA, gamma2020, CL_XF_RGBA, CL_TONEMAP_OFF);
+
+    // A few chunks plus a partial one, split over several tasks
+    const int pixelCount = (CL_TRANSFORM_CHUNK_PIXELS * 3) + 13;
+    const int channelCount = pixelCount * 4;
+    float * srcPixels = clAllocate(sizeof(float) * channelCount);
+    float * floatPixels = clAllocate(sizeof(float) * channelCount);
+    uint8_t * pixelsU8 = clAllocate(sizeof(uint8_t) * channelCount);
+    uint16_t * pixelsU16 = clAllocate(sizeof(uint16_t) * channelCount);
+    for (int i = 0; i < channelCount; ++i) {
+        srcPixels[i] = (float)((i * 7919) % 1000) / 999.0f;
+    }
+
+    for (int simd = 0; simd < 2; ++simd) {
+        C->simdAllowed = simd ? clTrue : clFalse;
+        for (int jobs = 1; jobs <= 3; jobs += 2) {
+            C->jobs = jobs;
+            clTransformRun(C, transform, srcPixels, floatPixels, pixelCount);
+            clTransformRunPixels(C, transform, srcPixels, CL_PIXELFORMAT_F32, 32, pixelsU8, CL_PIXELFORMAT_U8, 8, pixelCount);
+            clTransformRunPixels(C, transform, srcPixels, CL_PIXELFORMAT_F32, 32, pixelsU16, CL_PIXELFORMAT_U16, 10, pixelCount);
+            for (int i = 0; i < channelCount; ++i) {
+                TEST_ASSERT_EQUAL_UINT(clPixelMathRoundUNorm(floatPixels[i], 255), pixelsU8[i]);
+                TEST_ASSERT_EQUAL_UINT(clPixelMathRoundUNorm(floatPixels[i], 1023), pixelsU16[i]);
+            }
+        }
+    }
+
+    // Out of range values clamp; both paths agree on the tail
+    float edges[11] = { -0.5f, NAN, 0.0f, 0.49f / 65535.0f, 0.5f, 1.0f, 1.5f, INFINITY, 0.25f, -INFINITY, 0.75f };
+    uint16_t expected[11] = { 0, 0, 0, 0, 32768, 65535, 65535, 65535, 16384, 0, 49151 };
+    for (int simd = 0; simd < 2; ++simd) {
+        C->simdAllowed = simd ? clTrue : clFalse;
+        uint16_t quantized[11];
+        clTransformQuantize(C, edges, quantized, CL_PIXELFORMAT_U16, 16, 11);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, quantized, 11);
+    }
+
+    clTransformDestroy(C, transform);
+    clFree(srcPixels);
+    clFree(floatPixels);
+    clFree(pixelsU8);
+    clFree(pixelsU16);
+    clProfileDestroy(C, srgb300);
+    clProfileDestroy(C, gamma2020);
+    clContextDestroy(C);
+}
+
+static void test_halfToFloat(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Every half bit pattern once (an odd pixel count, so the SIMD path has a tail), laid out like
+    // the JXR reader does it: halves at the start of the float buffer, expanded in place
+    const int pixelCount = 65536 / 4 + 1;
+    const int channelCount = pixelCount * 4;
+    uint16_t * halves = clAllocate(sizeof(uint16_t) * channelCount);
+    float * scalarPixels = clAllocate(sizeof(float) * channelCount);
+    float * simdPixels = clAllocate(sizeof(float) * channelCount);
+    for (int i = 0; i < channelCount; ++i) {
+        halves[i] = (uint16_t)i;
+    }
+
+    C->simdAllowed = clFalse;
+    memcpy(scalarPixels, halves, sizeof(uint16_t) * channelCount);
+    clTransformHalfToFloat(C, (const uint16_t *)scalarPixels, scalarPixels, pixelCount, 1.0f);
+    C->simdAllowed = clTrue;
+    memcpy(simdPixels, halves, sizeof(uint16_t) * channelCount);
+    clTransformHalfToFloat(C, (const uint16_t *)simdPixels, simdPixels, pixelCount, 1.0f);
+    TEST_ASSERT_EQUAL_MEMORY(scalarPixels, simdPixels, sizeof(float) * channelCount);
+
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, scalarPixels[0x0000]);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, scalarPixels[0x3c00]);
+    TEST_ASSERT_EQUAL_FLOAT(-2.0f, scalarPixels[0xc000]);
+    TEST_ASSERT_EQUAL_FLOAT(65504.0f, scalarPixels[0x7bff]);
+    TEST_ASSERT_EQUAL_FLOAT(ldexpf(1.0f, -24), scalarPixels[0x0001]); // denormals survive
+    TEST_ASSERT_TRUE(isinf(scalarPixels[0x7c00]));
+    TEST_ASSERT_TRUE(isnan(scalarPixels[0x7e00]));
+
+    // Scaling touches RGB only
+    for (int simd = 0; simd < 2; ++simd) {
+        C->simdAllowed = simd ? clTrue : clFalse;
+        clTransformHalfToFloat(C, halves, simdPixels, pixelCount, 0.125f);
+        for (int i = 0; i < channelCount; ++i) {
+            if ((i % 4) == 3) {
+                TEST_ASSERT_EQUAL_MEMORY(&scalarPixels[i], &simdPixels[i], sizeof(float));
+            } else if (!isnan(scalarPixels[i])) {
+                TEST_ASSERT_EQUAL_FLOAT(scalarPixels[i] * 0.125f, simdPixels[i]);
+            }
+        }
+    }
+
+    clFree(halves);
+    clFree(scalarPixels);
+    clFree(simdPixels);
+    clContextDestroy(C);
+}
+
+static void test_f16Pixels(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Narrowing: every half survives a round trip, and a sweep of float bit patterns (ties, overflow, denormals,
+    // NaNs) narrows identically with and without F16C. 4099 is odd on purpose, for the SIMD tail.
+    const int sweepCount = 65536 + 4099;
+    float * floats = clAllocate(sizeof(float) * sweepCount);
+    uint16_t * scalarHalves = clAllocate(sizeof(uint16_t) * sweepCount);
+    uint16_t * simdHalves = clAllocate(sizeof(uint16_t) * sweepCount);
+    uint16_t * allHalves = clAllocate(sizeof(uint16_t) * 65536);
+    for (int i = 0; i < 65536; ++i) {
+        allHalves[i] = (uint16_t)i;
+    }
+    clTransformHalfToFloat(C, allHalves, floats, 65536 / 4, 1.0f);
+    for (int i = 0; i < 4099; ++i) {
+        uint32_t bits = (uint32_t)i * 1048573u + ((i % 3) ? 0x1000 : 0);
+        memcpy(&floats[65536 + i], &bits, sizeof(float));
+    }
+    C->simdAllowed = clFalse;
+    clTransformFloatToHalf(C, floats, scalarHalves, sweepCount);
+    C->simdAllowed = clTrue;
+    clTransformFloatToHalf(C, floats, simdHalves, sweepCount);
+    TEST_ASSERT_EQUAL_MEMORY(scalarHalves, simdHalves, sizeof(uint16_t) * sweepCount);
+    for (int i = 0; i < 65536; ++i) {
+        if (!isnan(floats[i]) || ((i & 0x0200) != 0)) { // quiet NaNs come back as they were
+            TEST_ASSERT_EQUAL_HEX16(i, scalarHalves[i]);
+        }
+    }
+    const float edges[5] = { 65519.0f, 65520.0f, 1.0f + ldexpf(1.0f, -11), 1.0f + ldexpf(3.0f, -11), ldexpf(1.0f, -25) };
+    const uint16_t edgeHalves[5] = { 0x7bff, 0x7c00, 0x3c00, 0x3c02, 0x0000 }; // ties go to even
+    clTransformFloatToHalf(C, edges, scalarHalves, 5);
+    TEST_ASSERT_EQUAL_HEX16_ARRAY(edgeHalves, scalarHalves, 5);
+
+    // Images: F16 pixels convert both ways, and crop / rotate / resize keep them in F16
+    clImage * image = clImageCreate(C, 37, 21, 16, NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    int channelCount = image->width * image->height * 4;
+    for (int i = 0; i < channelCount; ++i) {
+        image->pixelsF32[i] = (float)((i * 7919) % 1000) / 256.0f; // exact in a half
+    }
+    float * expected = clAllocate(sizeof(float) * channelCount);
+    memcpy(expected, image->pixelsF32, sizeof(float) * channelCount);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F16);
+    TEST_ASSERT_NULL(image->pixelsF32);
+    TEST_ASSERT_NOT_NULL(image->pixelsF16);
+
+    clImage * rotated = clImageRotate(C, image, 2);
+    TEST_ASSERT_NOT_NULL(rotated->pixelsF16);
+    TEST_ASSERT_NULL(rotated->pixelsF32);
+    clImage * cropped = clImageCrop(C, rotated, 0, 0, 10, 10, clTrue);
+    TEST_ASSERT_NOT_NULL(cropped->pixelsF16);
+    clImagePrepareReadPixels(C, cropped, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_EQUAL_FLOAT(expected[channelCount - 4], cropped->pixelsF32[0]);
+    TEST_ASSERT_EQUAL_FLOAT(expected[channelCount - 1], cropped->pixelsF32[3]);
+    clImageDestroy(C, cropped);
+
+    clImage * resized = clImageResize(C, image, 74, 42, CL_FILTER_NEAREST);
+    TEST_ASSERT_NOT_NULL(resized->pixelsF16);
+    TEST_ASSERT_NULL(resized->pixelsF32);
+    TEST_ASSERT_EQUAL_MEMORY(&image->pixelsF16[0], &resized->pixelsF16[0], sizeof(uint16_t) * 4);
+    TEST_ASSERT_EQUAL_MEMORY(&image->pixelsF16[0], &resized->pixelsF16[4], sizeof(uint16_t) * 4);
+    clImageDestroy(C, resized);
+
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_EQUAL_MEMORY(expected, image->pixelsF32, sizeof(float) * channelCount);
+    TEST_ASSERT_EQUAL_UINT(clPixelMathRoundUNorm(expected[1], 65535), image->pixelsU16[1]);
+    TEST_ASSERT_EQUAL_FLOAT(clImageLargestChannel(C, image), clImageLargestChannel(C, rotated));
+    TEST_ASSERT_NULL(rotated->pixelsF32);
+
+    // Transforms read and write F16 directly
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * pq2020 = createPlanProfile(C, &bt2020, CL_PCT_PQ, 1.0f, 10000);
+    clTransform * transform = clTransformCreate(C, srgb, CL_XF_RGBA, pq2020, CL_XF_RGBA, CL_TONEMAP_OFF);
+    int pixelCount = channelCount / 4;
+    float * floatPixels = clAllocate(sizeof(float) * channelCount);
+    float * halfInPixels = clAllocate(sizeof(float) * channelCount);
+    uint16_t * halfOutPixels = clAllocate(sizeof(uint16_t) * channelCount);
+    clTransformRun(C, transform, expected, floatPixels, pixelCount);
+    clTransformRunPixels(C, transform, image->pixelsF16, CL_PIXELFORMAT_F16, 16, halfInPixels, CL_PIXELFORMAT_F32, 32, pixelCount);
+    clTransformRunPixels(C, transform, expected, CL_PIXELFORMAT_F32, 32, halfOutPixels, CL_PIXELFORMAT_F16, 16, pixelCount);
+    clTransformFloatToHalf(C, floatPixels, scalarHalves, channelCount);
+    TEST_ASSERT_EQUAL_MEMORY(scalarHalves, halfOutPixels, sizeof(uint16_t) * channelCount);
+    TEST_ASSERT_EQUAL_MEMORY(floatPixels, halfInPixels, sizeof(float) * channelCount);
+
+    clTransformDestroy(C, transform);
+    clProfileDestroy(C, srgb);
+    clProfileDestroy(C, pq2020);
+    clFree(floatPixels);
+    clFree(halfInPixels);
+    clFree(halfOutPixels);
+    clFree(expected);
+    clImageDestroy(C, rotated);
+    clImageDestroy(C, image);
+    clFree(floats);
+    clFree(scalarHalves);
+    clFree(simdHalves);
+    clFree(allHalves);
+    clContextDestroy(C);
+}
+
+static void test_integerSourceTransform(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt709;
+    clProfile * stock = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfileQuery(C, stock, &bt709, NULL, NULL);
+    clProfileDestroy(C, stock);
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * srgb300 = createPlanProfile(C, &bt709, CL_PCT_SRGB, 1.0f, 300);
+    clProfile * gamma2020 = createPlanProfile(C, &bt2020, CL_PCT_GAMMA, 2.4f, 300);
+
+    const int pixelCount = (CL_TRANSFORM_CHUNK_PIXELS * 2) + 5;
+    const int channelCount = pixelCount * 4;
+    uint16_t * pixelsU16 = clAllocate(sizeof(uint16_t) * channelCount);
+    uint8_t * pixelsU8 = clAllocate(sizeof(uint8_t) * channelCount);
+    float * normalizedU16 = clAllocate(sizeof(float) * channelCount);
+    float * normalizedU8 = clAllocate(sizeof(float) * channelCount);
+    float * expected = clAllocate(sizeof(float) * channelCount);
+    float * actual = clAllocate(sizeof(float) * channelCount);
+    uint16_t * quantized = clAllocate(sizeof(uint16_t) * channelCount);
+    for (int i = 0; i < channelCount; ++i) {
+        pixelsU16[i] = (uint16_t)((i * 7919) % 4096); // 12 bit
+        pixelsU8[i] = (uint8_t)((i * 7919) % 256);
+        normalizedU16[i] = (float)pixelsU16[i] / 4095.0f;
+        normalizedU8[i] = (float)pixelsU8[i] / 255.0f;
+    }
+
+    // CCMM (table-driven EOTF), LittleCMS, and a plain copy
+    for (int mode = 0; mode < 3; ++mode) {
+        C->ccmmAllowed = (mode != 1);
+        clProfile * dstProfile = (mode == 2) ? srgb300 : gamma2020;
+        clTransform * transform = clTransformCreate(C, srgb300, CL_XF_RGBA, dstProfile, CL_XF_RGBA, CL_TONEMAP_OFF);
+        for (int simd = 0; simd < 2; ++simd) {
+            C->simdAllowed = simd ? clTrue : clFalse;
+
+            clTransformRun(C, transform, normalizedU16, expected, pixelCount);
+            clTransformRunPixels(C, transform, pixelsU16, CL_PIXELFORMAT_U16, 12, actual, CL_PIXELFORMAT_F32, 32, pixelCount);
+            for (int i = 0; i < channelCount; ++i) {
+                TEST_ASSERT_FLOAT_WITHIN(CL_TRANSFORM_SIMD_TOLERANCE, expected[i], actual[i]);
+            }
+
+            clTransformRun(C, transform, normalizedU8, expected, pixelCount);
+            clTransformRunPixels(C, transform, pixelsU8, CL_PIXELFORMAT_U8, 8, actual, CL_PIXELFORMAT_F32, 32, pixelCount);
+            for (int i = 0; i < channelCount; ++i) {
+                TEST_ASSERT_FLOAT_WITHIN(CL_TRANSFORM_SIMD_TOLERANCE, expected[i], actual[i]);
+            }
+
+            // Integer in and out, no F32 image on either side
+            clTransformRunPixels(C, transform, pixelsU8, CL_PIXELFORMAT_U8, 8, quantized, CL_PIXELFORMAT_U16, 10, pixelCount);
+            for (int i = 0; i < channelCount; ++i) {
+                TEST_ASSERT_INT_WITHIN(1, clPixelMathRoundUNorm(expected[i], 1023), quantized[i]);
+            }
+        }
+        TEST_ASSERT_EQUAL(mode == 0, transform->ccmmSrcTables[8] != NULL);
+        TEST_ASSERT_EQUAL(mode == 0, transform->ccmmSrcTables[12] != NULL);
+        clTransformDestroy(C, transform);
+    }
+
+    clFree(pixelsU16);
+    clFree(pixelsU8);
+    clFree(normalizedU16);
+    clFree(normalizedU8);
+    clFree(expected);
+    clFree(actual);
+    clFree(quantized);
+    clProfileDestroy(C, srgb300);
+    clProfileDestroy(C, gamma2020);
+    clContextDestroy(C);
+}
+
+static void test_transformCache(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+    C->transformCache = clTransformCacheCreate(C, 2);
+    clTransformCache * cache = C->transformCache;
+
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clTransform * toXYZ = clTransformCacheAcquire(C, srgb, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL);
+    TEST_ASSERT_TRUE(toXYZ->ccmmReady);
+    TEST_ASSERT_TRUE(clTransformCacheAcquire(C, srgb, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL) == toXYZ);
+    TEST_ASSERT_EQUAL_INT(1, cache->hits);
+    TEST_ASSERT_EQUAL_INT(1, cache->misses);
+    clTransformCacheRelease(C, toXYZ);
+    clTransformCacheRelease(C, toXYZ);
+
+    // Keyed by signature, not pointer: the cached transform outlives the profile it was built from
+    clProfileDestroy(C, srgb);
+    srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    TEST_ASSERT_TRUE(clTransformCacheAcquire(C, srgb, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL) == toXYZ);
+    TEST_ASSERT_EQUAL_INT(2, cache->hits);
+    float rgba[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float xyz[3];
+    clTransformRun(C, toXYZ, rgba, xyz, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, (float)C->defaultLuminance, xyz[1]);
+
+    // Anything clTransformPrepare() depends on is part of the key
+    clTonemapParams params;
+    clTonemapParamsSetDefaults(C, &params);
+    params.contrast = 2.0f;
+    clTransform * tonemapped = clTransformCacheAcquire(C, srgb, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_ON, &params);
+    TEST_ASSERT_TRUE(tonemapped != toXYZ);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, tonemapped->tonemapParams.contrast);
+    TEST_ASSERT_EQUAL_INT(2, cache->misses);
+
+    // Both slots are held, so a third transform can't be cached and is destroyed on release
+    clTransform * fromXYZ = clTransformCacheAcquire(C, NULL, CL_XF_XYZ, srgb, CL_XF_RGB, CL_TONEMAP_OFF, NULL);
+    TEST_ASSERT_EQUAL_INT(2, cache->count);
+    TEST_ASSERT_EQUAL_INT(0, cache->evictions);
+    clTransformCacheRelease(C, fromXYZ);
+
+    // Once released, the least recently used entry is evicted
+    clTransformCacheRelease(C, toXYZ);
+    clTransformCacheRelease(C, tonemapped);
+    fromXYZ = clTransformCacheAcquire(C, NULL, CL_XF_XYZ, srgb, CL_XF_RGB, CL_TONEMAP_OFF, NULL);
+    TEST_ASSERT_EQUAL_INT(1, cache->evictions);
+    clTransformCacheRelease(C, fromXYZ);
+    TEST_ASSERT_TRUE(clTransformCacheAcquire(C, srgb, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_ON, &params) == tonemapped);
+    clTransformCacheRelease(C, tonemapped);
+
+    clProfileDestroy(C, srgb);
+    clContextDestroy(C);
+}
+
 static void test_types(void)
 {
     clContext * C = clContextCreate(&silentSystem);
@@ -600,6 +1817,451 @@ static void test_raw(void)
     clContextDestroy(C);
 }
 
+static void test_jxrOutput(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    // Noise doesn't compress, so this outgrows the writer's initial buffer several times over
+    clImage * image = clImageCreate(C, 512, 512, 16, NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16);
+    uint32_t seed = 1;
+    for (int i = 0; i < image->width * image->height * 4; ++i) {
+        seed = (seed * 1103515245) + 12345;
+        image->pixelsU16[i] = ((i % 4) == 3) ? 65535 : (uint16_t)(seed >> 16);
+    }
+
+    clWriteParams writeParams;
+    clWriteParamsSetDefaults(C, &writeParams);
+    writeParams.quality = 100;
+    clRaw output = CL_RAW_EMPTY;
+    TEST_ASSERT_TRUE(clContextWriteMemory(C, image, "jxr", &writeParams, &output));
+    TEST_ASSERT_TRUE(output.size > (1024 * 1024));
+
+    clImage * decoded = clContextReadMemory(C, &output, "jxr", NULL, NULL);
+    TEST_ASSERT_NOT_NULL(decoded);
+    TEST_ASSERT_EQUAL_INT(512, decoded->width);
+    TEST_ASSERT_EQUAL_INT(512, decoded->height);
+    clImagePrepareReadPixels(C, decoded, CL_PIXELFORMAT_U16);
+    TEST_ASSERT_EQUAL_MEMORY(image->pixelsU16, decoded->pixelsU16, sizeof(uint16_t) * 4 * 512 * 512);
+    clImageDestroy(C, decoded);
+    clRawFree(C, &output);
+
+    // A tiny image only needs a tiny buffer
+    clImageDestroy(C, image);
+    image = clImageParseString(C, "8x8,(255,0,0)", 8, NULL);
+    TEST_ASSERT_TRUE(clContextWriteMemory(C, image, "jxr", &writeParams, &output));
+    TEST_ASSERT_TRUE(output.size > 0);
+    TEST_ASSERT_TRUE(output.size < (64 * 1024));
+    clRawFree(C, &output);
+
+    clImageDestroy(C, image);
+    clContextDestroy(C);
+}
+
+static void test_probe(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * profile = createPlanProfile(C, &bt2020, CL_PCT_GAMMA, 2.2f, 300);
+
+    static const char * formats[] = { "jxr", "png", "jpg", "jp2", "j2k", "tiff", "webp" };
+    for (int i = 0; i < (int)(sizeof(formats) / sizeof(formats[0])); ++i) {
+        int depth = clFormatBestDepth(C, formats[i], 16);
+        clImage * image = clImageParseString(C, "64x48,(255,0,0)", depth, profile);
+
+        clWriteParams writeParams;
+        clWriteParamsSetDefaults(C, &writeParams);
+        clRaw output = CL_RAW_EMPTY;
+        TEST_ASSERT_TRUE_MESSAGE(clContextWriteMemory(C, image, formats[i], &writeParams, &output), formats[i]);
+
+        // The probe must agree with a full read on everything but the pixels
+        clImage * decoded = clContextReadMemory(C, &output, formats[i], NULL, NULL);
+        clImage * probed = clContextProbeMemory(C, &output, formats[i], NULL, NULL);
+        TEST_ASSERT_NOT_NULL(decoded);
+        TEST_ASSERT_NOT_NULL(probed);
+        TEST_ASSERT_EQUAL_INT(decoded->width, probed->width);
+        TEST_ASSERT_EQUAL_INT(decoded->height, probed->height);
+        TEST_ASSERT_EQUAL_INT(decoded->depth, probed->depth);
+        TEST_ASSERT_TRUE(clProfileMatches(C, decoded->profile, probed->profile));
+        TEST_ASSERT_NULL(probed->pixelsU8);
+        TEST_ASSERT_NULL(probed->pixelsU16);
+        TEST_ASSERT_NULL(probed->pixelsF32);
+        TEST_ASSERT_NULL(probed->pixelsF16);
+        clImageDestroy(C, probed);
+        clImageDestroy(C, decoded);
+
+        if (!strcmp(formats[i], "jxr")) {
+            // JXR has no fixed signature, so detection relies on its probe
+            TEST_ASSERT_EQUAL_STRING("jxr", clFormatDetectRaw(C, &output));
+        }
+
+        clRawFree(C, &output);
+        clImageDestroy(C, image);
+    }
+
+    // Header-only garbage is rejected rather than half-parsed
+    static const uint8_t notAnImage[16] = { 0x49, 0x49, 0xBC, 0x01 };
+    clRaw garbage = CL_RAW_EMPTY;
+    clRawSet(C, &garbage, notAnImage, sizeof(notAnImage));
+    TEST_ASSERT_NULL(clFormatDetectRaw(C, &garbage));
+    TEST_ASSERT_NULL(clContextProbeMemory(C, &garbage, "jp2", NULL, NULL));
+    clRawFree(C, &garbage);
+
+    clProfileDestroy(C, profile);
+    clContextDestroy(C);
+}
+
+static void test_imageStats(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    C->jobs = 3;
+
+    clImage * image = clImageParseString(C, "40x30,(0,64,32)..(1000,16,4000)", 12, NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16); // so the U16 pixels are what gets scanned
+    const clImageStats * stats = clImageGetStats(C, image);
+    TEST_ASSERT_TRUE(image->statsValid);
+    TEST_ASSERT_NULL(image->pixelsF32);
+
+    // Must agree with a plain scan of the F32 pixels, index included
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+    int pixelCount = image->width * image->height;
+    int largestIndex = 0;
+    float largest = 0.0f;
+    float channelMin[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float channelMax[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < pixelCount; ++i) {
+        for (int channel = 0; channel < 4; ++channel) {
+            float value = image->pixelsF32[(i * 4) + channel];
+            channelMin[channel] = CL_MIN(channelMin[channel], value);
+            channelMax[channel] = CL_MAX(channelMax[channel], value);
+            if ((channel < 3) && (largest < value)) {
+                largest = value;
+                largestIndex = i;
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(largestIndex > 0);
+    TEST_ASSERT_EQUAL_INT(largestIndex, stats->largestChannelIndex);
+    TEST_ASSERT_EQUAL_FLOAT(largest, stats->largestChannel);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(channelMin, stats->channelMin, 4);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(channelMax, stats->channelMax, 4);
+
+    // Writing drops the cache
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_FALSE(image->statsValid);
+    image->pixelsF32[(7 * 4) + 1] = 2.5f;
+    TEST_ASSERT_EQUAL_FLOAT(2.5f, clImageLargestChannel(C, image));
+    TEST_ASSERT_EQUAL_INT(7, clImageGetStats(C, image)->largestChannelIndex);
+    TEST_ASSERT_TRUE(clImagePeakLuminance(C, image) > 0.0f);
+    TEST_ASSERT_EQUAL_FLOAT(clImagePeakLuminance(C, image), image->stats.peakLuminance);
+
+    // Conversions hand back the stats of what they wrote, matching a rescan
+    static const int depths[] = { 8, 10, 16, 32 };
+    for (int i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); ++i) {
+        clImage * converted = clImageConvert(C, image, depths[i], image->profile, CL_TONEMAP_OFF, NULL);
+        TEST_ASSERT_TRUE(converted->statsValid);
+        clImageStats produced = converted->stats;
+        clImageInvalidateStats(C, converted);
+        stats = clImageGetStats(C, converted);
+        TEST_ASSERT_EQUAL_FLOAT_ARRAY(stats->channelMin, produced.channelMin, 4);
+        TEST_ASSERT_EQUAL_FLOAT_ARRAY(stats->channelMax, produced.channelMax, 4);
+        TEST_ASSERT_EQUAL_FLOAT(stats->largestChannel, produced.largestChannel);
+        TEST_ASSERT_EQUAL_INT(stats->largestChannelIndex, produced.largestChannelIndex);
+        float maxCLL, maxFALL;
+        clImageContentLightLevels(C, converted, &maxCLL, &maxFALL);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, maxCLL, produced.maxCLL);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, maxFALL, produced.maxFALL);
+        clImageDestroy(C, converted);
+    }
+
+    // Light levels into PQ: the brightest pixel agrees with the peak luminance, the average sits below it
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * pq = createPlanProfile(C, &bt2020, CL_PCT_PQ, 1.0f, 10000);
+    clImage * hdr = clImageConvert(C, image, 12, pq, CL_TONEMAP_OFF, NULL);
+    TEST_ASSERT_TRUE(hdr->stats.maxCLL > hdr->stats.maxFALL);
+    TEST_ASSERT_TRUE(hdr->stats.maxFALL > 0.0f);
+    TEST_ASSERT_FLOAT_WITHIN(hdr->stats.maxCLL * 0.01f, clImagePeakLuminance(C, hdr), hdr->stats.maxCLL);
+    clImageDestroy(C, hdr);
+    clProfileDestroy(C, pq);
+
+    clImageDestroy(C, image);
+    clContextDestroy(C);
+}
+
+// The brightest Y at a chromaticity the slow way, through both linear transforms: scale its clamped RGB until the
+// largest channel hits 1
+static float referenceMaxY(clContext * C, clTransform * linearFromXYZ, clTransform * linearToXYZ, float x, float y)
+{
+    float XYZ[3] = { x / y, 1.0f, (1.0f - x - y) / y };
+    float rgba[4];
+    float maxXYZ[3];
+    clTransformRun(C, linearFromXYZ, XYZ, rgba, 1);
+    float maxChannel = CL_MAX(rgba[0], CL_MAX(rgba[1], rgba[2]));
+    for (int channel = 0; channel < 3; ++channel) {
+        rgba[channel] /= maxChannel;
+    }
+    rgba[3] = 1.0f;
+    clTransformRun(C, linearToXYZ, rgba, maxXYZ, 1);
+    return maxXYZ[1];
+}
+
+static void test_gamutCeiling(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfileCurve gamma1;
+    gamma1.type = CL_PCT_GAMMA;
+    gamma1.gamma = 1.0f;
+    gamma1.implicitScale = 1.0f;
+    clProfile * linear = clProfileCreate(C, &bt2020, &gamma1, 1, NULL);
+
+    // White reaches Y = 1, and each primary reaches its own share of white
+    clProfileGamutCeiling ceiling;
+    clProfileYUVCoefficients yuv;
+    TEST_ASSERT_TRUE(clProfileQueryGamutCeiling(C, linear, &ceiling));
+    clProfileQueryYUVCoefficients(C, linear, &yuv);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1.0f, clProfileGamutCeilingMaxY(&ceiling, bt2020.white[0], bt2020.white[1]));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, yuv.kr, clProfileGamutCeilingMaxY(&ceiling, bt2020.red[0], bt2020.red[1]));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, yuv.kb, clProfileGamutCeilingMaxY(&ceiling, bt2020.blue[0], bt2020.blue[1]));
+
+    // Across the chromaticity plane (in and out of gamut), the transform's ceiling matches scaling each chromaticity's
+    // clamped RGB until its largest channel hits 1
+    clTransform * linearToXYZ = clTransformCreate(C, linear, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * linearFromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, linear, CL_XF_RGBA, CL_TONEMAP_OFF);
+    const clProfileGamutCeiling * transformCeiling = clTransformGetGamutCeiling(C, linearToXYZ);
+    TEST_ASSERT_EQUAL_PTR(transformCeiling, clTransformGetGamutCeiling(C, linearToXYZ));
+    for (int j = 1; j < 16; ++j) {
+        for (int i = 1; i < 16 - j; ++i) {
+            float x = (float)i / 20.0f;
+            float y = (float)j / 20.0f;
+            float referenceY = referenceMaxY(C, linearFromXYZ, linearToXYZ, x, y);
+            float maxY = clProfileGamutCeilingMaxY(transformCeiling, x, y);
+            TEST_ASSERT_FLOAT_WITHIN(referenceY * 0.001f, referenceY, maxY);
+            TEST_ASSERT_FLOAT_WITHIN(maxY * 0.001f, maxY, clProfileGamutCeilingMaxY(&ceiling, x, y));
+            TEST_ASSERT_EQUAL_FLOAT(maxY, clTransformCalcMaxY(C, linearToXYZ, x, y));
+        }
+    }
+
+    // Collinear primaries (a malformed profile) have no ceiling
+    const float collinear[3][3] = { { 0.4f, 0.2f, 0.0f }, { 0.2f, 0.1f, 0.0f }, { 0.3f, 0.6f, 1.0f } };
+    clProfileGamutCeiling degenerate;
+    TEST_ASSERT_FALSE(clProfileGamutCeilingFromColorants(C, collinear, &degenerate));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, clProfileGamutCeilingMaxY(&degenerate, bt2020.white[0], bt2020.white[1]));
+    clTransformDestroy(C, linearToXYZ);
+    clTransformDestroy(C, linearFromXYZ);
+    clProfileDestroy(C, linear);
+    clContextDestroy(C);
+}
+
+static void test_measureHDR(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    C->jobs = 3;
+
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * pq = createPlanProfile(C, &bt2020, CL_PCT_PQ, 1.0f, 10000);
+    clImage * image = clImageParseString(C, "40x30,(700,40,30)..(100,650,500)", 10, pq);
+    int pixelCount = image->width * image->height;
+
+    clImage * highlight = NULL;
+    clImageHDRStats stats;
+    clImageHDRQuantization quantization;
+    clImageHDRPixelInfo * pixelInfo = clImageHDRPixelInfoCreate(C, pixelCount);
+    clImageMeasureHDR(C, image, 100, 0.0f, &highlight, &stats, pixelInfo, &quantization);
+    TEST_ASSERT_NOT_NULL(highlight);
+    TEST_ASSERT_EQUAL_INT(pixelCount, stats.pixelCount);
+    TEST_ASSERT_TRUE(stats.overbrightPixelCount + stats.bothPixelCount > 0);
+    TEST_ASSERT_TRUE(stats.outOfGamutPixelCount + stats.bothPixelCount > 0);
+    TEST_ASSERT_EQUAL_INT(stats.overbrightPixelCount + stats.outOfGamutPixelCount + stats.bothPixelCount, stats.hdrPixelCount);
+
+    // Each pixel's ceiling agrees with the one found through both linear transforms, and the per-band counts add up
+    clProfileCurve gamma1;
+    gamma1.type = CL_PCT_GAMMA;
+    gamma1.gamma = 1.0f;
+    gamma1.implicitScale = 1.0f;
+    clProfile * linear = clProfileCreate(C, &bt2020, &gamma1, 1, NULL);
+    clTransform * linearToXYZ = clTransformCreate(C, linear, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * linearFromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, linear, CL_XF_RGBA, CL_TONEMAP_OFF);
+    int brightestIndex = 0;
+    int nitsCount = 0;
+    int saturationCount = 0;
+    for (int i = 0; i < pixelCount; ++i) {
+        const clImageHDRPixel * pixel = &pixelInfo->pixels[i];
+        float maxY = referenceMaxY(C, linearFromXYZ, linearToXYZ, pixel->x, pixel->y) * 100.0f;
+        TEST_ASSERT_FLOAT_WITHIN(maxY * 0.001f, maxY, pixel->maxNits);
+        if (pixelInfo->pixels[brightestIndex].nits < pixel->nits) {
+            brightestIndex = i;
+        }
+    }
+    for (int i = 0; i < CL_QUANTIZATION_BUCKET_COUNT; ++i) {
+        nitsCount += quantization.pixelCountsNitsPQ[i];
+        saturationCount += quantization.pixelCountsSaturation[i];
+    }
+    TEST_ASSERT_EQUAL_INT(pixelCount, nitsCount);
+    TEST_ASSERT_EQUAL_INT(pixelCount, saturationCount);
+    TEST_ASSERT_EQUAL_FLOAT(pixelInfo->pixels[brightestIndex].nits, stats.brightestPixelNits);
+    TEST_ASSERT_EQUAL_INT(brightestIndex % image->width, stats.brightestPixelX);
+    TEST_ASSERT_EQUAL_INT(brightestIndex / image->width, stats.brightestPixelY);
+
+    // Percentiles are exact: each one is a pixel's value holding that rank in sorted order
+    for (int i = 0; i <= 100; ++i) {
+        int rank = (i == 100) ? (pixelCount - 1) : (int)((float)i * (float)pixelCount / 100.0f);
+        int nitsBelow = 0, nitsAtOrBelow = 0, saturationBelow = 0, saturationAtOrBelow = 0;
+        for (int j = 0; j < pixelCount; ++j) {
+            const clImageHDRPixel * pixel = &pixelInfo->pixels[j];
+            nitsBelow += (pixel->nits < quantization.percentiles[i].nits);
+            nitsAtOrBelow += (pixel->nits <= quantization.percentiles[i].nits);
+            saturationBelow += (pixel->saturation < quantization.percentiles[i].saturation);
+            saturationAtOrBelow += (pixel->saturation <= quantization.percentiles[i].saturation);
+        }
+        TEST_ASSERT_TRUE((nitsBelow <= rank) && (rank < nitsAtOrBelow));
+        TEST_ASSERT_TRUE((saturationBelow <= rank) && (rank < saturationAtOrBelow));
+    }
+    clTransformDestroy(C, linearToXYZ);
+    clTransformDestroy(C, linearFromXYZ);
+    clProfileDestroy(C, linear);
+
+    // A single job gives the same answers
+    C->jobs = 1;
+    clImage * serialHighlight = NULL;
+    clImageHDRStats serialStats;
+    clImageMeasureHDR(C, image, 100, 0.0f, &serialHighlight, &serialStats, NULL, NULL);
+    TEST_ASSERT_EQUAL_MEMORY(&stats, &serialStats, sizeof(stats));
+    TEST_ASSERT_EQUAL_MEMORY(
+        highlight->pixelsU16, serialHighlight->pixelsU16, sizeof(uint16_t) * CL_CHANNELS_PER_PIXEL * pixelCount);
+    clImageDestroy(C, serialHighlight);
+
+    clImageHDRPixelInfoDestroy(C, pixelInfo);
+    clImageDestroy(C, highlight);
+    clImageDestroy(C, image);
+    clProfileDestroy(C, pq);
+    clContextDestroy(C);
+}
+
+static int compareFloats(const void * a, const void * b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static void test_measureHDRPercentileBudget(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    // 1.2M pixels whose nits all share one of the percentile histogram's buckets (1/64 octave), which is more than
+    // its gather budget (2^20 values), so those percentiles are interpolated between the bucket's extremes
+    clProfilePrimaries bt2020 = { { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, { 0.3127f, 0.3290f } };
+    clProfile * pq = createPlanProfile(C, &bt2020, CL_PCT_PQ, 1.0f, 10000);
+    clImage * image = clImageParseString(C, "1200x1000,rgb16(35900,32900,29900)..rgb16(35940,32940,29940)", 16, pq);
+    int pixelCount = image->width * image->height;
+
+    clImageHDRStats stats;
+    clImageHDRQuantization quantization;
+    clImageHDRPixelInfo * pixelInfo = clImageHDRPixelInfoCreate(C, pixelCount);
+    clImageMeasureHDR(C, image, 100, 0.0f, NULL, &stats, pixelInfo, &quantization);
+
+    float * sortedNits = clAllocate(sizeof(float) * pixelCount);
+    float * sortedSaturation = clAllocate(sizeof(float) * pixelCount);
+    for (int i = 0; i < pixelCount; ++i) {
+        sortedNits[i] = pixelInfo->pixels[i].nits;
+        sortedSaturation[i] = pixelInfo->pixels[i].saturation;
+    }
+    qsort(sortedNits, pixelCount, sizeof(float), compareFloats);
+    qsort(sortedSaturation, pixelCount, sizeof(float), compareFloats);
+
+    // Same bucketing as the histogram: the float's exponent and top 6 mantissa bits
+    uint32_t firstBits, lastBits;
+    memcpy(&firstBits, &sortedNits[0], sizeof(firstBits));
+    memcpy(&lastBits, &sortedNits[pixelCount - 1], sizeof(lastBits));
+    TEST_ASSERT_TRUE(sortedNits[0] < sortedNits[pixelCount - 1]);
+    TEST_ASSERT_EQUAL_UINT32(firstBits >> 17, lastBits >> 17);
+
+    // The image's 41 levels are spread evenly over the rows, so interpolating by rank lands within 5% of the bucket's
+    // spread (two levels) of the sorted answer. Saturation straddles two buckets, each under budget, so it is exact.
+    const float nitsTolerance = (sortedNits[pixelCount - 1] - sortedNits[0]) * 0.05f;
+    for (int i = 0; i <= 100; ++i) {
+        int rank = (i == 100) ? (pixelCount - 1) : (int)((float)i * (float)pixelCount / 100.0f);
+        TEST_ASSERT_FLOAT_WITHIN(nitsTolerance, sortedNits[rank], quantization.percentiles[i].nits);
+        TEST_ASSERT_FLOAT_WITHIN(0.00001f, sortedSaturation[rank], quantization.percentiles[i].saturation);
+        if (i > 0) {
+            TEST_ASSERT_TRUE(quantization.percentiles[i - 1].nits <= quantization.percentiles[i].nits);
+            TEST_ASSERT_TRUE(quantization.percentiles[i - 1].saturation <= quantization.percentiles[i].saturation);
+        }
+    }
+    TEST_ASSERT_EQUAL_FLOAT(sortedNits[0], quantization.percentiles[0].nits);
+    TEST_ASSERT_EQUAL_FLOAT(sortedNits[pixelCount - 1], quantization.percentiles[100].nits);
+
+    clFree(sortedNits);
+    clFree(sortedSaturation);
+    clImageHDRPixelInfoDestroy(C, pixelInfo);
+    clImageDestroy(C, image);
+    clProfileDestroy(C, pq);
+    clContextDestroy(C);
+}
+
+static int rawReleaseCount = 0;
+static void countRawRelease(void * owner, uint8_t * ptr)
+{
+    TEST_ASSERT_EQUAL_PTR(owner, ptr);
+    ++rawReleaseCount;
+}
+
+static void test_rawBorrow(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+
+    // Borrowed buffers go back through their release func, whether freed or moved into an owned buffer
+    uint8_t lent[4] = { 1, 2, 3, 4 };
+    clRaw raw = CL_RAW_EMPTY;
+    rawReleaseCount = 0;
+    clRawBorrow(C, &raw, lent, sizeof(lent), countRawRelease, lent);
+    TEST_ASSERT_TRUE(raw.borrowed);
+    TEST_ASSERT_EQUAL_PTR(lent, raw.ptr);
+    clRawFree(C, &raw);
+    TEST_ASSERT_EQUAL_INT(1, rawReleaseCount);
+    TEST_ASSERT_FALSE(raw.borrowed);
+
+    clRawBorrow(C, &raw, lent, sizeof(lent), countRawRelease, lent);
+    clRawSet(C, &raw, lent, sizeof(lent)); // same size, but must not write into the lent buffer
+    TEST_ASSERT_EQUAL_INT(2, rawReleaseCount);
+    TEST_ASSERT_FALSE(raw.borrowed);
+    TEST_ASSERT_TRUE(raw.ptr != lent);
+    clRawRealloc(C, &raw, 2);
+    TEST_ASSERT_EQUAL_UINT8(2, raw.ptr[1]);
+    clRawFree(C, &raw);
+
+    // Big files are mapped copy-on-write, small ones read
+    clRaw big = CL_RAW_EMPTY;
+    clRawRealloc(C, &big, CL_RAW_MAP_MIN_BYTES + 1);
+    for (size_t i = 0; i < big.size; ++i) {
+        big.ptr[i] = (uint8_t)(i * 7);
+    }
+    TEST_ASSERT_TRUE(clRawWriteFile(C, &big, L"test_raw_map.bin"));
+    TEST_ASSERT_TRUE(clRawReadFile(C, &raw, L"test_raw_map.bin"));
+    TEST_ASSERT_TRUE(raw.borrowed);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)big.size, (uint32_t)raw.size);
+    TEST_ASSERT_EQUAL_MEMORY(big.ptr, raw.ptr, big.size);
+    raw.ptr[0] = 0xff;
+    clRawFree(C, &raw);
+    TEST_ASSERT_TRUE(clRawReadFileHeader(C, &raw, L"test_raw_map.bin", 4));
+    TEST_ASSERT_EQUAL_UINT8(0, raw.ptr[0]);
+    clRawFree(C, &raw);
+
+    clRawRealloc(C, &big, 16);
+    TEST_ASSERT_TRUE(clRawWriteFile(C, &big, L"test_raw_map.bin"));
+    TEST_ASSERT_TRUE(clRawReadFile(C, &raw, L"test_raw_map.bin"));
+    TEST_ASSERT_FALSE(raw.borrowed);
+    TEST_ASSERT_EQUAL_MEMORY(big.ptr, raw.ptr, 16);
+    clRawFree(C, &raw);
+    clRawFree(C, &big);
+    remove("test_raw_map.bin");
+
+    clContextDestroy(C);
+}
+
 int test_coverage(void)
 {
     UNITY_BEGIN();
@@ -611,12 +2273,34 @@ int test_coverage(void)
     RUN_TEST(test_clFilter);
     RUN_TEST(test_stockPrimaries);
     RUN_TEST(test_clContextParseArgs);
+    RUN_TEST(test_batchJobArgs);
+    RUN_TEST(test_convertMemory);
+    RUN_TEST(test_convertMemoryFrames);
+    RUN_TEST(test_batchFrames);
+    RUN_TEST(test_jobContexts);
     RUN_TEST(test_debugDump);
     RUN_TEST(test_resize);
     RUN_TEST(test_clTask);
+    RUN_TEST(test_clTaskPool);
+    RUN_TEST(test_simdTransform);
+    RUN_TEST(test_transformPlan);
+    RUN_TEST(test_lcmsTransform);
+    RUN_TEST(test_lutTransform);
+    RUN_TEST(test_quantizedTransform);
+    RUN_TEST(test_halfToFloat);
+    RUN_TEST(test_f16Pixels);
+    RUN_TEST(test_integerSourceTransform);
+    RUN_TEST(test_transformCache);
     RUN_TEST(test_types);
     RUN_TEST(test_floorRound);
     RUN_TEST(test_raw);
+    RUN_TEST(test_rawBorrow);
+    RUN_TEST(test_jxrOutput);
+    RUN_TEST(test_probe);
+    RUN_TEST(test_imageStats);
+    RUN_TEST(test_gamutCeiling);
+    RUN_TEST(test_measureHDR);
+    RUN_TEST(test_measureHDRPercentileBudget);
 
     return UNITY_END();
 }
@@ -0,0 +1,276 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "main.h"
+
+#include "colorist/transform.h"
+
+#include <math.h>
+
+// ------------------------------------------------------------------------------------------------
+// Transfer function accuracy: compares clTransformEOTF() / clTransformOETF() against double
+// precision references for inputs in [0, 1]. The "curves" suite samples that range; the
+// "curvereport" suite (colorist-curve-report target) walks every float in it and prints a report.
+
+#define CURVE_CHUNK_SIZE 4096
+#define CURVE_ONE_BITS 0x3f800000U // 1.0f
+#define CURVE_ERROR_FLOOR 1e-3     // errors are relative to max(|reference|, this)
+
+typedef struct CurveCase
+{
+    const char * name;
+    clTransformTransferFunction xtf;
+    float param;
+    clBool oetf;
+} CurveCase;
+
+static const CurveCase curveCases[] = {
+    { "gamma 2.2 EOTF", CL_XTF_GAMMA, 2.2f, clFalse },
+    { "gamma 2.2 OETF", CL_XTF_GAMMA, 2.2f, clTrue },
+    { "sRGB EOTF", CL_XTF_SRGB, 0.0f, clFalse },
+    { "sRGB OETF", CL_XTF_SRGB, 0.0f, clTrue },
+    { "PQ EOTF", CL_XTF_PQ, 0.0f, clFalse },
+    { "PQ OETF", CL_XTF_PQ, 0.0f, clTrue },
+    { "HLG 1000 EOTF", CL_XTF_HLG, 1000.0f, clFalse },
+    { "HLG 1000 OETF", CL_XTF_HLG, 1000.0f, clTrue },
+    { "HLG 4000 EOTF", CL_XTF_HLG, 4000.0f, clFalse },
+    { "HLG 4000 OETF", CL_XTF_HLG, 4000.0f, clTrue },
+};
+static const int curveCaseCount = sizeof(curveCases) / sizeof(curveCases[0]);
+
+// Same constants as transform.c, evaluated in double
+static const double PQ_C1 = 0.8359375f;
+static const double PQ_C2 = 18.8515625f;
+static const double PQ_C3 = 18.6875f;
+static const double PQ_M1 = 0.1593017578125f;
+static const double PQ_M2 = 78.84375f;
+static const double HLG_A = 0.17883277f;
+static const double HLG_B = 0.28466892f;
+static const double HLG_C = 0.55991072953f;
+
+static double referenceCurve(const CurveCase * curve, double hlgExponent, double v)
+{
+    if (curve->oetf) {
+        switch (curve->xtf) {
+            case CL_XTF_NONE:
+                return v;
+            case CL_XTF_GAMMA:
+                return pow(v, 1.0 / curve->param);
+            case CL_XTF_SRGB:
+                return (v <= 0.0031308) ? (v * 12.92) : ((pow(v, 1.0 / 2.4) * 1.055) - 0.055);
+            case CL_XTF_HLG: {
+                double N = pow(v, 1.0 / hlgExponent);
+                return (N <= (1.0 / 12.0)) ? sqrt(3.0 * N) : (HLG_A * log((12.0 * N) - HLG_B) + HLG_C);
+            }
+            case CL_XTF_PQ: {
+                double Lm1 = pow(v, PQ_M1);
+                return pow((PQ_C1 + (PQ_C2 * Lm1)) / (1 + (PQ_C3 * Lm1)), PQ_M2);
+            }
+        }
+    } else {
+        switch (curve->xtf) {
+            case CL_XTF_NONE:
+                return v;
+            case CL_XTF_GAMMA:
+                return pow(v, curve->param);
+            case CL_XTF_SRGB:
+                return (v <= 0.04045) ? (v / 12.92) : pow((v + 0.055) / 1.055, 2.4);
+            case CL_XTF_HLG: {
+                double L = (v < 0.5) ? ((v * v) / 3.0) : ((exp((v - HLG_C) / HLG_A) + HLG_B) / 12.0);
+                return pow(L, hlgExponent);
+            }
+            case CL_XTF_PQ: {
+                double N1m2 = pow(v, 1.0 / PQ_M2);
+                double N1m2c1 = N1m2 - PQ_C1;
+                if (N1m2c1 < 0.0)
+                    N1m2c1 = 0.0;
+                return pow(N1m2c1 / (PQ_C2 - (PQ_C3 * N1m2)), 1.0 / PQ_M1);
+            }
+        }
+    }
+    return v;
+}
+
+// One entry per mode compared against the reference
+typedef enum CurveMode
+{
+    CURVE_MODE_SCALAR = 0, // --simd off (libm)
+    CURVE_MODE_EXACT,      // --precision exact
+    CURVE_MODE_FAST,       // --precision fast
+
+    CURVE_MODE_COUNT
+} CurveMode;
+static const char * curveModeNames[CURVE_MODE_COUNT] = { "scalar", "exact", "fast" };
+
+typedef struct CurveError
+{
+    double maxError;
+    float maxErrorInput;
+} CurveError;
+
+typedef struct CurveChunk
+{
+    clContext * contexts[CURVE_MODE_COUNT];
+    const CurveCase * curve;
+    uint32_t firstBits;
+    uint32_t stride;
+    int count;
+    CurveError errors[CURVE_MODE_COUNT];
+} CurveChunk;
+
+static void curveChunkFunc(CurveChunk * chunks, int index)
+{
+    CurveChunk * chunk = &chunks[index];
+    float inputs[CURVE_CHUNK_SIZE];
+    float outputs[CURVE_CHUNK_SIZE];
+    double references[CURVE_CHUNK_SIZE];
+
+    double hlgExponent = 1.2 + (0.42 * log10(chunk->curve->param / 1000.0));
+    for (int i = 0; i < chunk->count; ++i) {
+        uint32_t bits = chunk->firstBits + ((uint32_t)i * chunk->stride);
+        memcpy(&inputs[i], &bits, sizeof(float));
+        references[i] = referenceCurve(chunk->curve, hlgExponent, (double)inputs[i]);
+    }
+
+    for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+        CurveError * error = &chunk->errors[mode];
+        error->maxError = 0.0;
+        error->maxErrorInput = 0.0f;
+
+        memcpy(outputs, inputs, sizeof(float) * chunk->count);
+        if (chunk->curve->oetf) {
+            clTransformOETF(chunk->contexts[mode], chunk->curve->xtf, chunk->curve->param, outputs, chunk->count);
+        } else {
+            clTransformEOTF(chunk->contexts[mode], chunk->curve->xtf, chunk->curve->param, outputs, chunk->count);
+        }
+
+        for (int i = 0; i < chunk->count; ++i) {
+            double err = fabs((double)outputs[i] - references[i]) / CL_MAX(fabs(references[i]), CURVE_ERROR_FLOOR);
+            if (err > error->maxError) {
+                error->maxError = err;
+                error->maxErrorInput = inputs[i];
+            }
+        }
+    }
+}
+
+// Walks [0, 1] with the given stride (in float bit patterns) and checks the batched modes against
+// their documented tolerances. Returns the number of values checked per curve.
+static uint32_t curveReport(uint32_t stride, clBool verbose)
+{
+    clContext * contexts[CURVE_MODE_COUNT];
+    for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+        contexts[mode] = clContextCreate(&silentSystem);
+        contexts[mode]->simdAllowed = (mode != CURVE_MODE_SCALAR);
+        contexts[mode]->curvePrecision = (mode == CURVE_MODE_FAST) ? CL_CURVEPRECISION_FAST : CL_CURVEPRECISION_EXACT;
+    }
+    clContext * C = contexts[CURVE_MODE_EXACT];
+
+    uint32_t valueCount = (CURVE_ONE_BITS / stride) + 1;
+    int chunkCount = (int)((valueCount + CURVE_CHUNK_SIZE - 1) / CURVE_CHUNK_SIZE);
+    CurveChunk * chunks = clAllocate(sizeof(CurveChunk) * chunkCount);
+
+    if (verbose) {
+        printf("Transfer function error vs. double precision, relative to max(|ref|, %g), %u inputs in [0, 1]\n",
+               CURVE_ERROR_FLOOR,
+               valueCount);
+        printf("%-16s", "curve");
+        for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+            printf("  %-10s %-12s", curveModeNames[mode], "(at input)");
+        }
+        printf("\n");
+    }
+
+    for (int curveIndex = 0; curveIndex < curveCaseCount; ++curveIndex) {
+        const CurveCase * curve = &curveCases[curveIndex];
+        for (int chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex) {
+            CurveChunk * chunk = &chunks[chunkIndex];
+            memcpy(chunk->contexts, contexts, sizeof(contexts));
+            chunk->curve = curve;
+            chunk->firstBits = (uint32_t)chunkIndex * CURVE_CHUNK_SIZE * stride;
+            chunk->stride = stride;
+            chunk->count = CURVE_CHUNK_SIZE;
+            if (chunkIndex == (chunkCount - 1)) {
+                chunk->count = (int)(valueCount - ((uint32_t)chunkIndex * CURVE_CHUNK_SIZE));
+            }
+        }
+        clTaskParallelFor(C, chunkCount, (clTaskIndexFunc)curveChunkFunc, chunks);
+
+        CurveError errors[CURVE_MODE_COUNT];
+        memset(errors, 0, sizeof(errors));
+        for (int chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex) {
+            for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+                if (chunks[chunkIndex].errors[mode].maxError > errors[mode].maxError) {
+                    errors[mode] = chunks[chunkIndex].errors[mode];
+                }
+            }
+        }
+
+        if (verbose) {
+            printf("%-16s", curve->name);
+            for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+                printf("  %-10.3g (%-10.4g)", errors[mode].maxError, errors[mode].maxErrorInput);
+            }
+            printf("\n");
+        }
+        TEST_ASSERT_TRUE_MESSAGE(errors[CURVE_MODE_EXACT].maxError <= CL_TRANSFORM_CURVE_TOLERANCE_EXACT, curve->name);
+        TEST_ASSERT_TRUE_MESSAGE(errors[CURVE_MODE_FAST].maxError <= CL_TRANSFORM_CURVE_TOLERANCE_FAST, curve->name);
+    }
+
+    clFree(chunks);
+    for (int mode = 0; mode < CURVE_MODE_COUNT; ++mode) {
+        clContextDestroy(contexts[mode]);
+    }
+    return valueCount;
+}
+
+static void test_curvesSampled(void)
+{
+    curveReport(16381, clFalse);
+}
+
+static void test_curvesTail(void)
+{
+    // Counts that don't fill a whole batch go through the padded tail
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    float batched[11];
+    float scalar[11];
+    for (int i = 0; i < 11; ++i) {
+        batched[i] = (float)i / 10.0f;
+    }
+    memcpy(scalar, batched, sizeof(scalar));
+    clTransformOETF(C, CL_XTF_PQ, 0.0f, batched, 11);
+    C->simdAllowed = clFalse;
+    clTransformOETF(C, CL_XTF_PQ, 0.0f, scalar, 11);
+    for (int i = 0; i < 11; ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(CL_TRANSFORM_CURVE_TOLERANCE_EXACT, scalar[i], batched[i]);
+    }
+
+    clContextDestroy(C);
+}
+
+static void test_curvesExhaustive(void)
+{
+    curveReport(1, clTrue);
+}
+
+int test_curves(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_curvesSampled);
+    RUN_TEST(test_curvesTail);
+    return UNITY_END();
+}
+
+int test_curvereport(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_curvesExhaustive);
+    return UNITY_END();
+}
@@ -73,7 +73,7 @@ static void test_images(const char * ext, int threshold, int additionalArgc, cha
 
     TEST_ASSERT_TRUE_MESSAGE(clContextWrite(C, srcImage, tmpFilename, NULL, &C->params.writeParams), "failed to write image");
 
-    clImage * dstImage = clContextRead(C, tmpFilename, NULL, NULL);
+    clImage * dstImage = clContextRead(C, tmpFilename, NULL, NULL, NULL);
     TEST_ASSERT_NOT_NULL_MESSAGE(dstImage, "failed to read back image");
 
 #ifdef DEBUG_TEST_IMAGES
@@ -0,0 +1,630 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+// colorist-watch: the Linux counterpart of colorist-hdrconv. Watches a directory for new captures
+// (JXR by default) and converts each one to AVIF with the same preset (BT.2020 PQ, 10bpc, 4:4:4,
+// speed 6, quality 80), all in one process: the clContext (formats, task pool, transform cache)
+// stays warm across jobs instead of paying for a fresh `colorist convert` per file.
+//
+// The watcher thread debounces inotify events into a bounded queue; a single worker thread owns
+// the clContext and runs the conversions.
+
+#define _DEFAULT_SOURCE
+
+#include "colorist/colorist.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#define WATCH_DEFAULT_EXTENSION "jxr"
+#define WATCH_DEFAULT_QUEUE_SIZE 8
+#define WATCH_DEFAULT_DEBOUNCE_MS 500
+#define WATCH_MAX_PENDING 256
+#define WATCH_EVENT_BUFFER_SIZE (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+// ------------------------------------------------------------------------------------------------
+// Types
+
+typedef struct WatchJob
+{
+    char * path;
+    double firstSeen; // first event for this file, latency is measured from here
+} WatchJob;
+
+// A file that has seen events but hasn't settled yet
+typedef struct WatchPending
+{
+    char * path;
+    double firstSeen;
+    double lastEvent;
+    long long lastSize; // size at the previous settle check, -1 if never checked
+    clBool closed;      // last event was IN_CLOSE_WRITE / IN_MOVED_TO
+    clBool deferred;    // already counted as deferred by a full queue
+} WatchPending;
+
+typedef struct WatchStats
+{
+    int done;
+    int failed;
+    int deferred;  // settled files that had to wait for room in the queue
+    int overflows; // inotify queue overflows (events were lost)
+    double totalLatency;
+    double maxLatency;
+    double busySeconds;
+    long long inputBytes;
+    long long outputBytes;
+} WatchStats;
+
+typedef struct Watch
+{
+    clContext * C;
+    const char * watchDir;
+    const char * outputDir;
+    const char * extension;
+    int debounceMS;
+
+    // Bounded job queue (ring buffer), guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t queueChanged;
+    WatchJob * jobs;
+    int queueCapacity;
+    int queueHead;
+    int queueCount;
+    clBool stopping;
+    WatchStats stats;
+
+    // Watcher thread only
+    WatchPending pending[WATCH_MAX_PENDING];
+    int pendingCount;
+} Watch;
+
+static volatile sig_atomic_t watchInterrupted = 0;
+
+// Every log line from either thread (including the library's, through the clContextSystem hooks) takes this,
+// so that the watcher's and the worker's lines stay whole
+static pthread_mutex_t watchLogLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void watchSystemLog(clContext * C, const char * section, int indent, const char * format, va_list args)
+{
+    pthread_mutex_lock(&watchLogLock);
+    clContextDefaultLog(C, section, indent, format, args);
+    pthread_mutex_unlock(&watchLogLock);
+}
+
+static void watchSystemLogError(clContext * C, const char * format, va_list args)
+{
+    pthread_mutex_lock(&watchLogLock);
+    clContextDefaultLogError(C, format, args);
+    pthread_mutex_unlock(&watchLogLock);
+}
+
+static void watchSignalHandler(int signum)
+{
+    COLORIST_UNUSED(signum);
+    watchInterrupted = 1;
+}
+
+static double watchNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static long long watchFileSize(const char * path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    return (long long)st.st_size;
+}
+
+static void watchLog(Watch * watch, const char * format, ...)
+{
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    clContextLog(watch->C, "watch", 0, "%s", buffer);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Worker
+
+static char * watchOutputPath(Watch * watch, const char * inputPath)
+{
+    const char * filename = strrchr(inputPath, '/');
+    filename = filename ? filename + 1 : inputPath;
+    const char * ext = strrchr(filename, '.');
+    int stemLength = ext ? (int)(ext - filename) : (int)strlen(filename);
+
+    size_t size = strlen(watch->outputDir) + strlen(filename) + 8;
+    char * outputPath = malloc(size);
+    snprintf(outputPath, size, "%s/%.*s.avif", watch->outputDir, stemLength, filename);
+    return outputPath;
+}
+
+static wchar_t * watchWidePath(const char * path)
+{
+    size_t length = mbstowcs(NULL, path, 0);
+    if (length == (size_t)-1) {
+        return NULL;
+    }
+    wchar_t * widePath = malloc(sizeof(wchar_t) * (length + 1));
+    mbstowcs(widePath, path, length + 1);
+    return widePath;
+}
+
+static void watchConvert(Watch * watch, WatchJob * job)
+{
+    clContext * C = watch->C;
+    char * outputPath = watchOutputPath(watch, job->path);
+    wchar_t * wideInput = watchWidePath(job->path);
+    wchar_t * wideOutput = watchWidePath(outputPath);
+    long long inputSize = watchFileSize(job->path);
+
+    double start = watchNow();
+    int ret = 1;
+    if (wideInput && wideOutput) {
+        C->inputFilename = wideInput;
+        C->outputFilename = wideOutput;
+        ret = clContextConvert(C);
+        C->inputFilename = NULL;
+        C->outputFilename = NULL;
+    }
+    double finish = watchNow();
+    double convertSeconds = finish - start;
+    double latency = finish - job->firstSeen;
+
+    pthread_mutex_lock(&watch->lock);
+    WatchStats * stats = &watch->stats;
+    if (ret == 0) {
+        ++stats->done;
+        stats->totalLatency += latency;
+        if (stats->maxLatency < latency) {
+            stats->maxLatency = latency;
+        }
+        stats->busySeconds += convertSeconds;
+        stats->inputBytes += (inputSize > 0) ? inputSize : 0;
+        long long outputSize = watchFileSize(outputPath);
+        stats->outputBytes += (outputSize > 0) ? outputSize : 0;
+    } else {
+        ++stats->failed;
+    }
+    WatchStats snapshot = *stats;
+    int queued = watch->queueCount;
+    pthread_mutex_unlock(&watch->lock);
+
+    if (ret == 0) {
+        watchLog(watch, "Converted %s -> %s (convert %.3fs, latency %.3fs)", job->path, outputPath, convertSeconds, latency);
+    } else {
+        watchLog(watch, "Failed to convert %s", job->path);
+    }
+    watchLog(watch,
+             "Jobs: %d done, %d failed, %d deferred, %d queued | latency avg %.3fs max %.3fs | %.2f jobs/s, %.1f MB/s in",
+             snapshot.done,
+             snapshot.failed,
+             snapshot.deferred,
+             queued,
+             (snapshot.done > 0) ? (snapshot.totalLatency / snapshot.done) : 0.0,
+             snapshot.maxLatency,
+             (snapshot.busySeconds > 0.0) ? (snapshot.done / snapshot.busySeconds) : 0.0,
+             (snapshot.busySeconds > 0.0) ? ((snapshot.inputBytes / (1024.0 * 1024.0)) / snapshot.busySeconds) : 0.0);
+
+    free(wideInput);
+    free(wideOutput);
+    free(outputPath);
+}
+
+static void * watchWorkerThreadProc(void * userData)
+{
+    Watch * watch = (Watch *)userData;
+    for (;;) {
+        pthread_mutex_lock(&watch->lock);
+        while ((watch->queueCount == 0) && !watch->stopping) {
+            pthread_cond_wait(&watch->queueChanged, &watch->lock);
+        }
+        if (watch->queueCount == 0) {
+            // Stopping, and the queue is drained
+            pthread_mutex_unlock(&watch->lock);
+            break;
+        }
+        WatchJob job = watch->jobs[watch->queueHead];
+        watch->queueHead = (watch->queueHead + 1) % watch->queueCapacity;
+        --watch->queueCount;
+        pthread_mutex_unlock(&watch->lock);
+
+        watchConvert(watch, &job);
+        free(job.path);
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Watcher (inotify)
+
+static clBool watchWantsFile(Watch * watch, const char * filename)
+{
+    const char * ext = strrchr(filename, '.');
+    return ext && !strcasecmp(ext + 1, watch->extension);
+}
+
+static void watchNoteEvent(Watch * watch, const char * filename, clBool closed)
+{
+    double now = watchNow();
+    size_t size = strlen(watch->watchDir) + strlen(filename) + 2;
+    char * path = malloc(size);
+    snprintf(path, size, "%s/%s", watch->watchDir, filename);
+
+    for (int i = 0; i < watch->pendingCount; ++i) {
+        WatchPending * pending = &watch->pending[i];
+        if (!strcmp(pending->path, path)) {
+            pending->lastEvent = now;
+            pending->closed = closed;
+            free(path);
+            return;
+        }
+    }
+
+    if (watch->pendingCount == WATCH_MAX_PENDING) {
+        watchLog(watch, "Too many files settling at once, ignoring %s", path);
+        free(path);
+        return;
+    }
+    WatchPending * pending = &watch->pending[watch->pendingCount++];
+    pending->path = path;
+    pending->firstSeen = now;
+    pending->lastEvent = now;
+    pending->lastSize = -1;
+    pending->closed = closed;
+    pending->deferred = clFalse;
+}
+
+// Moves settled files into the job queue. Returns the number of seconds until the next check is due
+// (negative when nothing is pending).
+static double watchSettle(Watch * watch)
+{
+    double now = watchNow();
+    double debounce = watch->debounceMS / 1000.0;
+    double nextCheck = -1.0;
+
+    for (int i = 0; i < watch->pendingCount;) {
+        WatchPending * pending = &watch->pending[i];
+        double quietFor = now - pending->lastEvent;
+        if (quietFor < debounce) {
+            double wait = debounce - quietFor;
+            nextCheck = ((nextCheck < 0.0) || (wait < nextCheck)) ? wait : nextCheck;
+            ++i;
+            continue;
+        }
+
+        // Quiet long enough. A file that was closed (or renamed into place) is done; otherwise its size has
+        // to hold still across a whole debounce window, since the writer may just be slow.
+        long long size = watchFileSize(pending->path);
+        clBool remove = clFalse;
+        if (size < 0) {
+            remove = clTrue; // deleted or renamed away before it settled
+        } else if ((size == 0) || (!pending->closed && (size != pending->lastSize))) {
+            pending->lastSize = size;
+            pending->lastEvent = now;
+            nextCheck = ((nextCheck < 0.0) || (debounce < nextCheck)) ? debounce : nextCheck;
+        } else {
+            pthread_mutex_lock(&watch->lock);
+            if (watch->queueCount < watch->queueCapacity) {
+                WatchJob * job = &watch->jobs[(watch->queueHead + watch->queueCount) % watch->queueCapacity];
+                job->path = pending->path;
+                job->firstSeen = pending->firstSeen;
+                ++watch->queueCount;
+                pending->path = NULL; // owned by the job now
+                remove = clTrue;
+                pthread_cond_signal(&watch->queueChanged);
+            } else if (!pending->deferred) {
+                pending->deferred = clTrue;
+                ++watch->stats.deferred;
+            }
+            pthread_mutex_unlock(&watch->lock);
+            if (!remove) {
+                // Queue is full; try again shortly
+                nextCheck = ((nextCheck < 0.0) || (debounce < nextCheck)) ? debounce : nextCheck;
+            }
+        }
+
+        if (remove) {
+            free(pending->path);
+            watch->pending[i] = watch->pending[--watch->pendingCount];
+        } else {
+            ++i;
+        }
+    }
+    return nextCheck;
+}
+
+static int watchRun(Watch * watch)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        clContextLogError(watch->C, "inotify_init1 failed: %s", strerror(errno));
+        return 1;
+    }
+    int wd = inotify_add_watch(fd, watch->watchDir, IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF);
+    if (wd < 0) {
+        clContextLogError(watch->C, "Can't watch %s: %s", watch->watchDir, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    watchLog(watch,
+             "Watching %s for *.%s (queue %d, debounce %dms), writing to %s",
+             watch->watchDir,
+             watch->extension,
+             watch->queueCapacity,
+             watch->debounceMS,
+             watch->outputDir);
+
+    int ret = 0;
+    char buffer[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!watchInterrupted) {
+        double nextCheck = watchSettle(watch);
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        int timeoutMS = (nextCheck < 0.0) ? -1 : (int)(nextCheck * 1000.0) + 1;
+        int polled = poll(&pfd, 1, timeoutMS);
+        if (polled < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            clContextLogError(watch->C, "poll failed: %s", strerror(errno));
+            ret = 1;
+            break;
+        }
+        if (polled == 0) {
+            continue;
+        }
+
+        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
+        if (bytesRead <= 0) {
+            if ((bytesRead < 0) && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            clContextLogError(watch->C, "Reading inotify events failed: %s", strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        clBool lostDir = clFalse;
+        for (char * p = buffer; p < buffer + bytesRead;) {
+            struct inotify_event * event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                pthread_mutex_lock(&watch->lock);
+                ++watch->stats.overflows;
+                pthread_mutex_unlock(&watch->lock);
+                watchLog(watch, "inotify queue overflowed, some new files may have been missed");
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                lostDir = clTrue;
+                continue;
+            }
+            if ((event->len == 0) || (event->mask & IN_ISDIR) || !watchWantsFile(watch, event->name)) {
+                continue;
+            }
+            watchNoteEvent(watch, event->name, (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) ? clTrue : clFalse);
+        }
+        if (lostDir) {
+            clContextLogError(watch->C, "%s went away, stopping", watch->watchDir);
+            ret = 1;
+            break;
+        }
+    }
+
+    close(fd);
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Setup
+
+// Outputs are always AVIF, so watching for AVIF where they land would feed every output back in as a new job
+static clBool watchWritesIntoItself(Watch * watch)
+{
+    if (strcasecmp(watch->extension, "avif") != 0) {
+        return clFalse;
+    }
+    char watchPath[PATH_MAX];
+    char outputPath[PATH_MAX];
+    if (!realpath(watch->watchDir, watchPath) || !realpath(watch->outputDir, outputPath)) {
+        return !strcmp(watch->watchDir, watch->outputDir);
+    }
+    return !strcmp(watchPath, outputPath);
+}
+
+static void watchApplyPreset(clContext * C)
+{
+    // Same as colorist-hdrconv: -g pq -l 10000 -p bt2020 -b 10 -f avif --yuv 444 --nclx 9,16,9 --speed 6 -q 80
+    C->params.curveType = CL_PCT_PQ;
+    C->params.gamma = 1.0f;
+    C->params.luminance = 10000;
+    clProfilePrimaries primaries;
+    clContextGetStockPrimaries(C, "bt2020", &primaries);
+    C->params.primaries[0] = primaries.red[0];
+    C->params.primaries[1] = primaries.red[1];
+    C->params.primaries[2] = primaries.green[0];
+    C->params.primaries[3] = primaries.green[1];
+    C->params.primaries[4] = primaries.blue[0];
+    C->params.primaries[5] = primaries.blue[1];
+    C->params.primaries[6] = primaries.white[0];
+    C->params.primaries[7] = primaries.white[1];
+    C->params.bpc = 10;
+    C->params.formatName = "avif";
+    C->params.writeParams.yuvFormat = CL_YUVFORMAT_444;
+    C->params.writeParams.nclx[0] = 9;
+    C->params.writeParams.nclx[1] = 16;
+    C->params.writeParams.nclx[2] = 9;
+    C->params.writeParams.speed = 6;
+    C->params.writeParams.quality = 80;
+}
+
+static void watchPrintSyntax(void)
+{
+    fprintf(stderr,
+            "Syntax: colorist-watch [options] DIR [OUTPUTDIR]\n"
+            "Converts new files in DIR to AVIF (BT.2020 PQ, 10bpc, 4:4:4), written to OUTPUTDIR (default: DIR).\n"
+            "OUTPUTDIR must differ from DIR when watching for AVIF files.\n"
+            "Options:\n"
+            "    -e, --ext EXT      : Extension of files to convert (default: " WATCH_DEFAULT_EXTENSION ")\n"
+            "    -j JOBS            : Threads per conversion (default: all cores)\n"
+            "    --queue COUNT      : Max settled files waiting for conversion (default: %d)\n"
+            "    --debounce MS      : Quiet time before a file counts as fully written (default: %d)\n"
+            "    -q QUALITY         : AVIF quality (default: 80)\n"
+            "    --speed SPEED      : AVIF encoder speed (default: 6)\n"
+            "    -v                 : Verbose conversion logging\n",
+            WATCH_DEFAULT_QUEUE_SIZE,
+            WATCH_DEFAULT_DEBOUNCE_MS);
+}
+
+int main(int argc, char * argv[])
+{
+    clContextSystem system;
+    system.alloc = clContextDefaultAlloc;
+    system.free = clContextDefaultFree;
+    system.log = watchSystemLog;
+    system.error = watchSystemLogError;
+
+    clContext * C = clContextCreate(&system);
+    watchApplyPreset(C);
+
+    Watch watch;
+    memset(&watch, 0, sizeof(watch));
+    watch.C = C;
+    watch.extension = WATCH_DEFAULT_EXTENSION;
+    watch.queueCapacity = WATCH_DEFAULT_QUEUE_SIZE;
+    watch.debounceMS = WATCH_DEFAULT_DEBOUNCE_MS;
+
+    for (int i = 1; i < argc; ++i) {
+        const char * arg = argv[i];
+        const char * value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            watchPrintSyntax();
+            clContextDestroy(C);
+            return 0;
+        } else if (!strcmp(arg, "-v")) {
+            C->verbose = clTrue;
+        } else if (arg[0] == '-') {
+            if (!value) {
+                clContextLogError(C, "%s requires an argument", arg);
+                clContextDestroy(C);
+                return 1;
+            }
+            ++i;
+            if (!strcmp(arg, "-e") || !strcmp(arg, "--ext")) {
+                watch.extension = (value[0] == '.') ? value + 1 : value;
+            } else if (!strcmp(arg, "-j")) {
+                C->jobs = CL_CLAMP(atoi(value), 1, clTaskLimit());
+            } else if (!strcmp(arg, "--queue")) {
+                watch.queueCapacity = CL_MAX(atoi(value), 1);
+            } else if (!strcmp(arg, "--debounce")) {
+                watch.debounceMS = CL_MAX(atoi(value), 0);
+            } else if (!strcmp(arg, "-q")) {
+                C->params.writeParams.quality = CL_CLAMP(atoi(value), 0, 100);
+            } else if (!strcmp(arg, "--speed")) {
+                C->params.writeParams.speed = CL_CLAMP(atoi(value), 0, 10);
+            } else {
+                clContextLogError(C, "Unknown option: %s", arg);
+                clContextDestroy(C);
+                return 1;
+            }
+        } else if (!watch.watchDir) {
+            watch.watchDir = arg;
+        } else if (!watch.outputDir) {
+            watch.outputDir = arg;
+        } else {
+            clContextLogError(C, "Too many arguments: %s", arg);
+            clContextDestroy(C);
+            return 1;
+        }
+    }
+    if (!watch.watchDir) {
+        watchPrintSyntax();
+        clContextDestroy(C);
+        return 1;
+    }
+    if (!watch.outputDir) {
+        watch.outputDir = watch.watchDir;
+    }
+    if (watchWritesIntoItself(&watch)) {
+        clContextLogError(C, "Watching for *.%s where the output goes would convert our own output; pass a separate OUTPUTDIR",
+                          watch.extension);
+        clContextDestroy(C);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watchSignalHandler; // no SA_RESTART, so poll() wakes up with EINTR
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    watch.jobs = calloc(watch.queueCapacity, sizeof(WatchJob));
+    pthread_mutex_init(&watch.lock, NULL);
+    pthread_cond_init(&watch.queueChanged, NULL);
+    pthread_t worker;
+    int createError = pthread_create(&worker, NULL, watchWorkerThreadProc, &watch);
+    if (createError != 0) {
+        clContextLogError(C, "Can't start the worker thread: %s", strerror(createError));
+        free(watch.jobs);
+        pthread_cond_destroy(&watch.queueChanged);
+        pthread_mutex_destroy(&watch.lock);
+        clContextDestroy(C);
+        return 1;
+    }
+
+    int ret = watchRun(&watch);
+
+    // Let the worker finish whatever already settled, then report
+    pthread_mutex_lock(&watch.lock);
+    watch.stopping = clTrue;
+    pthread_cond_signal(&watch.queueChanged);
+    pthread_mutex_unlock(&watch.lock);
+    pthread_join(worker, NULL);
+
+    watchLog(&watch,
+             "Stopped: %d done, %d failed, %d deferred, %d inotify overflows, %.1f MB in, %.1f MB out",
+             watch.stats.done,
+             watch.stats.failed,
+             watch.stats.deferred,
+             watch.stats.overflows,
+             watch.stats.inputBytes / (1024.0 * 1024.0),
+             watch.stats.outputBytes / (1024.0 * 1024.0));
+
+    for (int i = 0; i < watch.pendingCount; ++i) {
+        free(watch.pending[i].path);
+    }
+    free(watch.jobs);
+    pthread_cond_destroy(&watch.queueChanged);
+    pthread_mutex_destroy(&watch.lock);
+    clContextDestroy(C);
+    return ret;
+}
@@ -31,7 +31,7 @@ int main(int argc, char * argv[])
 
     clContext * C = clContextCreate(NULL);
 
-    clImage * image = clContextRead(C, inputFilename, NULL, NULL);
+    clImage * image = clContextRead(C, inputFilename, NULL, NULL, NULL);
     if (image && (image->depth > 8)) {
         avifImage * avif = avifImageCreate(image->width, image->height, image->depth, avifYUVFormat);
 
@@ -104,6 +104,9 @@ int main(int argc, char * argv[])
         case CL_ACTION_MODIFY:
             ret = clContextModify(C);
             break;
+        case CL_ACTION_BATCH:
+            ret = clContextBatch(C, jsonOutput);
+            break;
         case CL_ACTION_ERROR:
         case CL_ACTION_NONE:
         default:
@@ -18,9 +18,12 @@ struct _cmsContext_struct;
 
 struct clContext;
 struct clImage;
+struct clMutex;
 struct clProfile;
 struct clProfilePrimaries;
 struct clRaw;
+struct clTaskPool;
+struct clTransformCache;
 struct cJSON;
 
 #define CL_DIAGNOSTIC_ERROR_SIZE 256
@@ -34,6 +37,7 @@ typedef enum clAction
     CL_ACTION_HIGHLIGHT,
     CL_ACTION_IDENTIFY,
     CL_ACTION_MODIFY,
+    CL_ACTION_BATCH,
 
     CL_ACTION_ERROR
 } clAction;
@@ -42,12 +46,20 @@ clAction clActionFromString(struct clContext * C, const char * str);
 const char * clActionToString(struct clContext * C, clAction action);
 
 struct clFormat;
+struct clReadParams;
 struct clWriteParams;
 typedef clBool (*clFormatDetectFunc)(struct clContext * C, struct clFormat * format, struct clRaw * input);
 typedef struct clImage * (*clFormatReadFunc)(struct clContext * C,
                                              const char * formatName,
                                              struct clProfile * overrideProfile,
-                                             struct clRaw * input);
+                                             struct clRaw * input,
+                                             const struct clReadParams * readParams);
+// Optional: parses only the container metadata, returning an image with width, height, depth and profile
+// but no pixels allocated, or NULL if the header can't be understood.
+typedef struct clImage * (*clFormatProbeFunc)(struct clContext * C,
+                                              const char * formatName,
+                                              struct clProfile * overrideProfile,
+                                              struct clRaw * input);
 typedef clBool (*clFormatWriteFunc)(struct clContext * C,
                                     struct clImage * image,
                                     const char * formatName,
@@ -80,6 +92,7 @@ typedef struct clFormat
     clBool usesYUVFormat;
     clFormatDetectFunc detectFunc;
     clFormatReadFunc readFunc;
+    clFormatProbeFunc probeFunc;
     clFormatWriteFunc writeFunc;
 } clFormat;
 
@@ -87,6 +100,7 @@ clBool clFormatExists(struct clContext * C, const char * formatName);
 int clFormatMaxDepth(struct clContext * C, const char * formatName);
 int clFormatBestDepth(struct clContext * C, const char * formatName, int reqDepth);
 const wchar_t * clFormatDetect(struct clContext * C, const wchar_t * filename);
+const char * clFormatDetectRaw(struct clContext * C, struct clRaw * input); // by signature (or probe), NULL if unknown
 
 // TODO: consider merging with clTonemapParams (requires API refactor)
 typedef enum clTonemap
@@ -131,6 +145,45 @@ typedef enum clFilter
 clFilter clFilterFromString(struct clContext * C, const char * str);
 const char * clFilterToString(struct clContext * C, clFilter filter);
 
+// Polynomial approximations used by the batched (SIMD) transfer functions
+typedef enum clCurvePrecision
+{
+    CL_CURVEPRECISION_EXACT = 0, // ~1 ulp log/exp, matches libm to within a few ulps (default)
+    CL_CURVEPRECISION_FAST,      // short minimax log2/exp2 fits, good to ~1e-4 (plenty for 12bit output)
+
+    CL_CURVEPRECISION_INVALID = -1
+} clCurvePrecision;
+
+clCurvePrecision clCurvePrecisionFromString(struct clContext * C, const char * str);
+const char * clCurvePrecisionToString(struct clContext * C, clCurvePrecision precision);
+
+// How autograde (-a) searches for the best gamma. Candidates are scored against a histogram of the image, not the
+// pixels, see clPixelMathColorGrade().
+typedef enum clGradeSearch
+{
+    CL_GRADESEARCH_GOLDEN = 0, // coarse bracket, then golden-section refinement down to the precision (default).
+                               // Discrete histograms (8-12 bit sources) are swept instead.
+    CL_GRADESEARCH_SWEEP,      // every multiple of the precision across the range (61 candidates at 0.05)
+
+    CL_GRADESEARCH_INVALID = -1
+} clGradeSearch;
+
+clGradeSearch clGradeSearchFromString(struct clContext * C, const char * str);
+const char * clGradeSearchToString(struct clContext * C, clGradeSearch search);
+
+#define CL_GRADE_DEFAULT_PRECISION 0.01f
+#define CL_GRADE_MIN_PRECISION 0.001f
+#define CL_GRADE_DEFAULT_ITERATIONS 20
+
+typedef struct clGradeParams
+{
+    clGradeSearch search; // --grade-search
+    float precision;      // --grade-precision, gamma resolution
+    int maxIterations;    // --grade-iterations, golden-section candidates after the coarse bracket
+    int sampleStep;       // --grade-sample, histogram every Nth pixel (1 = all); the error bound is logged
+} clGradeParams;
+void clGradeParamsSetDefaults(struct clContext * C, clGradeParams * params);
+
 typedef enum clPixelFormat
 {
     CL_PIXELFORMAT_FIRST = 0,
@@ -138,6 +191,7 @@ typedef enum clPixelFormat
     CL_PIXELFORMAT_U8 = 0,
     CL_PIXELFORMAT_U16,
     CL_PIXELFORMAT_F32,
+    CL_PIXELFORMAT_F16, // half floats, same range as F32
 
     CL_PIXELFORMAT_COUNT
 } clPixelFormat;
@@ -155,6 +209,13 @@ typedef enum clYUVFormat
 clYUVFormat clYUVFormatFromString(struct clContext * C, const char * str);
 const char * clYUVFormatToString(struct clContext * C, clYUVFormat format);
 
+typedef struct clReadParams
+{
+    const char * codec;  // AVIF only. Specify a codec to read with (NULL == auto)
+    uint32_t frameIndex; // Image sequences only. Which frame to decode
+} clReadParams;
+void clReadParamsSetDefaults(struct clContext * C, clReadParams * readParams);
+
 typedef struct clWriteParams
 {
     int quality;
@@ -226,12 +287,12 @@ typedef struct clReadExtraInfo
 typedef struct clConversionParams
 {
     clBool autoGrade;               // -a
+    clGradeParams gradeParams;      // --grade-search, --grade-precision, --grade-iterations, --grade-sample
     int bpc;                        // -b
     const char * copyright;         // -c
     const char * description;       // -d
     const char * formatName;        // -f
     uint32_t curveType;             // -g
-    uint32_t frameIndex;            // --frameindex
     float gamma;                    // -g
     const char * hald;              // --hald
     int luminance;                  // -l
@@ -245,8 +306,8 @@ typedef struct clConversionParams
     clBool stats;                   // --stats
     clTonemap tonemap;              // -t
     clTonemapParams tonemapParams;  // -t
+    clReadParams readParams;        // --codec, --frameindex
     clWriteParams writeParams;      // -n, -q, -r, --yuv
-    const char * readCodec;         // AVIF only. Specify a codec to read with (NULL == auto)
     int rect[4];                    // -z
     const char * compositeFilename; // --composite
     clBlendParams compositeParams;  // --composite-gamma, --composite-premultiplied
@@ -266,10 +327,18 @@ typedef struct clContext
 {
     clContextSystem system;
 
+    // Shared with job contexts (see clContextCreateJob()); on a job context these are the parent's
     struct _cmsContext_struct * lcms; // cmsContext
+    clFormatRecord * formats;         // register formats before creating any job contexts
 
-    clFormatRecord * formats;
+    // Owned by the root context only (a job context's are NULL and it uses its parent's)
+    struct clTaskPool * taskPool;             // created on first use, see clContextGetTaskPool()
+    struct clTransformCache * transformCache; // created on first use, see clTransformCacheAcquire()
+    struct clMutex * lock;                    // guards the two above and jobCount
+    int jobCount;                             // live job contexts
+    struct clContext * parent;                // NULL unless this is a job context
 
+    // Everything below is per context, and therefore per job
     clAction action;
     clConversionParams params;     // see above
     clReadExtraInfo readExtraInfo; // populated by some formats' readers
@@ -278,12 +347,23 @@ typedef struct clContext
     int jobs;                      // -j
     clBool verbose;                // -v
     clBool ccmmAllowed;            // --ccmm
+    clBool simdAllowed;            // --simd
+    clCurvePrecision curvePrecision; // --precision
+    int lutSize;                   // --lut (grid points per axis, 0 disables baked LUTs)
     const wchar_t * inputFilename;    // index 0
     const wchar_t * outputFilename;   // index 1
+    const char * batchSource;      // batch: manifest filename or glob pattern (index 0)
+    const char * batchOutputDir;   // batch: output directory for glob jobs (index 1)
+    int batchMemoryMB;             // --batch-memory
     int defaultLuminance;
     clBool enforceLuminance;
+    int scRGBLuminance; // --scrgb-nits, see CL_SCRGB_LUMINANCE
 } clContext;
 
+// scRGB 1.0 is 80 nits. Untagged half/float JXRs (Game Bar captures) are decoded with their pixels rescaled to be
+// relative to C->scRGBLuminance instead, and tagged with it as their max luminance.
+#define CL_SCRGB_LUMINANCE 80
+
 struct clImage;
 
 #define clAllocate(BYTES) C->system.alloc(C, BYTES)
@@ -295,6 +375,12 @@ char * clContextStrdup(clContext * C, const char * str);
 // No need to allocate the clContextSystem structure; just put it on the stack. Any values will be shallow copied.
 clContext * clContextCreate(clContextSystem * system);
 void clContextDestroy(clContext * C);
+
+// A job context is a cheap clContext for running one conversion at a time alongside others. It starts
+// with a copy of parent's options and params, keeps its own params / filenames / readExtraInfo, and shares
+// parent's formats, LittleCMS context, task pool and transform cache, all of which are safe to use from
+// several job contexts on different threads at once. Destroy jobs (with clContextDestroy()) before parent.
+clContext * clContextCreateJob(clContext * parent);
 void clContextRegisterFormat(clContext * C, clFormat * format);
 
 void clContextLog(clContext * C, const char * section, int indent, const char * format, ...);
@@ -304,9 +390,43 @@ void clContextPrintSyntax(clContext * C);
 void clContextPrintVersions(clContext * C);
 clBool clContextParseArgs(clContext * C, int argc, const char * argv[]);
 
-struct clImage * clContextRead(clContext * C, const wchar_t * filename, const char * iccOverride, const char ** outFormatName);
+// Parses a batch job's arguments (conversion options plus up to two filenames) on top of params.
+// C->params is left untouched; context-wide options (-j, -v, --cmm, ...) still apply to C.
+clBool clContextParseJobArgs(clContext * C,
+                             clConversionParams * params,
+                             int argc,
+                             const char * argv[],
+                             const char * filenames[2]);
+
+// readParams may be NULL for the defaults (first frame, automatic codec)
+struct clImage * clContextRead(clContext * C,
+                               const wchar_t * filename,
+                               const char * iccOverride,
+                               const clReadParams * readParams,
+                               const char ** outFormatName);
 clBool clContextWrite(clContext * C, struct clImage * image, const wchar_t * filename, const char * formatName, clWriteParams * writeParams);
+
+// In-memory counterparts of the above. formatName may be NULL when reading, to detect it from the data.
+struct clImage * clContextReadMemory(clContext * C,
+                                     struct clRaw * input,
+                                     const char * formatName,
+                                     const char * iccOverride,
+                                     const clReadParams * readParams);
+clBool clContextWriteMemory(clContext * C, struct clImage * image, const char * formatName, clWriteParams * writeParams, struct clRaw * output);
 char * clContextWriteURI(struct clContext * C, struct clImage * image, const char * formatName, clWriteParams * writeParams);
+
+// Header-only counterparts of the readers: the returned image has its dimensions, depth and profile filled in but
+// no pixels. Formats without a probeFunc (or whose probe fails) fall back to a full read.
+struct clImage * clContextProbe(clContext * C,
+                                const wchar_t * filename,
+                                const char * iccOverride,
+                                const clReadParams * readParams,
+                                const char ** outFormatName);
+struct clImage * clContextProbeMemory(clContext * C,
+                                      struct clRaw * input,
+                                      const char * formatName,
+                                      const char * iccOverride,
+                                      const clReadParams * readParams);
 void clContextLogWrite(clContext * C, const wchar_t * filename, const char * formatName, clWriteParams * writeParams);
 
 clBool clContextGetStockPrimaries(struct clContext * C, const char * name, struct clProfilePrimaries * outPrimaries);
@@ -314,11 +434,23 @@ clBool clContextGetRawStockPrimaries(struct clContext * C, const char * name, fl
 const char * clContextFindStockPrimariesPrettyName(struct clContext * C, struct clProfilePrimaries * primaries); // returns NULL if not found
 
 int clContextConvert(clContext * C);
+// The part of clContextConvert() after decoding; takes ownership of srcImage
+int clContextConvertImage(clContext * C,
+                          struct clImage * srcImage,
+                          const clConversionParams * params,
+                          const wchar_t * outputFilename);
+// Converts an encoded image in memory, with no files involved: input is decoded (format detected from its
+// contents), converted according to params and encoded into output (free it with clRawFree()). Nothing in
+// C->params or C's filenames is read or changed, so the same context can serve calls with different params.
+int clContextConvertMemory(clContext * C, struct clRaw * input, const clConversionParams * params, struct clRaw * output);
+int clContextBatch(clContext * C, struct cJSON * output);
 int clContextGenerate(clContext * C, struct cJSON * output); // output here only used in ACTION_CALC
 int clContextHighlight(clContext * C);
 int clContextIdentify(clContext * C, struct cJSON * output);
 int clContextModify(clContext * C);
 
+#define CL_BATCH_DEFAULT_MEMORY_MB 2048 // decoded images allowed in flight at once during batch
+
 #define TIMING_FORMAT "--> %.3f sec"
 #define OVERALL_TIMING_FORMAT "==> %.3f sec"
 
@@ -14,13 +14,28 @@
 #define CL_CHANNELS_PER_PIXEL 4 // R, G, B, A
 static const uint32_t CL_BYTES_PER_CHANNEL[CL_PIXELFORMAT_COUNT] = { (uint32_t)sizeof(uint8_t),
                                                                      (uint32_t)sizeof(uint16_t),
-                                                                     (uint32_t)sizeof(float) };
+                                                                     (uint32_t)sizeof(float),
+                                                                     (uint32_t)sizeof(uint16_t) };
 #define CL_BYTES_PER_PIXEL(PIXELFORMAT) (CL_CHANNELS_PER_PIXEL * CL_BYTES_PER_CHANNEL[PIXELFORMAT])
 
 struct clProfile;
 struct clRaw;
 struct cJSON;
 
+// Whole-image statistics, scanned lazily by clImageGetStats() (or produced by the pass that wrote the pixels, such
+// as clImageConvert()) and cached on the image until clImagePrepareWritePixels() or clImageInvalidateStats().
+// Channel values are normalized as clImagePrepareReadPixels(F32) would, so float pixels may overrange.
+typedef struct clImageStats
+{
+    float channelMin[CL_CHANNELS_PER_PIXEL]; // R, G, B, A
+    float channelMax[CL_CHANNELS_PER_PIXEL];
+    float largestChannel;    // largest R, G or B value, never below 0
+    int largestChannelIndex; // first pixel holding largestChannel
+    float peakLuminance;     // clImagePeakLuminance(), depends on the profile; < 0 until asked for
+    float maxCLL;            // content light levels in nits, see clImageContentLightLevels(); < 0 until measured
+    float maxFALL;
+} clImageStats;
+
 typedef struct clImage
 {
     int width;
@@ -34,6 +49,10 @@ typedef struct clImage
     uint8_t * pixelsU8;
     uint16_t * pixelsU16;
     float * pixelsF32;
+    uint16_t * pixelsF16; // half floats (IEEE binary16), see clTransformHalfToFloat()
+
+    clImageStats stats; // only meaningful when statsValid, see clImageGetStats()
+    clBool statsValid;
 } clImage;
 
 typedef struct clImageSignals
@@ -152,7 +171,13 @@ void clImageMeasureHDR(clContext * C,
 void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
 void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
 clBool clImageAdjustRect(struct clContext * C, clImage * image, int * x, int * y, int * w, int * h);
-void clImageColorGrade(struct clContext * C, clImage * image, int dstColorDepth, int * outLuminance, float * outGamma, clBool verbose);
+void clImageColorGrade(struct clContext * C,
+                       clImage * image,
+                       int dstColorDepth,
+                       const clGradeParams * gradeParams, // NULL for defaults
+                       int * outLuminance,
+                       float * outGamma,
+                       clBool verbose);
 void clImageDebugDump(struct clContext * C, clImage * image, int x, int y, int w, int h, int extraIndent);
 void clImageDebugDumpJSON(struct clContext * C, struct cJSON * jsonOutput, clImage * image, int x, int y, int w, int h);
 void clImageDebugDumpPixel(struct clContext * C, clImage * image, int x, int y, clImagePixelInfo * pixelInfo);
@@ -160,8 +185,23 @@ void clImageDestroy(struct clContext * C, clImage * image);
 void clImageLogCreate(struct clContext * C, int width, int height, int depth, struct clProfile * profile);
 clImage * clImageParseString(struct clContext * C, const char * str, int depth, struct clProfile * profile);
 clBool clImageCalcSignals(struct clContext * C, clImage * srcImage, clImage * dstImage, clImageSignals * signals);
+const clImageStats * clImageGetStats(struct clContext * C, clImage * image);
+void clImageInvalidateStats(struct clContext * C, clImage * image); // call after changing pixels or the profile in place
 float clImageLargestChannel(struct clContext * C, clImage * image);
 float clImagePeakLuminance(struct clContext * C, clImage * image); // Doesn't return maxCLL, but the lum of (largestChannel, largestChannel, largestChannel)
+void clImageContentLightLevels(struct clContext * C, clImage * image, float * outMaxCLL, float * outMaxFALL); // nits
+
+// The reductions behind clImageStats, for passes that already touch every pixel. Accumulate count RGBA pixels of the
+// given format/depth, the first of which is pixel firstIndex of the image; partial stats are merged in pixel order.
+void clImageStatsReset(clImageStats * stats);
+void clImageStatsAccumulate(struct clContext * C,
+                            clImageStats * stats,
+                            const void * pixels,
+                            clPixelFormat pixelFormat,
+                            int depth,
+                            int firstIndex,
+                            int count);
+void clImageStatsMerge(clImageStats * stats, const clImageStats * partial);
 void clImageClear(struct clContext * C, clImage * image, float color[4]);
 void clImageDrawCIE(struct clContext * C, clImage * image, float borderColor[4], int borderThickness);
 void clImageDrawGamut(struct clContext * C,
@@ -24,8 +24,10 @@ void clPixelMathColorGrade(struct clContext * C,
                            float * pixels,
                            int pixelCount,
                            int imageWidth,
+                           int largestChannelIndex, // from clImageStats, or -1 to search
                            int srcLuminance,
                            int dstColorDepth,
+                           const clGradeParams * gradeParams, // NULL for defaults
                            int * outLuminance,
                            float * outGamma,
                            clBool verbose);
@@ -71,6 +71,17 @@ typedef struct clProfileYUVCoefficients
 } clProfileYUVCoefficients;
 void clProfileYUVCoefficientsSetDefaults(struct clContext * C, clProfileYUVCoefficients * yuv);
 
+// The brightest Y an RGB gamut reaches at a chromaticity, relative to its white (Y = 1). Scaled by y, each linear
+// channel of xyY (x, y, 1) is affine in x and y, so the coefficients are solved once and every query is a few FLOPs.
+typedef struct clProfileGamutCeiling
+{
+    float channelCoeffs[3][3];  // { x, y, 1 } coefficients of each channel
+    float channelLuminances[3]; // Y of each primary
+} clProfileGamutCeiling;
+// colorants[i] is the XYZ of primary i. Fails (leaving a ceiling of 0 everywhere) when they are collinear.
+clBool clProfileGamutCeilingFromColorants(struct clContext * C, const float colorants[3][3], clProfileGamutCeiling * ceiling);
+float clProfileGamutCeilingMaxY(const clProfileGamutCeiling * ceiling, float x, float y);
+
 clProfile * clProfileCreateStock(struct clContext * C, clProfileStock stock);
 clProfile * clProfileClone(struct clContext * C, clProfile * profile);
 clProfile * clProfileCreate(struct clContext * C, clProfilePrimaries * primaries, clProfileCurve * curve, int maxLuminance, const char * description);
@@ -81,6 +92,7 @@ clBool clProfileWrite(struct clContext * C, clProfile * profile, const wchar_t *
 clBool clProfileQuery(struct clContext * C, clProfile * profile, clProfilePrimaries * primaries, clProfileCurve * curve, int * luminance);
 void clProfileDescribe(struct clContext * C, clProfile * profile, char * outDescription, size_t outDescriptionSize);
 void clProfileQueryYUVCoefficients(struct clContext * C, clProfile * profile, clProfileYUVCoefficients * yuv);
+clBool clProfileQueryGamutCeiling(struct clContext * C, clProfile * profile, clProfileGamutCeiling * ceiling);
 clBool clProfileHasPQSignature(struct clContext * C, clProfile * profile, clProfilePrimaries * primaries);
 clProfileCurveType clProfileCurveSignature(struct clContext * C, clProfile * profile);
 char * clProfileGetMLU(struct clContext * C, clProfile * profile, const char tag[5], const char languageCode[3], const char countryCode[3]);
@@ -10,17 +10,30 @@
 
 #include "colorist/types.h"
 
+// Hands a borrowed buffer back to whoever lent it (see clRawBorrow())
+typedef void (*clRawReleaseFunc)(void * owner, uint8_t * ptr);
+
 typedef struct clRaw
 {
     uint8_t * ptr;
     size_t size;
+
+    // A borrowed raw points at memory that didn't come from clAllocate(), such as a mapped file or an
+    // encoder's output buffer. clRawFree() returns it through release (if any) instead of freeing it, and
+    // clRawRealloc() / clRawSet() move a borrowed raw into an owned buffer before touching it.
+    clBool borrowed;
+    clRawReleaseFunc release;
+    void * releaseOwner;
 } clRaw;
 
-#define CL_RAW_EMPTY \
-    {                \
-        NULL, 0      \
+#define CL_RAW_EMPTY                    \
+    {                                   \
+        NULL, 0, clFalse, NULL, NULL    \
     }
 
+// clRawReadFile() maps files at least this big instead of reading them into the heap
+#define CL_RAW_MAP_MIN_BYTES (1024 * 1024)
+
 struct clContext;
 
 void clRawRealloc(struct clContext * C, clRaw * raw, size_t newSize);
@@ -29,6 +42,11 @@ clBool clRawDeflate(struct clContext * C, clRaw * dst, const clRaw * src);
 char * clRawToBase64(struct clContext * C, clRaw * src);
 void clRawSet(struct clContext * C, clRaw * raw, const uint8_t * data, size_t len);
 void clRawFree(struct clContext * C, clRaw * raw);
+// Frees raw's current contents, then points it at ptr without copying. release(owner, ptr) is called by clRawFree()
+// once raw is done with it; pass NULL if ptr outlives raw anyway.
+void clRawBorrow(struct clContext * C, clRaw * raw, uint8_t * ptr, size_t size, clRawReleaseFunc release, void * owner);
+// Maps the whole file copy-on-write (writes to raw->ptr never reach the file). clFalse if it can't be mapped.
+clBool clRawMapFile(struct clContext * C, clRaw * raw, const wchar_t * filename);
 clBool clRawReadFile(struct clContext * C, clRaw * raw, const wchar_t * filename);
 clBool clRawReadFileHeader(struct clContext * C, clRaw * raw, const wchar_t * filename, size_t bytes);
 clBool clRawWriteFile(struct clContext * C, clRaw * raw, const wchar_t * filename);
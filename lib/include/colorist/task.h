@@ -11,20 +11,55 @@
 #include "colorist/types.h"
 
 struct clContext;
+struct clMutex;
+struct clTaskPool;
 
 typedef void (*clTaskFunc)(void * userData);
+typedef void (*clTaskIndexFunc)(void * userData, int index);
 
+typedef enum clTaskState
+{
+    CL_TASKSTATE_QUEUED = 0,
+    CL_TASKSTATE_RUNNING,
+    CL_TASKSTATE_DONE
+} clTaskState;
+
+// A clTask is a single unit of work submitted to the clContext's clTaskPool. The pool is created
+// on first use (sized from C->jobs) and lives until clContextDestroy(), so creating a clTask no
+// longer spawns a thread.
 typedef struct clTask
 {
     clTaskFunc func;
-    void * nativeData;
+    clTaskIndexFunc indexFunc; // used instead of func by clTaskParallelFor()
     void * userData;
+    int index;
+    struct clTaskPool * pool;
+    clTaskState state; // guarded by the pool's lock
     clBool joined;
 } clTask;
 
 clTask * clTaskCreate(struct clContext * C, clTaskFunc func, void * userData);
+// Like clTaskCreate(), but on a pool of the caller's choosing (e.g. a private one-worker pool for a pipeline stage)
+clTask * clTaskCreateInPool(struct clContext * C, struct clTaskPool * pool, clTaskFunc func, void * userData);
 void clTaskJoin(struct clContext * C, clTask * task);
 void clTaskDestroy(struct clContext * C, clTask * task);
 int clTaskLimit(void);
 
+// Calls func(userData, index) for every index in [0, count) using the context's pool, and returns
+// once all of them have finished. The calling thread helps out instead of idling.
+void clTaskParallelFor(struct clContext * C, int count, clTaskIndexFunc func, void * userData);
+
+// Persistent work-stealing pool. Each worker owns a queue and steals from the others when it runs
+// dry; threads waiting in clTaskJoin() run queued work as well, so a pool with zero workers
+// (C->jobs == 1) simply runs everything on the joining thread.
+struct clTaskPool * clTaskPoolCreate(struct clContext * C, int workerCount);
+void clTaskPoolDestroy(struct clContext * C, struct clTaskPool * pool);
+struct clTaskPool * clContextGetTaskPool(struct clContext * C); // creates or resizes C->taskPool to match C->jobs
+
+// Plain (non-recursive) mutex for state shared between job contexts, see clContextCreateJob()
+struct clMutex * clMutexCreate(struct clContext * C);
+void clMutexDestroy(struct clContext * C, struct clMutex * mutex);
+void clMutexLock(struct clMutex * mutex);
+void clMutexUnlock(struct clMutex * mutex);
+
 #endif // ifndef COLORIST_TASK_H
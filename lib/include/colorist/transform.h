@@ -9,6 +9,7 @@
 #define COLORIST_TRANSFORM_H
 
 #include "colorist/context.h"
+#include "colorist/profile.h"
 #include "colorist/types.h"
 
 // for gbMat3
@@ -18,6 +19,7 @@
 #include "lcms2.h"
 
 struct clContext;
+struct clImageStats;
 struct clProfile;
 struct clProfilePrimaries;
 
@@ -39,6 +41,36 @@ typedef enum clTransformTransferFunction
     CL_XTF_PQ
 } clTransformTransferFunction;
 
+// The steps a prepared clTransform actually runs, in order. clTransformPrepare() fuses what it can:
+// without tonemapping, luminance scaling is a constant factor in XYZ and folds into the src->dst
+// matrix, so the XYZ round trip disappears; the matrix itself is dropped when the primaries match and
+// there is nothing to scale, and identity curves (gamma 1.0) are reduced to their clamp.
+typedef enum clTransformOp
+{
+    CL_XOP_COPY = 0,  // profiles match, repack only
+    CL_XOP_EOTF,      // src curve -> linear
+    CL_XOP_CLAMP_SRC, // clamp to >= 0; all that's left of an identity (gamma 1.0) EOTF
+    CL_XOP_MATRIX,    // single 3x3 src linear -> dst linear, luminance scale included (clTransformPlan.matrix)
+    CL_XOP_TO_XYZ,    // src -> XYZ
+    CL_XOP_LUMINANCE, // luminance scale and tonemap, via xyY
+    CL_XOP_FROM_XYZ,  // XYZ -> dst
+    CL_XOP_CLAMP_DST, // clamp to >= 0, or [0, 1] ahead of an HLG/PQ OETF (skipped for XYZ)
+    CL_XOP_OETF,      // linear -> dst curve
+    CL_XOP_COMBINED   // LittleCMS only: the whole src -> dst conversion as one optimized transform (lcmsCombined)
+} clTransformOp;
+
+#define CL_TRANSFORM_MAX_OPS 9
+
+// Integer sources of up to this depth linearize through a 2^depth entry table instead of the EOTF
+#define CL_TRANSFORM_MAX_TABLE_DEPTH 16
+
+typedef struct clTransformPlan
+{
+    clTransformOp ops[CL_TRANSFORM_MAX_OPS];
+    int count;
+    gbMat3 matrix; // used by CL_XOP_MATRIX
+} clTransformPlan;
+
 // clTransform does not own either clProfile and it is expected that both will outlive the clTransform that uses them
 typedef struct clTransform
 {
@@ -66,14 +98,32 @@ typedef struct clTransform
     gbMat3 ccmmXYZToDst;
     gbMat3 ccmmCombined;
     float ccmmHLGLuminance;
+    float ccmmHLGExponent; // clTransformCalcHLGExponent(ccmmHLGLuminance)
+    clTransformPlan ccmmPlan;
+    float * ccmmSrcTables[CL_TRANSFORM_MAX_TABLE_DEPTH + 1]; // integer src value -> linear, per depth (built on first use)
     clBool ccmmReady;
 
     // Cache for LittleCMS objects
     cmsHPROFILE lcmsXYZProfile;
     cmsHTRANSFORM lcmsSrcToXYZ;
     cmsHTRANSFORM lcmsXYZToDst;
-    cmsHTRANSFORM lcmsCombined;
+    cmsHTRANSFORM lcmsCombined; // only created when nothing needs to happen in XYZ between the two halves
+    clTransformPlan lcmsPlan;
     clBool lcmsReady;
+
+    // Baked LittleCMS conversion (see clTransformBakeLUT()), lutSize^3 RGB entries with red varying fastest
+    float * lut;
+    int lutSize;
+
+    clBool ownsProfiles; // clTransformDestroy() destroys srcProfile/dstProfile (set on transforms from clTransformCacheAcquire())
+
+    // Gamut ceiling of a linear RGB -> XYZ transform (see clTransformGetGamutCeiling())
+    clProfileGamutCeiling gamutCeiling;
+    clBool gamutCeilingReady;
+
+    // Guards the lazily built state above (ccmmReady/lcmsReady, ccmmSrcTables, lut, gamutCeiling), so that job
+    // contexts can run one cached transform concurrently
+    struct clMutex * lock;
 } clTransform;
 
 clTransform * clTransformCreate(struct clContext * C,
@@ -87,15 +137,196 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform);
 clBool clTransformUsesCCMM(struct clContext * C, clTransform * transform);
 const char * clTransformCMMName(struct clContext * C, clTransform * transform);    // Convenience function
 float clTransformGetLuminanceScale(struct clContext * C, clTransform * transform); // Convenience function
+const clTransformPlan * clTransformGetPlan(struct clContext * C, clTransform * transform); // prepares, plan for the current CMM
+clBool clTransformPlanHasOp(const clTransformPlan * plan, clTransformOp op);
+const char * clTransformOpName(clTransformOp op);
+void clTransformDescribePlan(struct clContext * C, clTransform * transform, char * buffer, int bufferSize); // "CCMM: EOTF > ..."
 void clTransformRun(struct clContext * C, clTransform * transform, float * srcPixels, float * dstPixels, int pixelCount);
 
+// clTransformRun() between any clPixelFormats. U8, U16 and F16 pixels are RGBA (U8/U16 at the given depth, as in
+// clImage, U16 stores values up to 2^depth-1) and need a CL_XF_RGBA format on that side. Pixels are converted
+// CL_TRANSFORM_CHUNK_PIXELS at a time, so neither side needs an F32 copy: integer sources are linearized through
+// ccmmSrcTables straight into the matrix stage (or normalized, for LittleCMS and baked LUTs), half sources are
+// widened, integer destinations are rounded/clamped by clTransformQuantize() and half destinations are narrowed by
+// clTransformFloatToHalf().
+#define CL_TRANSFORM_CHUNK_PIXELS 1024
+void clTransformRunPixels(struct clContext * C,
+                          clTransform * transform,
+                          void * srcPixels,
+                          clPixelFormat srcPixelFormat,
+                          int srcDepth,
+                          void * dstPixels,
+                          clPixelFormat dstPixelFormat,
+                          int dstDepth,
+                          int pixelCount);
+
+// clTransformRunPixels() that also reduces the destination pixels (as stored) into dstStats, per task and merged
+// afterwards, so writing an image yields its clImageStats (content light levels included) without another pass.
+// Needs a CL_XF_RGBA dst format.
+void clTransformRunPixelsWithStats(struct clContext * C,
+                                   clTransform * transform,
+                                   void * srcPixels,
+                                   clPixelFormat srcPixelFormat,
+                                   int srcDepth,
+                                   void * dstPixels,
+                                   clPixelFormat dstPixelFormat,
+                                   int dstDepth,
+                                   int pixelCount,
+                                   struct clImageStats * dstStats);
+
+// CTA-861.3 content light levels of pixelCount RGBA pixels encoded for profile, in nits: the largest linear R, G or B
+// of any pixel (MaxCLL) and the average over the frame of each pixel's largest one (MaxFALL). This is the standalone
+// pass for images that didn't come out of clTransformRunPixelsWithStats().
+void clTransformMeasureLightLevels(struct clContext * C,
+                                   struct clProfile * profile,
+                                   const void * pixels,
+                                   clPixelFormat pixelFormat,
+                                   int depth,
+                                   int pixelCount,
+                                   float * outMaxCLL,
+                                   float * outMaxFALL);
+
+// Rounds count floats into U8 (depth 8) or U16 channels of the given depth. Identical to clPixelMathRoundUNorm()
+// for inputs in [0, 1]; overranged values clamp to the max, negatives and NaN to 0.
+void clTransformQuantize(struct clContext * C, const float * src, void * dst, clPixelFormat pixelFormat, int depth, int count);
+
+// Baked 3D LUTs for the LittleCMS path. clTransformRun() bakes a C->lutSize^3 grid of the whole conversion
+// (luminance scaling, tonemapping and dst clamp included) once an image has at least CL_TRANSFORM_LUT_BAKE_RATIO
+// pixels per grid point, then interpolates it tetrahedrally. Only RGB/RGBA sources are baked, and pixels with a
+// channel outside [0, 1] still go through LittleCMS. The grid lives on the transform, so cached transforms keep it.
+// clTransformRun() never swaps out a grid baked at another size (it runs unbaked instead), whereas
+// clTransformBakeLUT() does, so don't call that on a transform other threads are running.
+#define CL_TRANSFORM_LUT_DEFAULT_SIZE 33
+#define CL_TRANSFORM_LUT_MIN_SIZE 2
+#define CL_TRANSFORM_LUT_MAX_SIZE 129
+#define CL_TRANSFORM_LUT_BAKE_RATIO 2
+clBool clTransformBakeLUT(struct clContext * C, clTransform * transform, int lutSize); // clFalse if this transform can't be baked
+void clTransformLUTLookup(const float * lut, int lutSize, const float * rgb, float * dstRGB); // rgb is clamped to [0, 1]
+
+// Per-context LRU cache of prepared transforms (C->transformCache, created on first use and shared by job
+// contexts, which may acquire and release concurrently). Entries are
+// keyed by the profiles' MD5 signatures plus everything else clTransformPrepare() depends on, and own
+// clones of their profiles, so callers may destroy theirs as soon as clTransformCacheAcquire() returns.
+// Acquired transforms are shared and ready to run: don't modify or destroy them, hand them back with
+// clTransformCacheRelease(). Entries still held are never evicted; if every slot is held (or a profile
+// has no signature), Acquire returns a private transform that Release destroys.
+#define CL_TRANSFORM_CACHE_DEFAULT_CAPACITY 32
+
+typedef struct clTransformCacheEntry
+{
+    uint8_t srcSignature[16]; // all zero for XYZ
+    uint8_t dstSignature[16]; // all zero for XYZ
+    clTransformFormat srcFormat;
+    clTransformFormat dstFormat;
+    clTonemap tonemap;
+    clTonemapParams tonemapParams;
+    int defaultLuminance;
+
+    clTransform * transform;
+    int refCount;
+    uint64_t lastUsed;
+} clTransformCacheEntry;
+
+typedef struct clTransformCache
+{
+    clTransformCacheEntry * entries;
+    int count;
+    int capacity; // 0 disables caching
+    uint64_t clock;
+    struct clMutex * lock; // job contexts share their parent's cache
+
+    // stats
+    int hits;
+    int misses;
+    int evictions;
+} clTransformCache;
+
+clTransformCache * clTransformCacheCreate(struct clContext * C, int capacity);
+void clTransformCacheDestroy(struct clContext * C, clTransformCache * cache);
+clTransform * clTransformCacheAcquire(struct clContext * C,
+                                      struct clProfile * srcProfile,
+                                      clTransformFormat srcFormat,
+                                      struct clProfile * dstProfile,
+                                      clTransformFormat dstFormat,
+                                      clTonemap tonemap,
+                                      const clTonemapParams * tonemapParams); // NULL for defaults
+void clTransformCacheRelease(struct clContext * C, clTransform * transform);
+
+// Batched (AVX2/FMA) CCMM kernel, used by clTransformRun() when C->simdAllowed. Returns clFalse without
+// touching dstPixels if colorist wasn't built with AVX2/FMA. Its output matches the scalar CCMM path to
+// within CL_TRANSFORM_SIMD_TOLERANCE, relative to max(1, |value|). Channels that land within float rounding
+// noise of black (~1e-6 linear) can still encode differently through steep curves such as PQ.
+#define CL_TRANSFORM_SIMD_WIDTH 8
+#define CL_TRANSFORM_SIMD_TOLERANCE 0.0001f
+clBool clTransformRunCCMMBatch(struct clContext * C,
+                               clTransform * transform,
+                               clBool srcLinear, // srcPixels are already linear (skip the EOTF)
+                               const float * srcPixels,
+                               int srcChannelCount,
+                               float * dstPixels,
+                               int dstChannelCount,
+                               int pixelCount);
+
+// Batched (AVX2) clTransformLUTLookup() over whole pixels, alpha is left alone. Returns clFalse without touching
+// dstPixels if colorist wasn't built with AVX2.
+clBool clTransformRunLUTBatch(struct clContext * C,
+                              clTransform * transform,
+                              const float * srcPixels,
+                              int srcChannelCount,
+                              float * dstPixels,
+                              int dstChannelCount,
+                              int pixelCount);
+
+// Expands pixelCount RGBA half float pixels to floats, exactly (denormals included), multiplying RGB by rgbScale. The
+// batched (F16C) and scalar paths agree bit for bit. Runs back to front, so src may alias the start of dst, which is
+// how readers expand half pixels in place.
+void clTransformHalfToFloat(struct clContext * C, const uint16_t * src, float * dst, int pixelCount, float rgbScale);
+clBool clTransformRunHalfToFloatBatch(struct clContext * C, const uint16_t * src, float * dst, int pixelCount, float rgbScale);
+
+// Narrows count floats to half floats, rounding to nearest even (overflow -> inf, NaN stays NaN). The batched (F16C)
+// and scalar paths agree bit for bit.
+void clTransformFloatToHalf(struct clContext * C, const float * src, uint16_t * dst, int count);
+clBool clTransformRunFloatToHalfBatch(struct clContext * C, const float * src, uint16_t * dst, int count);
+
+// Batched backend for clTransformQuantize(); returns clFalse if colorist wasn't built with AVX2.
+clBool clTransformRunQuantizeBatch(struct clContext * C,
+                                   const float * src,
+                                   void * dst,
+                                   clPixelFormat pixelFormat,
+                                   int depth,
+                                   int count);
+
+// Transfer functions, applied in place to count values (EOTF: encoded -> linear, OETF: linear -> encoded).
+// param is the gamma for CL_XTF_GAMMA and the max luminance for CL_XTF_HLG, and is ignored otherwise.
+// When C->simdAllowed these run in batches of CL_TRANSFORM_SIMD_WIDTH using polynomial approximations
+// chosen by C->curvePrecision; otherwise they use the scalar (libm) versions colorConvert() uses.
+void clTransformEOTF(struct clContext * C, clTransformTransferFunction xtf, float param, float * values, int count);
+void clTransformOETF(struct clContext * C, clTransformTransferFunction xtf, float param, float * values, int count);
+
+// Batched backend for the two functions above; returns clFalse if colorist wasn't built with AVX2/FMA.
+clBool clTransformRunCurveBatch(struct clContext * C,
+                                clTransformTransferFunction xtf,
+                                float param,
+                                clBool oetf,
+                                float * values,
+                                int count);
+
+// Worst-case error of the batched transfer functions on [0, 1] inputs, relative to max(|reference|, 1e-3)
+// against a double precision reference. `colorist-test curvereport` checks every float in that range.
+#define CL_TRANSFORM_CURVE_TOLERANCE_EXACT 0.00005f
+#define CL_TRANSFORM_CURVE_TOLERANCE_FAST 0.0002f
+
 // if X+Y+Z is 0, clTransformXYZToXYY() returns (whitePointX, whitePointY, 0)
 void clTransformXYZToXYY(struct clContext * C, float * dstXYY, const float * srcXYZ, float whitePointX, float whitePointY);
 void clTransformXYYToXYZ(struct clContext * C, float * dstXYZ, const float * srcXYY);
 
 int clTransformCalcHLGLuminance(int diffuseWhite);
+float clTransformCalcHLGExponent(float maxLuminance); // HLG OOTF exponent (system gamma) for a given peak luminance
 int clTransformCalcDefaultLuminanceFromHLG(int hlgLuminance);
-float clTransformCalcMaxY(clContext * C, clTransform * linearFromXYZ, clTransform * linearToXYZ, float x, float y);
+// linearToXYZ is a linear (gamma 1.0, 1 nit) RGBA -> XYZ transform. The ceiling is read back through it once, so its
+// answers match what that transform (and whichever CMM runs it) would produce.
+const clProfileGamutCeiling * clTransformGetGamutCeiling(clContext * C, clTransform * linearToXYZ);
+float clTransformCalcMaxY(clContext * C, clTransform * linearToXYZ, float x, float y); // see clTransformGetGamutCeiling()
 void clTransformDeriveXYZMatrix(struct clContext * C, struct clProfilePrimaries * primaries, gbMat3 * toXYZ);
 
 float clTransformEOTF_PQ(float N);
@@ -7,6 +7,7 @@
 
 #include "colorist/context.h"
 
+#include "colorist/image.h"
 #include "colorist/profile.h"
 #include "colorist/task.h"
 #include "colorist/transform.h"
@@ -67,6 +68,8 @@ clAction clActionFromString(struct clContext * C, const char * str)
         return CL_ACTION_CONVERT;
     if (!strcmp(str, "modify"))
         return CL_ACTION_MODIFY;
+    if (!strcmp(str, "batch"))
+        return CL_ACTION_BATCH;
     return CL_ACTION_ERROR;
 }
 
@@ -89,6 +92,8 @@ const char * clActionToString(struct clContext * C, clAction action)
             return "convert";
         case CL_ACTION_MODIFY:
             return "modify";
+        case CL_ACTION_BATCH:
+            return "batch";
         case CL_ACTION_ERROR:
         default:
             break;
@@ -99,21 +104,38 @@ const char * clActionToString(struct clContext * C, clAction action)
 // ------------------------------------------------------------------------------------------------
 // clFormat
 
-static char const * clFormatDetectHeader(struct clContext * C, const wchar_t * filename)
+const char * clFormatDetectRaw(struct clContext * C, struct clRaw * input)
 {
-    clRaw raw = CL_RAW_EMPTY;
-    if (clRawReadFileHeader(C, &raw, filename, 1024)) {
-        for (clFormatRecord * record = C->formats; record != NULL; record = record->next) {
-            if (record->format.detectFunc(C, &record->format, &raw)) {
-                clRawFree(C, &raw);
+    for (clFormatRecord * record = C->formats; record != NULL; record = record->next) {
+        if (record->format.detectFunc(C, &record->format, input)) {
+            return record->format.name;
+        }
+    }
+
+    // Formats without a usable signature can only be recognized by parsing their header
+    for (clFormatRecord * record = C->formats; record != NULL; record = record->next) {
+        if ((record->format.signatureLengths[0] == 0) && record->format.probeFunc) {
+            clImage * image = record->format.probeFunc(C, record->format.name, NULL, input);
+            if (image) {
+                clImageDestroy(C, image);
                 return record->format.name;
             }
         }
     }
-    clRawFree(C, &raw);
     return NULL;
 }
 
+static char const * clFormatDetectHeader(struct clContext * C, const wchar_t * filename)
+{
+    const char * formatName = NULL;
+    clRaw raw = CL_RAW_EMPTY;
+    if (clRawReadFileHeader(C, &raw, filename, 1024)) {
+        formatName = clFormatDetectRaw(C, &raw);
+    }
+    clRawFree(C, &raw);
+    return formatName;
+}
+
 //const wchar_t * clFormatDetect(struct clContext * C, const wchar_t * filename)
 //{
 //    // If either slash is AFTER the last period in the filename, there is no extension
@@ -350,6 +372,36 @@ const char * clFilterToString(struct clContext * C, clFilter filter)
     return "invalid";
 }
 
+// ------------------------------------------------------------------------------------------------
+// clCurvePrecision
+
+clCurvePrecision clCurvePrecisionFromString(struct clContext * C, const char * str)
+{
+    COLORIST_UNUSED(C);
+
+    if (!strcmp(str, "exact"))
+        return CL_CURVEPRECISION_EXACT;
+    if (!strcmp(str, "fast"))
+        return CL_CURVEPRECISION_FAST;
+    return CL_CURVEPRECISION_INVALID;
+}
+
+const char * clCurvePrecisionToString(struct clContext * C, clCurvePrecision precision)
+{
+    COLORIST_UNUSED(C);
+
+    switch (precision) {
+        case CL_CURVEPRECISION_EXACT:
+            return "exact";
+        case CL_CURVEPRECISION_FAST:
+            return "fast";
+        case CL_CURVEPRECISION_INVALID:
+        default:
+            break;
+    }
+    return "invalid";
+}
+
 // ------------------------------------------------------------------------------------------------
 // clYUVFormat
 
@@ -388,6 +440,43 @@ const char * clYUVFormatToString(struct clContext * C, clYUVFormat format)
     return "invalid";
 }
 
+clGradeSearch clGradeSearchFromString(struct clContext * C, const char * str)
+{
+    COLORIST_UNUSED(C);
+
+    if (!strcmp(str, "golden"))
+        return CL_GRADESEARCH_GOLDEN;
+    if (!strcmp(str, "sweep"))
+        return CL_GRADESEARCH_SWEEP;
+    return CL_GRADESEARCH_INVALID;
+}
+
+const char * clGradeSearchToString(struct clContext * C, clGradeSearch search)
+{
+    COLORIST_UNUSED(C);
+
+    switch (search) {
+        case CL_GRADESEARCH_GOLDEN:
+            return "golden";
+        case CL_GRADESEARCH_SWEEP:
+            return "sweep";
+        case CL_GRADESEARCH_INVALID:
+        default:
+            break;
+    }
+    return "invalid";
+}
+
+void clGradeParamsSetDefaults(struct clContext * C, clGradeParams * params)
+{
+    COLORIST_UNUSED(C);
+
+    params->search = CL_GRADESEARCH_GOLDEN;
+    params->precision = CL_GRADE_DEFAULT_PRECISION;
+    params->maxIterations = CL_GRADE_DEFAULT_ITERATIONS;
+    params->sampleStep = 1;
+}
+
 // ------------------------------------------------------------------------------------------------
 // clContext
 
@@ -399,7 +488,7 @@ static void clConversionParamsSetOutputProfileDefaults(clContext * C, clConversi
     params->copyright = NULL;
     params->description = NULL;
     params->curveType = CL_PCT_GAMMA;
-    params->frameIndex = 0;
+    params->readParams.frameIndex = 0;
     params->gamma = 0;
     params->luminance = CL_LUMINANCE_SOURCE;
     memset(params->primaries, 0, sizeof(float) * 8);
@@ -409,6 +498,7 @@ void clConversionParamsSetDefaults(clContext * C, clConversionParams * params)
 {
     clConversionParamsSetOutputProfileDefaults(C, params);
     params->bpc = 0;
+    clGradeParamsSetDefaults(C, &params->gradeParams);
     params->formatName = NULL;
     params->hald = NULL;
     params->iccOverrideOut = NULL;
@@ -423,13 +513,21 @@ void clConversionParamsSetDefaults(clContext * C, clConversionParams * params)
     params->stripTags = NULL;
     params->stats = clFalse;
     params->tonemap = CL_TONEMAP_AUTO;
-    params->readCodec = NULL;
     clTonemapParamsSetDefaults(C, &params->tonemapParams);
     params->compositeFilename = NULL;
+    clReadParamsSetDefaults(C, &params->readParams);
     clWriteParamsSetDefaults(C, &params->writeParams);
     clBlendParamsSetDefaults(C, &params->compositeParams);
 }
 
+void clReadParamsSetDefaults(struct clContext * C, clReadParams * readParams)
+{
+    COLORIST_UNUSED(C);
+
+    readParams->codec = NULL;
+    readParams->frameIndex = 0;
+}
+
 void clWriteParamsSetDefaults(struct clContext * C, clWriteParams * writeParams)
 {
     COLORIST_UNUSED(C);
@@ -458,10 +556,17 @@ static void clContextSetDefaultArgs(clContext * C)
     C->jobs = clTaskLimit();
     C->verbose = clFalse;
     C->ccmmAllowed = clTrue;
+    C->simdAllowed = clTrue;
+    C->curvePrecision = CL_CURVEPRECISION_EXACT;
+    C->lutSize = CL_TRANSFORM_LUT_DEFAULT_SIZE;
     C->inputFilename = NULL;
     C->outputFilename = NULL;
+    C->batchSource = NULL;
+    C->batchOutputDir = NULL;
+    C->batchMemoryMB = CL_BATCH_DEFAULT_MEMORY_MB;
     C->defaultLuminance = COLORIST_DEFAULT_LUMINANCE;
     C->enforceLuminance = clFalse;
+    C->scRGBLuminance = CL_SCRGB_LUMINANCE;
 }
 
 clContext * clContextCreate(clContextSystem * system)
@@ -495,13 +600,48 @@ clContext * clContextCreate(clContextSystem * system)
     // to fully honor the chad tags in the profiles (if any).
     cmsSetAdaptationStateTHR(C->lcms, 0);
 
+    C->taskPool = NULL;
+    C->transformCache = NULL;
+    C->lock = clMutexCreate(C);
+    C->jobCount = 0;
+    C->parent = NULL;
+
     clContextSetDefaultArgs(C);
     clContextRegisterBuiltinFormats(C);
     return C;
 }
 
+clContext * clContextCreateJob(clContext * parent)
+{
+    clContext * root = parent->parent ? parent->parent : parent;
+    clContext * C = (clContext *)root->system.alloc(NULL, sizeof(clContext));
+    memcpy(C, parent, sizeof(clContext));
+    C->taskPool = NULL;
+    C->transformCache = NULL;
+    C->lock = NULL;
+    C->jobCount = 0;
+    C->parent = root;
+    memset(&C->readExtraInfo, 0, sizeof(C->readExtraInfo));
+
+    clMutexLock(root->lock);
+    ++root->jobCount;
+    clMutexUnlock(root->lock);
+    return C;
+}
+
 void clContextDestroy(clContext * C)
 {
+    if (C->parent) {
+        // Job context, everything else belongs to the parent
+        clContext * root = C->parent;
+        clMutexLock(root->lock);
+        --root->jobCount;
+        clMutexUnlock(root->lock);
+        clFree(C);
+        return;
+    }
+    COLORIST_ASSERT(C->jobCount == 0);
+
     clFormatRecord * record = C->formats;
     while (record != NULL) {
         clFormatRecord * freeme = record;
@@ -509,12 +649,22 @@ void clContextDestroy(clContext * C)
         clFree(freeme);
     }
     C->formats = NULL;
+    if (C->taskPool) {
+        clTaskPoolDestroy(C, C->taskPool);
+        C->taskPool = NULL;
+    }
+    if (C->transformCache) {
+        clTransformCacheDestroy(C, C->transformCache);
+        C->transformCache = NULL;
+    }
+    clMutexDestroy(C, C->lock);
     cmsDeleteContext(C->lcms);
     clFree(C);
 }
 
 void clContextRegisterFormat(clContext * C, clFormat * format)
 {
+    COLORIST_ASSERT(!C->parent && !C->jobCount); // job contexts read C->formats without locking
     clFormatRecord * record = clAllocateStruct(clFormatRecord);
     memcpy(&record->format, format, sizeof(clFormat));
     record->next = NULL;
@@ -747,14 +897,12 @@ static clBool parseResize(clContext * C, clConversionParams * params, const char
 
 static clBool validateArgs(clContext * C);
 
-clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
+// Applies argv[1..argc) to C, collecting positional filenames (and the action, if C doesn't have one yet)
+static clBool parseArgList(clContext * C, int argc, const char * argv[], const char * filenames[2])
 {
-    clContextSetDefaultArgs(C); // Reset to all defaults
-
     int taskLimit = clTaskLimit();
 
     int argIndex = 1;
-    const char * filenames[2] = { NULL, NULL };
     while (argIndex < argc) {
         const char * arg = argv[argIndex];
         if ((arg[0] == '-')) {
@@ -898,6 +1046,41 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                     clContextLogError(C, "Unknown CMM: %s", arg);
                     return clFalse;
                 }
+            } else if (!strcmp(arg, "--simd")) {
+                NEXTARG();
+                if (!strcmp(arg, "auto") || !strcmp(arg, "on")) {
+                    C->simdAllowed = clTrue;
+                } else if (!strcmp(arg, "off")) {
+                    C->simdAllowed = clFalse;
+                } else {
+                    clContextLogError(C, "Unknown SIMD mode: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--precision")) {
+                NEXTARG();
+                C->curvePrecision = clCurvePrecisionFromString(C, arg);
+                if (C->curvePrecision == CL_CURVEPRECISION_INVALID) {
+                    clContextLogError(C, "Unknown curve precision: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--lut")) {
+                NEXTARG();
+                if (!strcmp(arg, "off")) {
+                    C->lutSize = 0;
+                } else {
+                    C->lutSize = atoi(arg);
+                    if ((C->lutSize < CL_TRANSFORM_LUT_MIN_SIZE) || (C->lutSize > CL_TRANSFORM_LUT_MAX_SIZE)) {
+                        clContextLogError(C, "Invalid LUT size: %s", arg);
+                        return clFalse;
+                    }
+                }
+            } else if (!strcmp(arg, "--batch-memory")) {
+                NEXTARG();
+                C->batchMemoryMB = atoi(arg);
+                if (C->batchMemoryMB <= 0) {
+                    clContextLogError(C, "Invalid batch memory budget: %s", arg);
+                    return clFalse;
+                }
             } else if (!strcmp(arg, "--deflum")) {
                 NEXTARG();
                 C->defaultLuminance = atoi(arg);
@@ -915,7 +1098,42 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                 }
             } else if (!strcmp(arg, "--frameindex")) {
                 NEXTARG();
-                C->params.frameIndex = (uint32_t)atoi(arg);
+                C->params.readParams.frameIndex = (uint32_t)atoi(arg);
+            } else if (!strcmp(arg, "--grade-search")) {
+                NEXTARG();
+                C->params.gradeParams.search = clGradeSearchFromString(C, arg);
+                if (C->params.gradeParams.search == CL_GRADESEARCH_INVALID) {
+                    clContextLogError(C, "Unknown grade search: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--grade-precision")) {
+                NEXTARG();
+                C->params.gradeParams.precision = (float)atof(arg);
+                if ((C->params.gradeParams.precision < CL_GRADE_MIN_PRECISION) || (C->params.gradeParams.precision > 1.0f)) {
+                    clContextLogError(C, "Invalid grade precision: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--grade-iterations")) {
+                NEXTARG();
+                C->params.gradeParams.maxIterations = atoi(arg);
+                if (C->params.gradeParams.maxIterations < 2) {
+                    clContextLogError(C, "Invalid grade iterations: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--grade-sample")) {
+                NEXTARG();
+                C->params.gradeParams.sampleStep = atoi(arg);
+                if (C->params.gradeParams.sampleStep < 1) {
+                    clContextLogError(C, "Invalid grade sample step: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--scrgb-nits")) {
+                NEXTARG();
+                C->scRGBLuminance = atoi(arg);
+                if (C->scRGBLuminance <= 0) {
+                    clContextLogError(C, "Invalid scRGB luminance: %s", arg);
+                    return clFalse;
+                }
             } else if (!strcmp(arg, "--hlglum")) {
                 NEXTARG();
                 int hlgLum = atoi(arg);
@@ -994,10 +1212,10 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                 if (comma) {
                     *comma = 0;
                     ++comma;
-                    C->params.readCodec = clContextStrdup(C, tmpBuffer);
+                    C->params.readParams.codec = clContextStrdup(C, tmpBuffer);
                     C->params.writeParams.codec = clContextStrdup(C, comma);
                 } else {
-                    C->params.readCodec = clContextStrdup(C, tmpBuffer);
+                    C->params.readParams.codec = clContextStrdup(C, tmpBuffer);
                     C->params.writeParams.codec = clContextStrdup(C, tmpBuffer);
                 }
             } else if (!strcmp(arg, "-r") || !strcmp(arg, "--rate")) {
@@ -1024,6 +1242,17 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
         }
         ++argIndex;
     }
+    return clTrue;
+}
+
+clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
+{
+    clContextSetDefaultArgs(C); // Reset to all defaults
+
+    const char * filenames[2] = { NULL, NULL };
+    if (!parseArgList(C, argc, argv, filenames)) {
+        return clFalse;
+    }
 
     switch (C->action) {
         case CL_ACTION_IDENTIFY:
@@ -1099,6 +1328,15 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
             }
             break;
 
+        case CL_ACTION_BATCH:
+            C->batchSource = filenames[0];
+            if (!C->batchSource) {
+                clContextLogError(C, "batch requires a manifest filename or a glob.");
+                return clFalse;
+            }
+            C->batchOutputDir = filenames[1];
+            break;
+
         case CL_ACTION_ERROR:
             return clFalse;
 
@@ -1108,6 +1346,24 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
     return validateArgs(C);
 }
 
+clBool clContextParseJobArgs(clContext * C,
+                             clConversionParams * params,
+                             int argc,
+                             const char * argv[],
+                             const char * filenames[2])
+{
+    // Borrow C->params so the job's options land on top of params, then put the context's back
+    clConversionParams contextParams;
+    memcpy(&contextParams, &C->params, sizeof(contextParams));
+    memcpy(&C->params, params, sizeof(C->params));
+
+    clBool result = parseArgList(C, argc, argv, filenames) && validateArgs(C);
+
+    memcpy(params, &C->params, sizeof(C->params));
+    memcpy(&C->params, &contextParams, sizeof(C->params));
+    return result;
+}
+
 static clBool validateArgs(clContext * C)
 {
     if (C->params.autoGrade && (C->params.gamma != 0.0f) && (C->params.luminance != 0)) {
@@ -1138,12 +1394,16 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "        colorist generate  [image string] [output image] [OPTIONS]");
     clContextLog(C, NULL, 0, "        colorist modify    [input.icc]    [output.icc]   [OPTIONS]");
     clContextLog(C, NULL, 0, "        colorist calc      [image string]                [OPTIONS]");
+    clContextLog(C, NULL, 0, "        colorist batch     [manifest or glob] [output dir] [OPTIONS]");
     clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Basic Options:");
     clContextLog(C, NULL, 0, "    -h,--help                : Display this help");
     clContextLog(C, NULL, 0, "    -j,--jobs JOBS           : Number of jobs to use when working. 0 for as many as possible (default)");
     clContextLog(C, NULL, 0, "    -v,--verbose             : Verbose mode.");
     clContextLog(C, NULL, 0, "    --cmm WHICH,--cms WHICH  : Choose Color Management Module/System: auto (default), lcms, colorist (built-in, uses when possible)");
+    clContextLog(C, NULL, 0, "    --simd MODE              : Batched AVX2 color conversion in the built-in CMM: auto (default), off (scalar reference path)");
+    clContextLog(C, NULL, 0, "    --precision PRECISION    : Transfer function approximations used with --simd: exact (default), fast");
+    clContextLog(C, NULL, 0, "    --lut SIZE               : Baked 3D LUT grid size for LittleCMS conversions of large images: 33 (default), 65, off");
     clContextLog(C,
                  NULL,
                  0,
@@ -1155,10 +1415,15 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "Input Options:");
     clContextLog(C, NULL, 0, "    -i,--iccin file.icc      : Override source ICC profile. default is to use embedded profile (if any), or sRGB@deflum");
     clContextLog(C, NULL, 0, "    --frameindex INDEX       : Choose the source frame from an image sequence (AVIF only, defaults to frame 0)");
+    clContextLog(C, NULL, 0, "    --scrgb-nits LUMINANCE   : Max luminance untagged half/float JXRs (scRGB, 1.0 = 80 nits) are rescaled to (default: 80)");
     clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Output Profile Options:");
     clContextLog(C, NULL, 0, "    -o,--iccout file.icc     : Override destination ICC profile. Disables all other output profile options");
     clContextLog(C, NULL, 0, "    -a,--autograde           : Enable automatic color grading of max luminance and gamma (disabled by default)");
+    clContextLog(C, NULL, 0, "    --grade-search SEARCH    : Autograde gamma search: golden (default; sweeps 8-12 bit sources), sweep");
+    clContextLog(C, NULL, 0, "    --grade-precision STEP   : Autograde gamma resolution, 0.001 - 1 (default: 0.01)");
+    clContextLog(C, NULL, 0, "    --grade-iterations N     : Autograde golden search budget after the coarse bracket (default: 20)");
+    clContextLog(C, NULL, 0, "    --grade-sample N         : Autograde from every Nth pixel only, logging an error bound (default: 1)");
     clContextLog(C, NULL, 0, "    -c,--copyright COPYRIGHT : ICC profile copyright string.");
     clContextLog(C, NULL, 0, "    -d,--description DESC    : ICC profile description.");
     clContextLog(C, NULL, 0, "    -g,--gamma GAMMA         : Output gamma (transfer func). 0 for auto (default), \"pq\" for PQ, \"hlg\" for HLG, or \"source\" to force source gamma");
@@ -1195,6 +1460,14 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "    -z,--rect x,y,w,h        : Pixels to dump. x,y,w,h");
     clContextLog(C, NULL, 0, "    --json                   : Output valid JSON description instead of standard log output");
     clContextLog(C, NULL, 0, "");
+    clContextLog(C, NULL, 0, "Batch Options:");
+    clContextLog(C,
+                 NULL,
+                 0,
+                 "    --batch-memory MB        : Budget for decoded images in flight; the next job is decoded early only if it fits (default: %d)",
+                 CL_BATCH_DEFAULT_MEMORY_MB);
+    clContextLog(C, NULL, 0, "    --json                   : Output per-job and total timing as one JSON object instead of log lines");
+    clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Modify Options:");
     clContextLog(C, NULL, 0, "    -s,--striptags TAG,...   : Strips ICC tags from profile");
     clContextLog(C, NULL, 0, "");
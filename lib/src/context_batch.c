@@ -0,0 +1,452 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "colorist/context.h"
+
+#include "colorist/image.h"
+#include "colorist/task.h"
+
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <glob.h>
+#endif
+
+#define CL_BATCH_MAX_LINE 4096
+#define CL_BATCH_MAX_ARGS 128
+
+// Converting an image roughly doubles its footprint (src + dst) until the dst is written
+#define CL_BATCH_CONVERT_FOOTPRINT 2
+
+typedef struct clBatchJob
+{
+    char * line;            // owns the strings params and the filenames below point into
+    const char * inputName; // for logs / JSON
+    char * outputName;
+    wchar_t * input;
+    wchar_t * output;
+    clConversionParams params;
+
+    // Filled by decodeJob(), possibly on the decode thread
+    clImage * srcImage;
+    size_t srcBytes;
+    double decodeSeconds;
+
+    double waitSeconds; // time the convert stage spent waiting on this job's decode
+    double convertSeconds;
+    clBool overlapped; // decoded while the previous job was converting
+    int returnCode;
+} clBatchJob;
+
+typedef struct clBatch
+{
+    clContext * C;
+    clBatchJob * jobs;
+    int count;
+    int capacity;
+} clBatch;
+
+static wchar_t * batchWidePath(clContext * C, const char * path)
+{
+    size_t length = mbstowcs(NULL, path, 0);
+    if (length == (size_t)-1) {
+        return NULL;
+    }
+    wchar_t * widePath = clAllocate(sizeof(wchar_t) * (length + 1));
+    mbstowcs(widePath, path, length + 1);
+    return widePath;
+}
+
+static clBatchJob * batchAddJob(clBatch * batch)
+{
+    clContext * C = batch->C;
+    if (batch->count == batch->capacity) {
+        int newCapacity = batch->capacity ? (batch->capacity * 2) : 16;
+        clBatchJob * jobs = clAllocate(sizeof(clBatchJob) * newCapacity);
+        if (batch->jobs) {
+            memcpy(jobs, batch->jobs, sizeof(clBatchJob) * batch->count);
+            clFree(batch->jobs);
+        }
+        batch->jobs = jobs;
+        batch->capacity = newCapacity;
+    }
+    clBatchJob * job = &batch->jobs[batch->count++];
+    memset(job, 0, sizeof(clBatchJob));
+    memcpy(&job->params, &C->params, sizeof(job->params));
+    return job;
+}
+
+static clBool batchFinishJob(clBatch * batch, clBatchJob * job, const char * inputName, const char * outputName)
+{
+    clContext * C = batch->C;
+    job->inputName = inputName;
+    job->outputName = clContextStrdup(C, outputName);
+    job->input = batchWidePath(C, inputName);
+    job->output = batchWidePath(C, outputName);
+    if (!job->input || !job->output) {
+        clContextLogError(C, "batch: can't convert filename: %s", !job->input ? inputName : outputName);
+        return clFalse;
+    }
+    return clTrue;
+}
+
+// Splits line in place on whitespace, honoring double quotes. argv[0] is left for the caller.
+static int splitArgs(char * line, const char * argv[CL_BATCH_MAX_ARGS])
+{
+    int argc = 1;
+    char * p = line;
+    for (;;) {
+        while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')) {
+            ++p;
+        }
+        if ((*p == 0) || (*p == '#') || (argc == CL_BATCH_MAX_ARGS)) {
+            break;
+        }
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            while (*p && (*p != '"')) {
+                ++p;
+            }
+        } else {
+            argv[argc++] = p;
+            while (*p && (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n')) {
+                ++p;
+            }
+        }
+        if (*p == 0) {
+            break;
+        }
+        *p++ = 0;
+    }
+    return argc;
+}
+
+// Manifest: one job per line, "input output [OPTIONS]". Options land on top of the batch's own;
+// blank lines and lines starting with # are skipped.
+static clBool batchReadManifest(clBatch * batch, const char * manifestFilename)
+{
+    clContext * C = batch->C;
+    FILE * f = fopen(manifestFilename, "rb");
+    if (!f) {
+        clContextLogError(C, "batch: can't open manifest: %s", manifestFilename);
+        return clFalse;
+    }
+
+    clBool result = clTrue;
+    char lineBuffer[CL_BATCH_MAX_LINE];
+    int lineNumber = 0;
+    while (result && fgets(lineBuffer, sizeof(lineBuffer), f)) {
+        ++lineNumber;
+        size_t lineLength = strlen(lineBuffer);
+        if ((lineLength == sizeof(lineBuffer) - 1) && (lineBuffer[lineLength - 1] != '\n') && !feof(f)) {
+            clContextLogError(C, "batch: manifest line %d is longer than %d characters", lineNumber, CL_BATCH_MAX_LINE - 1);
+            result = clFalse;
+            break;
+        }
+        char * line = clContextStrdup(C, lineBuffer);
+        const char * argv[CL_BATCH_MAX_ARGS];
+        argv[0] = "batch";
+        int argc = splitArgs(line, argv);
+        if (argc == 1) {
+            clFree(line);
+            continue;
+        }
+
+        clBatchJob * job = batchAddJob(batch);
+        job->line = line;
+        const char * filenames[2] = { NULL, NULL };
+        if (!clContextParseJobArgs(C, &job->params, argc, argv, filenames)) {
+            clContextLogError(C, "batch: bad options on manifest line %d", lineNumber);
+            result = clFalse;
+        } else if (!filenames[0] || !filenames[1]) {
+            clContextLogError(C, "batch: manifest line %d needs an input and an output filename", lineNumber);
+            result = clFalse;
+        } else {
+            result = batchFinishJob(batch, job, filenames[0], filenames[1]);
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+static clBool batchAddGlobMatch(clBatch * batch, const char * inputName, const char * extension)
+{
+    clContext * C = batch->C;
+    const char * basename = inputName;
+    for (const char * p = inputName; *p; ++p) {
+        if ((*p == '/') || (*p == '\\')) {
+            basename = p + 1;
+        }
+    }
+    const char * dot = strrchr(basename, '.');
+    int stemLength = dot ? (int)(dot - basename) : (int)strlen(basename);
+
+    clBatchJob * job = batchAddJob(batch);
+    job->line = clContextStrdup(C, inputName);
+    size_t outputSize = strlen(C->batchOutputDir) + stemLength + strlen(extension) + 3;
+    char * outputName = clAllocate(outputSize);
+    snprintf(outputName, outputSize, "%s/%.*s.%s", C->batchOutputDir, stemLength, basename, extension);
+    clBool result = batchFinishJob(batch, job, job->line, outputName);
+    clFree(outputName);
+    return result;
+}
+
+// Glob: every match is converted with the batch's options into the output directory
+static clBool batchExpandGlob(clBatch * batch, const char * pattern)
+{
+    clContext * C = batch->C;
+    if (!C->batchOutputDir) {
+        clContextLogError(C, "batch: a glob needs an output directory");
+        return clFalse;
+    }
+    clFormat * format = C->params.formatName ? clContextFindFormat(C, C->params.formatName) : NULL;
+    if (!format || !format->extensions[0]) {
+        clContextLogError(C, "batch: a glob needs an output format (-f)");
+        return clFalse;
+    }
+
+    clBool result = clTrue;
+#ifdef _WIN32
+    // FindFirstFile only reports names, so keep the pattern's directory around
+    const char * lastSlash = NULL;
+    for (const char * p = pattern; *p; ++p) {
+        if ((*p == '/') || (*p == '\\')) {
+            lastSlash = p;
+        }
+    }
+    int dirLength = lastSlash ? (int)(lastSlash - pattern) + 1 : 0;
+
+    WIN32_FIND_DATAA findData;
+    HANDLE findHandle = FindFirstFileA(pattern, &findData);
+    if (findHandle != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                char inputName[MAX_PATH * 2];
+                snprintf(inputName, sizeof(inputName), "%.*s%s", dirLength, pattern, findData.cFileName);
+                result = batchAddGlobMatch(batch, inputName, format->extensions[0]);
+            }
+        } while (result && FindNextFileA(findHandle, &findData));
+        FindClose(findHandle);
+    }
+#else
+    glob_t matches;
+    if (glob(pattern, 0, NULL, &matches) == 0) {
+        for (size_t i = 0; result && (i < matches.gl_pathc); ++i) {
+            result = batchAddGlobMatch(batch, matches.gl_pathv[i], format->extensions[0]);
+        }
+        globfree(&matches);
+    }
+#endif
+    return result;
+}
+
+static size_t imageBytes(clImage * image)
+{
+    size_t pixelCount = (size_t)image->width * (size_t)image->height;
+    size_t bytes = 0;
+    if (image->pixelsU8) {
+        bytes += pixelCount * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U8);
+    }
+    if (image->pixelsU16) {
+        bytes += pixelCount * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16);
+    }
+    if (image->pixelsF32) {
+        bytes += pixelCount * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_F32);
+    }
+    if (image->pixelsF16) {
+        bytes += pixelCount * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_F16);
+    }
+    return bytes;
+}
+
+typedef struct DecodeTaskInfo
+{
+    clContext * C; // a job context of its own, as the convert stage is using the batch's context meanwhile
+    clBatchJob * job;
+} DecodeTaskInfo;
+
+static void decodeJob(clContext * C, clBatchJob * job)
+{
+    Timer t;
+    timerStart(&t);
+    job->srcImage = clContextRead(C, job->input, C->iccOverrideIn, &job->params.readParams, NULL);
+    job->decodeSeconds = timerElapsedSeconds(&t);
+    job->srcBytes = job->srcImage ? imageBytes(job->srcImage) : 0;
+}
+
+static void decodeTaskFunc(void * userData)
+{
+    DecodeTaskInfo * info = (DecodeTaskInfo *)userData;
+    decodeJob(info->C, info->job);
+}
+
+static cJSON * jobToJSON(clBatchJob * job)
+{
+    cJSON * jsonJob = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonJob, "input", job->inputName);
+    cJSON_AddStringToObject(jsonJob, "output", job->outputName);
+    cJSON_AddBoolToObject(jsonJob, "ok", job->returnCode == 0);
+    cJSON_AddBoolToObject(jsonJob, "overlapped", job->overlapped);
+    cJSON_AddNumberToObject(jsonJob, "decodeSeconds", job->decodeSeconds);
+    cJSON_AddNumberToObject(jsonJob, "waitSeconds", job->waitSeconds);
+    cJSON_AddNumberToObject(jsonJob, "convertSeconds", job->convertSeconds);
+    cJSON_AddNumberToObject(jsonJob, "decodedMB", (double)job->srcBytes / (1024.0 * 1024.0));
+    return jsonJob;
+}
+
+static void logJSON(clContext * C, cJSON * json)
+{
+    char * text = cJSON_PrintUnformatted(json);
+    clContextLog(C, "batch", 0, "%s", text);
+    cJSON_free(text);
+}
+
+int clContextBatch(clContext * C, struct cJSON * output)
+{
+    Timer overall;
+    timerStart(&overall);
+
+    clBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.C = C;
+
+    clBool listed;
+    if (strchr(C->batchSource, '*') || strchr(C->batchSource, '?')) {
+        listed = batchExpandGlob(&batch, C->batchSource);
+    } else {
+        listed = batchReadManifest(&batch, C->batchSource);
+    }
+
+    int failedCount = 0;
+    int overlappedCount = 0;
+    double decodeSeconds = 0.0;
+    double waitSeconds = 0.0;
+    double convertSeconds = 0.0;
+    size_t peakInflightBytes = 0;
+    cJSON * jsonJobs = cJSON_CreateArray();
+    if (listed) {
+        clContextLog(C, "action", 0, "Batch: %d jobs [%d max threads, %d MB in flight]", batch.count, C->jobs, C->batchMemoryMB);
+
+        // Decodes run ahead on their own thread, so they overlap the previous job's convert/encode
+        // (which gets the shared pool). Make the shared pool now, before two threads could race to.
+        clContextGetTaskPool(C);
+        struct clTaskPool * decodePool = clTaskPoolCreate(C, 1);
+        size_t budgetBytes = (size_t)C->batchMemoryMB * 1024 * 1024;
+
+        clTask * decodeTask = NULL;
+        DecodeTaskInfo decodeInfo;
+        for (int jobIndex = 0; jobIndex < batch.count; ++jobIndex) {
+            clBatchJob * job = &batch.jobs[jobIndex];
+
+            Timer t;
+            timerStart(&t);
+            if (decodeTask) {
+                clTaskDestroy(C, decodeTask);
+                decodeTask = NULL;
+                clContextDestroy(decodeInfo.C);
+                decodeInfo.C = NULL;
+                job->waitSeconds = timerElapsedSeconds(&t);
+                job->overlapped = clTrue;
+                ++overlappedCount;
+            } else {
+                decodeJob(C, job);
+                job->waitSeconds = job->decodeSeconds;
+            }
+
+            // Start the next decode if it fits next to this job's convert. Jobs in a batch tend to be
+            // similar, so this job's decoded size stands in for the next one's.
+            size_t inflightBytes = job->srcBytes * CL_BATCH_CONVERT_FOOTPRINT;
+            if ((jobIndex + 1 < batch.count) && (inflightBytes + job->srcBytes <= budgetBytes)) {
+                decodeInfo.C = clContextCreateJob(C);
+                decodeInfo.job = &batch.jobs[jobIndex + 1];
+                decodeTask = clTaskCreateInPool(C, decodePool, decodeTaskFunc, &decodeInfo);
+                inflightBytes += job->srcBytes;
+            }
+            if (peakInflightBytes < inflightBytes) {
+                peakInflightBytes = inflightBytes;
+            }
+
+            if (job->srcImage) {
+                clContextLog(C, "batch", 0, "[%d/%d] %s -> %s", jobIndex + 1, batch.count, job->inputName, job->outputName);
+                timerStart(&t);
+                job->returnCode = clContextConvertImage(C, job->srcImage, &job->params, job->output);
+                job->srcImage = NULL; // clContextConvertImage() took it
+                job->convertSeconds = timerElapsedSeconds(&t);
+            } else {
+                clContextLogError(C, "batch: can't read %s", job->inputName);
+                job->returnCode = 1;
+            }
+
+            if (job->returnCode != 0) {
+                ++failedCount;
+            }
+            decodeSeconds += job->decodeSeconds;
+            waitSeconds += job->waitSeconds;
+            convertSeconds += job->convertSeconds;
+
+            cJSON * jsonJob = jobToJSON(job);
+            if (!output) {
+                logJSON(C, jsonJob);
+            }
+            cJSON_AddItemToArray(jsonJobs, jsonJob);
+        }
+        clTaskPoolDestroy(C, decodePool);
+    } else {
+        failedCount = CL_MAX(batch.count, 1);
+    }
+
+    double wallSeconds = timerElapsedSeconds(&overall);
+    cJSON * jsonSummary = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jsonSummary, "jobs", batch.count);
+    cJSON_AddNumberToObject(jsonSummary, "failed", failedCount);
+    cJSON_AddNumberToObject(jsonSummary, "overlapped", overlappedCount);
+    cJSON_AddNumberToObject(jsonSummary, "wallSeconds", wallSeconds);
+    cJSON_AddNumberToObject(jsonSummary, "decodeSeconds", decodeSeconds);
+    cJSON_AddNumberToObject(jsonSummary, "waitSeconds", waitSeconds);
+    cJSON_AddNumberToObject(jsonSummary, "convertSeconds", convertSeconds);
+    cJSON_AddNumberToObject(jsonSummary, "jobsPerSecond", (wallSeconds > 0.0) ? (batch.count / wallSeconds) : 0.0);
+    cJSON_AddNumberToObject(jsonSummary, "memoryBudgetMB", C->batchMemoryMB);
+    cJSON_AddNumberToObject(jsonSummary, "peakInflightMB", (double)peakInflightBytes / (1024.0 * 1024.0));
+    if (output) {
+        cJSON_AddItemToObject(output, "jobs", jsonJobs);
+        cJSON_AddItemToObject(output, "summary", jsonSummary);
+    } else {
+        logJSON(C, jsonSummary);
+        cJSON_Delete(jsonJobs);
+        cJSON_Delete(jsonSummary);
+        clContextLog(C, "timing", -1, OVERALL_TIMING_FORMAT, wallSeconds);
+    }
+
+    for (int jobIndex = 0; jobIndex < batch.count; ++jobIndex) {
+        clBatchJob * job = &batch.jobs[jobIndex];
+        if (job->srcImage) {
+            clImageDestroy(C, job->srcImage);
+        }
+        if (job->input) {
+            clFree(job->input);
+        }
+        if (job->output) {
+            clFree(job->output);
+        }
+        if (job->outputName) {
+            clFree(job->outputName);
+        }
+        if (job->line) {
+            clFree(job->line);
+        }
+    }
+    if (batch.jobs) {
+        clFree(batch.jobs);
+    }
+    return (failedCount > 0) ? 1 : 0;
+}
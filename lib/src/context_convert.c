@@ -10,6 +10,7 @@
 #include "colorist/image.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/raw.h"
 #include "colorist/task.h"
 
 #include <string.h>
@@ -31,32 +32,17 @@ struct ImageInfo
     int luminance;
 };
 
+static int convertImage(clContext * C, clImage * srcImage, const clConversionParams * convertParams, clRaw * output);
+
 int clContextConvert(clContext * C)
 {
     Timer overall, t;
-    int returnCode = 0;
-
-    // Goals
-    clImage * srcImage = NULL;
-    clImage * dstImage = NULL;
-    clProfile * dstProfile = NULL;
-
-    // Information about the src&dst images, used to make all decisions
-    struct ImageInfo srcInfo;
-    struct ImageInfo dstInfo;
 
-    // Hald CLUT
-    clImage * haldImage = NULL;
-    int haldDims = 0;
-
-    clConversionParams params;
-    memcpy(&params, &C->params, sizeof(params));
-
-//    if (!params.formatName)
-//        params.formatName = clFormatDetect(C, C->outputFilename);
-    if (!params.formatName) {
+//    if (!C->params.formatName)
+//        C->params.formatName = clFormatDetect(C, C->outputFilename);
+    if (!C->params.formatName) {
         clContextLogError(C, "Unknown output file format.");
-        FAIL();
+        return 1;
     }
 
     clContextLog(C, "action", 0, "Convert [%d max threads]", C->jobs);
@@ -64,22 +50,99 @@ int clContextConvert(clContext * C)
 
     clContextLog(C, "decode", 0, "Reading: <input> (%d bytes)", clFileSize(C->inputFilename));
     timerStart(&t);
-    srcImage = clContextRead(C, C->inputFilename, C->iccOverrideIn, NULL);
+    clImage * srcImage = clContextRead(C, C->inputFilename, C->iccOverrideIn, &C->params.readParams, NULL);
     if (srcImage == NULL) {
         return 1;
     }
     clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
-    if (!strcmp(params.formatName, "icc")) {
+    if (!strcmp(C->params.formatName, "icc")) {
         // Just dump out the profile to disk and bail out
-
+        int returnCode = 0;
         clContextLog(C, "encode", 0, "Writing ICC: %s", C->outputFilename);
         clProfileDebugDump(C, srcImage->profile, C->verbose, 0);
-
         if (!clProfileWrite(C, srcImage->profile, C->outputFilename)) {
-            FAIL();
+            returnCode = 1;
         }
-        goto convertCleanup;
+        clImageDestroy(C, srcImage);
+        return returnCode;
+    }
+
+    int returnCode = clContextConvertImage(C, srcImage, &C->params, C->outputFilename);
+    if (returnCode == 0) {
+        clContextLog(C, "action", 0, "Conversion complete.");
+        clContextLog(C, "timing", -1, OVERALL_TIMING_FORMAT, timerElapsedSeconds(&overall));
+    }
+    return returnCode;
+}
+
+int clContextConvertImage(clContext * C,
+                          clImage * srcImage,
+                          const clConversionParams * params,
+                          const wchar_t * outputFilename)
+{
+    clRaw output = CL_RAW_EMPTY;
+    int returnCode = convertImage(C, srcImage, params, &output);
+    if ((returnCode == 0) && !clRawWriteFile(C, &output, outputFilename)) {
+        returnCode = 1;
+    }
+    clRawFree(C, &output);
+    return returnCode;
+}
+
+int clContextConvertMemory(clContext * C, struct clRaw * input, const clConversionParams * params, struct clRaw * output)
+{
+    if (!params->formatName) {
+        clContextLogError(C, "Unknown output file format.");
+        return 1;
+    }
+
+    clImage * srcImage = clContextReadMemory(C, input, NULL, NULL, &params->readParams);
+    if (!srcImage) {
+        return 1;
+    }
+
+    int returnCode = 0;
+    if (!strcmp(params->formatName, "icc")) {
+        // Just the source's profile
+        if (!clProfilePack(C, srcImage->profile, output)) {
+            returnCode = 1;
+        }
+        clImageDestroy(C, srcImage);
+    } else {
+        returnCode = convertImage(C, srcImage, params, output);
+    }
+    if (returnCode != 0) {
+        clRawFree(C, output);
+    }
+    return returnCode;
+}
+
+// Everything in convert after the decode: grade, build the dst profile, convert, postprocess and encode.
+// All decisions come from convertParams (never C->params), and srcImage is always consumed.
+static int convertImage(clContext * C, clImage * srcImage, const clConversionParams * convertParams, clRaw * output)
+{
+    Timer t;
+    int returnCode = 0;
+
+    // Goals
+    clImage * dstImage = NULL;
+    clProfile * dstProfile = NULL;
+
+    // Information about the src&dst images, used to make all decisions
+    struct ImageInfo srcInfo;
+    struct ImageInfo dstInfo;
+
+    // Hald CLUT
+    clImage * haldImage = NULL;
+    int haldDims = 0;
+
+    clConversionParams params;
+    memcpy(&params, convertParams, sizeof(params));
+
+    if (!params.formatName) {
+        clContextLogError(C, "Unknown output file format.");
+        FAIL();
     }
 
     // Load HALD, if any
@@ -114,7 +177,7 @@ int clContextConvert(clContext * C)
 //    }
 
     int crop[4];
-    memcpy(crop, C->params.rect, 4 * sizeof(int));
+    memcpy(crop, params.rect, 4 * sizeof(int));
     if (clImageAdjustRect(C, srcImage, &crop[0], &crop[1], &crop[2], &crop[3])) {
         timerStart(&t);
         clContextLog(C,
@@ -266,7 +329,7 @@ int clContextConvert(clContext * C)
         clContextLog(C, "grading", 0, "Color grading ...");
         timerStart(&t);
         dstInfo.curve.type = CL_PCT_GAMMA;
-        clImageColorGrade(C, srcImage, dstInfo.depth, &dstInfo.luminance, &dstInfo.curve.gamma, C->verbose);
+        clImageColorGrade(C, srcImage, dstInfo.depth, &params.gradeParams, &dstInfo.luminance, &dstInfo.curve.gamma, C->verbose);
         clContextLog(C, "grading", 0, "Using maxLum: %d, gamma: %g", dstInfo.luminance, dstInfo.curve.gamma);
         clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
     }
@@ -404,18 +467,18 @@ int clContextConvert(clContext * C)
     }
 
     timerStart(&t);
-    clContextLogWrite(C, C->outputFilename, params.formatName, &params.writeParams);
-    if (!clContextWrite(C, dstImage, C->outputFilename, params.formatName, &params.writeParams)) {
+    clContextLogWrite(C, NULL, params.formatName, &params.writeParams);
+    if (!clContextWriteMemory(C, dstImage, params.formatName, &params.writeParams, output)) {
         FAIL();
     }
-    clContextLog(C, "encode", 1, "Wrote %d bytes.", clFileSize(C->outputFilename));
+    clContextLog(C, "encode", 1, "Encoded %d bytes.", (int)output->size);
     clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
     if (params.stats) {
         clContextLog(C, "stats", 0, "Calculating conversion stats...");
         timerStart(&t);
 
-        clImage * convertedImage = clContextRead(C, C->outputFilename, NULL, NULL);
+        clImage * convertedImage = clContextReadMemory(C, output, params.formatName, NULL, &params.readParams);
         if (convertedImage) {
             clImageSignals signals;
             if (clImageCalcSignals(C, srcImage, convertedImage, &signals)) {
@@ -441,10 +504,5 @@ convertCleanup:
         clImageDestroy(C, dstImage);
     if (haldImage)
         clImageDestroy(C, haldImage);
-
-    if (returnCode == 0) {
-        clContextLog(C, "action", 0, "Conversion complete.");
-        clContextLog(C, "timing", -1, OVERALL_TIMING_FORMAT, timerElapsedSeconds(&overall));
-    }
     return returnCode;
 }
@@ -12,36 +12,75 @@
 #include <string.h>
 
 clBool clFormatDetectAVIF(struct clContext * C, struct clFormat * format, struct clRaw * input);
-struct clImage * clFormatReadAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadAVIF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteAVIF(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
                          struct clRaw * output,
                          struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadBMP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadBMP(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
 clBool clFormatWriteBMP(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadJPG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadJP2(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJP2(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadJXR(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadPNG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbePNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadTIFF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteTIFF(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
                          struct clRaw * output,
                          struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadWebP(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteWebP(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
@@ -86,6 +125,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clTrue;
         format.detectFunc = clFormatDetectAVIF;
         format.readFunc = clFormatReadAVIF;
+        format.probeFunc = clFormatProbeAVIF;
         format.writeFunc = clFormatWriteAVIF;
         clContextRegisterFormat(C, &format);
     }
@@ -131,6 +171,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadJPG;
+        format.probeFunc = clFormatProbeJPG;
         format.writeFunc = clFormatWriteJPG;
         clContextRegisterFormat(C, &format);
     }
@@ -153,6 +194,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadJP2;
+        format.probeFunc = clFormatProbeJP2;
         format.writeFunc = clFormatWriteJP2;
         clContextRegisterFormat(C, &format);
     }
@@ -175,6 +217,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadJP2;
+        format.probeFunc = clFormatProbeJP2;
         format.writeFunc = clFormatWriteJP2;
         clContextRegisterFormat(C, &format);
     }
@@ -197,6 +240,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadJXR;
+        format.probeFunc = clFormatProbeJXR;
         format.writeFunc = clFormatWriteJXR;
         clContextRegisterFormat(C, &format);
     }
@@ -219,6 +263,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadPNG;
+        format.probeFunc = clFormatProbePNG;
         format.writeFunc = clFormatWritePNG;
         clContextRegisterFormat(C, &format);
     }
@@ -245,6 +290,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadTIFF;
+        format.probeFunc = clFormatProbeTIFF;
         format.writeFunc = clFormatWriteTIFF;
         clContextRegisterFormat(C, &format);
     }
@@ -267,6 +313,7 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.usesYUVFormat = clFalse;
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadWebP;
+        format.probeFunc = clFormatProbeWebP;
         format.writeFunc = clFormatWriteWebP;
         clContextRegisterFormat(C, &format);
     }
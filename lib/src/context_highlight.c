@@ -32,7 +32,7 @@ int clContextHighlight(clContext * C)
 
     clContextLog(C, "action", 0, "Highlight: %s", C->inputFilename);
     clContextLog(C, "decode", 0, "Reading: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
-    clImage * image = clContextRead(C, C->inputFilename, C->iccOverrideIn, &formatName);
+    clImage * image = clContextRead(C, C->inputFilename, C->iccOverrideIn, &C->params.readParams, &formatName);
     int ret = 1;
     if (image) {
         clImageDebugDump(C, image, 0, 0, 0, 0, 1);
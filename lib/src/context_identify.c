@@ -37,11 +37,19 @@ int clContextIdentify(clContext * C, struct cJSON * output)
             clProfileDestroy(C, profile);
         }
     } else {
-        clContextLog(C, "decode", 0, "Reading: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
-        clImage * image = clContextRead(C, C->inputFilename, C->iccOverrideIn, &formatName);
+        int rect[4];
+        memcpy(rect, C->params.rect, sizeof(rect));
+
+        // Without a pixel rect to dump, the header has everything identify reports
+        clImage * image;
+        if ((rect[0] < 0) || (rect[1] < 0) || (rect[2] <= 0) || (rect[3] <= 0)) {
+            clContextLog(C, "decode", 0, "Probing: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
+            image = clContextProbe(C, C->inputFilename, C->iccOverrideIn, &C->params.readParams, &formatName);
+        } else {
+            clContextLog(C, "decode", 0, "Reading: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
+            image = clContextRead(C, C->inputFilename, C->iccOverrideIn, &C->params.readParams, &formatName);
+        }
         if (image) {
-            int rect[4];
-            memcpy(rect, C->params.rect, sizeof(rect));
             // if ((rect[2] < 0) && (rect[3] < 0)) {
             //     // Defaults for identify
             //     rect[2] = 3;
@@ -13,10 +13,20 @@
 #include <stdio.h>
 #include <string.h>
 
-struct clImage * clContextRead(clContext * C, const wchar_t * filename, const char * iccOverride, const char ** outFormatName)
+static struct clImage * readMemory(clContext * C,
+                                   struct clRaw * input,
+                                   const char * formatName,
+                                   const char * iccOverride,
+                                   const clReadParams * readParams,
+                                   clBool probe);
+
+static struct clImage * readFile(clContext * C,
+                                 const wchar_t * filename,
+                                 const char * iccOverride,
+                                 const clReadParams * readParams,
+                                 const char ** outFormatName,
+                                 clBool probe)
 {
-    clImage * image = NULL;
-    clFormat * format;
 //    const char * formatName = clFormatDetect(C, filename);
     const char * formatName = "jxr";
     if (outFormatName)
@@ -29,6 +39,47 @@ struct clImage * clContextRead(clContext * C, const wchar_t * filename, const ch
         return NULL;
     }
 
+    // Large files are mapped rather than read, so a probe only pages in the header
+    clRaw input = CL_RAW_EMPTY;
+    if (!clRawReadFile(C, &input, filename)) {
+        return NULL;
+    }
+    clImage * image = readMemory(C, &input, formatName, iccOverride, readParams, probe);
+    clRawFree(C, &input);
+    return image;
+}
+
+struct clImage * clContextRead(clContext * C,
+                               const wchar_t * filename,
+                               const char * iccOverride,
+                               const clReadParams * readParams,
+                               const char ** outFormatName)
+{
+    return readFile(C, filename, iccOverride, readParams, outFormatName, clFalse);
+}
+
+static struct clImage * readMemory(clContext * C,
+                                   struct clRaw * input,
+                                   const char * formatName,
+                                   const char * iccOverride,
+                                   const clReadParams * readParams,
+                                   clBool probe)
+{
+    clImage * image = NULL;
+    clFormat * format;
+    clReadParams defaultReadParams;
+    if (!readParams) {
+        clReadParamsSetDefaults(C, &defaultReadParams);
+        readParams = &defaultReadParams;
+    }
+    if (!formatName) {
+        formatName = clFormatDetectRaw(C, input);
+        if (!formatName) {
+            clContextLogError(C, "Unable to guess input format");
+            return NULL;
+        }
+    }
+
     clProfile * overrideProfile = NULL;
     if (iccOverride) {
         overrideProfile = clProfileRead(C, iccOverride);
@@ -40,20 +91,23 @@ struct clImage * clContextRead(clContext * C, const wchar_t * filename, const ch
         }
     }
 
-    clRaw input = CL_RAW_EMPTY;
-    if (!clRawReadFile(C, &input, filename)) {
-        return clFalse;
-    }
-
     // Clear this out, only some of the format readers actually populate anything in here
     memset(&C->readExtraInfo, 0, sizeof(C->readExtraInfo));
 
     format = clContextFindFormat(C, formatName);
-    COLORIST_ASSERT(format);
-    if (format->readFunc) {
-        image = format->readFunc(C, formatName, overrideProfile, &input);
+    if (!format) {
+        clContextLogError(C, "Unknown format: %s", formatName);
     } else {
-        clContextLogError(C, "Unimplemented file reader '%s'", formatName);
+        if (probe && format->probeFunc) {
+            image = format->probeFunc(C, formatName, overrideProfile, input);
+        }
+        if (image) {
+            // The header was enough
+        } else if (format->readFunc) {
+            image = format->readFunc(C, formatName, overrideProfile, input, readParams);
+        } else {
+            clContextLogError(C, "Unimplemented file reader '%s'", formatName);
+        }
     }
 
     if (overrideProfile) {
@@ -66,6 +120,7 @@ struct clImage * clContextRead(clContext * C, const wchar_t * filename, const ch
                 clProfileDestroy(C, image->profile);
                 image->profile = overrideProfile; // take ownership
                 overrideProfile = NULL;
+                clImageInvalidateStats(C, image);
             }
         }
 
@@ -76,19 +131,46 @@ struct clImage * clContextRead(clContext * C, const wchar_t * filename, const ch
         }
     }
 
-    if (C->enforceLuminance) {
+    if (image && C->enforceLuminance) {
         if (!image->profile) {
             clContextLogError(C, "No profile for input, cannot enforce luminance");
         } else {
             clProfileSetLuminance(C, image->profile, C->defaultLuminance);
+            clImageInvalidateStats(C, image);
             clContextLog(C, "profile", 1, "Overriding profile luminance as: %d nits", C->defaultLuminance);
         }
     }
 
-    clRawFree(C, &input);
     return image;
 }
 
+struct clImage * clContextReadMemory(clContext * C,
+                                     struct clRaw * input,
+                                     const char * formatName,
+                                     const char * iccOverride,
+                                     const clReadParams * readParams)
+{
+    return readMemory(C, input, formatName, iccOverride, readParams, clFalse);
+}
+
+struct clImage * clContextProbe(clContext * C,
+                                const wchar_t * filename,
+                                const char * iccOverride,
+                                const clReadParams * readParams,
+                                const char ** outFormatName)
+{
+    return readFile(C, filename, iccOverride, readParams, outFormatName, clTrue);
+}
+
+struct clImage * clContextProbeMemory(clContext * C,
+                                      struct clRaw * input,
+                                      const char * formatName,
+                                      const char * iccOverride,
+                                      const clReadParams * readParams)
+{
+    return readMemory(C, input, formatName, iccOverride, readParams, clTrue);
+}
+
 clBool clContextWrite(clContext * C, struct clImage * image, const wchar_t * filename, const char * formatName, clWriteParams * writeParams)
 {
     clBool result = clFalse;
@@ -101,17 +183,25 @@ clBool clContextWrite(clContext * C, struct clImage * image, const wchar_t * fil
 //        }
 //    }
 
+    clRaw output = CL_RAW_EMPTY;
+    if (clContextWriteMemory(C, image, formatName, writeParams, &output)) {
+        if (clRawWriteFile(C, &output, filename)) {
+            result = clTrue;
+        }
+    }
+    clRawFree(C, &output);
+    return result;
+}
+
+clBool clContextWriteMemory(clContext * C, struct clImage * image, const char * formatName, clWriteParams * writeParams, struct clRaw * output)
+{
+    clBool result = clFalse;
+
     clFormat * format = clContextFindFormat(C, formatName);
     COLORIST_ASSERT(format);
 
     if (format->writeFunc) {
-        clRaw output = CL_RAW_EMPTY;
-        if (format->writeFunc(C, image, formatName, &output, writeParams)) {
-            if (clRawWriteFile(C, &output, filename)) {
-                result = clTrue;
-            }
-        }
-        clRawFree(C, &output);
+        result = format->writeFunc(C, image, formatName, output, writeParams);
     } else {
         clContextLogError(C, "Unimplemented file writer '%s'", formatName);
     }
@@ -20,7 +20,12 @@ static clBool clProfileToNclx(struct clContext * C, struct clProfile * profile,
 static void logAvifImage(struct clContext * C, avifImage * avif, avifIOStats * ioStats);
 
 clBool clFormatDetectAVIF(struct clContext * C, struct clFormat * format, struct clRaw * input);
-struct clImage * clFormatReadAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadAVIF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteAVIF(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
@@ -41,7 +46,11 @@ clBool clFormatDetectAVIF(struct clContext * C, struct clFormat * format, struct
     return clFalse;
 }
 
-struct clImage * clFormatReadAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+struct clImage * clFormatReadAVIF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams)
 {
     COLORIST_UNUSED(formatName);
     COLORIST_UNUSED(input);
@@ -58,8 +67,8 @@ struct clImage * clFormatReadAVIF(struct clContext * C, const char * formatName,
     timerStart(&t);
 
     avifDecoder * decoder = avifDecoderCreate();
-    if (C->params.readCodec) {
-        decoder->codecChoice = avifCodecChoiceFromName(C->params.readCodec);
+    if (readParams->codec) {
+        decoder->codecChoice = avifCodecChoiceFromName(readParams->codec);
     }
     const char * codecName = avifCodecName(decoder->codecChoice, AVIF_CODEC_FLAG_CAN_DECODE);
     if (codecName == NULL) {
@@ -81,7 +90,7 @@ struct clImage * clFormatReadAVIF(struct clContext * C, const char * formatName,
 
     uint32_t frameIndex = 0;
     if (decoder->imageCount > 1) {
-        frameIndex = C->params.frameIndex;
+        frameIndex = readParams->frameIndex;
         clContextLog(C, "avif", 1, "AVIF contains %d frames, decoding frame %d.", decoder->imageCount, frameIndex);
         uint32_t nearestKeyframe = avifDecoderNearestKeyframe(decoder, frameIndex);
         if (nearestKeyframe != frameIndex) {
@@ -189,6 +198,49 @@ readCleanup:
     return image;
 }
 
+struct clImage * clFormatProbeAVIF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    clImage * image = NULL;
+    clProfile * profile = NULL;
+
+    // avifDecoderParse() only reads the container (ispe, pixi, colr, ...), no AV1 payload is decoded
+    avifDecoder * decoder = avifDecoderCreate();
+    avifDecoderSetIOMemory(decoder, input->ptr, input->size);
+    if (avifDecoderParse(decoder) != AVIF_RESULT_OK) {
+        goto probeCleanup;
+    }
+
+    avifImage * avif = decoder->image;
+    if (overrideProfile) {
+        profile = clProfileClone(C, overrideProfile);
+    } else if (avif->icc.data && avif->icc.size) {
+        profile = clProfileParse(C, avif->icc.data, avif->icc.size, NULL);
+        if (!profile) {
+            goto probeCleanup;
+        }
+    } else {
+        profile = nclxToclProfile(C, avif);
+    }
+
+    image = clImageCreate(C, avif->width, avif->height, avif->depth, profile);
+
+probeCleanup:
+    avifDecoderDestroy(decoder);
+    if (profile) {
+        clProfileDestroy(C, profile);
+    }
+    return image;
+}
+
+// The encoder's output buffer is handed to the output clRaw as is
+static void freeAVIFOutput(void * owner, uint8_t * ptr)
+{
+    COLORIST_UNUSED(owner);
+    avifFree(ptr);
+}
+
 clBool clFormatWriteAVIF(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(formatName);
@@ -254,8 +306,16 @@ clBool clFormatWriteAVIF(struct clContext * C, struct clImage * image, const cha
             clContextLog(C, "avif", 1, "Writing colr box (icc): %u bytes", (uint32_t)rawProfile.size);
             avifImageSetProfileICC(avif, rawProfile.ptr, rawProfile.size);
         }
-        avif->clli.maxCLL = (uint16_t)roundf(clImagePeakLuminance(C, image));
-        clContextLog(C, "avif", 1, "Writing clli box : maxCLL: %u", (uint32_t)avif->clli.maxCLL);
+        float maxCLL, maxFALL;
+        clImageContentLightLevels(C, image, &maxCLL, &maxFALL);
+        avif->clli.maxCLL = (uint16_t)roundf(CL_MIN(maxCLL, 65535.0f));
+        avif->clli.maxPALL = (uint16_t)roundf(CL_MIN(maxFALL, 65535.0f));
+        clContextLog(C,
+                     "avif",
+                     1,
+                     "Writing clli box : maxCLL: %u / maxPALL: %u",
+                     (uint32_t)avif->clli.maxCLL,
+                     (uint32_t)avif->clli.maxPALL);
     }
 
     avifRGBImage rgb;
@@ -337,7 +397,9 @@ clBool clFormatWriteAVIF(struct clContext * C, struct clImage * image, const cha
         goto writeCleanup;
     }
 
-    clRawSet(C, output, avifOutput.data, avifOutput.size);
+    clRawBorrow(C, output, avifOutput.data, avifOutput.size, freeAVIFOutput, NULL);
+    avifOutput.data = NULL;
+    avifOutput.size = 0;
 
     logAvifImage(C, avif, &encoder->ioStats);
 
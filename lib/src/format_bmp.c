@@ -80,7 +80,11 @@ typedef struct BITMAPV5HEADER
     memcpy(p, PTR, SIZE); \
     p += (SIZE);
 
-struct clImage * clFormatReadBMP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadBMP(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
 clBool clFormatWriteBMP(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
 // ---------------------------------------------------------------------------
@@ -109,9 +113,14 @@ static int maskDepth(uint32_t mask, int currentDepth, int * channelDepth, int *
     return (depth > currentDepth) ? depth : currentDepth;
 }
 
-struct clImage * clFormatReadBMP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+struct clImage * clFormatReadBMP(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams)
 {
     COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
 
     clImage * image = NULL;
     clProfile * profile = NULL;
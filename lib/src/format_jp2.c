@@ -20,7 +20,12 @@ extern void color_sycc_to_rgb(opj_image_t * img);
 extern void color_cmyk_to_rgb(opj_image_t * image);
 extern void color_esycc_to_rgb(opj_image_t * image);
 
-struct clImage * clFormatReadJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadJP2(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJP2(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
 static void error_callback(const char * msg, void * client_data)
@@ -85,9 +90,14 @@ static OPJ_BOOL seekCallback(OPJ_OFF_T p_nb_bytes, void * p_user_data)
     return OPJ_TRUE;
 }
 
-struct clImage * clFormatReadJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+struct clImage * clFormatReadJP2(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams)
 {
     COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
 
     clImage * image = NULL;
     clProfile * profile = NULL;
@@ -245,6 +255,117 @@ struct clImage * clFormatReadJP2(struct clContext * C, const char * formatName,
     return image;
 }
 
+// ------------------------------------------------------------------------------------------------
+// Header probing
+//
+// openjpeg only hands over the ICC profile once opj_decode() has run, so the probe walks the
+// boxes and the codestream's SIZ marker itself.
+
+static uint32_t readU32BE(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint16_t readU16BE(const uint8_t * p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Finds the first box of the given type in [data, data+size), returning its payload
+static clBool findBox(const uint8_t * data, size_t size, const char * type, const uint8_t ** outPayload, size_t * outPayloadSize)
+{
+    size_t offset = 0;
+    while ((size - offset) >= 8) {
+        uint64_t boxSize = readU32BE(data + offset);
+        size_t headerSize = 8;
+        if (boxSize == 1) {
+            // Extended size
+            if ((size - offset) < 16) {
+                return clFalse;
+            }
+            boxSize = ((uint64_t)readU32BE(data + offset + 8) << 32) | readU32BE(data + offset + 12);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            // Box extends to the end of the file
+            boxSize = size - offset;
+        }
+        if ((boxSize < headerSize) || (boxSize > (size - offset))) {
+            return clFalse;
+        }
+        if (!memcmp(data + offset + 4, type, 4)) {
+            *outPayload = data + offset + headerSize;
+            *outPayloadSize = (size_t)boxSize - headerSize;
+            return clTrue;
+        }
+        offset += (size_t)boxSize;
+    }
+    return clFalse;
+}
+
+struct clImage * clFormatProbeJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    static const unsigned char j2kHeader[4] = { 0xff, 0x4f, 0xff, 0x51 };
+    const uint8_t * codestream = input->ptr;
+    size_t codestreamSize = input->size;
+    const uint8_t * icc = NULL;
+    size_t iccSize = 0;
+
+    if ((input->size < 4) || memcmp(input->ptr, j2kHeader, 4)) {
+        // JP2: the jp2h superbox carries the colr box, and jp2c holds the codestream
+        const uint8_t * jp2h;
+        size_t jp2hSize;
+        if (!findBox(input->ptr, input->size, "jp2h", &jp2h, &jp2hSize)) {
+            return NULL;
+        }
+        const uint8_t * colr;
+        size_t colrSize;
+        if (findBox(jp2h, jp2hSize, "colr", &colr, &colrSize) && (colrSize > 3) && (colr[0] == 2)) {
+            // METH 2: restricted ICC profile after METH, PREC and APPROX
+            icc = colr + 3;
+            iccSize = colrSize - 3;
+        }
+        if (!findBox(input->ptr, input->size, "jp2c", &codestream, &codestreamSize)) {
+            return NULL;
+        }
+    }
+
+    // SOC, SIZ, Lsiz, Rsiz, Xsiz, Ysiz, XOsiz, YOsiz, XTsiz, YTsiz, XTOsiz, YTOsiz, Csiz
+    if ((codestreamSize < 42) || memcmp(codestream, j2kHeader, 4)) {
+        return NULL;
+    }
+    int width = (int)readU32BE(codestream + 8);
+    int height = (int)readU32BE(codestream + 12);
+    int componentCount = readU16BE(codestream + 40);
+    if ((width <= 0) || (height <= 0) || ((componentCount != 3) && (componentCount != 4)) ||
+        (codestreamSize < (size_t)(42 + (3 * componentCount)))) {
+        // Let the real decoder sort out (or complain about) anything unusual
+        return NULL;
+    }
+
+    // Matches clFormatReadJP2()'s choice: the biggest component, clamped to what Colorist supports
+    int depth = 8;
+    for (int i = 0; i < componentCount; ++i) {
+        int precision = (codestream[42 + (3 * i)] & 0x7f) + 1; // Ssiz
+        depth = (depth > precision) ? depth : precision;
+    }
+    depth = CL_CLAMP(depth, 8, 16);
+
+    clProfile * profile = NULL;
+    if (overrideProfile) {
+        profile = clProfileClone(C, overrideProfile);
+    } else if (icc) {
+        profile = clProfileParse(C, icc, iccSize, NULL);
+    }
+
+    clImage * image = clImageCreate(C, width, height, depth, profile);
+    if (profile) {
+        clProfileDestroy(C, profile);
+    }
+    return image;
+}
+
 clBool clFormatWriteJP2(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     struct opjCallbackInfo ci;
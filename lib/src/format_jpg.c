@@ -36,13 +36,16 @@ static void setup_read_icc_profile(j_decompress_ptr cinfo);
 static boolean read_icc_profile(struct clContext * C, j_decompress_ptr cinfo, JOCTET ** icc_data_ptr, unsigned int * icc_data_len);
 static void write_icc_profile(j_compress_ptr cinfo, const JOCTET * icc_data_ptr, unsigned int icc_data_len);
 
-struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadJPG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static clImage * readJPG(struct clContext * C, struct clProfile * overrideProfile, struct clRaw * input, clBool headerOnly)
 {
-    COLORIST_UNUSED(formatName);
-
     clImage * image = NULL;
 
     struct my_error_mgr jerr;
@@ -65,10 +68,12 @@ struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName,
     jpeg_mem_src(&cinfo, input->ptr, (unsigned long)input->size);
     jpeg_read_header(&cinfo, TRUE);
     cinfo.out_color_space = JCS_RGB;
-    jpeg_start_decompress(&cinfo);
-
-    int row_stride = cinfo.output_width * cinfo.output_components;
-    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, row_stride, 1);
+    if (headerOnly) {
+        // The SOF and any APP2 ICC chunks have been read by now, this just fills in output_width/height
+        jpeg_calc_output_dimensions(&cinfo);
+    } else {
+        jpeg_start_decompress(&cinfo);
+    }
 
     clProfile * profile = NULL;
     if (overrideProfile) {
@@ -89,11 +94,18 @@ struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName,
 
     clImageLogCreate(C, cinfo.output_width, cinfo.output_height, 8, profile);
     image = clImageCreate(C, cinfo.output_width, cinfo.output_height, 8, profile);
-    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
 
     if (profile) {
         clProfileDestroy(C, profile);
     }
+    if (headerOnly) {
+        jpeg_destroy_decompress(&cinfo);
+        return image;
+    }
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
+
+    int row_stride = cinfo.output_width * cinfo.output_components;
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, row_stride, 1);
 
     int row = 0;
     while (cinfo.output_scanline < cinfo.output_height) {
@@ -117,6 +129,32 @@ struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName,
     return image;
 }
 
+struct clImage * clFormatReadJPG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
+
+    return readJPG(C, overrideProfile, input, clFalse);
+}
+
+struct clImage * clFormatProbeJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    return readJPG(C, overrideProfile, input, clTrue);
+}
+
+// jpeg_mem_dest() output is malloc()'d, and handed to the output clRaw as is
+static void freeJPGOutput(void * owner, uint8_t * ptr)
+{
+    COLORIST_UNUSED(owner);
+    free(ptr);
+}
+
 clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(formatName);
@@ -171,7 +209,8 @@ clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char
     jpeg_finish_compress(&cinfo);
 
     if (outbuffer && outsize) {
-        clRawSet(C, output, outbuffer, outsize);
+        clRawBorrow(C, output, outbuffer, outsize, freeJPGOutput, NULL);
+        outbuffer = NULL;
     } else {
         clContextLogError(C, "ERROR: JPG compression failed");
         clRawFree(C, output);
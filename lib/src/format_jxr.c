@@ -9,13 +9,15 @@
 
 #include "colorist/context.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
+#include "colorist/transform.h"
 
 #include <string.h>
 
 #include "JXRGlue.h"
 
-// This is the yuckiest.
-#define LARGEST_JXR_OUTPUT_SIZE (200 * 1024 * 1024)
+// Encoded output starts this big and doubles whenever the encoder writes past the end
+#define JXR_OUTPUT_INITIAL_SIZE (256 * 1024)
 
 // Y, U, V, YHP, UHP, VHP
 static int DPK_QPS_420[11][6] = { // for 8 bit only
@@ -42,16 +44,169 @@ static int DPK_QPS_16[11][6] = { { 197, 203, 210, 202, 207, 213 },
                                  { 16, 27, 33, 14, 27, 33 },
                                  { 5, 8, 9, 4, 7, 8 } };
 
-struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
-clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
+// WMPStream that encodes into a growable clRaw. output->size is the capacity while encoding, length is how much
+// has been written (the encoder seeks back to patch headers, so the two can differ from pos).
+typedef struct clJXROutputStream
+{
+    struct WMPStream ws; // must be first, jxrlib only sees this
+    struct clContext * C;
+    clRaw * output;
+    size_t pos;
+    size_t length;
+} clJXROutputStream;
+
+static ERR outputStreamClose(struct WMPStream ** pme)
+{
+    clJXROutputStream * stream = (clJXROutputStream *)*pme;
+    clContext * C = stream->C;
+    clFree(stream);
+    *pme = NULL;
+    return WMP_errSuccess;
+}
 
-struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static Bool outputStreamEOS(struct WMPStream * me)
 {
-    COLORIST_UNUSED(C);
-    COLORIST_UNUSED(formatName);
-    COLORIST_UNUSED(overrideProfile);
-    COLORIST_UNUSED(input);
+    clJXROutputStream * stream = (clJXROutputStream *)me;
+    return stream->pos >= stream->length;
+}
+
+static ERR outputStreamRead(struct WMPStream * me, void * pv, size_t cb)
+{
+    clJXROutputStream * stream = (clJXROutputStream *)me;
+    if ((stream->pos > stream->length) || (cb > (stream->length - stream->pos))) {
+        return WMP_errBufferOverflow;
+    }
+    memcpy(pv, stream->output->ptr + stream->pos, cb);
+    stream->pos += cb;
+    return WMP_errSuccess;
+}
+
+static ERR outputStreamWrite(struct WMPStream * me, const void * pv, size_t cb)
+{
+    clJXROutputStream * stream = (clJXROutputStream *)me;
+    clContext * C = stream->C;
+    size_t end = stream->pos + cb;
+    if (end < stream->pos) {
+        return WMP_errBufferOverflow;
+    }
+    if (end > stream->output->size) {
+        size_t capacity = stream->output->size ? stream->output->size : JXR_OUTPUT_INITIAL_SIZE;
+        while (capacity < end) {
+            capacity *= 2;
+        }
+        clRawRealloc(C, stream->output, capacity);
+    }
+    if (stream->pos > stream->length) {
+        // Seeked past the end, don't leave garbage in the gap
+        memset(stream->output->ptr + stream->length, 0, stream->pos - stream->length);
+    }
+    memcpy(stream->output->ptr + stream->pos, pv, cb);
+    stream->pos = end;
+    if (stream->length < end) {
+        stream->length = end;
+    }
+    return WMP_errSuccess;
+}
+
+static ERR outputStreamSetPos(struct WMPStream * me, size_t offPos)
+{
+    clJXROutputStream * stream = (clJXROutputStream *)me;
+    stream->pos = offPos;
+    return WMP_errSuccess;
+}
+
+static ERR outputStreamGetPos(struct WMPStream * me, size_t * poffPos)
+{
+    clJXROutputStream * stream = (clJXROutputStream *)me;
+    *poffPos = stream->pos;
+    return WMP_errSuccess;
+}
+
+static clJXROutputStream * outputStreamCreate(struct clContext * C, clRaw * output)
+{
+    clJXROutputStream * stream = clAllocateStruct(clJXROutputStream);
+    memset(stream, 0, sizeof(clJXROutputStream));
+    stream->ws.fMem = TRUE;
+    stream->ws.Close = outputStreamClose;
+    stream->ws.EOS = outputStreamEOS;
+    stream->ws.Read = outputStreamRead;
+    stream->ws.Write = outputStreamWrite;
+    stream->ws.SetPos = outputStreamSetPos;
+    stream->ws.GetPos = outputStreamGetPos;
+    stream->C = C;
+    stream->output = output;
+    clRawRealloc(C, output, JXR_OUTPUT_INITIAL_SIZE);
+    return stream;
+}
+
+// Finishes scRGB pixels in parallel row bands: expands the decoder's native halves in place (each row's halves sit
+// at the start of its float row), and/or folds in the --scrgb-nits scale
+typedef struct scRGBBand
+{
+    clContext * C;
+    clImage * image;
+    int rowStart;
+    int rowCount;
+    clBool half;   // rows hold RGBA halves
+    clBool opaque; // the 4th channel is padding, not alpha
+    float scale;   // applied to RGB
+} scRGBBand;
+
+static void scRGBBandFunc(scRGBBand * bands, int index)
+{
+    scRGBBand * band = &bands[index];
+    clContext * C = band->C;
+    int width = band->image->width;
+    for (int y = band->rowStart; y < (band->rowStart + band->rowCount); ++y) {
+        float * row = &band->image->pixelsF32[(size_t)y * width * 4];
+        if (band->half) {
+            clTransformHalfToFloat(C, (const uint16_t *)row, row, width, band->scale);
+        } else if (band->scale != 1.0f) {
+            for (int x = 0; x < width; ++x) {
+                row[(x * 4) + 0] *= band->scale;
+                row[(x * 4) + 1] *= band->scale;
+                row[(x * 4) + 2] *= band->scale;
+            }
+        }
+        if (band->opaque) {
+            for (int x = 0; x < width; ++x) {
+                row[(x * 4) + 3] = 1.0f;
+            }
+        }
+    }
+}
+
+static void finishSCRGB(struct clContext * C, clImage * image, clBool half, clBool opaque, float scale)
+{
+    int bandCount = (C->jobs < image->height) ? C->jobs : image->height;
+    if (bandCount < 1) {
+        bandCount = 1;
+    }
+    int rowsPerBand = image->height / bandCount;
+    scRGBBand * bands = clAllocate(sizeof(scRGBBand) * bandCount);
+    for (int i = 0; i < bandCount; ++i) {
+        bands[i].C = C;
+        bands[i].image = image;
+        bands[i].rowStart = i * rowsPerBand;
+        bands[i].rowCount = (i == (bandCount - 1)) ? (image->height - bands[i].rowStart) : rowsPerBand;
+        bands[i].half = half;
+        bands[i].opaque = opaque;
+        bands[i].scale = scale;
+    }
+    clTaskParallelFor(C, bandCount, (clTaskIndexFunc)scRGBBandFunc, bands);
+    clFree(bands);
+}
+
+struct clImage * clFormatReadJXR(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbeJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
+static clImage * readJXR(struct clContext * C, struct clRaw * input, clBool headerOnly)
+{
     clRaw rawProfile = CL_RAW_EMPTY;
     clProfile * profile = NULL;
     clImage * image = NULL;
@@ -69,6 +224,9 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
     U32 frameCount = 0;
     PKRect rect = { 0, 0, 0, 0 };
     clBool scRGB = clFalse;
+    clBool scRGBHalf = clFalse;   // decode native RGBA halves and expand them ourselves
+    clBool scRGBOpaque = clFalse; // ... whose 4th channel is padding
+    float scRGBScale = 1.0f;
 
     memset(&rawProfile, 0, sizeof(rawProfile));
 
@@ -84,6 +242,10 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
 
     if (Failed(err = pCodecFactory->CreateDecoderFromMemory(".jxr", input->ptr, input->size, &pDecoder))) {
         clContextLogError(C, "Can't create JXR codec factory");
+        if (pDecoder && pDecoder->pStream) {
+            // jxrlib only hands the stream over once the header parses, let Release() close it regardless
+            pDecoder->fStreamOwner = !0;
+        }
         goto readCleanup;
     }
 
@@ -122,6 +284,9 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
     } else {
         if (pixelFormat.bdBitDepth == BD_32F || pixelFormat.bdBitDepth == BD_16F) {
             clContextLog(C, "jxr", 1, "Decoded %s JXR with no profile, assuming MS Game Bar screencap (scRGB linear @ 80 nits)", pixelFormat.bdBitDepth == BD_32F ? "float" : "half");
+            if (C->scRGBLuminance != CL_SCRGB_LUMINANCE) {
+                clContextLog(C, "jxr", 1, "Rescaling scRGB pixels to be relative to %d nits", C->scRGBLuminance);
+            }
 
             clProfilePrimaries primaries;
             primaries.red[0] = 0.64f;
@@ -137,9 +302,17 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
             curve.type = CL_PCT_GAMMA;
             curve.gamma = 1.0f;
 
-            profile = clProfileCreate(C, &primaries, &curve, 80, NULL);
+            profile = clProfileCreate(C, &primaries, &curve, C->scRGBLuminance, NULL);
 
             scRGB = clTrue;
+            scRGBScale = (float)CL_SCRGB_LUMINANCE / (float)C->scRGBLuminance;
+            // pixelFormat is the TIF lookup by now, which may not be the decoder's native format
+            if (!memcmp(&pDecoder->guidPixFormat, &GUID_PKPixelFormat64bppRGBAHalf, sizeof(GUID_PKPixelFormat64bppRGBAHalf))) {
+                scRGBHalf = clTrue;
+            } else if (!memcmp(&pDecoder->guidPixFormat, &GUID_PKPixelFormat64bppRGBHalf, sizeof(GUID_PKPixelFormat64bppRGBHalf))) {
+                scRGBHalf = clTrue;
+                scRGBOpaque = clTrue;
+            }
         } else if (!memcmp(pixelFormat.pGUIDPixFmt, &GUID_PKPixelFormat32bppRGB101010, sizeof(GUID_PKPixelFormat32bppRGB101010))) {
             clContextLog(C, "jxr", 1, "Decoded RGB10X2 JXR with no profile, assuming BT2020 PQ @ 10000 nits");
 
@@ -162,7 +335,10 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
     }
 
     depth = (pixelFormat.uBitsPerSample > 8) ? 16 : 8;
-    if (scRGB) {
+    if (scRGBHalf) {
+        // jxrlib's half -> float converters are scalar, see finishSCRGB()
+        guidPixFormat = pDecoder->guidPixFormat;
+    } else if (scRGB) {
         guidPixFormat = GUID_PKPixelFormat128bppRGBAFloat;
     } else {
         guidPixFormat = (depth > 8) ? GUID_PKPixelFormat64bppRGBA : GUID_PKPixelFormat32bppRGBA;
@@ -173,6 +349,11 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
         goto readCleanup;
     }
 
+    if (headerOnly) {
+        image = clImageCreate(C, pDecoder->uWidth, pDecoder->uHeight, depth, profile);
+        goto readCleanup;
+    }
+
     if (Failed(err = pCodecFactory->CreateFormatConverter(&pConverter))) {
         clContextLogError(C, "Can't create JXR format converter");
         goto readCleanup;
@@ -188,7 +369,32 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
     clImageLogCreate(C, rect.Width, rect.Height, depth, profile);
     image = clImageCreate(C, pDecoder->uWidth, pDecoder->uHeight, depth, profile);
 
-    if (!memcmp(&guidPixFormat, &GUID_PKPixelFormat128bppRGBAFloat, sizeof(guidPixFormat))) {
+    if (scRGBHalf && (scRGBScale == 1.0f)) {
+        // Nothing to fold in, so keep the native halves; they are widened lazily (and exactly) if anything needs F32
+        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F16);
+        if (Failed(err = pConverter->Copy(pConverter, &rect, (U8 *)image->pixelsF16, image->width * 4 * sizeof(uint16_t)))) {
+            clContextLogError(C, "Can't copy JXR pixels (F16)");
+            clImageDestroy(C, image);
+            image = NULL;
+            goto readCleanup;
+        }
+        if (scRGBOpaque) {
+            int pixelCount = image->width * image->height;
+            for (int i = 0; i < pixelCount; ++i) {
+                image->pixelsF16[(i * 4) + 3] = 0x3c00; // 1.0
+            }
+        }
+    } else if (scRGBHalf) {
+        // Rows of halves at the start of each float row, expanded in place
+        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+        if (Failed(err = pConverter->Copy(pConverter, &rect, (U8 *)image->pixelsF32, image->width * 4 * sizeof(float)))) {
+            clContextLogError(C, "Can't copy JXR pixels (F16)");
+            clImageDestroy(C, image);
+            image = NULL;
+            goto readCleanup;
+        }
+        finishSCRGB(C, image, clTrue, scRGBOpaque, scRGBScale);
+    } else if (!memcmp(&guidPixFormat, &GUID_PKPixelFormat128bppRGBAFloat, sizeof(guidPixFormat))) {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
         if (Failed(err = pConverter->Copy(pConverter, &rect, (U8 *)image->pixelsF32, image->width * 4 * sizeof(float)))) {
             clContextLogError(C, "Can't copy JXR pixels (F32)");
@@ -196,6 +402,9 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
             image = NULL;
             goto readCleanup;
         }
+        if (scRGBScale != 1.0f) {
+            finishSCRGB(C, image, clFalse, clFalse, scRGBScale);
+        }
     } else if (!memcmp(&guidPixFormat, &GUID_PKPixelFormat64bppRGBA, sizeof(guidPixFormat))) {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16);
         if (Failed(err = pConverter->Copy(pConverter, &rect, (U8 *)image->pixelsU16, image->width * 4 * sizeof(uint16_t)))) {
@@ -220,12 +429,57 @@ struct clImage * clFormatReadJXR(struct clContext * C, const char * formatName,
     }
 
 readCleanup:
+    if (pConverter) {
+        pConverter->Release(&pConverter);
+    }
+    if (pDecoder) {
+        pDecoder->Release(&pDecoder);
+    }
+    if (pCodecFactory) {
+        pCodecFactory->Release(&pCodecFactory);
+    }
+    if (pFactory) {
+        pFactory->Release(&pFactory);
+    }
+    clRawFree(C, &rawProfile);
     if (profile) {
         clProfileDestroy(C, profile);
     }
     return image;
 }
 
+struct clImage * clFormatReadJXR(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(overrideProfile);
+    COLORIST_UNUSED(readParams);
+
+    return readJXR(C, input, clFalse);
+}
+
+struct clImage * clFormatProbeJXR(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(overrideProfile);
+
+    // Bail quietly on anything else, this is also used to recognize JXRs during format detection. jxrlib itself
+    // is quite chatty when handed a bogus IFD, so at least make sure the first one is somewhere in the file.
+    static const unsigned char jxrSig[3] = { 0x49, 0x49, 0xBC };
+    if ((input->size < 8) || memcmp(input->ptr, jxrSig, sizeof(jxrSig))) {
+        return NULL;
+    }
+    uint32_t ifdOffset = (uint32_t)input->ptr[4] | ((uint32_t)input->ptr[5] << 8) | ((uint32_t)input->ptr[6] << 16) |
+                         ((uint32_t)input->ptr[7] << 24);
+    if ((ifdOffset < 8) || (ifdOffset >= input->size)) {
+        return NULL;
+    }
+    return readJXR(C, input, clTrue);
+}
+
 clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(C);
@@ -234,7 +488,7 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
     COLORIST_UNUSED(output);
     COLORIST_UNUSED(writeParams);
 
-    clBool writeResult = clTrue;
+    clBool writeResult = clFalse;
     clRaw rawProfile;
 
     ERR err = WMP_errSuccess;
@@ -242,14 +496,10 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
     CWMIStrCodecParam wmiSCP;
     float fltImageQuality;
 
-    PKFactory * pFactory = NULL;
-    struct WMPStream * pEncodeStream = NULL;
+    clJXROutputStream * outputStream = NULL;
     PKCodecFactory * pCodecFactory = NULL;
     PKImageEncode * pEncoder = NULL;
 
-    // This is the worst hack ever.
-    clRawRealloc(C, output, LARGEST_JXR_OUTPUT_SIZE);
-
     // Defaults
     guidPixFormat = (image->depth > 8) ? GUID_PKPixelFormat64bppRGBA : GUID_PKPixelFormat32bppRGBA;
     memset(&wmiSCP, 0, sizeof(wmiSCP));
@@ -274,14 +524,7 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
         goto cleanup;
     }
 
-    if (Failed(err = PKCreateFactory(&pFactory, PK_SDK_VERSION))) {
-        clContextLogError(C, "Can't create JXR PK factory");
-        goto cleanup;
-    }
-    if (Failed(err = pFactory->CreateStreamFromMemory(&pEncodeStream, output->ptr, output->size))) {
-        clContextLogError(C, "Can't open JXR file for write");
-        goto cleanup;
-    }
+    outputStream = outputStreamCreate(C, output);
     if (Failed(err = PKCreateCodecFactory(&pCodecFactory, WMP_SDK_VERSION))) {
         clContextLogError(C, "Can't create JXR codec factory");
         goto cleanup;
@@ -302,7 +545,7 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
         wmiSCP.cNumOfSliceMinus1V = (U32)image->width < (uTileX >> 1) ? 0 : (image->width + (uTileX >> 1)) / uTileX - 1;
     }
 
-    if (Failed(err = pEncoder->Initialize(pEncoder, pEncodeStream, &wmiSCP, sizeof(wmiSCP)))) {
+    if (Failed(err = pEncoder->Initialize(pEncoder, &outputStream->ws, &wmiSCP, sizeof(wmiSCP)))) {
         clContextLogError(C, "Can't initialize JXR codec");
         goto cleanup;
     }
@@ -376,19 +619,27 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
 
     if (image->depth > 8) {
         clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
-        pEncoder->WritePixels(pEncoder, image->height, (U8 *)image->pixelsU16, image->width * 4 * sizeof(uint16_t));
+        err = pEncoder->WritePixels(pEncoder, image->height, (U8 *)image->pixelsU16, image->width * 4 * sizeof(uint16_t));
     } else {
         clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-        pEncoder->WritePixels(pEncoder, image->height, image->pixelsU8, image->width * 4 * sizeof(uint8_t));
+        err = pEncoder->WritePixels(pEncoder, image->height, image->pixelsU8, image->width * 4 * sizeof(uint8_t));
     }
-    output->size = pEncodeStream->state.buf.cbLast;
+    if (Failed(err)) {
+        clContextLogError(C, "Can't encode JXR pixels");
+        goto cleanup;
+    }
+    output->size = outputStream->length;
 
     writeResult = clTrue;
 cleanup:
+    if (pEncoder && pEncoder->pStream)
+        outputStream = NULL; // the encoder closes it
     if (pEncoder)
         pEncoder->Release(&pEncoder);
-    if (pFactory)
-        pFactory->Release(&pFactory);
+    if (outputStream)
+        outputStream->ws.Close((struct WMPStream **)&outputStream);
+    if (!writeResult)
+        clRawFree(C, output);
     clRawFree(C, &rawProfile);
     return writeResult;
 }
@@ -14,7 +14,12 @@
 
 #include <string.h>
 
-struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadPNG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams);
+struct clImage * clFormatProbePNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
 
 struct readInfo
@@ -33,14 +38,12 @@ static void readCallback(png_structp png, png_bytep data, png_size_t length)
     ri->offset += length;
 }
 
-struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static clImage * readPNG(struct clContext * C, struct clProfile * overrideProfile, struct clRaw * input, clBool headerOnly)
 {
-    COLORIST_UNUSED(formatName);
-
     clImage * image = NULL;
     png_bytep * rowPointers = NULL;
 
-    if (png_sig_cmp(input->ptr, 0, 8)) {
+    if ((input->size < 8) || png_sig_cmp(input->ptr, 0, 8)) {
         clContextLogError(C, "not a PNG");
         return NULL;
     }
@@ -124,6 +127,11 @@ struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName,
     if (profile) {
         clProfileDestroy(C, profile);
     }
+    if (headerOnly) {
+        // IHDR and iCCP both precede IDAT, so png_read_info() never touched any pixel data
+        png_destroy_read_struct(&png, &info, NULL);
+        return image;
+    }
     rowPointers = (png_bytep *)clAllocate(sizeof(png_bytep) * rawHeight);
     if (imgBytesPerChannel == 1) {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
@@ -144,6 +152,25 @@ struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName,
     return image;
 }
 
+struct clImage * clFormatReadPNG(struct clContext * C,
+                                 const char * formatName,
+                                 struct clProfile * overrideProfile,
+                                 struct clRaw * input,
+                                 const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
+
+    return readPNG(C, overrideProfile, input, clFalse);
+}
+
+struct clImage * clFormatProbePNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    return readPNG(C, overrideProfile, input, clTrue);
+}
+
 struct writeInfo
 {
     struct clContext * C;
@@ -14,7 +14,12 @@
 
 #include <string.h>
 
-struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadTIFF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteTIFF(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
@@ -127,10 +132,8 @@ static void warningHandler(thandle_t handle, const char * module, const char * f
     clContextLogError(ci->C, "TIFF Warning: %s", tmp);
 }
 
-struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static clImage * readTIFF(struct clContext * C, struct clProfile * overrideProfile, struct clRaw * input, clBool headerOnly)
 {
-    COLORIST_UNUSED(formatName);
-
     clProfile * profile = NULL;
     clImage * image = NULL;
     TIFF * tiff;
@@ -250,6 +253,10 @@ struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName,
 
     clImageLogCreate(C, width, height, depth, profile);
     image = clImageCreate(C, width, height, depth, profile);
+    if (headerOnly) {
+        // Everything above came from the first IFD's tags, no strips or tiles have been read
+        goto readCleanup;
+    }
 
     if (fp32) {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
@@ -480,6 +487,25 @@ readCleanup:
     return image;
 }
 
+struct clImage * clFormatReadTIFF(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
+
+    return readTIFF(C, overrideProfile, input, clFalse);
+}
+
+struct clImage * clFormatProbeTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    return readTIFF(C, overrideProfile, input, clTrue);
+}
+
 clBool clFormatWriteTIFF(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(formatName);
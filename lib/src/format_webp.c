@@ -16,17 +16,20 @@
 
 #include <string.h>
 
-struct clImage * clFormatReadWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
+struct clImage * clFormatReadWebP(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams);
+struct clImage * clFormatProbeWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteWebP(struct clContext * C,
                          struct clImage * image,
                          const char * formatName,
                          struct clRaw * output,
                          struct clWriteParams * writeParams);
 
-struct clImage * clFormatReadWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static clImage * readWebP(struct clContext * C, struct clProfile * overrideProfile, struct clRaw * input, clBool headerOnly)
 {
-    COLORIST_UNUSED(formatName);
-
     clImage * image = NULL;
     clProfile * profile = NULL;
 
@@ -71,6 +74,10 @@ struct clImage * clFormatReadWebP(struct clContext * C, const char * formatName,
 
     clImageLogCreate(C, width, height, 8, profile);
     image = clImageCreate(C, width, height, 8, profile);
+    if (headerOnly) {
+        // WebPGetInfo() only looked at the VP8/VP8L frame header
+        goto readCleanup;
+    }
     clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
     if (!WebPDecodeRGBAInto(frameInfo.bitstream.bytes,
                             frameInfo.bitstream.size,
@@ -94,6 +101,32 @@ readCleanup:
     return image;
 }
 
+struct clImage * clFormatReadWebP(struct clContext * C,
+                                  const char * formatName,
+                                  struct clProfile * overrideProfile,
+                                  struct clRaw * input,
+                                  const struct clReadParams * readParams)
+{
+    COLORIST_UNUSED(formatName);
+    COLORIST_UNUSED(readParams);
+
+    return readWebP(C, overrideProfile, input, clFalse);
+}
+
+struct clImage * clFormatProbeWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    return readWebP(C, overrideProfile, input, clTrue);
+}
+
+// The assembled WebP is handed to the output clRaw as is
+static void freeWebPOutput(void * owner, uint8_t * ptr)
+{
+    COLORIST_UNUSED(owner);
+    WebPFree(ptr);
+}
+
 clBool clFormatWriteWebP(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(formatName);
@@ -161,7 +194,9 @@ clBool clFormatWriteWebP(struct clContext * C, struct clImage * image, const cha
         goto writeCleanup;
     }
 
-    clRawSet(C, output, assembledChunk.bytes, assembledChunk.size);
+    clRawBorrow(C, output, (uint8_t *)assembledChunk.bytes, assembledChunk.size, freeWebPOutput, NULL);
+    assembledChunk.bytes = NULL;
+    assembledChunk.size = 0;
 
 writeCleanup:
     if (mux) {
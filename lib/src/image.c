@@ -10,8 +10,10 @@
 #include "colorist/context.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
 #include "colorist/transform.h"
 
+#include <float.h>
 #include <string.h>
 
 static uint8_t * clImagePixelPtr(clContext * C, clImage * image, clPixelFormat pixelFormat)
@@ -24,6 +26,8 @@ static uint8_t * clImagePixelPtr(clContext * C, clImage * image, clPixelFormat p
             return (uint8_t *)image->pixelsU16;
         case CL_PIXELFORMAT_F32:
             return (uint8_t *)image->pixelsF32;
+        case CL_PIXELFORMAT_F16:
+            return (uint8_t *)image->pixelsF16;
         case CL_PIXELFORMAT_COUNT:
             COLORIST_ASSERT(0);
             break;
@@ -49,6 +53,11 @@ static void clImageAllocatePixels(struct clContext * C, clImage * image, clPixel
                 image->pixelsF32 = clAllocate(image->width * image->height * CL_BYTES_PER_PIXEL(pixelFormat));
             }
             break;
+        case CL_PIXELFORMAT_F16:
+            if (!image->pixelsF16) {
+                image->pixelsF16 = clAllocate(image->width * image->height * CL_BYTES_PER_PIXEL(pixelFormat));
+            }
+            break;
         case CL_PIXELFORMAT_COUNT:
             COLORIST_ASSERT(0);
             break;
@@ -81,6 +90,8 @@ clImage * clImageCreate(clContext * C, int width, int height, int depth, clProfi
     image->pixelsU8 = NULL;
     image->pixelsU16 = NULL;
     image->pixelsF32 = NULL;
+    image->pixelsF16 = NULL;
+    image->statsValid = clFalse;
     return image;
 }
 
@@ -121,6 +132,18 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
                             dstPixel[3] = (uint8_t)clPixelMathRoundUNorm(srcPixel[3] / maxChannelU16f, maxChannelU8);
                         }
                     }
+                } else if (image->pixelsF16) {
+                    // F16 -> U8, widened a row at a time
+                    float * row = clAllocate(sizeof(float) * CL_CHANNELS_PER_PIXEL * image->width);
+                    int rowChannelCount = image->width * CL_CHANNELS_PER_PIXEL;
+                    for (int j = 0; j < image->height; ++j) {
+                        clTransformHalfToFloat(C, &image->pixelsF16[j * rowChannelCount], row, image->width, 1.0f);
+                        uint8_t * dstRow = &image->pixelsU8[j * rowChannelCount];
+                        for (int i = 0; i < rowChannelCount; ++i) {
+                            dstRow[i] = (uint8_t)clPixelMathRoundUNorm(row[i], maxChannelU8);
+                        }
+                    }
+                    clFree(row);
                 } else {
                     // U8 White
                     memset(image->pixelsU8, 0xff, image->width * image->height * CL_CHANNELS_PER_PIXEL * sizeof(uint8_t));
@@ -156,6 +179,18 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
                             dstPixel[3] = (uint16_t)clPixelMathRoundUNorm(srcPixel[3] / maxChannelU8f, maxChannelU16);
                         }
                     }
+                } else if (image->pixelsF16) {
+                    // F16 -> U16, widened a row at a time
+                    float * row = clAllocate(sizeof(float) * CL_CHANNELS_PER_PIXEL * image->width);
+                    int rowChannelCount = image->width * CL_CHANNELS_PER_PIXEL;
+                    for (int j = 0; j < image->height; ++j) {
+                        clTransformHalfToFloat(C, &image->pixelsF16[j * rowChannelCount], row, image->width, 1.0f);
+                        uint16_t * dstRow = &image->pixelsU16[j * rowChannelCount];
+                        for (int i = 0; i < rowChannelCount; ++i) {
+                            dstRow[i] = (uint16_t)clPixelMathRoundUNorm(row[i], maxChannelU16);
+                        }
+                    }
+                    clFree(row);
                 } else {
                     // U16 White
                     memset(image->pixelsU16, 0xff, image->width * image->height * CL_CHANNELS_PER_PIXEL * sizeof(uint16_t));
@@ -167,7 +202,10 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
             if (!image->pixelsF32) {
                 clImageAllocatePixels(C, image, pixelFormat);
 
-                if (image->pixelsU16) {
+                if (image->pixelsF16) {
+                    // F16 -> F32 (exact)
+                    clTransformHalfToFloat(C, image->pixelsF16, image->pixelsF32, image->width * image->height, 1.0f);
+                } else if (image->pixelsU16) {
                     // U16 -> F32
                     for (int j = 0; j < image->height; ++j) {
                         for (int i = 0; i < image->width; ++i) {
@@ -201,6 +239,35 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
             }
             break;
 
+        case CL_PIXELFORMAT_F16:
+            if (!image->pixelsF16) {
+                clImageAllocatePixels(C, image, pixelFormat);
+
+                int rowChannelCount = image->width * CL_CHANNELS_PER_PIXEL;
+                if (image->pixelsF32) {
+                    // F32 -> F16
+                    clTransformFloatToHalf(C, image->pixelsF32, image->pixelsF16, rowChannelCount * image->height);
+                } else if (image->pixelsU16 || image->pixelsU8) {
+                    // U16/U8 -> F16, normalized a row at a time
+                    float * row = clAllocate(sizeof(float) * rowChannelCount);
+                    for (int j = 0; j < image->height; ++j) {
+                        for (int i = 0; i < rowChannelCount; ++i) {
+                            int index = (j * rowChannelCount) + i;
+                            row[i] = image->pixelsU16 ? (image->pixelsU16[index] / maxChannelU16f)
+                                                      : (image->pixelsU8[index] / maxChannelU8f);
+                        }
+                        clTransformFloatToHalf(C, row, &image->pixelsF16[j * rowChannelCount], rowChannelCount);
+                    }
+                    clFree(row);
+                } else {
+                    // F16 White
+                    for (int i = 0; i < rowChannelCount * image->height; ++i) {
+                        image->pixelsF16[i] = 0x3c00; // 1.0
+                    }
+                }
+            }
+            break;
+
         case CL_PIXELFORMAT_COUNT:
             COLORIST_ASSERT(0);
             break;
@@ -210,6 +277,7 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
 void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
 {
     clImagePrepareReadPixels(C, image, pixelFormat);
+    clImageInvalidateStats(C, image);
 
     // Throw away anything that isn't about to be written to; it will be stale and can be repopulated
     // lazily by a future call to clImagePrepareReadPixels().
@@ -225,6 +293,10 @@ void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFor
         clFree(image->pixelsF32);
         image->pixelsF32 = NULL;
     }
+    if (image->pixelsF16 && (pixelFormat != CL_PIXELFORMAT_F16)) {
+        clFree(image->pixelsF16);
+        image->pixelsF16 = NULL;
+    }
 }
 
 clImage * clImageCrop(struct clContext * C, clImage * srcImage, int x, int y, int w, int h, clBool keepSrc)
@@ -282,15 +354,35 @@ clImage * clImageApplyHALD(struct clContext * C, clImage * image, clImage * hald
 clImage * clImageResize(struct clContext * C, clImage * image, int width, int height, clFilter resizeFilter)
 {
     clImage * resizedImage = clImageCreate(C, width, height, image->depth, image->profile);
+    int resizedChannelCount = resizedImage->width * resizedImage->height * CL_CHANNELS_PER_PIXEL;
 
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-    clImagePrepareWritePixels(C, resizedImage, CL_PIXELFORMAT_F32);
+    // Half images stay half: the filters only take floats, so they get temporary float copies
+    clBool half = (image->pixelsF16 && !image->pixelsF32);
+    float * srcPixels;
+    float * dstPixels;
+    if (half) {
+        srcPixels = clAllocate(sizeof(float) * CL_CHANNELS_PER_PIXEL * image->width * image->height);
+        dstPixels = clAllocate(sizeof(float) * resizedChannelCount);
+        clTransformHalfToFloat(C, image->pixelsF16, srcPixels, image->width * image->height, 1.0f);
+    } else {
+        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+        clImagePrepareWritePixels(C, resizedImage, CL_PIXELFORMAT_F32);
+        srcPixels = image->pixelsF32;
+        dstPixels = resizedImage->pixelsF32;
+    }
 
-    clPixelMathResize(C, image->width, image->height, image->pixelsF32, resizedImage->width, resizedImage->height, resizedImage->pixelsF32, resizeFilter);
-    int resizedChannelCount = resizedImage->width * resizedImage->height * CL_CHANNELS_PER_PIXEL;
+    clPixelMathResize(
+        C, image->width, image->height, srcPixels, resizedImage->width, resizedImage->height, dstPixels, resizeFilter);
     for (int i = 0; i < resizedChannelCount; ++i) {
         // catmullrom and mitchell sometimes give negative values. Protect against that
-        resizedImage->pixelsF32[i] = CL_MAX(resizedImage->pixelsF32[i], 0.0f);
+        dstPixels[i] = CL_MAX(dstPixels[i], 0.0f);
+    }
+
+    if (half) {
+        clImagePrepareWritePixels(C, resizedImage, CL_PIXELFORMAT_F16);
+        clTransformFloatToHalf(C, dstPixels, resizedImage->pixelsF16, resizedChannelCount);
+        clFree(srcPixels);
+        clFree(dstPixels);
     }
     return resizedImage;
 }
@@ -328,13 +420,12 @@ clImage * clImageBlend(struct clContext * C, clImage * image, clImage * composit
     clProfile * blendProfile = clProfileCreate(C, &primaries, &curve, maxLuminance, NULL);
 
     // Build transforms that go [src -> blend], [cmp -> blend], [blend -> dst]
-    clTransform * srcBlendTransform = clTransformCreate(C, image->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->srcTonemap);
-    memcpy(&srcBlendTransform->tonemapParams, &blendParams->srcParams, sizeof(clTonemapParams));
-    clTransform * cmpBlendTransform =
-        clTransformCreate(C, compositeImage->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->cmpTonemap);
-    memcpy(&cmpBlendTransform->tonemapParams, &blendParams->cmpParams, sizeof(clTonemapParams));
-    clTransform * dstTransform =
-        clTransformCreate(C, blendProfile, CL_XF_RGBA, image->profile, CL_XF_RGBA, CL_TONEMAP_OFF); // maxLuminance should match, no need to tonemap
+    clTransform * srcBlendTransform = clTransformCacheAcquire(
+        C, image->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->srcTonemap, &blendParams->srcParams);
+    clTransform * cmpBlendTransform = clTransformCacheAcquire(
+        C, compositeImage->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->cmpTonemap, &blendParams->cmpParams);
+    clTransform * dstTransform = clTransformCacheAcquire(
+        C, blendProfile, CL_XF_RGBA, image->profile, CL_XF_RGBA, CL_TONEMAP_OFF, NULL); // maxLuminance should match, no need to tonemap
 
     // Transform src and comp images into normalized blend space
     clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
@@ -393,9 +484,9 @@ clImage * clImageBlend(struct clContext * C, clImage * image, clImage * composit
     clTransformRun(C, dstTransform, dstFloats, dstImage->pixelsF32, image->width * image->height);
 
     // Cleanup
-    clTransformDestroy(C, srcBlendTransform);
-    clTransformDestroy(C, cmpBlendTransform);
-    clTransformDestroy(C, dstTransform);
+    clTransformCacheRelease(C, srcBlendTransform);
+    clTransformCacheRelease(C, cmpBlendTransform);
+    clTransformCacheRelease(C, dstTransform);
     clProfileDestroy(C, blendProfile);
     clFree(srcFloats);
     clFree(cmpFloats);
@@ -572,15 +663,38 @@ clImage * clImageConvert(struct clContext * C, clImage * srcImage, int depth, st
     }
 
     // Create the transform
-    clTransform * transform = clTransformCreate(C, srcImage->profile, CL_XF_RGBA, dstImage->profile, CL_XF_RGBA, tonemap);
-    if (tonemapParams) {
-        memcpy(&transform->tonemapParams, tonemapParams, sizeof(clTonemapParams));
-    }
-    clTransformPrepare(C, transform);
+    clTransform * transform =
+        clTransformCacheAcquire(C, srcImage->profile, CL_XF_RGBA, dstImage->profile, CL_XF_RGBA, tonemap, tonemapParams);
     float luminanceScale = clTransformGetLuminanceScale(C, transform);
 
-    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
-    clImagePrepareWritePixels(C, dstImage, CL_PIXELFORMAT_F32);
+    // Integer depths are rounded and clamped by the transform itself, straight into the pixels the encoder will read
+    clPixelFormat dstPixelFormat = CL_PIXELFORMAT_F32;
+    if (depth <= 8) {
+        dstPixelFormat = CL_PIXELFORMAT_U8;
+    } else if (depth <= 16) {
+        dstPixelFormat = CL_PIXELFORMAT_U16;
+    }
+    clImagePrepareWritePixels(C, dstImage, dstPixelFormat);
+
+    // Half and integer sources are read as they are (the transform widens or linearizes them itself), without an
+    // F32 copy
+    clPixelFormat srcPixelFormat = CL_PIXELFORMAT_F32;
+    void * srcPixels = srcImage->pixelsF32;
+    if (!srcPixels) {
+        if (srcImage->pixelsF16) {
+            srcPixelFormat = CL_PIXELFORMAT_F16;
+            srcPixels = srcImage->pixelsF16;
+        } else if (srcImage->pixelsU16) {
+            srcPixelFormat = CL_PIXELFORMAT_U16;
+            srcPixels = srcImage->pixelsU16;
+        } else if (srcImage->pixelsU8) {
+            srcPixelFormat = CL_PIXELFORMAT_U8;
+            srcPixels = srcImage->pixelsU8;
+        } else {
+            clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
+            srcPixels = srcImage->pixelsF32;
+        }
+    }
 
     const char * tonemapDescription = transform->tonemapEnabled ? "tonemap" : "clip";
     if ((tonemap == CL_TONEMAP_OFF) && (depth == 32)) {
@@ -589,6 +703,9 @@ clImage * clImageConvert(struct clContext * C, clImage * srcImage, int depth, st
 
     // Perform conversion
     clContextLog(C, "convert", 0, "Converting (%s, lum scale %gx, %s)...", clTransformCMMName(C, transform), luminanceScale, tonemapDescription);
+    char planDescription[128];
+    clTransformDescribePlan(C, transform, planDescription, sizeof(planDescription));
+    clContextLog(C, "convert", 1, "Plan: %s", planDescription);
     if (transform->tonemapEnabled) {
         clContextLog(C,
                      "tonemap",
@@ -600,64 +717,322 @@ clImage * clImageConvert(struct clContext * C, clImage * srcImage, int depth, st
                      transform->tonemapParams.power);
     }
     timerStart(&t);
-    clTransformRun(C, transform, srcImage->pixelsF32, dstImage->pixelsF32, srcImage->width * srcImage->height);
+    void * dstPixels = dstImage->pixelsF32;
+    if (dstPixelFormat == CL_PIXELFORMAT_U8) {
+        dstPixels = dstImage->pixelsU8;
+    } else if (dstPixelFormat == CL_PIXELFORMAT_U16) {
+        dstPixels = dstImage->pixelsU16;
+    }
+    // The destination's stats come out of the same pass, so encoders asking for them don't rescan
+    clTransformRunPixelsWithStats(C,
+                                  transform,
+                                  srcPixels,
+                                  srcPixelFormat,
+                                  srcImage->depth,
+                                  dstPixels,
+                                  dstPixelFormat,
+                                  depth,
+                                  srcImage->width * srcImage->height,
+                                  &dstImage->stats);
+    dstImage->statsValid = clTrue;
     clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
     // Cleanup
-    clTransformDestroy(C, transform);
+    clTransformCacheRelease(C, transform);
     return dstImage;
 }
 
-void clImageColorGrade(struct clContext * C, clImage * image, int dstColorDepth, int * outLuminance, float * outGamma, clBool verbose)
+void clImageColorGrade(struct clContext * C,
+                       clImage * image,
+                       int dstColorDepth,
+                       const clGradeParams * gradeParams,
+                       int * outLuminance,
+                       float * outGamma,
+                       clBool verbose)
 {
     int srcLuminance = 0;
     clProfileQuery(C, image->profile, NULL, NULL, &srcLuminance);
     srcLuminance = (srcLuminance != 0) ? srcLuminance : C->defaultLuminance;
 
+    // Stats first: they may already be cached, or come cheaper from the pixels the image already has
+    int largestChannelIndex = (*outLuminance == 0) ? clImageGetStats(C, image)->largestChannelIndex : -1;
+
     int pixelCount = image->width * image->height;
     clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-    clPixelMathColorGrade(C, image->profile, image->pixelsF32, pixelCount, image->width, srcLuminance, dstColorDepth, outLuminance, outGamma, verbose);
+    clPixelMathColorGrade(C,
+                          image->profile,
+                          image->pixelsF32,
+                          pixelCount,
+                          image->width,
+                          largestChannelIndex,
+                          srcLuminance,
+                          dstColorDepth,
+                          gradeParams,
+                          outLuminance,
+                          outGamma,
+                          verbose);
 }
 
-float clImageLargestChannel(struct clContext * C, clImage * image)
+void clImageStatsReset(clImageStats * stats)
 {
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+    for (int channel = 0; channel < CL_CHANNELS_PER_PIXEL; ++channel) {
+        stats->channelMin[channel] = FLT_MAX;
+        stats->channelMax[channel] = -FLT_MAX;
+    }
+    stats->largestChannel = 0.0f;
+    stats->largestChannelIndex = 0;
+    stats->peakLuminance = -1.0f;
+    stats->maxCLL = -1.0f;
+    stats->maxFALL = -1.0f;
+}
 
-    float largestChannel = 0.0f;
-    int pixelCount = image->width * image->height;
-    for (int i = 0; i < pixelCount; ++i) {
-        float * pixel = &image->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
-        if (largestChannel < pixel[0]) {
-            largestChannel = pixel[0];
+static void accumulateFloat(clImageStats * stats, const float * pixels, int firstIndex, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const float * pixel = &pixels[i * CL_CHANNELS_PER_PIXEL];
+        for (int channel = 0; channel < CL_CHANNELS_PER_PIXEL; ++channel) {
+            if (stats->channelMin[channel] > pixel[channel]) {
+                stats->channelMin[channel] = pixel[channel];
+            }
+            if (stats->channelMax[channel] < pixel[channel]) {
+                stats->channelMax[channel] = pixel[channel];
+            }
+        }
+        for (int channel = 0; channel < 3; ++channel) {
+            if (stats->largestChannel < pixel[channel]) {
+                stats->largestChannel = pixel[channel];
+                stats->largestChannelIndex = firstIndex + i;
+            }
         }
-        if (largestChannel < pixel[1]) {
-            largestChannel = pixel[1];
+    }
+}
+
+// Integer pixels are reduced as they are and only the results normalized, which matches normalizing every pixel first
+static void accumulateUNorm(clImageStats * stats,
+                            const uint8_t * pixelsU8,
+                            const uint16_t * pixelsU16,
+                            int depth,
+                            int firstIndex,
+                            int count)
+{
+    uint32_t lo[CL_CHANNELS_PER_PIXEL] = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+    uint32_t hi[CL_CHANNELS_PER_PIXEL] = { 0, 0, 0, 0 };
+    uint32_t largest = 0;
+    int largestIndex = -1;
+    for (int i = 0; i < count; ++i) {
+        for (int channel = 0; channel < CL_CHANNELS_PER_PIXEL; ++channel) {
+            int index = (i * CL_CHANNELS_PER_PIXEL) + channel;
+            uint32_t value = pixelsU16 ? pixelsU16[index] : pixelsU8[index];
+            lo[channel] = CL_MIN(lo[channel], value);
+            hi[channel] = CL_MAX(hi[channel], value);
+            if ((channel < 3) && (largest < value)) {
+                largest = value;
+                largestIndex = i;
+            }
         }
-        if (largestChannel < pixel[2]) {
-            largestChannel = pixel[2];
+    }
+    if (count < 1) {
+        return;
+    }
+
+    float maxChannel = (float)(pixelsU16 ? ((1 << CL_CLAMP(depth, 8, 16)) - 1) : 255);
+    for (int channel = 0; channel < CL_CHANNELS_PER_PIXEL; ++channel) {
+        float channelMin = (float)lo[channel] / maxChannel;
+        float channelMax = (float)hi[channel] / maxChannel;
+        stats->channelMin[channel] = CL_MIN(stats->channelMin[channel], channelMin);
+        stats->channelMax[channel] = CL_MAX(stats->channelMax[channel], channelMax);
+    }
+    float largestChannel = (float)largest / maxChannel;
+    if ((largestIndex >= 0) && (stats->largestChannel < largestChannel)) {
+        stats->largestChannel = largestChannel;
+        stats->largestChannelIndex = firstIndex + largestIndex;
+    }
+}
+
+void clImageStatsAccumulate(struct clContext * C,
+                            clImageStats * stats,
+                            const void * pixels,
+                            clPixelFormat pixelFormat,
+                            int depth,
+                            int firstIndex,
+                            int count)
+{
+    switch (pixelFormat) {
+        case CL_PIXELFORMAT_U8:
+            accumulateUNorm(stats, (const uint8_t *)pixels, NULL, depth, firstIndex, count);
+            break;
+        case CL_PIXELFORMAT_U16:
+            accumulateUNorm(stats, NULL, (const uint16_t *)pixels, depth, firstIndex, count);
+            break;
+        case CL_PIXELFORMAT_F32:
+            accumulateFloat(stats, (const float *)pixels, firstIndex, count);
+            break;
+        case CL_PIXELFORMAT_F16: {
+            // Widened (exactly) a chunk at a time rather than keeping an F32 copy around
+            float widened[CL_CHANNELS_PER_PIXEL * CL_TRANSFORM_CHUNK_PIXELS];
+            for (int chunkStart = 0; chunkStart < count; chunkStart += CL_TRANSFORM_CHUNK_PIXELS) {
+                int chunkCount = CL_MIN(count - chunkStart, CL_TRANSFORM_CHUNK_PIXELS);
+                const uint16_t * chunk = &((const uint16_t *)pixels)[chunkStart * CL_CHANNELS_PER_PIXEL];
+                clTransformHalfToFloat(C, chunk, widened, chunkCount, 1.0f);
+                accumulateFloat(stats, widened, firstIndex + chunkStart, chunkCount);
+            }
+            break;
         }
+        case CL_PIXELFORMAT_COUNT:
+            break;
     }
-    return largestChannel;
+}
+
+void clImageStatsMerge(clImageStats * stats, const clImageStats * partial)
+{
+    for (int channel = 0; channel < CL_CHANNELS_PER_PIXEL; ++channel) {
+        stats->channelMin[channel] = CL_MIN(stats->channelMin[channel], partial->channelMin[channel]);
+        stats->channelMax[channel] = CL_MAX(stats->channelMax[channel], partial->channelMax[channel]);
+    }
+    // Strictly larger only, so the earliest pixel wins ties as long as partials arrive in pixel order
+    if (stats->largestChannel < partial->largestChannel) {
+        stats->largestChannel = partial->largestChannel;
+        stats->largestChannelIndex = partial->largestChannelIndex;
+    }
+}
+
+// Whatever is already there (the most precise first), rather than converting just to scan it
+static const uint8_t * scanPixels(struct clContext * C, clImage * image, clPixelFormat * outPixelFormat)
+{
+    if (image->pixelsF32) {
+        *outPixelFormat = CL_PIXELFORMAT_F32;
+        return (const uint8_t *)image->pixelsF32;
+    }
+    if (image->pixelsF16) {
+        *outPixelFormat = CL_PIXELFORMAT_F16;
+        return (const uint8_t *)image->pixelsF16;
+    }
+    if (image->pixelsU16) {
+        *outPixelFormat = CL_PIXELFORMAT_U16;
+        return (const uint8_t *)image->pixelsU16;
+    }
+    if (image->pixelsU8) {
+        *outPixelFormat = CL_PIXELFORMAT_U8;
+        return image->pixelsU8;
+    }
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+    *outPixelFormat = CL_PIXELFORMAT_F32;
+    return (const uint8_t *)image->pixelsF32;
+}
+
+typedef struct clImageStatsBand
+{
+    clContext * C;
+    const uint8_t * pixels;
+    clPixelFormat pixelFormat;
+    int depth;
+    int firstIndex;
+    int count;
+    clImageStats stats;
+} clImageStatsBand;
+
+static void statsBandFunc(clImageStatsBand * bands, int index)
+{
+    clImageStatsBand * band = &bands[index];
+    clImageStatsReset(&band->stats);
+    clImageStatsAccumulate(band->C, &band->stats, band->pixels, band->pixelFormat, band->depth, band->firstIndex, band->count);
+}
+
+const clImageStats * clImageGetStats(struct clContext * C, clImage * image)
+{
+    if (image->statsValid) {
+        return &image->stats;
+    }
+
+    clPixelFormat pixelFormat;
+    const uint8_t * pixels = scanPixels(C, image, &pixelFormat);
+
+    int pixelCount = image->width * image->height;
+    int bandCount = CL_CLAMP(C->jobs, 1, CL_MAX(pixelCount, 1));
+    int pixelsPerBand = pixelCount / bandCount;
+    clImageStatsBand * bands = clAllocate(sizeof(clImageStatsBand) * bandCount);
+    for (int i = 0; i < bandCount; ++i) {
+        bands[i].C = C;
+        bands[i].firstIndex = i * pixelsPerBand;
+        bands[i].pixels = pixels + ((size_t)bands[i].firstIndex * CL_BYTES_PER_PIXEL(pixelFormat));
+        bands[i].pixelFormat = pixelFormat;
+        bands[i].depth = image->depth;
+        bands[i].count = (i == (bandCount - 1)) ? (pixelCount - bands[i].firstIndex) : pixelsPerBand;
+    }
+    if (bandCount == 1) {
+        statsBandFunc(bands, 0);
+    } else {
+        clTaskParallelFor(C, bandCount, (clTaskIndexFunc)statsBandFunc, bands);
+    }
+
+    clImageStatsReset(&image->stats);
+    for (int i = 0; i < bandCount; ++i) {
+        clImageStatsMerge(&image->stats, &bands[i].stats);
+    }
+    clFree(bands);
+
+    if (pixelCount < 1) {
+        memset(image->stats.channelMin, 0, sizeof(image->stats.channelMin));
+        memset(image->stats.channelMax, 0, sizeof(image->stats.channelMax));
+    }
+    image->statsValid = clTrue;
+    return &image->stats;
+}
+
+void clImageInvalidateStats(struct clContext * C, clImage * image)
+{
+    COLORIST_UNUSED(C);
+
+    image->statsValid = clFalse;
+}
+
+float clImageLargestChannel(struct clContext * C, clImage * image)
+{
+    return clImageGetStats(C, image)->largestChannel;
 }
 
 float clImagePeakLuminance(struct clContext * C, clImage * image)
 {
-    float largestChannel = clImageLargestChannel(C, image);
+    const clImageStats * stats = clImageGetStats(C, image);
+    if (stats->peakLuminance >= 0.0f) {
+        return stats->peakLuminance;
+    }
 
     float peakPixel[4];
-    peakPixel[0] = largestChannel;
-    peakPixel[1] = largestChannel;
-    peakPixel[2] = largestChannel;
+    peakPixel[0] = stats->largestChannel;
+    peakPixel[1] = stats->largestChannel;
+    peakPixel[2] = stats->largestChannel;
     peakPixel[3] = 1.0f;
 
     float peakXYZ[3];
-    clTransform * toXYZ = clTransformCreate(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * toXYZ = clTransformCacheAcquire(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL);
     clTransformRun(C, toXYZ, peakPixel, peakXYZ, 1);
-    clTransformDestroy(C, toXYZ);
+    clTransformCacheRelease(C, toXYZ);
 
+    image->stats.peakLuminance = peakXYZ[1];
     return peakXYZ[1];
 }
 
+void clImageContentLightLevels(struct clContext * C, clImage * image, float * outMaxCLL, float * outMaxFALL)
+{
+    const clImageStats * stats = clImageGetStats(C, image);
+    if (stats->maxCLL < 0.0f) {
+        // Only conversions measure these as they go; anything else pays for a pass here, once
+        clPixelFormat pixelFormat;
+        const uint8_t * pixels = scanPixels(C, image, &pixelFormat);
+        clTransformMeasureLightLevels(C,
+                                      image->profile,
+                                      pixels,
+                                      pixelFormat,
+                                      image->depth,
+                                      image->width * image->height,
+                                      &image->stats.maxCLL,
+                                      &image->stats.maxFALL);
+    }
+    *outMaxCLL = image->stats.maxCLL;
+    *outMaxFALL = image->stats.maxFALL;
+}
+
 void clImageClear(struct clContext * C, clImage * image, float color[4])
 {
     clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
@@ -681,5 +1056,8 @@ void clImageDestroy(clContext * C, clImage * image)
     if (image->pixelsF32) {
         clFree(image->pixelsF32);
     }
+    if (image->pixelsF16) {
+        clFree(image->pixelsF16);
+    }
     clFree(image);
 }
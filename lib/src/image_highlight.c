@@ -10,23 +10,12 @@
 #include "colorist/context.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
 #include "colorist/transform.h"
 
-#include <stdlib.h>
+#include <float.h>
 #include <string.h>
 
-static int compareFloats(const void * p, const void * q)
-{
-    const float x = *(const float *)p;
-    const float y = *(const float *)q;
-    if (x < y) {
-        return -1;
-    } else if (x > y) {
-        return 1;
-    }
-    return 0;
-}
-
 static float calcOverbright(float Y, float overbrightScale, float maxY)
 {
     // Even at 10,000 nits, this is only 1 nit difference. If its less than this, we're not over.
@@ -41,88 +30,70 @@ static float calcOverbright(float Y, float overbrightScale, float maxY)
     return 0.0f;
 }
 
-static void calcGamutDistances(float x, float y, const clProfilePrimaries * primaries, float outDistances[3])
-{
-    float rX = primaries->red[0];
-    float rY = primaries->red[1];
-    float gX = primaries->green[0];
-    float gY = primaries->green[1];
-    float bX = primaries->blue[0];
-    float bY = primaries->blue[1];
-
-    float distBetweenRG = sqrtf(((rY - gY) * (rY - gY)) + ((rX - gX) * (rX - gX)));
-    float distBetweenGB = sqrtf(((gY - bY) * (gY - bY)) + ((gX - bX) * (gX - bX)));
-    float distBetweenRB = sqrtf(((rY - bY) * (rY - bY)) + ((rX - bX) * (rX - bX)));
-    float distFromRGEdge = ((x * (gY - rY)) - (y * (gX - rX)) + (gX * rY) - (gY * rX)) / distBetweenRG;
-    float distFromGBEdge = ((x * (bY - gY)) - (y * (bX - gX)) + (bX * gY) - (bY * gX)) / distBetweenGB;
-    float distFromRBEdge = ((x * (rY - bY)) - (y * (rX - bX)) + (rX * bY) - (rY * bX)) / distBetweenRB;
-
-    outDistances[0] = distFromRGEdge;
-    outDistances[1] = distFromGBEdge;
-    outDistances[2] = distFromRBEdge;
+// Signed distance from the directed edge through two primaries, as a * x + b * y + c. Positive is outside the
+// triangle for the counter-clockwise R -> G -> B winding every RGB gamut uses.
+typedef struct clGamutEdge
+{
+    float a;
+    float b;
+    float c;
+} clGamutEdge;
+
+// Per-call gamut geometry, hoisted out of the pixel loop. Edge order is RG, GB, BR.
+typedef struct clHighlightGeometry
+{
+    clGamutEdge gamutEdges[3];
+    clGamutEdge srgbEdges[3];
+    float srgbWhiteDistances[3]; // distance of the sRGB white point from each sRGB edge
+    clProfileGamutCeiling ceiling;
+} clHighlightGeometry;
+
+static void deriveGamutEdge(const float p[2], const float q[2], clGamutEdge * edge)
+{
+    float length = sqrtf(((q[1] - p[1]) * (q[1] - p[1])) + ((q[0] - p[0]) * (q[0] - p[0])));
+    edge->a = (q[1] - p[1]) / length;
+    edge->b = -(q[0] - p[0]) / length;
+    edge->c = ((q[0] * p[1]) - (q[1] * p[0])) / length;
 }
 
-static const clProfilePrimaries srgbPrimaries = { { 0.64f, 0.33f }, { 0.30f, 0.60f }, { 0.15f, 0.06f }, { 0.3127f, 0.3290f } };
+static void deriveGamutEdges(const clProfilePrimaries * primaries, clGamutEdge edges[3])
+{
+    deriveGamutEdge(primaries->red, primaries->green, &edges[0]);
+    deriveGamutEdge(primaries->green, primaries->blue, &edges[1]);
+    deriveGamutEdge(primaries->blue, primaries->red, &edges[2]);
+}
 
-static float calcDistance(float x1, float y1, float x2, float y2)
+static float edgeDistance(const clGamutEdge * edge, float x, float y)
 {
-    float xDist = x2 - x1;
-    float yDist = y2 - y1;
-    return sqrtf((xDist * xDist) + (yDist * yDist));
+    return (edge->a * x) + (edge->b * y) + edge->c;
 }
 
-static float srgbSaturation(float x, float y, int whichEdge)
-{
-    float x1 = x;
-    float y1 = y;
-    float x2 = srgbPrimaries.white[0];
-    float y2 = srgbPrimaries.white[1];
-    float x3, y3, x4, y4;
-    switch (whichEdge) {
-        case 0: // RG
-            x3 = srgbPrimaries.red[0];
-            y3 = srgbPrimaries.red[1];
-            x4 = srgbPrimaries.green[0];
-            y4 = srgbPrimaries.green[1];
-            break;
-        case 1: // GB
-            x3 = srgbPrimaries.green[0];
-            y3 = srgbPrimaries.green[1];
-            x4 = srgbPrimaries.blue[0];
-            y4 = srgbPrimaries.blue[1];
-            break;
-        case 2: // RB
-            x3 = srgbPrimaries.red[0];
-            y3 = srgbPrimaries.red[1];
-            x4 = srgbPrimaries.blue[0];
-            y4 = srgbPrimaries.blue[1];
-            break;
-        default:
-            return 0.0f;
-    }
+static const clProfilePrimaries srgbPrimaries = { { 0.64f, 0.33f }, { 0.30f, 0.60f }, { 0.15f, 0.06f }, { 0.3127f, 0.3290f } };
 
-    float denominator = ((x1 - x2) * (y3 - y4)) - ((y1 - y2) * (x3 - x4));
-    if (fabsf(denominator) < 0.00001f) {
-        // coincident/parallel lines?
-        return 0.0f;
+static void deriveHighlightGeometry(clContext * C,
+                                    const clProfilePrimaries * primaries,
+                                    clTransform * linearToXYZ,
+                                    clHighlightGeometry * geometry)
+{
+    deriveGamutEdges(primaries, geometry->gamutEdges);
+    deriveGamutEdges(&srgbPrimaries, geometry->srgbEdges);
+    for (int i = 0; i < 3; ++i) {
+        geometry->srgbWhiteDistances[i] = edgeDistance(&geometry->srgbEdges[i], srgbPrimaries.white[0], srgbPrimaries.white[1]);
     }
-
-    float xInt = ((((x1 * y2) - (y1 * x2)) * (x3 - x4)) - ((x1 - x2) * ((x3 * y4) - (y3 * x4)))) / denominator;
-    float yInt = ((((x1 * y2) - (y1 * x2)) * (y3 - y4)) - ((y1 - y2) * ((x3 * y4) - (y3 * x4)))) / denominator;
-    float maxDist = calcDistance(xInt, yInt, srgbPrimaries.white[0], srgbPrimaries.white[1]);
-    float dist = calcDistance(x, y, srgbPrimaries.white[0], srgbPrimaries.white[1]);
-    return dist / maxDist;
+    memcpy(&geometry->ceiling, clTransformGetGamutCeiling(C, linearToXYZ), sizeof(geometry->ceiling));
 }
 
-static float calcSaturation(float x, float y, clProfilePrimaries * primaries)
+static float calcSaturation(const clHighlightGeometry * geometry, float x, float y)
 {
     float gamutDistances[3];
     float srgbDistances[3];
     float srgbMaxDist, gamutMaxDist = 0.0f, totalDist, ratio;
     int i;
 
-    calcGamutDistances(x, y, primaries, gamutDistances);
-    calcGamutDistances(x, y, &srgbPrimaries, srgbDistances);
+    for (i = 0; i < 3; ++i) {
+        gamutDistances[i] = edgeDistance(&geometry->gamutEdges[i], x, y);
+        srgbDistances[i] = edgeDistance(&geometry->srgbEdges[i], x, y);
+    }
 
     int whichEdge = 0;
     srgbMaxDist = srgbDistances[whichEdge];
@@ -135,8 +106,10 @@ static float calcSaturation(float x, float y, clProfilePrimaries * primaries)
     }
 
     if (srgbMaxDist < 0.0002f) {
-        // in gamut
-        return srgbSaturation(x, y, whichEdge);
+        // in gamut: how far along the ray from white to this edge the pixel sits. Distances from the edge
+        // are linear along that ray, so this is the ratio of the pixel's and white's offsets from it.
+        float whiteDist = geometry->srgbWhiteDistances[whichEdge];
+        return fabsf(srgbDistances[whichEdge] - whiteDist) / fabsf(whiteDist);
     }
 
     if (gamutMaxDist > -0.00001f) {
@@ -178,127 +151,395 @@ void clImageHDRPixelInfoDestroy(struct clContext * C, clImageHDRPixelInfo * pixe
     clFree(pixelInfo);
 }
 
-void clImageMeasureHDR(clContext * C,
-                       clImage * srcImage,
-                       int srgbLuminance,
-                       float satLuminance,
-                       clImage ** outImage,
-                       clImageHDRStats * outStats,
-                       clImageHDRPixelInfo * outPixelInfo,
-                       clImageHDRQuantization * outQuantization)
+// Percentiles come from fine histograms filled during the scan: nits in the log domain (64 buckets per octave,
+// read straight from the float's bits), saturation linearly over [0, 2]. The buckets the requested ranks land in
+// are then gathered in a second pass and quickselected, so the answers match a full sort without one. A bucket too
+// big for the gather budget only has its extremes gathered, and is interpolated between them. The gather runs per
+// band like the scan: each band writes its values into its own stretch of a bucket's gathered values (the band's
+// histogram says how many it has), and keeps its own extremes for the over-budget buckets, merged afterwards.
+#define CL_PERCENTILE_BUCKET_COUNT 4096
+#define CL_PERCENTILE_GATHER_BUDGET (1 << 20) // values per histogram
+#define CL_PERCENTILE_COUNT 101
+#define CL_PERCENTILE_LOG_SHIFT 17                  // keeps the exponent and 6 mantissa bits
+#define CL_PERCENTILE_LOG_FIRST ((127 - 32) << 6)   // 2^-32 and below share bucket 0
+
+typedef struct clPercentileHistogram
 {
-    const float minHighlight = 0.4f;
+    int counts[CL_PERCENTILE_BUCKET_COUNT];
+    float minValue;
+    float maxValue;
+} clPercentileHistogram;
 
-    clTransform * toXYZ = clTransformCreate(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-    clTransform * fromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, srcImage->profile, CL_XF_RGB, CL_TONEMAP_OFF);
+typedef struct clPercentilePlan
+{
+    const clPercentileHistogram * histogram;
+    int buckets[CL_PERCENTILE_COUNT];
+    int offsets[CL_PERCENTILE_COUNT];            // rank within the bucket
+    int gatherStart[CL_PERCENTILE_BUCKET_COUNT]; // CL_PERCENTILE_UNGATHERED, CL_PERCENTILE_BOUNDED or an index
+    int slots[CL_PERCENTILE_BUCKET_COUNT];       // index into targets, -1 for buckets no percentile landed in
+    int targets[CL_PERCENTILE_COUNT];            // each bucket a percentile landed in, once
+    int targetCount;
+    float bucketMin[CL_PERCENTILE_COUNT]; // per target, for bounded ones
+    float bucketMax[CL_PERCENTILE_COUNT];
+    int bucketMinCount[CL_PERCENTILE_COUNT]; // how many values equal bucketMin
+    float * gathered;
+} clPercentilePlan;
+
+// One band's share of a plan's gather, per target
+typedef struct clPercentileGather
+{
+    const clPercentilePlan * plan;
+    int next[CL_PERCENTILE_COUNT]; // gathered targets: where the band's next value goes
+    int end[CL_PERCENTILE_COUNT];
+    float bucketMin[CL_PERCENTILE_COUNT]; // bounded targets: the band's extremes
+    float bucketMax[CL_PERCENTILE_COUNT];
+    int bucketMinCount[CL_PERCENTILE_COUNT];
+} clPercentileGather;
+
+#define CL_PERCENTILE_UNGATHERED -1
+#define CL_PERCENTILE_BOUNDED -2 // over budget, only its min and max are gathered
+
+static int nitsPercentileBucket(float nits)
+{
+    union
+    {
+        float f;
+        uint32_t u;
+    } bits;
+    bits.f = CL_MAX(nits, 0.0f);
+    int bucket = (int)(bits.u >> CL_PERCENTILE_LOG_SHIFT) - CL_PERCENTILE_LOG_FIRST;
+    return CL_CLAMP(bucket, 0, CL_PERCENTILE_BUCKET_COUNT - 1);
+}
 
-    clProfilePrimaries srcPrimaries;
-    clProfileCurve srcCurve;
-    int srcLuminance = 0;
-    clProfileQuery(C, srcImage->profile, &srcPrimaries, &srcCurve, &srcLuminance);
-    if (srcLuminance == CL_LUMINANCE_UNSPECIFIED) {
-        if (srcCurve.type == CL_PCT_HLG) {
-            srcLuminance = clTransformCalcHLGLuminance(C->defaultLuminance);
-        } else {
-            srcLuminance = C->defaultLuminance;
-        }
+static int saturationPercentileBucket(float saturation)
+{
+    int bucket = (int)(saturation * 0.5f * (float)CL_PERCENTILE_BUCKET_COUNT);
+    return CL_CLAMP(bucket, 0, CL_PERCENTILE_BUCKET_COUNT - 1);
+}
+
+static void percentileHistogramReset(clPercentileHistogram * histogram)
+{
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    histogram->minValue = FLT_MAX;
+    histogram->maxValue = -FLT_MAX;
+}
+
+static void percentileHistogramAdd(clPercentileHistogram * histogram, int bucket, float value)
+{
+    ++histogram->counts[bucket];
+    histogram->minValue = CL_MIN(histogram->minValue, value);
+    histogram->maxValue = CL_MAX(histogram->maxValue, value);
+}
+
+static void percentileHistogramMerge(clPercentileHistogram * dst, const clPercentileHistogram * src)
+{
+    for (int i = 0; i < CL_PERCENTILE_BUCKET_COUNT; ++i) {
+        dst->counts[i] += src->counts[i];
     }
+    dst->minValue = CL_MIN(dst->minValue, src->minValue);
+    dst->maxValue = CL_MAX(dst->maxValue, src->maxValue);
+}
 
-    // clTransformCalcMaxY assumes the RGB profile is linear with a 1 nit luminance
-    clProfileCurve gamma1;
-    gamma1.type = CL_PCT_GAMMA;
-    gamma1.gamma = 1.0f;
-    clProfile * linearProfile = clProfileCreate(C, &srcPrimaries, &gamma1, 1, NULL);
-    clTransform * linearToXYZ = clTransformCreate(C, linearProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-    clTransform * linearFromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, linearProfile, CL_XF_RGB, CL_TONEMAP_OFF);
+static int percentileRank(int percentile, int pixelCount)
+{
+    if (percentile == (CL_PERCENTILE_COUNT - 1)) {
+        return pixelCount - 1;
+    }
+    return (int)((float)percentile * (float)pixelCount / 100.0f);
+}
 
-    memset(outStats, 0, sizeof(clImageHDRStats));
-    int pixelCount = outStats->pixelCount = srcImage->width * srcImage->height;
+// Finds the bucket holding each percentile's rank and reserves gather space for as many of them as the budget allows
+static void planPercentiles(clContext * C, clPercentilePlan * plan, const clPercentileHistogram * histogram, int pixelCount)
+{
+    plan->histogram = histogram;
+    plan->gathered = NULL;
+
+    int bucket = 0;
+    int below = 0; // pixels in buckets before this one
+    for (int i = 0; i < CL_PERCENTILE_COUNT; ++i) {
+        int rank = percentileRank(i, pixelCount);
+        while ((bucket < (CL_PERCENTILE_BUCKET_COUNT - 1)) && ((below + histogram->counts[bucket]) <= rank)) {
+            below += histogram->counts[bucket];
+            ++bucket;
+        }
+        plan->buckets[i] = bucket;
+        plan->offsets[i] = rank - below;
+    }
 
-    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
+    int gatherCount = 0;
+    for (int i = 0; i < CL_PERCENTILE_BUCKET_COUNT; ++i) {
+        plan->gatherStart[i] = CL_PERCENTILE_UNGATHERED;
+        plan->slots[i] = -1;
+    }
+    plan->targetCount = 0;
+    for (int i = 0; i < CL_PERCENTILE_COUNT; ++i) {
+        int target = plan->buckets[i];
+        if (plan->gatherStart[target] != CL_PERCENTILE_UNGATHERED) {
+            continue;
+        }
+        int count = histogram->counts[target];
+        if ((gatherCount + count) <= CL_PERCENTILE_GATHER_BUDGET) {
+            plan->gatherStart[target] = gatherCount;
+            gatherCount += count;
+        } else {
+            plan->gatherStart[target] = CL_PERCENTILE_BOUNDED;
+        }
+        int slot = plan->targetCount++;
+        plan->slots[target] = slot;
+        plan->targets[slot] = target;
+        plan->bucketMin[slot] = FLT_MAX;
+        plan->bucketMax[slot] = -FLT_MAX;
+        plan->bucketMinCount[slot] = 0;
+    }
+    if (gatherCount > 0) {
+        plan->gathered = clAllocate(sizeof(float) * gatherCount);
+    }
+}
 
-    float measuredPeakLuminance = clImagePeakLuminance(C, srcImage);
-    float overbrightScale = measuredPeakLuminance * srcCurve.implicitScale / (float)srgbLuminance;
+// Sets up the next band's gather. cursors holds each gathered target's next free index, starting from the plan's
+// gatherStart, and is advanced past the bandHistogram's share.
+static void beginGather(clPercentileGather * gather,
+                        const clPercentilePlan * plan,
+                        const clPercentileHistogram * bandHistogram,
+                        int cursors[CL_PERCENTILE_COUNT])
+{
+    gather->plan = plan;
+    for (int slot = 0; slot < plan->targetCount; ++slot) {
+        int target = plan->targets[slot];
+        gather->next[slot] = cursors[slot];
+        if (plan->gatherStart[target] >= 0) {
+            cursors[slot] += bandHistogram->counts[target];
+        }
+        gather->end[slot] = cursors[slot];
+        gather->bucketMin[slot] = FLT_MAX;
+        gather->bucketMax[slot] = -FLT_MAX;
+        gather->bucketMinCount[slot] = 0;
+    }
+}
 
-    float * xyzPixels = clAllocate(3 * sizeof(float) * pixelCount);
-    clTransformRun(C, toXYZ, srcImage->pixelsF32, xyzPixels, pixelCount);
+static void gatherPercentile(clPercentileGather * gather, int bucket, float value)
+{
+    const clPercentilePlan * plan = gather->plan;
+    int slot = plan->slots[bucket];
+    if (slot < 0) {
+        return;
+    }
+    if (plan->gatherStart[bucket] >= 0) {
+        if (gather->next[slot] < gather->end[slot]) {
+            plan->gathered[gather->next[slot]++] = value;
+        }
+    } else {
+        if (value < gather->bucketMin[slot]) {
+            gather->bucketMin[slot] = value;
+            gather->bucketMinCount[slot] = 1;
+        } else if (value == gather->bucketMin[slot]) {
+            ++gather->bucketMinCount[slot];
+        }
+        gather->bucketMax[slot] = CL_MAX(gather->bucketMax[slot], value);
+    }
+}
 
-    clImage * highlight = NULL;
-    if (outImage) {
-        clContextLog(C, "highlight", 1, "Creating sRGB highlight (%d nits, %s)...", srgbLuminance, clTransformCMMName(C, toXYZ));
+// Folds a band's extremes for the bounded targets into the plan
+static void endGather(clPercentilePlan * plan, const clPercentileGather * gather)
+{
+    for (int slot = 0; slot < plan->targetCount; ++slot) {
+        if (gather->bucketMinCount[slot] == 0) {
+            continue;
+        }
+        if (gather->bucketMin[slot] < plan->bucketMin[slot]) {
+            plan->bucketMin[slot] = gather->bucketMin[slot];
+            plan->bucketMinCount[slot] = gather->bucketMinCount[slot];
+        } else if (gather->bucketMin[slot] == plan->bucketMin[slot]) {
+            plan->bucketMinCount[slot] += gather->bucketMinCount[slot];
+        }
+        plan->bucketMax[slot] = CL_MAX(plan->bucketMax[slot], gather->bucketMax[slot]);
+    }
+}
 
-        highlight = clImageCreate(C, srcImage->width, srcImage->height, 8, NULL);
-        *outImage = highlight;
+// Hoare-style quickselect: leaves the nth smallest value at values[n] and returns it
+static float selectNth(float * values, int count, int n)
+{
+    int left = 0;
+    int right = count - 1;
+    while (left < right) {
+        float pivot = values[left + ((right - left) / 2)];
+        int i = left;
+        int j = right;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                ++i;
+            }
+            while (values[j] > pivot) {
+                --j;
+            }
+            if (i <= j) {
+                float t = values[i];
+                values[i] = values[j];
+                values[j] = t;
+                ++i;
+                --j;
+            }
+        }
+        if (n <= j) {
+            right = j;
+        } else if (n >= i) {
+            left = i;
+        } else {
+            break;
+        }
+    }
+    return values[n];
+}
 
-        clImagePrepareWritePixels(C, highlight, CL_PIXELFORMAT_U16);
+static float resolvePercentile(clPercentilePlan * plan, int percentile, int pixelCount)
+{
+    int rank = percentileRank(percentile, pixelCount);
+    if (rank == 0) {
+        return plan->histogram->minValue;
+    }
+    if (rank == (pixelCount - 1)) {
+        return plan->histogram->maxValue;
     }
 
-    float * saturationForPercentiles = NULL;
-    float * nitsForPercentiles = NULL;
-    if (outQuantization) {
-        memset(outQuantization, 0, sizeof(clImageHDRQuantization));
-        saturationForPercentiles = clAllocate(sizeof(float) * pixelCount);
-        nitsForPercentiles = clAllocate(sizeof(float) * pixelCount);
+    int bucket = plan->buckets[percentile];
+    int offset = plan->offsets[percentile];
+    int count = plan->histogram->counts[bucket];
+    if (plan->gatherStart[bucket] >= 0) {
+        return selectNth(&plan->gathered[plan->gatherStart[bucket]], count, offset);
+    }
+
+    // Over budget: ranks inside a run of the bucket's smallest value (e.g. black, or pixels too dim for a saturation
+    // reading) are still exact. Past it, interpolate by rank up to the bucket's largest value.
+    int slot = plan->slots[bucket];
+    int minCount = plan->bucketMinCount[slot];
+    if (offset < minCount) {
+        return plan->bucketMin[slot];
     }
+    float t = (float)(offset - minCount + 1) / (float)(count - minCount);
+    return plan->bucketMin[slot] + ((plan->bucketMax[slot] - plan->bucketMin[slot]) * t);
+}
 
-    for (int i = 0; i < pixelCount; ++i) {
-        float * srcXYZ = &xyzPixels[i * 3];
-        uint16_t * dstPixel = highlight ? &highlight->pixelsU16[i * CL_CHANNELS_PER_PIXEL] : NULL;
+static void finishPercentiles(clContext * C, clPercentilePlan * plan)
+{
+    if (plan->gathered) {
+        clFree(plan->gathered);
+        plan->gathered = NULL;
+    }
+}
 
-        cmsCIEXYZ XYZ;
-        XYZ.X = srcXYZ[0];
-        XYZ.Y = srcXYZ[1];
-        XYZ.Z = srcXYZ[2];
+// Read-only state shared by every band of a clImageMeasureHDR() scan
+typedef struct clHighlightScan
+{
+    const float * xyzPixels;
+    clHighlightGeometry geometry;
+    float whiteX;
+    float whiteY;
+    float srgbLuminance;
+    float overbrightScale;
+    float satLuminance;
+    float relativeScale; // nits -> profile-relative Y
+    uint16_t * highlightPixels;
+    clImageHDRPixel * pixelInfo;
+    clBool quantize;
+} clHighlightScan;
+
+// Each band owns its counters and histograms; they are summed in band order once every band is done
+typedef struct clHighlightBand
+{
+    const clHighlightScan * scan;
+    int firstIndex;
+    int count;
+    int overbrightPixelCount;
+    int outOfGamutPixelCount;
+    int bothPixelCount;
+    int brightestPixelIndex;
+    float brightestPixelNits;
+    int pixelCountsNitsPQ[CL_QUANTIZATION_BUCKET_COUNT];
+    int pixelCountsSaturation[CL_QUANTIZATION_BUCKET_COUNT];
+    clPercentileHistogram nitsPercentiles;
+    clPercentileHistogram saturationPercentiles;
+    clPercentileGather nitsGather;
+    clPercentileGather saturationGather;
+} clHighlightBand;
+
+// Returns the pixel's nits and writes its chromaticity (the white point when it is black)
+static float pixelChromaticity(const clHighlightScan * scan, int index, float * outX, float * outY)
+{
+    const float * srcXYZ = &scan->xyzPixels[index * 3];
+    if (srcXYZ[1] > 0.0f) {
+        float sum = srcXYZ[0] + srcXYZ[1] + srcXYZ[2];
+        *outX = srcXYZ[0] / sum;
+        *outY = srcXYZ[1] / sum;
+        return srcXYZ[1];
+    }
+    *outX = scan->whiteX;
+    *outY = scan->whiteY;
+    return 0.0f;
+}
 
-        cmsCIExyY xyY;
-        if (XYZ.Y > 0) {
-            cmsXYZ2xyY(&xyY, &XYZ);
-        } else {
-            xyY.x = srcPrimaries.white[0];
-            xyY.y = srcPrimaries.white[1];
-            xyY.Y = 0.0f;
-        }
+// Pixels too dim for a saturation reading count as 0 saturation in the percentiles
+static float percentileSaturation(const clHighlightScan * scan, float nits, float saturation)
+{
+    return (CL_CLAMP(nits, 0.0f, 10000.0f) >= scan->satLuminance) ? saturation : 0.0f;
+}
 
-        float pixelNits = (float)xyY.Y;
-        if (outStats->brightestPixelNits < pixelNits) {
-            outStats->brightestPixelNits = pixelNits;
-            outStats->brightestPixelX = i % srcImage->width;
-            outStats->brightestPixelY = i / srcImage->width;
+static void highlightBandFunc(clHighlightBand * bands, int index)
+{
+    static const float minHighlight = 0.4f;
+
+    clHighlightBand * band = &bands[index];
+    const clHighlightScan * scan = band->scan;
+    const int lastIndex = band->firstIndex + band->count;
+    const float pqBucketScale = (float)(CL_QUANTIZATION_BUCKET_COUNT - 1);
+
+    band->brightestPixelIndex = band->firstIndex;
+    band->brightestPixelNits = 0.0f;
+    percentileHistogramReset(&band->nitsPercentiles);
+    percentileHistogramReset(&band->saturationPercentiles);
+    for (int i = band->firstIndex; i < lastIndex; ++i) {
+        uint16_t * dstPixel = scan->highlightPixels ? &scan->highlightPixels[i * CL_CHANNELS_PER_PIXEL] : NULL;
+
+        float x, y;
+        float pixelNits = pixelChromaticity(scan, i, &x, &y);
+
+        if (band->brightestPixelNits < pixelNits) {
+            band->brightestPixelNits = pixelNits;
+            band->brightestPixelIndex = i;
         }
 
-        float maxY = clTransformCalcMaxY(C, linearFromXYZ, linearToXYZ, (float)xyY.x, (float)xyY.y) * (float)srgbLuminance;
-        float overbright = calcOverbright((float)xyY.Y, overbrightScale, maxY);
-        float saturation = calcSaturation((float)xyY.x, (float)xyY.y, &srcPrimaries);
+        float maxY = clProfileGamutCeilingMaxY(&scan->geometry.ceiling, x, y) * scan->srgbLuminance;
+        float overbright = calcOverbright(pixelNits, scan->overbrightScale, maxY);
+        float saturation = calcSaturation(&scan->geometry, x, y);
 
-        if (outPixelInfo) {
-            clImageHDRPixel * pixelHighlightInfo = &outPixelInfo->pixels[i];
-            pixelHighlightInfo->x = (float)xyY.x;
-            pixelHighlightInfo->y = (float)xyY.y;
-            pixelHighlightInfo->Y = (float)xyY.Y / ((float)srcLuminance * srcCurve.implicitScale);
+        if (scan->pixelInfo) {
+            clImageHDRPixel * pixelHighlightInfo = &scan->pixelInfo[i];
+            pixelHighlightInfo->x = x;
+            pixelHighlightInfo->y = y;
+            pixelHighlightInfo->Y = pixelNits * scan->relativeScale;
             pixelHighlightInfo->nits = pixelNits;
             pixelHighlightInfo->maxNits = maxY;
             pixelHighlightInfo->saturation = saturation;
         }
 
-        if (outQuantization) {
+        if (scan->quantize) {
             float clampedNits = CL_CLAMP(pixelNits, 0.0f, 10000.0f);
-            int pqBucket =
-                (int)clPixelMathRoundf(clTransformOETF_PQ(clampedNits / 10000.0f) * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
+            int pqBucket = (int)clPixelMathRoundf(clTransformOETF_PQ(clampedNits / 10000.0f) * pqBucketScale);
             pqBucket = CL_CLAMP(pqBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1);
-            ++outQuantization->pixelCountsNitsPQ[pqBucket];
-            nitsForPercentiles[i] = pixelNits;
+            ++band->pixelCountsNitsPQ[pqBucket];
+            percentileHistogramAdd(&band->nitsPercentiles, nitsPercentileBucket(pixelNits), pixelNits);
 
-            if (clampedNits >= satLuminance) {
-                int saturationBucket = (int)clPixelMathRoundf(saturation * 0.5f * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
+            if (clampedNits >= scan->satLuminance) {
+                int saturationBucket = (int)clPixelMathRoundf(saturation * 0.5f * pqBucketScale);
                 saturationBucket = CL_CLAMP(saturationBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1);
-                ++outQuantization->pixelCountsSaturation[saturationBucket];
-                saturationForPercentiles[i] = saturation;
+                ++band->pixelCountsSaturation[saturationBucket];
             }
+            float percentileSat = percentileSaturation(scan, pixelNits, saturation);
+            percentileHistogramAdd(&band->saturationPercentiles, saturationPercentileBucket(percentileSat), percentileSat);
         }
 
         if (dstPixel) {
             float outOfSRGB = CL_CLAMP(saturation - 1.0f, 0.0f, 1.0f);
-            float baseIntensity = pixelNits / (float)srgbLuminance;
+            float baseIntensity = pixelNits / scan->srgbLuminance;
             baseIntensity = CL_CLAMP(baseIntensity, 0.0f, 1.0f);
             uint8_t intensity8 = intensityToU8(baseIntensity);
 
@@ -309,21 +550,21 @@ void clImageMeasureHDR(clContext * C,
                 dstPixel[0] = intensity8;
                 dstPixel[1] = intensity8;
                 dstPixel[2] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
-                ++outStats->bothPixelCount;
+                ++band->bothPixelCount;
             } else if (overbright > 0.0f) {
                 float highlightIntensity = minHighlight + (overbright * (1.0f - minHighlight));
                 // Magenta
                 dstPixel[0] = intensity8;
                 dstPixel[1] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
                 dstPixel[2] = intensity8;
-                ++outStats->overbrightPixelCount;
+                ++band->overbrightPixelCount;
             } else if (outOfSRGB > 0.0f) {
                 float highlightIntensity = minHighlight + (outOfSRGB * (1.0f - minHighlight));
                 // Cyan
                 dstPixel[0] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
                 dstPixel[1] = intensity8;
                 dstPixel[2] = intensity8;
-                ++outStats->outOfGamutPixelCount;
+                ++band->outOfGamutPixelCount;
             } else {
                 // Gray
                 dstPixel[0] = intensity8;
@@ -333,31 +574,189 @@ void clImageMeasureHDR(clContext * C,
             dstPixel[3] = 255;
         }
     }
-    outStats->hdrPixelCount = outStats->bothPixelCount + outStats->overbrightPixelCount + outStats->outOfGamutPixelCount;
+}
+
+// Pulls the band's values for the buckets the percentiles landed in, recomputed exactly as highlightBandFunc() did
+static void gatherBandFunc(clHighlightBand * bands, int index)
+{
+    clHighlightBand * band = &bands[index];
+    const clHighlightScan * scan = band->scan;
+    const int lastIndex = band->firstIndex + band->count;
+    for (int i = band->firstIndex; i < lastIndex; ++i) {
+        float x, y;
+        float pixelNits = pixelChromaticity(scan, i, &x, &y);
+        float saturation = percentileSaturation(scan, pixelNits, calcSaturation(&scan->geometry, x, y));
+        gatherPercentile(&band->nitsGather, nitsPercentileBucket(pixelNits), pixelNits);
+        gatherPercentile(&band->saturationGather, saturationPercentileBucket(saturation), saturation);
+    }
+}
+
+void clImageMeasureHDR(clContext * C,
+                       clImage * srcImage,
+                       int srgbLuminance,
+                       float satLuminance,
+                       clImage ** outImage,
+                       clImageHDRStats * outStats,
+                       clImageHDRPixelInfo * outPixelInfo,
+                       clImageHDRQuantization * outQuantization)
+{
+    clTransform * toXYZ = clTransformCacheAcquire(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL);
+
+    clProfilePrimaries srcPrimaries;
+    clProfileCurve srcCurve;
+    int srcLuminance = 0;
+    clProfileQuery(C, srcImage->profile, &srcPrimaries, &srcCurve, &srcLuminance);
+    if (srcLuminance == CL_LUMINANCE_UNSPECIFIED) {
+        if (srcCurve.type == CL_PCT_HLG) {
+            srcLuminance = clTransformCalcHLGLuminance(C->defaultLuminance);
+        } else {
+            srcLuminance = C->defaultLuminance;
+        }
+    }
+
+    // The max Y math assumes the RGB profile is linear with a 1 nit luminance
+    clProfileCurve gamma1;
+    gamma1.type = CL_PCT_GAMMA;
+    gamma1.gamma = 1.0f;
+    clProfile * linearProfile = clProfileCreate(C, &srcPrimaries, &gamma1, 1, NULL);
+    clTransform * linearToXYZ = clTransformCacheAcquire(C, linearProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL);
+
+    clHighlightScan scan;
+    memset(&scan, 0, sizeof(scan));
+    deriveHighlightGeometry(C, &srcPrimaries, linearToXYZ, &scan.geometry);
+
+    memset(outStats, 0, sizeof(clImageHDRStats));
+    int pixelCount = outStats->pixelCount = srcImage->width * srcImage->height;
+
+    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
+
+    float measuredPeakLuminance = clImagePeakLuminance(C, srcImage);
+
+    float * xyzPixels = clAllocate(3 * sizeof(float) * pixelCount);
+    clTransformRun(C, toXYZ, srcImage->pixelsF32, xyzPixels, pixelCount);
+
+    clImage * highlight = NULL;
+    if (outImage) {
+        clContextLog(C, "highlight", 1, "Creating sRGB highlight (%d nits, %s)...", srgbLuminance, clTransformCMMName(C, toXYZ));
+
+        highlight = clImageCreate(C, srcImage->width, srcImage->height, 8, NULL);
+        *outImage = highlight;
+
+        clImagePrepareWritePixels(C, highlight, CL_PIXELFORMAT_U16);
+    }
 
     if (outQuantization) {
-        qsort(saturationForPercentiles, pixelCount, sizeof(float), compareFloats);
-        qsort(nitsForPercentiles, pixelCount, sizeof(float), compareFloats);
+        memset(outQuantization, 0, sizeof(clImageHDRQuantization));
+    }
+
+    scan.xyzPixels = xyzPixels;
+    scan.whiteX = srcPrimaries.white[0];
+    scan.whiteY = srcPrimaries.white[1];
+    scan.srgbLuminance = (float)srgbLuminance;
+    scan.overbrightScale = measuredPeakLuminance * srcCurve.implicitScale / (float)srgbLuminance;
+    scan.satLuminance = satLuminance;
+    scan.relativeScale = 1.0f / ((float)srcLuminance * srcCurve.implicitScale);
+    scan.highlightPixels = highlight ? highlight->pixelsU16 : NULL;
+    scan.pixelInfo = outPixelInfo ? outPixelInfo->pixels : NULL;
+    scan.quantize = (outQuantization != NULL);
+
+    // Bands are whole rows, a few per job so an uneven image still spreads across the pool
+    int rowsPerBand = CL_MAX(srcImage->height / CL_MAX(C->jobs * 4, 1), 1);
+    int bandCount = CL_MAX((srcImage->height + rowsPerBand - 1) / rowsPerBand, 1);
+    clHighlightBand * bands = clAllocate(sizeof(clHighlightBand) * bandCount);
+    memset(bands, 0, sizeof(clHighlightBand) * bandCount);
+    for (int i = 0; i < bandCount; ++i) {
+        int firstRow = i * rowsPerBand;
+        int rowCount = CL_CLAMP(srcImage->height - firstRow, 0, rowsPerBand);
+        bands[i].scan = &scan;
+        bands[i].firstIndex = firstRow * srcImage->width;
+        bands[i].count = rowCount * srcImage->width;
+    }
+    if (bandCount == 1) {
+        highlightBandFunc(bands, 0);
+    } else {
+        clTaskParallelFor(C, bandCount, (clTaskIndexFunc)highlightBandFunc, bands);
+    }
 
-        for (int i = 0; i < 100; ++i) {
+    // Merge in band order so ties for the brightest pixel still go to the first one in scan order
+    clPercentileHistogram * nitsPercentiles = NULL;
+    clPercentileHistogram * saturationPercentiles = NULL;
+    if (outQuantization) {
+        nitsPercentiles = clAllocateStruct(clPercentileHistogram);
+        saturationPercentiles = clAllocateStruct(clPercentileHistogram);
+        percentileHistogramReset(nitsPercentiles);
+        percentileHistogramReset(saturationPercentiles);
+    }
+    for (int i = 0; i < bandCount; ++i) {
+        const clHighlightBand * band = &bands[i];
+        outStats->overbrightPixelCount += band->overbrightPixelCount;
+        outStats->outOfGamutPixelCount += band->outOfGamutPixelCount;
+        outStats->bothPixelCount += band->bothPixelCount;
+        if (outStats->brightestPixelNits < band->brightestPixelNits) {
+            outStats->brightestPixelNits = band->brightestPixelNits;
+            outStats->brightestPixelX = band->brightestPixelIndex % srcImage->width;
+            outStats->brightestPixelY = band->brightestPixelIndex / srcImage->width;
+        }
+        if (outQuantization) {
+            for (int bucket = 0; bucket < CL_QUANTIZATION_BUCKET_COUNT; ++bucket) {
+                outQuantization->pixelCountsNitsPQ[bucket] += band->pixelCountsNitsPQ[bucket];
+                outQuantization->pixelCountsSaturation[bucket] += band->pixelCountsSaturation[bucket];
+            }
+            percentileHistogramMerge(nitsPercentiles, &band->nitsPercentiles);
+            percentileHistogramMerge(saturationPercentiles, &band->saturationPercentiles);
+        }
+    }
+    outStats->hdrPixelCount = outStats->bothPixelCount + outStats->overbrightPixelCount + outStats->outOfGamutPixelCount;
+
+    if (outQuantization && (pixelCount > 0)) {
+        clPercentilePlan * nitsPlan = clAllocateStruct(clPercentilePlan);
+        clPercentilePlan * saturationPlan = clAllocateStruct(clPercentilePlan);
+        planPercentiles(C, nitsPlan, nitsPercentiles, pixelCount);
+        planPercentiles(C, saturationPlan, saturationPercentiles, pixelCount);
+
+        // Second pass, over the same bands
+        int nitsCursors[CL_PERCENTILE_COUNT];
+        int saturationCursors[CL_PERCENTILE_COUNT];
+        for (int slot = 0; slot < nitsPlan->targetCount; ++slot) {
+            nitsCursors[slot] = nitsPlan->gatherStart[nitsPlan->targets[slot]];
+        }
+        for (int slot = 0; slot < saturationPlan->targetCount; ++slot) {
+            saturationCursors[slot] = saturationPlan->gatherStart[saturationPlan->targets[slot]];
+        }
+        for (int i = 0; i < bandCount; ++i) {
+            beginGather(&bands[i].nitsGather, nitsPlan, &bands[i].nitsPercentiles, nitsCursors);
+            beginGather(&bands[i].saturationGather, saturationPlan, &bands[i].saturationPercentiles, saturationCursors);
+        }
+        if (bandCount == 1) {
+            gatherBandFunc(bands, 0);
+        } else {
+            clTaskParallelFor(C, bandCount, (clTaskIndexFunc)gatherBandFunc, bands);
+        }
+        for (int i = 0; i < bandCount; ++i) {
+            endGather(nitsPlan, &bands[i].nitsGather);
+            endGather(saturationPlan, &bands[i].saturationGather);
+        }
+
+        for (int i = 0; i < CL_PERCENTILE_COUNT; ++i) {
             clImageHDRPercentile * percentile = &outQuantization->percentiles[i];
-            int percentileIndex = (int)((float)i * (float)pixelCount / 100.0f);
-            percentile->saturation = saturationForPercentiles[percentileIndex];
-            percentile->nits = nitsForPercentiles[percentileIndex];
+            percentile->nits = resolvePercentile(nitsPlan, i, pixelCount);
+            percentile->saturation = resolvePercentile(saturationPlan, i, pixelCount);
         }
-        clImageHDRPercentile * topPercentile = &outQuantization->percentiles[100];
-        topPercentile->saturation = saturationForPercentiles[pixelCount - 1];
-        topPercentile->nits = nitsForPercentiles[pixelCount - 1];
 
-        clFree(saturationForPercentiles);
-        clFree(nitsForPercentiles);
+        finishPercentiles(C, nitsPlan);
+        finishPercentiles(C, saturationPlan);
+        clFree(nitsPlan);
+        clFree(saturationPlan);
+    }
+    clFree(bands);
+    if (outQuantization) {
+        clFree(nitsPercentiles);
+        clFree(saturationPercentiles);
     }
 
-    clTransformDestroy(C, linearToXYZ);
-    clTransformDestroy(C, linearFromXYZ);
+    clTransformCacheRelease(C, linearToXYZ);
     clProfileDestroy(C, linearProfile);
 
-    clTransformDestroy(C, fromXYZ);
-    clTransformDestroy(C, toXYZ);
+    clTransformCacheRelease(C, toXYZ);
     clFree(xyzPixels);
 }
@@ -749,7 +749,7 @@ clImage * clImageParseString(struct clContext * C, const char * str, int depth,
     char * buffer = clContextStrdup(C, str);
     const char * stripeDelims = "|/";
     char * stripeString;
-    clTransform * fromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, profile, CL_XF_RGB, CL_TONEMAP_OFF);
+    clTransform * fromXYZ = clTransformCacheAcquire(C, NULL, CL_XF_XYZ, profile, CL_XF_RGB, CL_TONEMAP_OFF, NULL);
     int luminance = 0;
 
     clContextLog(C, "parse", 0, "Parsing image string (%s)...", clTransformCMMName(C, fromXYZ));
@@ -826,7 +826,7 @@ parseCleanup:
         clFree(deleteme);
     }
     clFree(buffer);
-    clTransformDestroy(C, fromXYZ);
+    clTransformCacheRelease(C, fromXYZ);
     return image;
 }
 
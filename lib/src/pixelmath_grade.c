@@ -6,11 +6,14 @@
 #include "colorist/transform.h"
 
 #include <math.h>
+#include <string.h>
 
-// (1.0 - 4.0) by 0.05
-#define GAMMA_RANGE_START 20
-#define GAMMA_RANGE_END 80
-#define GAMMA_INT_DIVISOR 20.0f
+// Autograde picks a gamma in this range
+#define GAMMA_RANGE_MIN 1.0f
+#define GAMMA_RANGE_MAX 4.0f
+
+// CL_GRADESEARCH_GOLDEN brackets the minimum with this many evenly spaced candidates (0.5 apart) before refining
+#define GAMMA_COARSE_COUNT 7
 
 // NOTE: This is a work in progress. There are probably lots of problems with this.
 
@@ -49,53 +52,273 @@ float clPixelMathRoundNormalized(float normalizedValue, float factor)
     return clPixelMathRoundf(normalizedValue * factor);
 }
 
-static float gammaErrorTerm(float gamma, float * pixels, int pixelCount, float maxChannel, float luminanceScale)
+// The gamma search scores a histogram of the scaled (and clamped) channel values instead of the pixels, so building
+// the histogram is the only pass over the image and the candidates cost the same however large the image is.
+// Buckets are spaced evenly in sqrt(value), which keeps the levels near black (where gamma matters most) apart. A
+// bucket whose values all fall within one quantization step is scored at their mean; a wider one (and with deep
+// destinations, buckets span many steps) is scored as values spread evenly over its steps, which average a quarter
+// step of error. Scoring those at a single point too would alias the bucket grid against the quantization grid.
+#define GRADE_HISTOGRAM_BUCKETS 16384
+
+typedef struct clGradeBucket
 {
-    float invGamma = 1.0f / gamma;
-    float errorTerm = 0.0f;
-    float * pixel = pixels;
+    float mean;
+    float spread; // max - min of the values in it
+    float count;
+} clGradeBucket;
 
-    for (int i = 0; i < pixelCount; ++i) {
-        float channelErrorTerm;
-        float scaledChannel;
+typedef struct clGradeHistogramBand
+{
+    const float * pixels;
+    int pixelCount;
+    int sampleStep;
+    float luminanceScale;
+    uint32_t * counts; // GRADE_HISTOGRAM_BUCKETS of each
+    double * sums;
+    float * mins;
+    float * maxs;
+} clGradeHistogramBand;
 
-        scaledChannel = pixel[0] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
+static void gradeHistogramBandFunc(clGradeHistogramBand * bands, int index)
+{
+    clGradeHistogramBand * band = &bands[index];
+    memset(band->counts, 0, sizeof(uint32_t) * GRADE_HISTOGRAM_BUCKETS);
+    memset(band->sums, 0, sizeof(double) * GRADE_HISTOGRAM_BUCKETS);
+    for (int bucket = 0; bucket < GRADE_HISTOGRAM_BUCKETS; ++bucket) {
+        band->mins[bucket] = 1.0f;
+        band->maxs[bucket] = 0.0f;
+    }
 
-        scaledChannel = pixel[1] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
+    for (int i = 0; i < band->pixelCount; i += band->sampleStep) {
+        const float * pixel = &band->pixels[i * 4];
+        for (int channel = 0; channel < 3; ++channel) {
+            float scaledChannel = pixel[channel] * band->luminanceScale;
+            scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
+            int bucket = (int)(sqrtf(scaledChannel) * (float)GRADE_HISTOGRAM_BUCKETS);
+            bucket = CL_MIN(bucket, GRADE_HISTOGRAM_BUCKETS - 1);
+            ++band->counts[bucket];
+            band->sums[bucket] += scaledChannel;
+            band->mins[bucket] = CL_MIN(band->mins[bucket], scaledChannel);
+            band->maxs[bucket] = CL_MAX(band->maxs[bucket], scaledChannel);
+        }
+    }
+}
 
-        scaledChannel = pixel[2] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
+// Fills buckets with the non-empty ones and returns how many there are. outDiscrete is set when every bucket holds a
+// single value, as with integer sources.
+static int buildGradeHistogram(struct clContext * C,
+                               const float * pixels,
+                               int pixelCount,
+                               int sampleStep,
+                               float luminanceScale,
+                               clGradeBucket * buckets,
+                               clBool * outDiscrete)
+{
+    int bandCount = CL_CLAMP(C->jobs, 1, CL_MAX(pixelCount, 1));
+    int pixelsPerBand = pixelCount / bandCount;
+    size_t bucketTotal = (size_t)GRADE_HISTOGRAM_BUCKETS * bandCount;
+    clGradeHistogramBand * bands = clAllocate(sizeof(clGradeHistogramBand) * bandCount);
+    uint32_t * counts = clAllocate(sizeof(uint32_t) * bucketTotal);
+    double * sums = clAllocate(sizeof(double) * bucketTotal);
+    float * mins = clAllocate(sizeof(float) * bucketTotal);
+    float * maxs = clAllocate(sizeof(float) * bucketTotal);
+    for (int i = 0; i < bandCount; ++i) {
+        size_t offset = (size_t)i * GRADE_HISTOGRAM_BUCKETS;
+        bands[i].pixels = &pixels[(size_t)i * pixelsPerBand * 4];
+        bands[i].pixelCount = (i == (bandCount - 1)) ? (pixelCount - (i * pixelsPerBand)) : pixelsPerBand;
+        bands[i].sampleStep = sampleStep;
+        bands[i].luminanceScale = luminanceScale;
+        bands[i].counts = &counts[offset];
+        bands[i].sums = &sums[offset];
+        bands[i].mins = &mins[offset];
+        bands[i].maxs = &maxs[offset];
+    }
+    clTaskParallelFor(C, bandCount, (clTaskIndexFunc)gradeHistogramBandFunc, bands);
 
-        pixel += 4;
+    int usedCount = 0;
+    *outDiscrete = clTrue;
+    for (int bucket = 0; bucket < GRADE_HISTOGRAM_BUCKETS; ++bucket) {
+        uint64_t count = 0;
+        double sum = 0.0;
+        float bucketMin = 1.0f;
+        float bucketMax = 0.0f;
+        for (int i = 0; i < bandCount; ++i) {
+            count += bands[i].counts[bucket];
+            sum += bands[i].sums[bucket];
+            bucketMin = CL_MIN(bucketMin, bands[i].mins[bucket]);
+            bucketMax = CL_MAX(bucketMax, bands[i].maxs[bucket]);
+        }
+        if (count > 0) {
+            buckets[usedCount].mean = (float)(sum / (double)count);
+            buckets[usedCount].spread = bucketMax - bucketMin;
+            buckets[usedCount].count = (float)count;
+            if (bucketMax > bucketMin) {
+                *outDiscrete = clFalse;
+            }
+            ++usedCount;
+        }
     }
-    return errorTerm;
+
+    clFree(maxs);
+    clFree(mins);
+    clFree(sums);
+    clFree(counts);
+    clFree(bands);
+    return usedCount;
+}
+
+// Sum of every channel's error; outSumSquares (if set) gets the sum of their squares
+static float gammaErrorTerm(float gamma, const clGradeBucket * buckets, int bucketCount, float maxChannel, double * outSumSquares)
+{
+    float invGamma = 1.0f / gamma;
+    float halfStep = 0.5f / maxChannel;
+    double errorTerm = 0.0;
+    double sumSquares = 0.0;
+
+    for (int i = 0; i < bucketCount; ++i) {
+        float scaledChannel = buckets[i].mean;
+        float encoded = powf(scaledChannel, invGamma);
+
+        // Width (in linear) of the quantization step the mean falls in
+        float stepLow = encoded - halfStep;
+        float stepHigh = encoded + halfStep;
+        float stepWidth = powf(CL_MIN(stepHigh, 1.0f), gamma) - powf(CL_MAX(stepLow, 0.0f), gamma);
+
+        float channelErrorTerm;
+        if (buckets[i].spread > stepWidth) {
+            channelErrorTerm = stepWidth * 0.25f;
+        } else {
+            channelErrorTerm = fabsf(scaledChannel - powf(clPixelMathRoundf(encoded * maxChannel) / maxChannel, gamma));
+        }
+        errorTerm += channelErrorTerm * buckets[i].count;
+        sumSquares += channelErrorTerm * channelErrorTerm * buckets[i].count;
+    }
+    if (outSumSquares) {
+        *outSumSquares = sumSquares;
+    }
+    return (float)errorTerm;
 }
 
 typedef struct clGammaErrorTermTask
 {
-    int gammaInt;
     float gamma;
-    float * pixels;
-    int pixelCount;
+    const clGradeBucket * buckets;
+    int bucketCount;
     float maxChannel;
-    float luminanceScale;
     float outErrorTerm;
 } clGammaErrorTermTask;
 
-static void gammaErrorTermTaskFunc(clGammaErrorTermTask * info)
+static void gammaErrorTermTaskFunc(clGammaErrorTermTask * infos, int index)
+{
+    clGammaErrorTermTask * info = &infos[index];
+    info->outErrorTerm = gammaErrorTerm(info->gamma, info->buckets, info->bucketCount, info->maxChannel, NULL);
+}
+
+typedef struct clGammaSearch
+{
+    struct clContext * C;
+    const clGradeBucket * buckets;
+    int bucketCount;
+    float maxChannel;
+    clBool verbose;
+    int evaluations;
+    float bestGamma;
+    float bestErrorTerm; // < 0 until a candidate has been scored
+} clGammaSearch;
+
+static void noteGamma(clGammaSearch * search, float gamma, float errorTerm)
+{
+    ++search->evaluations;
+    if ((search->bestErrorTerm < 0.0f) || (search->bestErrorTerm > errorTerm)) {
+        search->bestErrorTerm = errorTerm;
+        search->bestGamma = gamma;
+    }
+    if (search->verbose)
+        clContextLog(search->C,
+                     "grading",
+                     2,
+                     "attempt: gamma %.4g, err: %g     best -> gamma: %.4g, err: %g",
+                     gamma,
+                     errorTerm,
+                     search->bestGamma,
+                     search->bestErrorTerm);
+}
+
+static float scoreGamma(clGammaSearch * search, float gamma)
+{
+    float errorTerm = gammaErrorTerm(gamma, search->buckets, search->bucketCount, search->maxChannel, NULL);
+    noteGamma(search, gamma, errorTerm);
+    return errorTerm;
+}
+
+// Independent candidates all go to the pool at once, and it balances them
+static void scoreGammas(clGammaSearch * search, const float * gammas, int count)
+{
+    struct clContext * C = search->C;
+    clGammaErrorTermTask * infos = clAllocate(count * sizeof(clGammaErrorTermTask));
+    for (int i = 0; i < count; ++i) {
+        infos[i].gamma = gammas[i];
+        infos[i].buckets = search->buckets;
+        infos[i].bucketCount = search->bucketCount;
+        infos[i].maxChannel = search->maxChannel;
+        infos[i].outErrorTerm = 0;
+    }
+    clTaskParallelFor(C, count, (clTaskIndexFunc)gammaErrorTermTaskFunc, infos);
+    for (int i = 0; i < count; ++i) {
+        noteGamma(search, infos[i].gamma, infos[i].outErrorTerm);
+    }
+    clFree(infos);
+}
+
+// Every multiple of precision across the range
+static void sweepGamma(clGammaSearch * search, float precision)
 {
-    info->outErrorTerm = gammaErrorTerm(info->gamma, info->pixels, info->pixelCount, info->maxChannel, info->luminanceScale);
+    struct clContext * C = search->C;
+    int count = (int)(((GAMMA_RANGE_MAX - GAMMA_RANGE_MIN) / precision) + 0.5f) + 1;
+    float * gammas = clAllocate(count * sizeof(float));
+    for (int i = 0; i < count; ++i) {
+        gammas[i] = CL_MIN(GAMMA_RANGE_MIN + (i * precision), GAMMA_RANGE_MAX);
+    }
+    scoreGammas(search, gammas, count);
+    clFree(gammas);
+}
+
+// A coarse sweep brackets the minimum, then golden-section steps narrow the bracket (one candidate each) until it
+// is under precision or the budget runs out. The error is only roughly unimodal at fine scales, so the answer is the
+// best candidate seen rather than the bracket's center.
+static void goldenGamma(clGammaSearch * search, float precision, int maxIterations)
+{
+    const float coarseStep = (GAMMA_RANGE_MAX - GAMMA_RANGE_MIN) / (GAMMA_COARSE_COUNT - 1);
+    float coarse[GAMMA_COARSE_COUNT];
+    for (int i = 0; i < GAMMA_COARSE_COUNT; ++i) {
+        coarse[i] = GAMMA_RANGE_MIN + (i * coarseStep);
+    }
+    scoreGammas(search, coarse, GAMMA_COARSE_COUNT);
+
+    int coarseBest = (int)clPixelMathRoundf((search->bestGamma - GAMMA_RANGE_MIN) / coarseStep);
+    float lo = coarse[CL_MAX(coarseBest - 1, 0)];
+    float hi = coarse[CL_MIN(coarseBest + 1, GAMMA_COARSE_COUNT - 1)];
+
+    const float invPhi = 0.6180340f;
+    float x1 = hi - (invPhi * (hi - lo));
+    float x2 = lo + (invPhi * (hi - lo));
+    float f1 = scoreGamma(search, x1);
+    float f2 = scoreGamma(search, x2);
+    for (int iteration = 2; ((hi - lo) > precision) && (iteration < maxIterations); ++iteration) {
+        if (f1 <= f2) {
+            hi = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = hi - (invPhi * (hi - lo));
+            f1 = scoreGamma(search, x1);
+        } else {
+            lo = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = lo + (invPhi * (hi - lo));
+            f2 = scoreGamma(search, x2);
+        }
+    }
 }
 
 void clPixelMathColorGrade(struct clContext * C,
@@ -103,8 +326,10 @@ void clPixelMathColorGrade(struct clContext * C,
                            float * pixels,
                            int pixelCount,
                            int imageWidth,
+                           int largestChannelIndex,
                            int srcLuminance,
                            int dstColorDepth,
+                           const clGradeParams * gradeParams,
                            int * outLuminance,
                            float * outGamma,
                            clBool verbose)
@@ -122,23 +347,34 @@ void clPixelMathColorGrade(struct clContext * C,
         int pixelX, pixelY;
         float pixelLuminance, maxLuminanceFloat;
 
-        clTransform * toXYZ = clTransformCreate(C, pixelProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+        clTransform * toXYZ = clTransformCacheAcquire(C, pixelProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL);
 
-        pixel = pixels;
-        for (int i = 0; i < pixelCount; ++i) {
-            if (maxChannel < pixel[0]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[0];
-            }
-            if (maxChannel < pixel[1]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[1];
+        if ((largestChannelIndex >= 0) && (largestChannelIndex < pixelCount)) {
+            // Already known (from cached image stats), just read it back
+            indexWithMaxChannel = largestChannelIndex;
+            pixel = &pixels[indexWithMaxChannel * 4];
+            for (int channel = 0; channel < 3; ++channel) {
+                if (maxChannel < pixel[channel]) {
+                    maxChannel = pixel[channel];
+                }
             }
-            if (maxChannel < pixel[2]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[2];
+        } else {
+            pixel = pixels;
+            for (int i = 0; i < pixelCount; ++i) {
+                if (maxChannel < pixel[0]) {
+                    indexWithMaxChannel = i;
+                    maxChannel = pixel[0];
+                }
+                if (maxChannel < pixel[1]) {
+                    indexWithMaxChannel = i;
+                    maxChannel = pixel[1];
+                }
+                if (maxChannel < pixel[2]) {
+                    indexWithMaxChannel = i;
+                    maxChannel = pixel[2];
+                }
+                pixel += 4;
             }
-            pixel += 4;
         }
 
         clTransformRun(C, toXYZ, &pixels[indexWithMaxChannel * 4], xyz, 1);
@@ -154,7 +390,7 @@ void clPixelMathColorGrade(struct clContext * C,
         maxLuminanceFloat = xyz[1];
         maxLuminance = (int)clPixelMathRoundf(maxLuminanceFloat);
 
-        clTransformDestroy(C, toXYZ);
+        clTransformCacheRelease(C, toXYZ);
 
         clContextLog(C,
                      "grading",
@@ -171,61 +407,90 @@ void clPixelMathColorGrade(struct clContext * C,
 
     // Find best gamma
     if (*outGamma <= 0.0f) {
+        clGradeParams defaultParams;
+        if (!gradeParams) {
+            clGradeParamsSetDefaults(C, &defaultParams);
+            gradeParams = &defaultParams;
+        }
+        float precision = CL_CLAMP(gradeParams->precision, CL_GRADE_MIN_PRECISION, GAMMA_RANGE_MAX - GAMMA_RANGE_MIN);
+        int sampleStep = CL_MAX(gradeParams->sampleStep, 1);
         float luminanceScale = (float)srcLuminance / maxLuminance;
-        int gammaInt;
-        int minGammaInt = 0;
-        float minErrorTerm = -1.0f;
-        float maxChannel = (float)((1 << dstColorDepth) - 1);
-        clTask ** tasks;
-        clGammaErrorTermTask * infos;
-        int tasksInFlight = 0;
         int taskCount = C->jobs;
 
         clContextLog(C, "grading", 1, "Using %d thread%s to find best gamma.", taskCount, (taskCount == 1) ? "" : "s");
 
-        tasks = clAllocate(taskCount * sizeof(clTask *));
-        infos = clAllocate(taskCount * sizeof(clGammaErrorTermTask));
-        for (gammaInt = GAMMA_RANGE_START; gammaInt <= GAMMA_RANGE_END; ++gammaInt) {
-            float gammaAttempt = (float)gammaInt / GAMMA_INT_DIVISOR;
-
-            infos[tasksInFlight].gammaInt = gammaInt;
-            infos[tasksInFlight].gamma = gammaAttempt;
-            infos[tasksInFlight].pixels = pixels;
-            infos[tasksInFlight].pixelCount = pixelCount;
-            infos[tasksInFlight].maxChannel = maxChannel;
-            infos[tasksInFlight].luminanceScale = luminanceScale;
-            infos[tasksInFlight].outErrorTerm = 0;
-            tasks[tasksInFlight] = clTaskCreate(C, (clTaskFunc)gammaErrorTermTaskFunc, &infos[tasksInFlight]);
-            ++tasksInFlight;
-
-            if ((tasksInFlight == taskCount) || (gammaInt == GAMMA_RANGE_END)) {
-                for (int i = 0; i < tasksInFlight; ++i) {
-                    clTaskJoin(C, tasks[i]);
-                    if (minErrorTerm < 0.0f) {
-                        minErrorTerm = infos[i].outErrorTerm;
-                        minGammaInt = infos[i].gammaInt;
-                    } else if (minErrorTerm > infos[i].outErrorTerm) {
-                        minErrorTerm = infos[i].outErrorTerm;
-                        minGammaInt = infos[i].gammaInt;
-                    }
-                    if (verbose)
-                        clContextLog(C,
-                                     "grading",
-                                     2,
-                                     "attempt: gamma %.3g, err: %g     best -> gamma: %g, err: %g",
-                                     infos[i].gamma,
-                                     infos[i].outErrorTerm,
-                                     (float)minGammaInt / GAMMA_INT_DIVISOR,
-                                     minErrorTerm);
-                    clTaskDestroy(C, tasks[i]);
-                }
-                tasksInFlight = 0;
+        clGradeBucket * buckets = clAllocate(sizeof(clGradeBucket) * GRADE_HISTOGRAM_BUCKETS);
+        clBool discrete = clFalse;
+        int bucketCount = buildGradeHistogram(C, pixels, pixelCount, sampleStep, luminanceScale, buckets, &discrete);
+        clContextLog(C, "grading", 1, "Scoring %d histogram buckets per gamma.", bucketCount);
+
+        // A few exact levels (an integer source) can roundtrip perfectly at their own encoding gamma, a minimum
+        // far sharper than anything around it that a bracketing search steps right over, and often nowhere near the
+        // coarse grid's best (so sweeping just that bracket misses it too). Those always get the full sweep. With at
+        // most 4096 buckets that is cheap: at the default precision, ~0.1 sec on one thread for a 12-bit source and
+        // ~6 ms for an 8-bit one, next to ~0.8 sec to build the histogram of a 12 MP image.
+        clGradeSearch searchType = gradeParams->search;
+        if ((searchType == CL_GRADESEARCH_GOLDEN) && discrete) {
+            clContextLog(C, "grading", 1, "Histogram is %d discrete levels, sweeping instead.", bucketCount);
+            searchType = CL_GRADESEARCH_SWEEP;
+        }
+
+        Timer t;
+        timerStart(&t);
+        clGammaSearch search;
+        search.C = C;
+        search.buckets = buckets;
+        search.bucketCount = bucketCount;
+        search.maxChannel = (float)((1 << dstColorDepth) - 1);
+        search.verbose = verbose;
+        search.evaluations = 0;
+        search.bestGamma = GAMMA_RANGE_MIN;
+        search.bestErrorTerm = -1.0f;
+        if (searchType == CL_GRADESEARCH_SWEEP) {
+            sweepGamma(&search, precision);
+        } else {
+            goldenGamma(&search, precision, CL_MAX(gradeParams->maxIterations, 2));
+        }
+
+        if (searchType == CL_GRADESEARCH_SWEEP) {
+            bestGamma = search.bestGamma;
+        } else {
+            // Report a gamma on the sweep's grid, like a sweep would. Golden-section candidates fall between grid
+            // points, so both grid points around the best one are scored and the better one wins.
+            float below = GAMMA_RANGE_MIN + (clPixelMathFloorf((search.bestGamma - GAMMA_RANGE_MIN) / precision) * precision);
+            float above = CL_MIN(below + precision, GAMMA_RANGE_MAX);
+            float belowErrorTerm = scoreGamma(&search, below);
+            float aboveErrorTerm = scoreGamma(&search, above);
+            bestGamma = (belowErrorTerm <= aboveErrorTerm) ? below : above;
+        }
+        clContextLog(C,
+                     "grading",
+                     1,
+                     "Found best gamma: %g (%s search, %d candidates, %.3f sec)",
+                     bestGamma,
+                     clGradeSearchToString(C, searchType),
+                     search.evaluations,
+                     timerElapsedSeconds(&t));
+
+        if ((sampleStep > 1) && (bucketCount > 0)) {
+            // The histogram only saw some of the pixels: bound how far the mean error could be from the whole image's
+            double channelCount = 0.0;
+            for (int i = 0; i < bucketCount; ++i) {
+                channelCount += buckets[i].count;
             }
+            double sumSquares = 0.0;
+            double meanError = gammaErrorTerm(bestGamma, buckets, bucketCount, search.maxChannel, &sumSquares) / channelCount;
+            double variance = CL_MAX((sumSquares / channelCount) - (meanError * meanError), 0.0);
+            double errorBound = 1.96 * sqrt(variance / channelCount);
+            clContextLog(C,
+                         "grading",
+                         1,
+                         "Sampled 1 in %d pixels: mean channel error %g, within %g of the full image's (95%% confidence)",
+                         sampleStep,
+                         meanError,
+                         errorBound);
         }
-        bestGamma = (float)minGammaInt / GAMMA_INT_DIVISOR;
-        clContextLog(C, "grading", 1, "Found best gamma: %g", bestGamma);
-        clFree(tasks);
-        clFree(infos);
+        clFree(buckets);
     } else {
         bestGamma = *outGamma;
         clContextLog(C, "grading", 1, "Using requested gamma: %g", bestGamma);
@@ -628,6 +628,82 @@ void clProfileQueryYUVCoefficients(struct clContext * C, clProfile * profile, cl
     yuv->kg = 1.0f - yuv->kr - yuv->kb;
 }
 
+clBool clProfileGamutCeilingFromColorants(struct clContext * C, const float colorants[3][3], clProfileGamutCeiling * ceiling)
+{
+    COLORIST_UNUSED(C);
+
+    memset(ceiling, 0, sizeof(clProfileGamutCeiling));
+
+    // fromXYZ is the inverse of the matrix whose columns are the colorants, via its adjugate
+    float fromXYZ[3][3];
+    for (int row = 0; row < 3; ++row) {
+        int a = (row + 1) % 3;
+        int b = (row + 2) % 3;
+        for (int axis = 0; axis < 3; ++axis) {
+            int u = (axis + 1) % 3;
+            int v = (axis + 2) % 3;
+            fromXYZ[row][axis] = (colorants[a][u] * colorants[b][v]) - (colorants[a][v] * colorants[b][u]);
+        }
+    }
+    float determinant = (colorants[0][0] * fromXYZ[0][0]) + (colorants[0][1] * fromXYZ[0][1]) + (colorants[0][2] * fromXYZ[0][2]);
+    if (!(fabsf(determinant) > 1e-6f)) {
+        // Collinear (or NaN) colorants, as from a malformed profile: leave the ceiling at 0 everywhere
+        return clFalse;
+    }
+
+    // XYZ of xyY (x, y, 1) scaled by y is (x, y, 1 - x - y)
+    for (int channel = 0; channel < 3; ++channel) {
+        float fromX = fromXYZ[channel][0] / determinant;
+        float fromY = fromXYZ[channel][1] / determinant;
+        float fromZ = fromXYZ[channel][2] / determinant;
+        ceiling->channelCoeffs[channel][0] = fromX - fromZ;
+        ceiling->channelCoeffs[channel][1] = fromY - fromZ;
+        ceiling->channelCoeffs[channel][2] = fromZ;
+        ceiling->channelLuminances[channel] = colorants[channel][1];
+    }
+    return clTrue;
+}
+
+float clProfileGamutCeilingMaxY(const clProfileGamutCeiling * ceiling, float x, float y)
+{
+    // Scale until the largest channel hits 1. Out of gamut channels are clamped at 0 the way the transforms clamp
+    // them, and the Y of what's left is the answer.
+    float maxChannel = 0.0f;
+    float luminance = 0.0f;
+    for (int channel = 0; channel < 3; ++channel) {
+        const float * coeffs = ceiling->channelCoeffs[channel];
+        float value = (coeffs[0] * x) + (coeffs[1] * y) + coeffs[2];
+        maxChannel = (channel == 0) ? value : CL_MAX(maxChannel, value);
+        luminance += ceiling->channelLuminances[channel] * CL_MAX(value, 0.0f);
+    }
+    if (maxChannel <= 0.0f) {
+        // A failed ceiling (or primaries outside of the visible gamut)
+        return 0.0f;
+    }
+    return luminance / maxChannel;
+}
+
+clBool clProfileQueryGamutCeiling(struct clContext * C, clProfile * profile, clProfileGamutCeiling * ceiling)
+{
+    clProfilePrimaries primaries;
+    if (!profile || !clProfileQuery(C, profile, &primaries, NULL, NULL)) {
+        return clFalse;
+    }
+
+    gbMat3 toXYZ;
+    clTransformDeriveXYZMatrix(C, &primaries, &toXYZ);
+
+    float colorants[3][3];
+    for (int channel = 0; channel < 3; ++channel) {
+        gbVec3 rgb = { { 0.0f, 0.0f, 0.0f } };
+        gbVec3 XYZ;
+        rgb.e[channel] = 1.0f;
+        gb_mat3_mul_vec3(&XYZ, &toXYZ, rgb);
+        memcpy(colorants[channel], XYZ.e, sizeof(colorants[channel]));
+    }
+    return clProfileGamutCeilingFromColorants(C, colorants, ceiling);
+}
+
 char * clProfileGetMLU(struct clContext * C, clProfile * profile, const char tag[5], const char languageCode[3], const char countryCode[3])
 {
     cmsTagSignature tagSignature;
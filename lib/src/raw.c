@@ -15,17 +15,31 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 void clRawRealloc(struct clContext * C, clRaw * raw, size_t newSize)
 {
-    if (raw->size != newSize) {
-        uint8_t * old = raw->ptr;
-        size_t oldSize = raw->size;
+    if ((raw->size != newSize) || raw->borrowed) {
+        clRaw old = *raw;
         raw->ptr = clAllocate(newSize);
         raw->size = newSize;
-        if (oldSize) {
-            size_t bytesToCopy = (oldSize < raw->size) ? oldSize : raw->size;
-            memcpy(raw->ptr, old, bytesToCopy);
-            clFree(old);
+        raw->borrowed = clFalse;
+        raw->release = NULL;
+        raw->releaseOwner = NULL;
+        if (old.size) {
+            size_t bytesToCopy = (old.size < raw->size) ? old.size : raw->size;
+            memcpy(raw->ptr, old.ptr, bytesToCopy);
+        }
+        if (old.ptr) {
+            clRawFree(C, &old);
         }
     }
 }
@@ -148,11 +162,98 @@ void clRawSet(struct clContext * C, clRaw * raw, const uint8_t * data, size_t le
 
 void clRawFree(struct clContext * C, clRaw * raw)
 {
-    clFree(raw->ptr);
+    if (raw->borrowed) {
+        if (raw->release && raw->ptr) {
+            raw->release(raw->releaseOwner, raw->ptr);
+        }
+    } else {
+        clFree(raw->ptr);
+    }
     raw->ptr = NULL;
     raw->size = 0;
+    raw->borrowed = clFalse;
+    raw->release = NULL;
+    raw->releaseOwner = NULL;
+}
+
+void clRawBorrow(struct clContext * C, clRaw * raw, uint8_t * ptr, size_t size, clRawReleaseFunc release, void * owner)
+{
+    clRawFree(C, raw);
+    raw->ptr = ptr;
+    raw->size = size;
+    raw->borrowed = clTrue;
+    raw->release = release;
+    raw->releaseOwner = owner;
+}
+
+#ifdef _WIN32
+
+static void unmapFile(void * owner, uint8_t * ptr)
+{
+    COLORIST_UNUSED(owner);
+    UnmapViewOfFile(ptr);
+}
+
+clBool clRawMapFile(struct clContext * C, clRaw * raw, const wchar_t * filename)
+{
+    HANDLE file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return clFalse;
+    }
+    LARGE_INTEGER fileSize;
+    uint8_t * ptr = NULL;
+    if (GetFileSizeEx(file, &fileSize) && (fileSize.QuadPart > 0) && ((uint64_t)fileSize.QuadPart <= SIZE_MAX)) {
+        HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping) {
+            ptr = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+    }
+    CloseHandle(file);
+    if (!ptr) {
+        return clFalse;
+    }
+    clRawBorrow(C, raw, ptr, (size_t)fileSize.QuadPart, unmapFile, NULL);
+    return clTrue;
+}
+
+#else /* ifdef _WIN32 */
+
+static void unmapFile(void * owner, uint8_t * ptr)
+{
+    // owner is the mapped length, which raw->size may no longer match
+    munmap(ptr, (size_t)(uintptr_t)owner);
 }
 
+clBool clRawMapFile(struct clContext * C, clRaw * raw, const wchar_t * filename)
+{
+    size_t pathLength = wcstombs(NULL, filename, 0);
+    if (pathLength == (size_t)-1) {
+        return clFalse;
+    }
+    char * path = clAllocate(pathLength + 1);
+    wcstombs(path, filename, pathLength + 1);
+    int fd = open(path, O_RDONLY);
+    clFree(path);
+    if (fd < 0) {
+        return clFalse;
+    }
+
+    struct stat st;
+    void * ptr = MAP_FAILED;
+    if (!fstat(fd, &st) && (st.st_size > 0) && ((uint64_t)st.st_size <= SIZE_MAX)) {
+        ptr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // the mapping holds its own reference to the file
+    if (ptr == MAP_FAILED) {
+        return clFalse;
+    }
+    clRawBorrow(C, raw, (uint8_t *)ptr, (size_t)st.st_size, unmapFile, (void *)(uintptr_t)st.st_size);
+    return clTrue;
+}
+
+#endif /* ifdef _WIN32 */
+
 clBool clRawReadFile(struct clContext * C, clRaw * raw, const wchar_t * filename)
 {
     long bytes;
@@ -167,6 +268,12 @@ clBool clRawReadFile(struct clContext * C, clRaw * raw, const wchar_t * filename
     bytes = ftell(f);
     fseek(f, 0, SEEK_SET);
 
+    if ((bytes >= CL_RAW_MAP_MIN_BYTES) && clRawMapFile(C, raw, filename)) {
+        // Big inputs are decoded straight from the page cache, rather than from a heap copy of it
+        fclose(f);
+        return clTrue;
+    }
+
     clRawRealloc(C, raw, bytes);
     if (fread(raw->ptr, raw->size, 1, f) != 1) {
         clContextLogError(C, "Failed to read file [%d bytes].", (int)raw->size);
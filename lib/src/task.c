@@ -9,24 +9,344 @@
 
 #include "colorist/context.h"
 
-static void nativeTaskStart(clContext * C, clTask * task);
-static void nativeTaskJoin(clContext * C, clTask * task);
+// Native primitives (implemented per-platform at the bottom of this file)
+static void * nativeMutexCreate(clContext * C);
+static void nativeMutexDestroy(clContext * C, void * mutex);
+static void nativeMutexLock(void * mutex);
+static void nativeMutexUnlock(void * mutex);
+static void * nativeCondCreate(clContext * C);
+static void nativeCondDestroy(clContext * C, void * cond);
+static void nativeCondWait(void * cond, void * mutex);
+static void nativeCondSignal(void * cond);
+static void nativeCondBroadcast(void * cond);
+static void * nativeThreadStart(clContext * C, clTaskFunc func, void * userData);
+static void nativeThreadJoin(clContext * C, void * thread);
 
-clTask * clTaskCreate(struct clContext * C, clTaskFunc func, void * userData)
+// ------------------------------------------------------------------------------------------------
+// clTaskPool
+
+typedef struct clTaskQueue
+{
+    void * lock;
+    clTask ** tasks; // ring buffer: the owning worker pops from the back, everyone else steals from the front
+    int capacity;
+    int head;
+    int count;
+} clTaskQueue;
+
+typedef struct clTaskWorker
+{
+    struct clTaskPool * pool;
+    int queueIndex;
+    void * thread;
+} clTaskWorker;
+
+typedef struct clTaskPool
+{
+    clContext * C;
+    int workerCount;
+    int queueCount; // one per worker, or a single queue when there are no workers
+    clTaskQueue * queues;
+    clTaskWorker * workers;
+
+    void * lock; // guards everything below, as well as every clTask's state
+    void * workAvailable;
+    void * taskFinished;
+    int pendingCount; // tasks sitting in a queue, not yet taken
+    int nextQueue;    // round robin for submissions
+    clBool shutdown;
+} clTaskPool;
+
+#define NOT_A_WORKER -1
+
+static void queuePush(clContext * C, clTaskQueue * queue, clTask * task)
+{
+    nativeMutexLock(queue->lock);
+    if (queue->count == queue->capacity) {
+        int newCapacity = queue->capacity ? (queue->capacity * 2) : 16;
+        clTask ** tasks = clAllocate(sizeof(clTask *) * newCapacity);
+        for (int i = 0; i < queue->count; ++i) {
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+        }
+        if (queue->tasks) {
+            clFree(queue->tasks);
+        }
+        queue->tasks = tasks;
+        queue->capacity = newCapacity;
+        queue->head = 0;
+    }
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = task;
+    ++queue->count;
+    nativeMutexUnlock(queue->lock);
+}
+
+static clTask * queuePopBack(clTaskQueue * queue)
+{
+    clTask * task = NULL;
+    nativeMutexLock(queue->lock);
+    if (queue->count > 0) {
+        --queue->count;
+        task = queue->tasks[(queue->head + queue->count) % queue->capacity];
+    }
+    nativeMutexUnlock(queue->lock);
+    return task;
+}
+
+static clTask * queuePopFront(clTaskQueue * queue)
+{
+    clTask * task = NULL;
+    nativeMutexLock(queue->lock);
+    if (queue->count > 0) {
+        task = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        --queue->count;
+    }
+    nativeMutexUnlock(queue->lock);
+    return task;
+}
+
+static void poolSubmit(clTaskPool * pool, clTask * task)
+{
+    // Pushing under the pool lock keeps pendingCount from ever underreporting a queued task
+    nativeMutexLock(pool->lock);
+    clTaskQueue * queue = &pool->queues[pool->nextQueue];
+    pool->nextQueue = (pool->nextQueue + 1) % pool->queueCount;
+    queuePush(pool->C, queue, task);
+    ++pool->pendingCount;
+    nativeCondSignal(pool->workAvailable);
+    nativeMutexUnlock(pool->lock);
+}
+
+// Workers look in their own queue first, then steal from everyone else. Joining threads only steal.
+static clTask * poolTake(clTaskPool * pool, int ownQueueIndex)
+{
+    clTask * task = NULL;
+    int startIndex = 0;
+    if (ownQueueIndex != NOT_A_WORKER) {
+        task = queuePopBack(&pool->queues[ownQueueIndex]);
+        startIndex = ownQueueIndex + 1;
+    }
+    for (int i = 0; !task && (i < pool->queueCount); ++i) {
+        int queueIndex = (startIndex + i) % pool->queueCount;
+        if (queueIndex != ownQueueIndex) {
+            task = queuePopFront(&pool->queues[queueIndex]);
+        }
+    }
+
+    if (task) {
+        nativeMutexLock(pool->lock);
+        --pool->pendingCount;
+        task->state = CL_TASKSTATE_RUNNING;
+        nativeMutexUnlock(pool->lock);
+    }
+    return task;
+}
+
+static void poolRun(clTaskPool * pool, clTask * task)
+{
+    if (task->indexFunc) {
+        task->indexFunc(task->userData, task->index);
+    } else {
+        task->func(task->userData);
+    }
+
+    // The joining thread may free the task as soon as the lock is released
+    nativeMutexLock(pool->lock);
+    task->state = CL_TASKSTATE_DONE;
+    nativeCondBroadcast(pool->taskFinished);
+    nativeMutexUnlock(pool->lock);
+}
+
+static void workerThreadFunc(void * userData)
+{
+    clTaskWorker * worker = (clTaskWorker *)userData;
+    clTaskPool * pool = worker->pool;
+    for (;;) {
+        clTask * task = poolTake(pool, worker->queueIndex);
+        if (task) {
+            poolRun(pool, task);
+            continue;
+        }
+
+        clBool exitWorker;
+        nativeMutexLock(pool->lock);
+        while (!pool->shutdown && (pool->pendingCount <= 0)) {
+            nativeCondWait(pool->workAvailable, pool->lock);
+        }
+        exitWorker = pool->shutdown && (pool->pendingCount <= 0);
+        nativeMutexUnlock(pool->lock);
+        if (exitWorker) {
+            break;
+        }
+    }
+}
+
+clTaskPool * clTaskPoolCreate(struct clContext * C, int workerCount)
+{
+    clTaskPool * pool = clAllocateStruct(clTaskPool);
+    pool->C = C;
+    pool->workerCount = (workerCount > 0) ? workerCount : 0;
+    pool->queueCount = (pool->workerCount > 0) ? pool->workerCount : 1;
+    pool->queues = clAllocate(sizeof(clTaskQueue) * pool->queueCount);
+    for (int i = 0; i < pool->queueCount; ++i) {
+        clTaskQueue * queue = &pool->queues[i];
+        queue->lock = nativeMutexCreate(C);
+        queue->tasks = NULL;
+        queue->capacity = 0;
+        queue->head = 0;
+        queue->count = 0;
+    }
+    pool->lock = nativeMutexCreate(C);
+    pool->workAvailable = nativeCondCreate(C);
+    pool->taskFinished = nativeCondCreate(C);
+    pool->pendingCount = 0;
+    pool->nextQueue = 0;
+    pool->shutdown = clFalse;
+
+    pool->workers = NULL;
+    if (pool->workerCount > 0) {
+        pool->workers = clAllocate(sizeof(clTaskWorker) * pool->workerCount);
+        for (int i = 0; i < pool->workerCount; ++i) {
+            clTaskWorker * worker = &pool->workers[i];
+            worker->pool = pool;
+            worker->queueIndex = i;
+            worker->thread = nativeThreadStart(C, workerThreadFunc, worker);
+        }
+    }
+    return pool;
+}
+
+void clTaskPoolDestroy(struct clContext * C, clTaskPool * pool)
+{
+    // Workers drain whatever is still queued before exiting
+    nativeMutexLock(pool->lock);
+    pool->shutdown = clTrue;
+    nativeCondBroadcast(pool->workAvailable);
+    nativeMutexUnlock(pool->lock);
+
+    for (int i = 0; i < pool->workerCount; ++i) {
+        nativeThreadJoin(C, pool->workers[i].thread);
+    }
+    if (pool->workers) {
+        clFree(pool->workers);
+    }
+
+    for (int i = 0; i < pool->queueCount; ++i) {
+        clTaskQueue * queue = &pool->queues[i];
+        COLORIST_ASSERT(queue->count == 0);
+        if (queue->tasks) {
+            clFree(queue->tasks);
+        }
+        nativeMutexDestroy(C, queue->lock);
+    }
+    clFree(pool->queues);
+
+    nativeCondDestroy(C, pool->taskFinished);
+    nativeCondDestroy(C, pool->workAvailable);
+    nativeMutexDestroy(C, pool->lock);
+    clFree(pool);
+}
+
+clTaskPool * clContextGetTaskPool(struct clContext * C)
+{
+    // Job contexts share their parent's pool, sized by the parent's -j
+    clContext * root = C->parent ? C->parent : C;
+
+    // The joining thread always helps, so C->jobs threads of work need one fewer worker
+    int workerCount = root->jobs - 1;
+    if (workerCount < 0) {
+        workerCount = 0;
+    }
+
+    clMutexLock(root->lock);
+    if (root->taskPool && (root->taskPool->workerCount != workerCount) && (root->jobCount == 0)) {
+        // -j changed since the pool was made (nothing can be in flight between conversions without job contexts)
+        clTaskPoolDestroy(root, root->taskPool);
+        root->taskPool = NULL;
+    }
+    if (!root->taskPool) {
+        root->taskPool = clTaskPoolCreate(root, workerCount);
+    }
+    clTaskPool * pool = root->taskPool;
+    clMutexUnlock(root->lock);
+    return pool;
+}
+
+// ------------------------------------------------------------------------------------------------
+// clMutex
+
+struct clMutex * clMutexCreate(struct clContext * C)
+{
+    return (struct clMutex *)nativeMutexCreate(C);
+}
+
+void clMutexDestroy(struct clContext * C, struct clMutex * mutex)
+{
+    nativeMutexDestroy(C, mutex);
+}
+
+void clMutexLock(struct clMutex * mutex)
+{
+    nativeMutexLock(mutex);
+}
+
+void clMutexUnlock(struct clMutex * mutex)
+{
+    nativeMutexUnlock(mutex);
+}
+
+// ------------------------------------------------------------------------------------------------
+// clTask
+
+static void taskInit(clTask * task, clTaskPool * pool, clTaskFunc func, clTaskIndexFunc indexFunc, void * userData, int index)
 {
-    clTask * task = clAllocateStruct(clTask);
     task->func = func;
-    task->nativeData = NULL;
+    task->indexFunc = indexFunc;
     task->userData = userData;
+    task->index = index;
+    task->pool = pool;
+    task->state = CL_TASKSTATE_QUEUED;
     task->joined = clFalse;
-    nativeTaskStart(C, task);
+}
+
+clTask * clTaskCreate(struct clContext * C, clTaskFunc func, void * userData)
+{
+    return clTaskCreateInPool(C, clContextGetTaskPool(C), func, userData);
+}
+
+clTask * clTaskCreateInPool(struct clContext * C, clTaskPool * pool, clTaskFunc func, void * userData)
+{
+    clTask * task = clAllocateStruct(clTask);
+    taskInit(task, pool, func, NULL, userData, 0);
+    poolSubmit(pool, task);
     return task;
 }
 
 void clTaskJoin(struct clContext * C, clTask * task)
 {
+    COLORIST_UNUSED(C);
+
     if (!task->joined) {
-        nativeTaskJoin(C, task);
+        clTaskPool * pool = task->pool;
+        nativeMutexLock(pool->lock);
+        while (task->state != CL_TASKSTATE_DONE) {
+            if (pool->pendingCount > 0) {
+                // Help out rather than sleep. This is also how a worker-less pool makes progress.
+                nativeMutexUnlock(pool->lock);
+                clTask * otherTask = poolTake(pool, NOT_A_WORKER);
+                if (otherTask) {
+                    poolRun(pool, otherTask);
+                }
+                nativeMutexLock(pool->lock);
+                if (otherTask || (task->state == CL_TASKSTATE_DONE)) {
+                    continue;
+                }
+                // Someone popped the last queued task but hasn't counted it yet. It broadcasts taskFinished when
+                // it is done, so wait for that rather than spin on pendingCount.
+            }
+            nativeCondWait(pool->taskFinished, pool->lock);
+        }
+        nativeMutexUnlock(pool->lock);
         task->joined = clTrue;
     }
 }
@@ -35,10 +355,34 @@ void clTaskDestroy(struct clContext * C, clTask * task)
 {
     clTaskJoin(C, task);
     COLORIST_ASSERT(task->joined);
-    COLORIST_ASSERT(task->nativeData == NULL);
     clFree(task);
 }
 
+void clTaskParallelFor(struct clContext * C, int count, clTaskIndexFunc func, void * userData)
+{
+    if (count <= 0) {
+        return;
+    }
+    if ((count == 1) || (C->jobs <= 1)) {
+        // Don't bother with the pool
+        for (int i = 0; i < count; ++i) {
+            func(userData, i);
+        }
+        return;
+    }
+
+    clTaskPool * pool = clContextGetTaskPool(C);
+    clTask * tasks = clAllocate(sizeof(clTask) * count);
+    for (int i = 0; i < count; ++i) {
+        taskInit(&tasks[i], pool, NULL, func, userData, i);
+        poolSubmit(pool, &tasks[i]);
+    }
+    for (int i = 0; i < count; ++i) {
+        clTaskJoin(C, &tasks[i]);
+    }
+    clFree(tasks);
+}
+
 #ifdef _WIN32
 
 #pragma warning(disable : 5031)
@@ -54,33 +398,87 @@ int clTaskLimit(void)
     return numCPU;
 }
 
-typedef struct clNativeTask
+typedef struct clNativeThread
 {
     HANDLE hThread;
-} clNativeTask;
+    clTaskFunc func;
+    void * userData;
+} clNativeThread;
 
-static DWORD WINAPI taskThreadProc(LPVOID lpParameter)
+static DWORD WINAPI nativeThreadProc(LPVOID lpParameter)
 {
-    clTask * task = (clTask *)lpParameter;
-    task->func(task->userData);
+    clNativeThread * nativeThread = (clNativeThread *)lpParameter;
+    nativeThread->func(nativeThread->userData);
     return 0;
 }
 
-static void nativeTaskStart(clContext * C, clTask * task)
+static void * nativeThreadStart(clContext * C, clTaskFunc func, void * userData)
 {
     DWORD threadId;
-    clNativeTask * nativeTask = clAllocateStruct(clNativeTask);
-    task->nativeData = nativeTask;
-    nativeTask->hThread = CreateThread(NULL, 0, taskThreadProc, task, 0, &threadId);
+    clNativeThread * nativeThread = clAllocateStruct(clNativeThread);
+    nativeThread->func = func;
+    nativeThread->userData = userData;
+    nativeThread->hThread = CreateThread(NULL, 0, nativeThreadProc, nativeThread, 0, &threadId);
+    return nativeThread;
+}
+
+static void nativeThreadJoin(clContext * C, void * thread)
+{
+    clNativeThread * nativeThread = (clNativeThread *)thread;
+    WaitForSingleObject(nativeThread->hThread, INFINITE);
+    CloseHandle(nativeThread->hThread);
+    clFree(nativeThread);
 }
 
-static void nativeTaskJoin(clContext * C, clTask * task)
+static void * nativeMutexCreate(clContext * C)
 {
-    clNativeTask * nativeTask = (clNativeTask *)task->nativeData;
-    WaitForSingleObject(nativeTask->hThread, INFINITE);
-    CloseHandle(nativeTask->hThread);
-    clFree(task->nativeData);
-    task->nativeData = NULL;
+    CRITICAL_SECTION * cs = clAllocateStruct(CRITICAL_SECTION);
+    InitializeCriticalSection(cs);
+    return cs;
+}
+
+static void nativeMutexDestroy(clContext * C, void * mutex)
+{
+    DeleteCriticalSection((CRITICAL_SECTION *)mutex);
+    clFree(mutex);
+}
+
+static void nativeMutexLock(void * mutex)
+{
+    EnterCriticalSection((CRITICAL_SECTION *)mutex);
+}
+
+static void nativeMutexUnlock(void * mutex)
+{
+    LeaveCriticalSection((CRITICAL_SECTION *)mutex);
+}
+
+static void * nativeCondCreate(clContext * C)
+{
+    CONDITION_VARIABLE * cv = clAllocateStruct(CONDITION_VARIABLE);
+    InitializeConditionVariable(cv);
+    return cv;
+}
+
+static void nativeCondDestroy(clContext * C, void * cond)
+{
+    // Windows condition variables need no cleanup
+    clFree(cond);
+}
+
+static void nativeCondWait(void * cond, void * mutex)
+{
+    SleepConditionVariableCS((CONDITION_VARIABLE *)cond, (CRITICAL_SECTION *)mutex, INFINITE);
+}
+
+static void nativeCondSignal(void * cond)
+{
+    WakeConditionVariable((CONDITION_VARIABLE *)cond);
+}
+
+static void nativeCondBroadcast(void * cond)
+{
+    WakeAllConditionVariable((CONDITION_VARIABLE *)cond);
 }
 
 #else /* ifdef _WIN32 */
@@ -127,31 +525,85 @@ int clTaskLimit()
 
 #include <pthread.h>
 
-typedef struct clNativeTask
+typedef struct clNativeThread
 {
     pthread_t pthread;
-} clNativeTask;
+    clTaskFunc func;
+    void * userData;
+} clNativeThread;
 
-static void * taskThreadProc(void * userData)
+static void * nativeThreadProc(void * userData)
 {
-    clTask * task = (clTask *)userData;
-    task->func(task->userData);
+    clNativeThread * nativeThread = (clNativeThread *)userData;
+    nativeThread->func(nativeThread->userData);
     pthread_exit(NULL);
 }
 
-static void nativeTaskStart(clContext * C, clTask * task)
+static void * nativeThreadStart(clContext * C, clTaskFunc func, void * userData)
+{
+    clNativeThread * nativeThread = clAllocateStruct(clNativeThread);
+    nativeThread->func = func;
+    nativeThread->userData = userData;
+    pthread_create(&nativeThread->pthread, NULL, nativeThreadProc, nativeThread);
+    return nativeThread;
+}
+
+static void nativeThreadJoin(clContext * C, void * thread)
+{
+    clNativeThread * nativeThread = (clNativeThread *)thread;
+    pthread_join(nativeThread->pthread, NULL);
+    clFree(nativeThread);
+}
+
+static void * nativeMutexCreate(clContext * C)
+{
+    pthread_mutex_t * mutex = clAllocateStruct(pthread_mutex_t);
+    pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+static void nativeMutexDestroy(clContext * C, void * mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+    clFree(mutex);
+}
+
+static void nativeMutexLock(void * mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t *)mutex);
+}
+
+static void nativeMutexUnlock(void * mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+static void * nativeCondCreate(clContext * C)
+{
+    pthread_cond_t * cond = clAllocateStruct(pthread_cond_t);
+    pthread_cond_init(cond, NULL);
+    return cond;
+}
+
+static void nativeCondDestroy(clContext * C, void * cond)
+{
+    pthread_cond_destroy((pthread_cond_t *)cond);
+    clFree(cond);
+}
+
+static void nativeCondWait(void * cond, void * mutex)
+{
+    pthread_cond_wait((pthread_cond_t *)cond, (pthread_mutex_t *)mutex);
+}
+
+static void nativeCondSignal(void * cond)
 {
-    clNativeTask * nativeTask = clAllocateStruct(clNativeTask);
-    task->nativeData = nativeTask;
-    pthread_create(&nativeTask->pthread, NULL, taskThreadProc, task);
+    pthread_cond_signal((pthread_cond_t *)cond);
 }
 
-static void nativeTaskJoin(clContext * C, clTask * task)
+static void nativeCondBroadcast(void * cond)
 {
-    clNativeTask * nativeTask = (clNativeTask *)task->nativeData;
-    pthread_join(nativeTask->pthread, NULL);
-    clFree(task->nativeData);
-    task->nativeData = NULL;
+    pthread_cond_broadcast((pthread_cond_t *)cond);
 }
 
 #endif /* ifdef _WIN32 */
@@ -1,6 +1,7 @@
 #include "colorist/transform.h"
 
 #include "colorist/context.h"
+#include "colorist/image.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
 #include "colorist/task.h"
@@ -8,6 +9,7 @@
 #include "gb_math.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <string.h>
 
 // The small amount after the 1.0 here buys us  a little imprecision wiggle
@@ -81,7 +83,13 @@ static const float HLG_B = 0.28466892f;    // 1.0f - (4.0f * HLG_A);
 static const float HLG_C = 0.55991072953f; // 0.5f - HLG_A * logf(4.0f * HLG_A);
 static const float HLG_ONE_TWELFTH = 1.0f / 12.0f;
 
-static float HLG_EOTF(float N, float maxLuminance)
+float clTransformCalcHLGExponent(float maxLuminance)
+{
+    return 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
+}
+
+// exponent is clTransformCalcHLGExponent(maxLuminance), which includes the HLG OOTF here
+static float HLG_EOTF(float N, float exponent)
 {
     float L;
     if (N < 0.5f) {
@@ -89,16 +97,12 @@ static float HLG_EOTF(float N, float maxLuminance)
     } else {
         L = (expf((N - HLG_C) / HLG_A) + HLG_B) / 12.0f;
     }
-
-    // This includes the HLG OOTF here
-    float exponent = 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
     return powf(L, exponent);
 }
 
-static float HLG_OETF(float L, float maxLuminance)
+// exponent is clTransformCalcHLGExponent(maxLuminance), which includes the HLG OOTF here
+static float HLG_OETF(float L, float exponent)
 {
-    // This includes the HLG OOTF here
-    float exponent = 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
     float N = powf(L, 1.0f / exponent);
 
     if (N <= HLG_ONE_TWELFTH) {
@@ -110,8 +114,7 @@ static float HLG_OETF(float L, float maxLuminance)
 static float hlgDiffuseWhite(float peakWhite)
 {
     float base = (expf((0.75f - HLG_C) / HLG_A) + HLG_B) / 12.0f;
-    float exponent = 1.2f + (0.42f * log10f(peakWhite / 1000.0f));
-    return peakWhite * powf(base, exponent);
+    return peakWhite * powf(base, clTransformCalcHLGExponent(peakWhite));
 }
 
 // Find the next integral HLG peak white, given a goal diffuse white
@@ -216,7 +219,99 @@ static clBool derivePrimariesAndXTF(struct clContext * C,
     return clTrue;
 }
 
-void clTransformPrepare(struct clContext * C, struct clTransform * transform)
+// ----------------------------------------------------------------------------
+// Planning
+
+// ccmmCombined lands this close to identity when the primaries match
+#define PLAN_IDENTITY_EPSILON 0.00001f
+
+static void planAppend(clTransformPlan * plan, clTransformOp op)
+{
+    COLORIST_ASSERT(plan->count < CL_TRANSFORM_MAX_OPS);
+    plan->ops[plan->count++] = op;
+}
+
+static clBool matrixIsIdentity(const gbMat3 * m)
+{
+    for (int i = 0; i < 9; ++i) {
+        float expected = ((i % 4) == 0) ? 1.0f : 0.0f;
+        if (fabsf(m->e[i] - expected) > PLAN_IDENTITY_EPSILON) {
+            return clFalse;
+        }
+    }
+    return clTrue;
+}
+
+static void planCCMM(struct clContext * C, struct clTransform * transform)
+{
+    clTransformPlan * plan = &transform->ccmmPlan;
+    memset(plan, 0, sizeof(clTransformPlan));
+
+    if (clProfileMatches(C, transform->srcProfile, transform->dstProfile)) {
+        planAppend(plan, CL_XOP_COPY);
+        return;
+    }
+
+    if ((transform->ccmmSrcEOTF == CL_XTF_GAMMA) && (transform->ccmmSrcGamma == 1.0f)) {
+        planAppend(plan, CL_XOP_CLAMP_SRC);
+    } else if (transform->ccmmSrcEOTF != CL_XTF_NONE) {
+        planAppend(plan, CL_XOP_EOTF);
+    }
+
+    if (transform->tonemapEnabled) {
+        // Tonemapping is nonlinear in Y, so it needs the full XYZ round trip
+        planAppend(plan, CL_XOP_TO_XYZ);
+        planAppend(plan, CL_XOP_LUMINANCE);
+        planAppend(plan, CL_XOP_FROM_XYZ);
+    } else {
+        // Scaling Y in xyY scales X and Z along with it, so luminance scaling is just a factor on the matrix
+        float scale = 1.0f;
+        if (transform->luminanceScaleEnabled) {
+            scale = (transform->srcCurveScale * transform->srcLuminanceScale) /
+                    (transform->dstLuminanceScale * transform->dstCurveScale);
+        }
+        for (int i = 0; i < 9; ++i) {
+            plan->matrix.e[i] = transform->ccmmCombined.e[i] * scale;
+        }
+        if ((scale != 1.0f) || !matrixIsIdentity(&transform->ccmmCombined)) {
+            planAppend(plan, CL_XOP_MATRIX);
+        }
+    }
+
+    if (transform->dstProfile) { // don't clamp XYZ
+        planAppend(plan, CL_XOP_CLAMP_DST);
+    }
+    clBool identityOETF = (transform->ccmmDstOETF == CL_XTF_GAMMA) && (transform->ccmmDstInvGamma == 1.0f);
+    if ((transform->ccmmDstOETF != CL_XTF_NONE) && !identityOETF) {
+        planAppend(plan, CL_XOP_OETF);
+    }
+}
+
+static void planLCMS(struct clContext * C, struct clTransform * transform)
+{
+    clTransformPlan * plan = &transform->lcmsPlan;
+    memset(plan, 0, sizeof(clTransformPlan));
+
+    if (clProfileMatches(C, transform->srcProfile, transform->dstProfile)) {
+        planAppend(plan, CL_XOP_COPY);
+        return;
+    }
+
+    // LittleCMS applies the curves itself
+    if (transform->lcmsCombined) {
+        planAppend(plan, CL_XOP_COMBINED);
+    } else {
+        planAppend(plan, CL_XOP_TO_XYZ);
+        planAppend(plan, CL_XOP_LUMINANCE);
+        planAppend(plan, CL_XOP_FROM_XYZ);
+    }
+    if (transform->dstProfile) {
+        planAppend(plan, CL_XOP_CLAMP_DST);
+    }
+}
+
+// Caller holds transform->lock
+static void prepareLocked(struct clContext * C, struct clTransform * transform)
 {
     clBool useCCMM = clTransformUsesCCMM(C, transform);
     if ((useCCMM && !transform->ccmmReady) || (!useCCMM && !transform->lcmsReady)) {
@@ -349,6 +444,13 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
             gb_mat3_mul(&transform->ccmmCombined, &transform->ccmmSrcToXYZ, &transform->ccmmXYZToDst);
             DEBUG_PRINT_MATRIX("MA*MB", &transform->ccmmCombined);
 
+            if ((transform->ccmmSrcEOTF == CL_XTF_HLG) || (transform->ccmmDstOETF == CL_XTF_HLG)) {
+                transform->ccmmHLGExponent = clTransformCalcHLGExponent(transform->ccmmHLGLuminance);
+            } else {
+                transform->ccmmHLGExponent = 1.0f;
+            }
+
+            planCCMM(C, transform);
             transform->ccmmReady = clTrue;
         }
     } else {
@@ -391,171 +493,234 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
                                                             INTENT_ABSOLUTE_COLORIMETRIC,
                                                             cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
 
+            // LittleCMS applies the curve scales itself, so without tonemapping the XYZ step only
+            // scales by srcLuminance / dstLuminance. When that's 1, let LittleCMS join and optimize
+            // the whole pipeline instead of stopping in XYZ.
+            if (!transform->tonemapEnabled &&
+                (fabsf(transform->srcLuminanceScale - transform->dstLuminanceScale) <= 0.00001f)) {
+                transform->lcmsCombined = cmsCreateTransformTHR(C->lcms,
+                                                                srcProfileHandle,
+                                                                srcFormat,
+                                                                dstProfileHandle,
+                                                                dstFormat,
+                                                                INTENT_ABSOLUTE_COLORIMETRIC,
+                                                                cmsFLAGS_COPY_ALPHA);
+            }
+
+            planLCMS(C, transform);
             transform->lcmsReady = clTrue;
         }
     }
 }
 
-// The real color conversion function
+// Luminance scale and tonemap (CL_XOP_LUMINANCE), in place on one XYZ value
+static void applyLuminanceScale(struct clContext * C, struct clTransform * transform, clBool useCCMM, float * XYZ)
+{
+    float xyY[3];
+
+    // Convert to xyY
+    clTransformXYZToXYY(C, xyY, XYZ, transform->whitePointX, transform->whitePointY);
+
+    // Apply srcCurveScale as CCMM, if any (LCMS implicitly does this)
+    if (useCCMM) {
+        xyY[2] *= transform->srcCurveScale;
+    }
+
+    // Luminance scale
+    xyY[2] *= transform->srcLuminanceScale;
+    xyY[2] /= transform->dstLuminanceScale;
+
+    // Apply inverse dstCurveScale prior to tonemapping to ensure tonemap gets [0-1] range
+    xyY[2] /= transform->dstCurveScale;
+
+    // Tonemap
+    if (transform->tonemapEnabled) {
+        // reinhard tonemap, with additional tuning (see context.h for attribution)
+        float z = powf(xyY[2] > 0.0f ? xyY[2] : 0.0f, transform->tonemapParams.contrast);
+        xyY[2] = z / ((powf(z, transform->tonemapParams.power) * transform->tonemapParams.clipPoint) +
+                      transform->tonemapParams.speed);
+    }
+
+    if (!useCCMM) {
+        // Re-apply dst scale for LCMS as it expects the XYZ->Dst input to be overranged
+        xyY[2] *= transform->dstCurveScale;
+    }
+
+    // Convert to XYZ
+    clTransformXYYToXYZ(C, XYZ, xyY);
+}
+
+// The CCMM color conversion function, running the steps in the transform's plan
+// (transform_simd.c has a batched copy of this)
 static void colorConvert(struct clContext * C,
                          struct clTransform * transform,
-                         clBool useCCMM,
+                         clBool srcLinear,
                          float * srcPixels,
                          int srcChannelCount,
                          float * dstPixels,
                          int dstChannelCount,
                          int pixelCount)
 {
+    const clTransformPlan * plan = &transform->ccmmPlan;
+    const clBool srcEOTFEnabled = !srcLinear && clTransformPlanHasOp(plan, CL_XOP_EOTF);
+    const clTransformTransferFunction srcEOTF = srcEOTFEnabled ? transform->ccmmSrcEOTF : CL_XTF_NONE;
+    const clTransformTransferFunction dstOETF = clTransformPlanHasOp(plan, CL_XOP_OETF) ? transform->ccmmDstOETF : CL_XTF_NONE;
+    const clBool clampSrc = !srcLinear && clTransformPlanHasOp(plan, CL_XOP_CLAMP_SRC);
+    const clBool fusedMatrix = clTransformPlanHasOp(plan, CL_XOP_MATRIX);
+    const clBool viaXYZ = clTransformPlanHasOp(plan, CL_XOP_TO_XYZ);
+    const clBool scaleLuminance = clTransformPlanHasOp(plan, CL_XOP_LUMINANCE);
+    const clBool clampDst = clTransformPlanHasOp(plan, CL_XOP_CLAMP_DST);
+    const clBool clampToOne = (dstOETF == CL_XTF_HLG) || (dstOETF == CL_XTF_PQ);
+
+    // if tonemapping is necessary, luminance scale MUST be enabled
+    COLORIST_ASSERT(!transform->tonemapEnabled || scaleLuminance);
+
     for (int i = 0; i < pixelCount; ++i) {
         float * srcPixel = &srcPixels[i * srcChannelCount];
         float * dstPixel = &dstPixels[i * dstChannelCount];
         gbVec3 src;
         float XYZ[3];
+        float tmp[3];
+
+        switch (srcEOTF) {
+            default:
+            case CL_XTF_NONE:
+                memcpy(&src, srcPixel, sizeof(src));
+                if (clampSrc) {
+                    src.x = CL_MAX(src.x, 0.0f);
+                    src.y = CL_MAX(src.y, 0.0f);
+                    src.z = CL_MAX(src.z, 0.0f);
+                }
+                break;
+            case CL_XTF_GAMMA:
+                src.x = powf((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmSrcGamma);
+                src.y = powf((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmSrcGamma);
+                src.z = powf((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmSrcGamma);
+                break;
+            case CL_XTF_SRGB:
+                src.x = (srcPixel[0] <= 0.04045f) ? (srcPixel[0] / 12.92f) : (powf((srcPixel[0] + 0.055f) / 1.055f, 2.4f));
+                src.y = (srcPixel[1] <= 0.04045f) ? (srcPixel[1] / 12.92f) : (powf((srcPixel[1] + 0.055f) / 1.055f, 2.4f));
+                src.z = (srcPixel[2] <= 0.04045f) ? (srcPixel[2] / 12.92f) : (powf((srcPixel[2] + 0.055f) / 1.055f, 2.4f));
+                break;
+            case CL_XTF_HLG:
+                src.x = HLG_EOTF((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmHLGExponent);
+                src.y = HLG_EOTF((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmHLGExponent);
+                src.z = HLG_EOTF((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmHLGExponent);
+                break;
+            case CL_XTF_PQ:
+                src.x = clTransformEOTF_PQ((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f);
+                src.y = clTransformEOTF_PQ((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f);
+                src.z = clTransformEOTF_PQ((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f);
+                break;
+        }
 
-        if (useCCMM) {
-            switch (transform->ccmmSrcEOTF) {
-                default:
-                case CL_XTF_NONE:
-                    memcpy(&src, srcPixel, sizeof(src));
-                    break;
-                case CL_XTF_GAMMA:
-                    src.x = powf((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmSrcGamma);
-                    src.y = powf((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmSrcGamma);
-                    src.z = powf((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmSrcGamma);
-                    break;
-                case CL_XTF_SRGB:
-                    src.x = (srcPixel[0] <= 0.04045f) ? (srcPixel[0] / 12.92f) : (powf((srcPixel[0] + 0.055f) / 1.055f, 2.4f));
-                    src.y = (srcPixel[1] <= 0.04045f) ? (srcPixel[1] / 12.92f) : (powf((srcPixel[1] + 0.055f) / 1.055f, 2.4f));
-                    src.z = (srcPixel[2] <= 0.04045f) ? (srcPixel[2] / 12.92f) : (powf((srcPixel[2] + 0.055f) / 1.055f, 2.4f));
-                    break;
-                case CL_XTF_HLG:
-                    src.x = HLG_EOTF((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmHLGLuminance);
-                    src.y = HLG_EOTF((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmHLGLuminance);
-                    src.z = HLG_EOTF((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmHLGLuminance);
-                    break;
-                case CL_XTF_PQ:
-                    src.x = clTransformEOTF_PQ((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f);
-                    src.y = clTransformEOTF_PQ((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f);
-                    src.z = clTransformEOTF_PQ((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f);
-                    break;
-            }
-
+        if (fusedMatrix) {
+            gb_mat3_mul_vec3((gbVec3 *)tmp, (gbMat3 *)&plan->matrix, src); // straight to dst linear
+        } else if (viaXYZ) {
             gb_mat3_mul_vec3((gbVec3 *)XYZ, &transform->ccmmSrcToXYZ, src);
-        } else {
-            // Use LCMS
-            if (transform->lcmsSrcToXYZ) {
-                cmsDoTransform(transform->lcmsSrcToXYZ, srcPixel, XYZ, 1);
+            if (scaleLuminance) {
+                applyLuminanceScale(C, transform, clTrue, XYZ);
             }
+            memcpy(&src, XYZ, sizeof(src));
+            gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
+        } else {
+            memcpy(tmp, &src, sizeof(tmp)); // primaries match, nothing to scale
         }
 
-        // if tonemapping is necessary, luminance scale MUST be enabled
-        COLORIST_ASSERT(!transform->tonemapEnabled || transform->luminanceScaleEnabled);
-
-        if (transform->luminanceScaleEnabled) {
-            float xyY[3];
-
-            // Convert to xyY
-            clTransformXYZToXYY(C, xyY, XYZ, transform->whitePointX, transform->whitePointY);
-
-            // Apply srcCurveScale as CCMM, if any (LCMS implicitly does this)
-            if (useCCMM) {
-                xyY[2] *= transform->srcCurveScale;
+        if (clampDst) {
+            if (clampToOne) {
+                tmp[0] = CL_CLAMP(tmp[0], 0.0f, 1.0f); // clamp
+                tmp[1] = CL_CLAMP(tmp[1], 0.0f, 1.0f); // clamp
+                tmp[2] = CL_CLAMP(tmp[2], 0.0f, 1.0f); // clamp
+            } else {
+                tmp[0] = CL_MAX(tmp[0], 0.0f); // clamp (allow overranging)
+                tmp[1] = CL_MAX(tmp[1], 0.0f); // clamp (allow overranging)
+                tmp[2] = CL_MAX(tmp[2], 0.0f); // clamp (allow overranging)
             }
+        }
 
-            // Luminance scale
-            xyY[2] *= transform->srcLuminanceScale;
-            xyY[2] /= transform->dstLuminanceScale;
-
-            // Apply inverse dstCurveScale prior to tonemapping to ensure tonemap gets [0-1] range
-            xyY[2] /= transform->dstCurveScale;
-
-            // Tonemap
-            if (transform->tonemapEnabled) {
-                // reinhard tonemap, with additional tuning (see context.h for attribution)
-                float z = powf(xyY[2] > 0.0f ? xyY[2] : 0.0f, transform->tonemapParams.contrast);
-                xyY[2] = z / ((powf(z, transform->tonemapParams.power) * transform->tonemapParams.clipPoint) +
-                              transform->tonemapParams.speed);
-            }
+        switch (dstOETF) {
+            case CL_XTF_NONE:
+                memcpy(dstPixel, tmp, sizeof(tmp));
+                break;
+            case CL_XTF_SRGB:
+                dstPixel[0] = (tmp[0] <= 0.0031308) ? (tmp[0] * 12.92f) : ((powf(tmp[0], 1.0f / 2.4f) * 1.055f) - 0.055f);
+                dstPixel[1] = (tmp[1] <= 0.0031308) ? (tmp[1] * 12.92f) : ((powf(tmp[1], 1.0f / 2.4f) * 1.055f) - 0.055f);
+                dstPixel[2] = (tmp[2] <= 0.0031308) ? (tmp[2] * 12.92f) : ((powf(tmp[2], 1.0f / 2.4f) * 1.055f) - 0.055f);
+                break;
+            case CL_XTF_GAMMA:
+                dstPixel[0] = powf((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmDstInvGamma);
+                dstPixel[1] = powf((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmDstInvGamma);
+                dstPixel[2] = powf((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmDstInvGamma);
+                break;
+            case CL_XTF_HLG:
+                dstPixel[0] = HLG_OETF((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmHLGExponent);
+                dstPixel[1] = HLG_OETF((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmHLGExponent);
+                dstPixel[2] = HLG_OETF((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmHLGExponent);
+                break;
+            case CL_XTF_PQ:
+                dstPixel[0] = clTransformOETF_PQ((tmp[0] >= 0.0f) ? tmp[0] : 0.0f);
+                dstPixel[1] = clTransformOETF_PQ((tmp[1] >= 0.0f) ? tmp[1] : 0.0f);
+                dstPixel[2] = clTransformOETF_PQ((tmp[2] >= 0.0f) ? tmp[2] : 0.0f);
+                break;
+        }
 
-            if (!useCCMM) {
-                // Re-apply dst scale for LCMS as it expects the XYZ->Dst input to be overranged
-                xyY[2] *= transform->dstCurveScale;
+        if (DST_FLOAT_HAS_ALPHA()) {
+            if (SRC_FLOAT_HAS_ALPHA()) {
+                // Copy alpha
+                dstPixel[3] = srcPixel[3];
+            } else {
+                // Full alpha
+                dstPixel[3] = 1.0f;
             }
-
-            // Convert to XYZ
-            clTransformXYYToXYZ(C, XYZ, xyY);
         }
+    }
+}
 
-        if (useCCMM) {
-            float tmp[3];
-            memcpy(&src, XYZ, sizeof(src));
-
-            switch (transform->ccmmDstOETF) {
-                case CL_XTF_NONE:
-                    gb_mat3_mul_vec3((gbVec3 *)dstPixel, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {                 // don't clamp XYZ
-                        dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
-                        dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
-                        dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
-                    }
-                    break;
-                case CL_XTF_SRGB:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {       // don't clamp XYZ
-                        tmp[0] = CL_MAX(tmp[0], 0.0f); // clamp (allow overranging)
-                        tmp[1] = CL_MAX(tmp[1], 0.0f); // clamp (allow overranging)
-                        tmp[2] = CL_MAX(tmp[2], 0.0f); // clamp (allow overranging)
-                    }
-                    dstPixel[0] = (tmp[0] <= 0.0031308) ? (tmp[0] * 12.92f) : ((powf(tmp[0], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    dstPixel[1] = (tmp[1] <= 0.0031308) ? (tmp[1] * 12.92f) : ((powf(tmp[1], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    dstPixel[2] = (tmp[2] <= 0.0031308) ? (tmp[2] * 12.92f) : ((powf(tmp[2], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    break;
-                case CL_XTF_GAMMA:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {       // don't clamp XYZ
-                        tmp[0] = CL_MAX(tmp[0], 0.0f); // clamp (allow overranging)
-                        tmp[1] = CL_MAX(tmp[1], 0.0f); // clamp (allow overranging)
-                        tmp[2] = CL_MAX(tmp[2], 0.0f); // clamp (allow overranging)
-                    }
-                    dstPixel[0] = powf((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmDstInvGamma);
-                    dstPixel[1] = powf((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmDstInvGamma);
-                    dstPixel[2] = powf((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmDstInvGamma);
-                    break;
-                case CL_XTF_HLG:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {               // don't clamp XYZ
-                        tmp[0] = CL_CLAMP(tmp[0], 0.0f, 1.0f); // clamp
-                        tmp[1] = CL_CLAMP(tmp[1], 0.0f, 1.0f); // clamp
-                        tmp[2] = CL_CLAMP(tmp[2], 0.0f, 1.0f); // clamp
-                    }
-                    dstPixel[0] = HLG_OETF((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmHLGLuminance);
-                    dstPixel[1] = HLG_OETF((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmHLGLuminance);
-                    dstPixel[2] = HLG_OETF((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmHLGLuminance);
-                    break;
-                case CL_XTF_PQ:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {               // don't clamp XYZ
-                        tmp[0] = CL_CLAMP(tmp[0], 0.0f, 1.0f); // clamp
-                        tmp[1] = CL_CLAMP(tmp[1], 0.0f, 1.0f); // clamp
-                        tmp[2] = CL_CLAMP(tmp[2], 0.0f, 1.0f); // clamp
-                    }
-                    dstPixel[0] = clTransformOETF_PQ((tmp[0] >= 0.0f) ? tmp[0] : 0.0f);
-                    dstPixel[1] = clTransformOETF_PQ((tmp[1] >= 0.0f) ? tmp[1] : 0.0f);
-                    dstPixel[2] = clTransformOETF_PQ((tmp[2] >= 0.0f) ? tmp[2] : 0.0f);
-                    break;
+// Pixels per cmsDoTransform() call on the split LittleCMS path (bounds the XYZ scratch buffer)
+#define LCMS_BATCH_PIXELS 1024
+
+// LittleCMS conversion. Works on whole batches of pixels per cmsDoTransform() call; when the plan has
+// a combined transform the entire range goes through it at once.
+static void lcmsConvert(struct clContext * C,
+                        struct clTransform * transform,
+                        float * srcPixels,
+                        int srcChannelCount,
+                        float * dstPixels,
+                        int dstChannelCount,
+                        int pixelCount)
+{
+    if (transform->lcmsCombined) {
+        cmsDoTransform(transform->lcmsCombined, srcPixels, dstPixels, (cmsUInt32Number)pixelCount);
+    } else {
+        float XYZ[3 * LCMS_BATCH_PIXELS];
+        for (int batchStart = 0; batchStart < pixelCount; batchStart += LCMS_BATCH_PIXELS) {
+            int batchCount = CL_MIN(pixelCount - batchStart, LCMS_BATCH_PIXELS);
+            float * batchSrc = &srcPixels[batchStart * srcChannelCount];
+            float * batchDst = &dstPixels[batchStart * dstChannelCount];
+            if (transform->lcmsSrcToXYZ) {
+                cmsDoTransform(transform->lcmsSrcToXYZ, batchSrc, XYZ, (cmsUInt32Number)batchCount);
+            } else {
+                memset(XYZ, 0, sizeof(float) * 3 * batchCount);
             }
-        } else {
-            // LittleCMS
-            if (transform->lcmsXYZToDst) {
-                cmsDoTransform(transform->lcmsXYZToDst, XYZ, dstPixel, 1);
+            for (int i = 0; i < batchCount; ++i) {
+                applyLuminanceScale(C, transform, clFalse, &XYZ[i * 3]);
             }
-            if (transform->dstProfile) {                 // don't clamp XYZ
-                dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
-                dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
-                dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
+            if (transform->lcmsXYZToDst) {
+                cmsDoTransform(transform->lcmsXYZToDst, XYZ, batchDst, (cmsUInt32Number)batchCount);
             }
         }
+    }
 
+    const clBool clampDst = clTransformPlanHasOp(&transform->lcmsPlan, CL_XOP_CLAMP_DST);
+    for (int i = 0; i < pixelCount; ++i) {
+        float * srcPixel = &srcPixels[i * srcChannelCount];
+        float * dstPixel = &dstPixels[i * dstChannelCount];
+        if (clampDst) {                              // don't clamp XYZ
+            dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
+            dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
+            dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
+        }
         if (DST_FLOAT_HAS_ALPHA()) {
             if (SRC_FLOAT_HAS_ALPHA()) {
                 // Copy alpha
@@ -568,10 +733,198 @@ static void colorConvert(struct clContext * C,
     }
 }
 
+// ----------------------------------------------------------------------------
+// Baked 3D LUT
+
+typedef struct lutBakeTask
+{
+    clContext * C;
+    clTransform * transform;
+    float * lut;
+    int lutSize;
+    int blue; // grid slice this task fills
+} lutBakeTask;
+
+static void lutBakeTaskFunc(lutBakeTask * tasks, int index)
+{
+    lutBakeTask * task = &tasks[index];
+    clContext * C = task->C;
+    clTransform * transform = task->transform;
+    int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
+    int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
+    int size = task->lutSize;
+    int sliceCount = size * size;
+    float maxIndex = (float)(size - 1);
+
+    float * srcPixels = clAllocate(sizeof(float) * srcChannelCount * sliceCount);
+    float * dstPixels = clAllocate(sizeof(float) * dstChannelCount * sliceCount);
+    for (int i = 0; i < sliceCount; ++i) {
+        float * srcPixel = &srcPixels[i * srcChannelCount];
+        srcPixel[0] = (float)(i % size) / maxIndex;
+        srcPixel[1] = (float)(i / size) / maxIndex;
+        srcPixel[2] = (float)task->blue / maxIndex;
+        if (SRC_FLOAT_HAS_ALPHA()) {
+            srcPixel[3] = 1.0f;
+        }
+    }
+    lcmsConvert(C, transform, srcPixels, srcChannelCount, dstPixels, dstChannelCount, sliceCount);
+
+    float * lutSlice = &task->lut[task->blue * sliceCount * 3];
+    for (int i = 0; i < sliceCount; ++i) {
+        memcpy(&lutSlice[i * 3], &dstPixels[i * dstChannelCount], sizeof(float) * 3);
+    }
+    clFree(srcPixels);
+    clFree(dstPixels);
+}
+
+void clTransformPrepare(struct clContext * C, struct clTransform * transform)
+{
+    clMutexLock(transform->lock);
+    prepareLocked(C, transform);
+    clMutexUnlock(transform->lock);
+}
+
+// The grid is baked without holding transform->lock (the bake runs on the task pool), then installed under it.
+// A different sized grid is only swapped out when replace is set, as other threads may still be reading it.
+static clBool bakeLUT(struct clContext * C, clTransform * transform, int lutSize, clBool replace)
+{
+    if ((transform->srcFormat == CL_XF_XYZ) || (lutSize < CL_TRANSFORM_LUT_MIN_SIZE) || (lutSize > CL_TRANSFORM_LUT_MAX_SIZE)) {
+        // XYZ isn't bounded to [0, 1], so there's no sensible grid to bake
+        return clFalse;
+    }
+    clMutexLock(transform->lock);
+    prepareLocked(C, transform);
+    clBool baked = transform->lut && (transform->lutSize == lutSize);
+    clMutexUnlock(transform->lock);
+    if (baked) {
+        return clTrue;
+    }
+
+    float * lut = clAllocate(sizeof(float) * 3 * lutSize * lutSize * lutSize);
+    lutBakeTask * tasks = clAllocate(sizeof(lutBakeTask) * lutSize);
+    for (int i = 0; i < lutSize; ++i) {
+        tasks[i].C = C;
+        tasks[i].transform = transform;
+        tasks[i].lut = lut;
+        tasks[i].lutSize = lutSize;
+        tasks[i].blue = i;
+    }
+    clTaskParallelFor(C, lutSize, (clTaskIndexFunc)lutBakeTaskFunc, tasks);
+    clFree(tasks);
+
+    clMutexLock(transform->lock);
+    if (transform->lut && ((transform->lutSize == lutSize) || !replace)) {
+        // Someone else installed a grid while this one was baking
+        baked = (transform->lutSize == lutSize);
+        clFree(lut);
+    } else {
+        if (transform->lut) {
+            clFree(transform->lut);
+        }
+        transform->lut = lut;
+        transform->lutSize = lutSize;
+        baked = clTrue;
+    }
+    clMutexUnlock(transform->lock);
+    return baked;
+}
+
+clBool clTransformBakeLUT(struct clContext * C, clTransform * transform, int lutSize)
+{
+    return bakeLUT(C, transform, lutSize, clTrue);
+}
+
+void clTransformLUTLookup(const float * lut, int lutSize, const float * rgb, float * dstRGB)
+{
+    // Same math as clTransformRunLUTBatch()
+    const int stride[3] = { 3, 3 * lutSize, 3 * lutSize * lutSize };
+    float fraction[3];
+    int base = 0;
+    for (int channel = 0; channel < 3; ++channel) {
+        float v = rgb[channel];
+        v = (v > 0.0f) ? ((v < 1.0f) ? v : 1.0f) : 0.0f; // NaN -> 0
+        v *= (float)(lutSize - 1);
+        int cell = CL_MIN((int)v, lutSize - 2);
+        fraction[channel] = v - (float)cell;
+        base += cell * stride[channel];
+    }
+
+    // Walk from the cell's black corner to its white corner along the axes in order of decreasing fraction
+    int axisMax = ((fraction[0] >= fraction[1]) && (fraction[0] >= fraction[2])) ? 0 : ((fraction[1] >= fraction[2]) ? 1 : 2);
+    int axisMin = ((fraction[2] <= fraction[1]) && (fraction[2] <= fraction[0])) ? 2 : ((fraction[1] <= fraction[0]) ? 1 : 0);
+    float f1 = fraction[axisMax];
+    float f3 = fraction[axisMin];
+    float f2 = CL_MAX(CL_MIN(fraction[0], fraction[1]), CL_MIN(CL_MAX(fraction[0], fraction[1]), fraction[2]));
+    const int strideAll = stride[0] + stride[1] + stride[2];
+    const float * c0 = &lut[base];
+    const float * c1 = c0 + stride[axisMax];
+    const float * c2 = c0 + (strideAll - stride[axisMin]);
+    const float * c3 = c0 + strideAll;
+    for (int channel = 0; channel < 3; ++channel) {
+        dstRGB[channel] = ((1.0f - f1) * c0[channel]) + ((f1 - f2) * c1[channel]) + ((f2 - f3) * c2[channel]) +
+                          (f3 * c3[channel]);
+    }
+}
+
+// Out of domain pixels per LittleCMS call in lutConvert()
+#define LUT_FALLBACK_PIXELS 256
+
+// Interpolates the baked LUT, sending pixels outside of its [0, 1] domain through LittleCMS
+static void lutConvert(struct clContext * C,
+                       struct clTransform * transform,
+                       float * srcPixels,
+                       int srcChannelCount,
+                       float * dstPixels,
+                       int dstChannelCount,
+                       int pixelCount)
+{
+    if (!C->simdAllowed ||
+        !clTransformRunLUTBatch(C, transform, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount)) {
+        for (int i = 0; i < pixelCount; ++i) {
+            float * srcPixel = &srcPixels[i * srcChannelCount];
+            clTransformLUTLookup(transform->lut, transform->lutSize, srcPixel, &dstPixels[i * dstChannelCount]);
+        }
+    }
+
+    // Out of domain pixels are gathered so that LittleCMS sees them in batches rather than one call apiece
+    float fallbackSrc[4 * LUT_FALLBACK_PIXELS];
+    float fallbackDst[4 * LUT_FALLBACK_PIXELS];
+    int fallbackIndices[LUT_FALLBACK_PIXELS];
+    int fallbackCount = 0;
+    for (int i = 0; i < pixelCount; ++i) {
+        float * srcPixel = &srcPixels[i * srcChannelCount];
+        float * dstPixel = &dstPixels[i * dstChannelCount];
+        if (!((srcPixel[0] >= 0.0f) && (srcPixel[0] <= 1.0f) && (srcPixel[1] >= 0.0f) && (srcPixel[1] <= 1.0f) &&
+              (srcPixel[2] >= 0.0f) && (srcPixel[2] <= 1.0f))) {
+            memcpy(&fallbackSrc[fallbackCount * srcChannelCount], srcPixel, sizeof(float) * srcChannelCount);
+            fallbackIndices[fallbackCount++] = i;
+        } else if (DST_FLOAT_HAS_ALPHA()) {
+            dstPixel[3] = SRC_FLOAT_HAS_ALPHA() ? srcPixel[3] : 1.0f;
+        }
+
+        if ((fallbackCount == LUT_FALLBACK_PIXELS) || ((i == pixelCount - 1) && (fallbackCount > 0))) {
+            lcmsConvert(C, transform, fallbackSrc, srcChannelCount, fallbackDst, dstChannelCount, fallbackCount);
+            for (int j = 0; j < fallbackCount; ++j) {
+                memcpy(&dstPixels[fallbackIndices[j] * dstChannelCount],
+                       &fallbackDst[j * dstChannelCount],
+                       sizeof(float) * dstChannelCount);
+            }
+            fallbackCount = 0;
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 // Transform entry point
 
-static void clCCMMTransform(struct clContext * C, struct clTransform * transform, clBool useCCMM, float * srcPixels, float * dstPixels, int pixelCount)
+static void clCCMMTransform(struct clContext * C,
+                            struct clTransform * transform,
+                            clBool useCCMM,
+                            clBool useLUT,
+                            clBool srcLinear, // CCMM only: srcPixels went through ccmmSrcTables already
+                            float * srcPixels,
+                            float * dstPixels,
+                            int pixelCount)
 {
     int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
     int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
@@ -579,7 +932,8 @@ static void clCCMMTransform(struct clContext * C, struct clTransform * transform
     // COLORIST_ASSERT(!transform->srcProfile || transform->srcProfile->ccmm);
     // COLORIST_ASSERT(!transform->dstProfile || transform->dstProfile->ccmm);
 
-    if (clProfileMatches(C, transform->srcProfile, transform->dstProfile)) {
+    const clTransformPlan * plan = useCCMM ? &transform->ccmmPlan : &transform->lcmsPlan;
+    if (clTransformPlanHasOp(plan, CL_XOP_COPY)) {
         // No color conversion necessary, just repack honoring src/dst alpha
 
         for (int i = 0; i < pixelCount; ++i) {
@@ -598,8 +952,95 @@ static void clCCMMTransform(struct clContext * C, struct clTransform * transform
     } else {
         // Color conversion is required
 
-        colorConvert(C, transform, useCCMM, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount);
+        if (useLUT) {
+            lutConvert(C, transform, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount);
+        } else if (!useCCMM) {
+            lcmsConvert(C, transform, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount);
+        } else if (!C->simdAllowed || !clTransformRunCCMMBatch(C,
+                                                                transform,
+                                                                srcLinear,
+                                                                srcPixels,
+                                                                srcChannelCount,
+                                                                dstPixels,
+                                                                dstChannelCount,
+                                                                pixelCount)) {
+            colorConvert(C, transform, srcLinear, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Transfer functions
+
+// Identical to the per-channel math in colorConvert()
+static void scalarEOTF(clTransformTransferFunction xtf, float param, float hlgExponent, float * values, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float v = values[i];
+        switch (xtf) {
+            case CL_XTF_NONE:
+                break;
+            case CL_XTF_GAMMA:
+                v = powf((v >= 0.0f) ? v : 0.0f, param);
+                break;
+            case CL_XTF_SRGB:
+                v = (v <= 0.04045f) ? (v / 12.92f) : (powf((v + 0.055f) / 1.055f, 2.4f));
+                break;
+            case CL_XTF_HLG:
+                v = HLG_EOTF((v >= 0.0f) ? v : 0.0f, hlgExponent);
+                break;
+            case CL_XTF_PQ:
+                v = clTransformEOTF_PQ((v >= 0.0f) ? v : 0.0f);
+                break;
+        }
+        values[i] = v;
+    }
+}
+
+// Identical to the per-channel math in colorConvert(). invGamma is the reciprocal, as in ccmmDstInvGamma.
+static void scalarOETF(clTransformTransferFunction xtf, float invGamma, float hlgExponent, float * values, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float v = values[i];
+        switch (xtf) {
+            case CL_XTF_NONE:
+                break;
+            case CL_XTF_GAMMA:
+                v = powf((v >= 0.0f) ? v : 0.0f, invGamma);
+                break;
+            case CL_XTF_SRGB:
+                v = (v <= 0.0031308) ? (v * 12.92f) : ((powf(v, 1.0f / 2.4f) * 1.055f) - 0.055f);
+                break;
+            case CL_XTF_HLG:
+                v = HLG_OETF((v >= 0.0f) ? v : 0.0f, hlgExponent);
+                break;
+            case CL_XTF_PQ:
+                v = clTransformOETF_PQ((v >= 0.0f) ? v : 0.0f);
+                break;
+        }
+        values[i] = v;
+    }
+}
+
+void clTransformEOTF(struct clContext * C, clTransformTransferFunction xtf, float param, float * values, int count)
+{
+    if (C->simdAllowed && clTransformRunCurveBatch(C, xtf, param, clFalse, values, count)) {
+        return;
     }
+
+    // Scalar fallback
+    scalarEOTF(xtf, param, (xtf == CL_XTF_HLG) ? clTransformCalcHLGExponent(param) : 1.0f, values, count);
+}
+
+void clTransformOETF(struct clContext * C, clTransformTransferFunction xtf, float param, float * values, int count)
+{
+    if (C->simdAllowed && clTransformRunCurveBatch(C, xtf, param, clTrue, values, count)) {
+        return;
+    }
+
+    // Scalar fallback
+    float invGamma = (param != 0.0f) ? (1.0f / param) : 0.0f;
+    scalarOETF(xtf, invGamma, (xtf == CL_XTF_HLG) ? clTransformCalcHLGExponent(param) : 1.0f, values, count);
 }
 
 // ----------------------------------------------------------------------------
@@ -636,31 +1077,38 @@ void clTransformXYYToXYZ(struct clContext * C, float * dstXYZ, const float * src
     dstXYZ[2] = ((1 - srcXYY[0] - srcXYY[1]) * srcXYY[2]) / srcXYY[1];
 }
 
-float clTransformCalcMaxY(clContext * C, clTransform * linearFromXYZ, clTransform * linearToXYZ, float x, float y)
-{
-    float floatXYZ[3];
-    float floatRGB[3];
-    float maxChannel;
-    cmsCIEXYZ XYZ;
-    cmsCIExyY xyY;
-    xyY.x = x;
-    xyY.y = y;
-    xyY.Y = 1.0f; // start with max luminance
-    cmsxyY2XYZ(&XYZ, &xyY);
-    floatXYZ[0] = (float)XYZ.X;
-    floatXYZ[1] = (float)XYZ.Y;
-    floatXYZ[2] = (float)XYZ.Z;
-    clTransformRun(C, linearFromXYZ, floatXYZ, floatRGB, 1);
-    maxChannel = floatRGB[0];
-    if (maxChannel < floatRGB[1])
-        maxChannel = floatRGB[1];
-    if (maxChannel < floatRGB[2])
-        maxChannel = floatRGB[2];
-    floatRGB[0] /= maxChannel;
-    floatRGB[1] /= maxChannel;
-    floatRGB[2] /= maxChannel;
-    clTransformRun(C, linearToXYZ, floatRGB, floatXYZ, 1);
-    return floatXYZ[1];
+const clProfileGamutCeiling * clTransformGetGamutCeiling(clContext * C, clTransform * linearToXYZ)
+{
+    clMutexLock(linearToXYZ->lock);
+    clBool ready = linearToXYZ->gamutCeilingReady;
+    clMutexUnlock(linearToXYZ->lock);
+    if (ready) {
+        return &linearToXYZ->gamutCeiling;
+    }
+
+    // Read the transform's matrix back by running the primaries through it (outside the lock, as clTransformRun()
+    // takes it). Racing callers compute the same answer.
+    float primariesRGBA[12] = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f };
+    float colorants[3][3];
+    clTransformRun(C, linearToXYZ, primariesRGBA, &colorants[0][0], 3);
+
+    clProfileGamutCeiling ceiling;
+    if (!clProfileGamutCeilingFromColorants(C, colorants, &ceiling)) {
+        clContextLogError(C, "Degenerate primaries, max luminance queries will all report 0");
+    }
+
+    clMutexLock(linearToXYZ->lock);
+    if (!linearToXYZ->gamutCeilingReady) {
+        memcpy(&linearToXYZ->gamutCeiling, &ceiling, sizeof(ceiling));
+        linearToXYZ->gamutCeilingReady = clTrue;
+    }
+    clMutexUnlock(linearToXYZ->lock);
+    return &linearToXYZ->gamutCeiling;
+}
+
+float clTransformCalcMaxY(clContext * C, clTransform * linearToXYZ, float x, float y)
+{
+    return clProfileGamutCeilingMaxY(clTransformGetGamutCeiling(C, linearToXYZ), x, y);
 }
 
 clTransform * clTransformCreate(struct clContext * C,
@@ -678,12 +1126,21 @@ clTransform * clTransformCreate(struct clContext * C,
     transform->requestedTonemap = tonemap;
     clTonemapParamsSetDefaults(C, &transform->tonemapParams);
 
+    memset(transform->ccmmSrcTables, 0, sizeof(transform->ccmmSrcTables));
     transform->ccmmReady = clFalse;
+    transform->gamutCeilingReady = clFalse;
 
     transform->lcmsXYZProfile = NULL;
     transform->lcmsSrcToXYZ = NULL;
     transform->lcmsXYZToDst = NULL;
+    transform->lcmsCombined = NULL;
     transform->lcmsReady = clFalse;
+
+    transform->lut = NULL;
+    transform->lutSize = 0;
+
+    transform->ownsProfiles = clFalse;
+    transform->lock = clMutexCreate(C);
     return transform;
 }
 
@@ -695,9 +1152,29 @@ void clTransformDestroy(struct clContext * C, clTransform * transform)
     if (transform->lcmsXYZToDst) {
         cmsDeleteTransform(transform->lcmsXYZToDst);
     }
+    if (transform->lcmsCombined) {
+        cmsDeleteTransform(transform->lcmsCombined);
+    }
     if (transform->lcmsXYZProfile) {
         cmsCloseProfile(transform->lcmsXYZProfile);
     }
+    if (transform->lut) {
+        clFree(transform->lut);
+    }
+    clMutexDestroy(C, transform->lock);
+    for (int depth = 0; depth <= CL_TRANSFORM_MAX_TABLE_DEPTH; ++depth) {
+        if (transform->ccmmSrcTables[depth]) {
+            clFree(transform->ccmmSrcTables[depth]);
+        }
+    }
+    if (transform->ownsProfiles) {
+        if (transform->srcProfile) {
+            clProfileDestroy(C, transform->srcProfile);
+        }
+        if (transform->dstProfile) {
+            clProfileDestroy(C, transform->dstProfile);
+        }
+    }
     clFree(transform);
 }
 
@@ -711,7 +1188,7 @@ static cmsUInt32Number clTransformFormatToLCMSFormat(struct clContext * C, clTra
         case CL_XF_RGB:
             return TYPE_RGB_FLT;
         case CL_XF_RGBA:
-            return TYPE_RGB_FLT; // CCMM deals with the alpha
+            return TYPE_RGBA_FLT; // so whole rows can be transformed in one call; alpha is still handled by colorist
     }
 
     COLORIST_FAILURE("clTransformFormatToLCMSFormat: Unknown transform format");
@@ -758,69 +1235,559 @@ float clTransformGetLuminanceScale(struct clContext * C, clTransform * transform
     return transform->srcLuminanceScale / transform->dstLuminanceScale * transform->srcCurveScale / transform->dstCurveScale;
 }
 
+const clTransformPlan * clTransformGetPlan(struct clContext * C, clTransform * transform)
+{
+    clTransformPrepare(C, transform);
+    return clTransformUsesCCMM(C, transform) ? &transform->ccmmPlan : &transform->lcmsPlan;
+}
+
+clBool clTransformPlanHasOp(const clTransformPlan * plan, clTransformOp op)
+{
+    for (int i = 0; i < plan->count; ++i) {
+        if (plan->ops[i] == op) {
+            return clTrue;
+        }
+    }
+    return clFalse;
+}
+
+const char * clTransformOpName(clTransformOp op)
+{
+    switch (op) {
+        case CL_XOP_COPY:
+            return "copy";
+        case CL_XOP_EOTF:
+            return "EOTF";
+        case CL_XOP_CLAMP_SRC:
+        case CL_XOP_CLAMP_DST:
+            return "clamp";
+        case CL_XOP_MATRIX:
+            return "matrix";
+        case CL_XOP_TO_XYZ:
+            return "toXYZ";
+        case CL_XOP_LUMINANCE:
+            return "luminance";
+        case CL_XOP_FROM_XYZ:
+            return "fromXYZ";
+        case CL_XOP_OETF:
+            return "OETF";
+        case CL_XOP_COMBINED:
+            return "combined";
+    }
+    return "unknown";
+}
+
+void clTransformDescribePlan(struct clContext * C, clTransform * transform, char * buffer, int bufferSize)
+{
+    const clTransformPlan * plan = clTransformGetPlan(C, transform);
+    int length = snprintf(buffer, bufferSize, "%s:", clTransformCMMName(C, transform));
+    for (int i = 0; (i < plan->count) && (length >= 0) && (length < bufferSize); ++i) {
+        length += snprintf(buffer + length, bufferSize - length, (i == 0) ? " %s" : " > %s", clTransformOpName(plan->ops[i]));
+    }
+    if (!clTransformUsesCCMM(C, transform) && transform->lut && (length >= 0) && (length < bufferSize)) {
+        snprintf(buffer + length, bufferSize - length, " (baked %d^3 LUT)", transform->lutSize);
+    }
+}
+
+void clTransformQuantize(struct clContext * C, const float * src, void * dst, clPixelFormat pixelFormat, int depth, int count)
+{
+    COLORIST_ASSERT((pixelFormat == CL_PIXELFORMAT_U8) || (pixelFormat == CL_PIXELFORMAT_U16));
+    if (C->simdAllowed && clTransformRunQuantizeBatch(C, src, dst, pixelFormat, depth, count)) {
+        return;
+    }
+
+    const float maxChannel = (float)((1 << depth) - 1);
+    for (int i = 0; i < count; ++i) {
+        float v = floorf((src[i] * maxChannel) + 0.5f);
+        v = (v > 0.0f) ? ((v < maxChannel) ? v : maxChannel) : 0.0f; // NaN -> 0
+        if (pixelFormat == CL_PIXELFORMAT_U8) {
+            ((uint8_t *)dst)[i] = (uint8_t)v;
+        } else {
+            ((uint16_t *)dst)[i] = (uint16_t)v;
+        }
+    }
+}
+
+static float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        // Zero or denormal: mantissa * 2^-24, which is exact in a float
+        float f = (float)mantissa * 5.9604644775390625e-8f;
+        memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    } else if (exponent == 31) {
+        // Inf or NaN (quieted, as F16C does)
+        bits = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x00400000 : 0);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void clTransformHalfToFloat(struct clContext * C, const uint16_t * src, float * dst, int pixelCount, float rgbScale)
+{
+    if (C->simdAllowed && clTransformRunHalfToFloatBatch(C, src, dst, pixelCount, rgbScale)) {
+        return;
+    }
+
+    // Back to front, and through memcpy, as src may alias dst
+    for (int i = (pixelCount * 4) - 1; i >= 0; --i) {
+        uint16_t half;
+        memcpy(&half, (const uint8_t *)src + (i * sizeof(uint16_t)), sizeof(half));
+        float f = halfToFloat(half) * (((i % 4) == 3) ? 1.0f : rgbScale);
+        memcpy((uint8_t *)dst + (i * sizeof(float)), &f, sizeof(f));
+    }
+}
+
+static uint16_t floatToHalf(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t absBits = bits & 0x7fffffff;
+    if (absBits > 0x7f800000) {
+        // NaN: keep the top of the payload and quiet it, as F16C does
+        return sign | 0x7e00 | (uint16_t)((absBits >> 13) & 0x3ff);
+    }
+    if (absBits >= 0x477ff000) {
+        // Inf, or at least 65520 (halfway past the largest half, 65504), which rounds up to inf
+        return sign | 0x7c00;
+    }
+    if (absBits < 0x38800000) {
+        // Below the smallest normal half (2^-14): a denormal in units of 2^-24. The scale is exact, and the
+        // rounding mode is the default round to nearest even.
+        float a;
+        memcpy(&a, &absBits, sizeof(a));
+        return sign | (uint16_t)nearbyintf(a * 16777216.0f);
+    }
+
+    // Rebias the exponent and round the mantissa to nearest even; a carry correctly bumps the exponent
+    uint32_t half = (absBits - 0x38000000) >> 13;
+    uint32_t remainder = absBits & 0x1fff;
+    if ((remainder > 0x1000) || ((remainder == 0x1000) && (half & 1))) {
+        ++half;
+    }
+    return sign | (uint16_t)half;
+}
+
+void clTransformFloatToHalf(struct clContext * C, const float * src, uint16_t * dst, int count)
+{
+    if (C->simdAllowed && clTransformRunFloatToHalfBatch(C, src, dst, count)) {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        dst[i] = floatToHalf(src[i]);
+    }
+}
+
+// Lazily builds the integer -> linear table for one source depth: the plan's EOTF (or clamp) applied to every
+// possible value, using the same scalar math as colorConvert(). Caller holds transform->lock.
+static const float * ccmmSrcTable(struct clContext * C, clTransform * transform, int depth)
+{
+    if (!transform->ccmmSrcTables[depth]) {
+        int entryCount = 1 << depth;
+        float maxChannel = (float)(entryCount - 1);
+        float * table = clAllocate(sizeof(float) * entryCount);
+        for (int i = 0; i < entryCount; ++i) {
+            table[i] = (float)i / maxChannel;
+        }
+        if (clTransformPlanHasOp(&transform->ccmmPlan, CL_XOP_EOTF)) {
+            scalarEOTF(transform->ccmmSrcEOTF, transform->ccmmSrcGamma, transform->ccmmHLGExponent, table, entryCount);
+        }
+        transform->ccmmSrcTables[depth] = table;
+    }
+    return transform->ccmmSrcTables[depth];
+}
+
+// Turns stored max(R, G, B) values into nits, for content light levels
+typedef struct clLightLevelCurve
+{
+    clTransformTransferFunction eotf;
+    float param;     // as clTransformEOTF() takes it
+    float nitsScale; // nits at linear 1.0
+} clLightLevelCurve;
+
+// luminance and curveScale are what prepareLocked() settles on for this profile as a destination
+static void deriveLightLevelCurve(struct clContext * C,
+                                  struct clProfile * profile,
+                                  float luminance,
+                                  float curveScale,
+                                  clLightLevelCurve * curve)
+{
+    clProfilePrimaries primaries;
+    float gamma = 0.0f;
+    if (!derivePrimariesAndXTF(C, profile, &primaries, &curve->eotf, &gamma)) {
+        curve->eotf = CL_XTF_NONE;
+    }
+    curve->param = (curve->eotf == CL_XTF_HLG) ? luminance : gamma;
+    curve->nitsScale = luminance * curveScale;
+}
+
+// Every pixel's largest linear R, G or B in nits goes into maxCLL (the max) and lightSum (for the average). The
+// EOTF is monotonic, so only the largest stored channel of each pixel needs linearizing.
+static void accumulateLightLevels(struct clContext * C,
+                                  const clLightLevelCurve * curve,
+                                  const void * pixels,
+                                  clPixelFormat pixelFormat,
+                                  int depth,
+                                  int count,
+                                  float * maxCLL,
+                                  double * lightSum)
+{
+    float widened[CL_CHANNELS_PER_PIXEL * CL_TRANSFORM_CHUNK_PIXELS];
+    float light[CL_TRANSFORM_CHUNK_PIXELS];
+    const float maxChannel = (pixelFormat == CL_PIXELFORMAT_U16) ? (float)((1 << depth) - 1) : 255.0f;
+    for (int chunkStart = 0; chunkStart < count; chunkStart += CL_TRANSFORM_CHUNK_PIXELS) {
+        int chunkCount = CL_MIN(count - chunkStart, CL_TRANSFORM_CHUNK_PIXELS);
+        int chunkOffset = chunkStart * CL_CHANNELS_PER_PIXEL;
+
+        const float * floats = NULL;
+        if (pixelFormat == CL_PIXELFORMAT_F32) {
+            floats = &((const float *)pixels)[chunkOffset];
+        } else if (pixelFormat == CL_PIXELFORMAT_F16) {
+            clTransformHalfToFloat(C, &((const uint16_t *)pixels)[chunkOffset], widened, chunkCount, 1.0f);
+            floats = widened;
+        }
+        for (int i = 0; i < chunkCount; ++i) {
+            int index = i * CL_CHANNELS_PER_PIXEL;
+            float largest;
+            if (floats) {
+                largest = CL_MAX(CL_MAX(floats[index], floats[index + 1]), floats[index + 2]);
+            } else {
+                uint32_t r, g, b;
+                if (pixelFormat == CL_PIXELFORMAT_U8) {
+                    const uint8_t * pixel = &((const uint8_t *)pixels)[chunkOffset + index];
+                    r = pixel[0];
+                    g = pixel[1];
+                    b = pixel[2];
+                } else {
+                    const uint16_t * pixel = &((const uint16_t *)pixels)[chunkOffset + index];
+                    r = pixel[0];
+                    g = pixel[1];
+                    b = pixel[2];
+                }
+                largest = (float)CL_MAX(CL_MAX(r, g), b) / maxChannel;
+            }
+            light[i] = CL_MAX(largest, 0.0f);
+        }
+
+        clTransformEOTF(C, curve->eotf, curve->param, light, chunkCount);
+
+        double chunkSum = 0.0;
+        for (int i = 0; i < chunkCount; ++i) {
+            float nits = light[i] * curve->nitsScale;
+            *maxCLL = CL_MAX(*maxCLL, nits);
+            chunkSum += nits;
+        }
+        *lightSum += chunkSum;
+    }
+}
+
+void clTransformMeasureLightLevels(struct clContext * C,
+                                   struct clProfile * profile,
+                                   const void * pixels,
+                                   clPixelFormat pixelFormat,
+                                   int depth,
+                                   int pixelCount,
+                                   float * outMaxCLL,
+                                   float * outMaxFALL)
+{
+    // Same luminance choices prepareLocked() makes for a destination profile
+    float luminance = 1.0f;
+    float curveScale = 1.0f;
+    if (profile) {
+        clProfileCurve curve;
+        int profileLuminance = 0;
+        clProfileQuery(C, profile, NULL, &curve, &profileLuminance);
+        if (profileLuminance == CL_LUMINANCE_UNSPECIFIED) {
+            profileLuminance = C->defaultLuminance;
+            if (curve.type == CL_PCT_HLG) {
+                profileLuminance = clTransformCalcHLGLuminance(C->defaultLuminance);
+            }
+        }
+        luminance = (float)profileLuminance;
+        curveScale = curve.implicitScale;
+    }
+
+    clLightLevelCurve lightCurve;
+    deriveLightLevelCurve(C, profile, luminance, curveScale, &lightCurve);
+    if (pixelFormat == CL_PIXELFORMAT_U16) {
+        depth = CL_CLAMP(depth, 8, 16);
+    }
+
+    float maxCLL = 0.0f;
+    double lightSum = 0.0;
+    accumulateLightLevels(C, &lightCurve, pixels, pixelFormat, depth, pixelCount, &maxCLL, &lightSum);
+    *outMaxCLL = maxCLL;
+    *outMaxFALL = (pixelCount > 0) ? (float)(lightSum / pixelCount) : 0.0f;
+}
+
 typedef struct clTransformTask
 {
     clContext * C;
     clTransform * transform;
-    float * inPixels;
-    float * outPixels;
+    void * inPixels;
+    void * outPixels;
     int pixelCount;
     clBool useCCMM;
+    clBool useLUT;
+    clPixelFormat inPixelFormat;
+    int inDepth;
+    const float * inTable; // if set, integer input is linearized through this instead of normalized (never for F16)
+    clPixelFormat outPixelFormat;
+    int outDepth;
+    int firstPixel;       // index of this task's first pixel in the whole run
+    clBool collectStats;  // reduce the output into stats and light levels as it is written
+    clImageStats stats;
+    const clLightLevelCurve * lightCurve;
+    float maxCLL;
+    double lightSum;
 } clTransformTask;
 
-static void transformTaskFunc(clTransformTask * info)
+// Expands count integer RGBA pixels into floats, through table (RGB only) or normalized to [0, 1]. Half pixels are
+// just widened.
+static void unpackPixels(const clTransformTask * info, int first, int count, float * dst)
 {
-    clCCMMTransform(info->C, info->transform, info->useCCMM, info->inPixels, info->outPixels, info->pixelCount);
+    if (info->inPixelFormat == CL_PIXELFORMAT_F16) {
+        clTransformHalfToFloat(info->C, &((const uint16_t *)info->inPixels)[first * CL_CHANNELS_PER_PIXEL], dst, count, 1.0f);
+        return;
+    }
+
+    const uint32_t maxChannel = (1 << info->inDepth) - 1;
+    const float maxChannelf = (float)maxChannel;
+    const int channelCount = count * CL_CHANNELS_PER_PIXEL;
+    const int firstChannel = first * CL_CHANNELS_PER_PIXEL;
+    for (int i = 0; i < channelCount; ++i) {
+        uint32_t v;
+        if (info->inPixelFormat == CL_PIXELFORMAT_U8) {
+            v = ((const uint8_t *)info->inPixels)[firstChannel + i];
+        } else {
+            v = ((const uint16_t *)info->inPixels)[firstChannel + i];
+        }
+        v = CL_MIN(v, maxChannel);
+        if (info->inTable && ((i % CL_CHANNELS_PER_PIXEL) != 3)) {
+            dst[i] = info->inTable[v];
+        } else {
+            dst[i] = (float)v / maxChannelf;
+        }
+    }
+}
+
+static void transformTaskFunc(clTransformTask * infos, int index)
+{
+    clTransformTask * info = &infos[index];
+    clContext * C = info->C;
+    const clBool srcLinear = (info->inTable != NULL);
+    if ((info->inPixelFormat == CL_PIXELFORMAT_F32) && (info->outPixelFormat == CL_PIXELFORMAT_F32)) {
+        clCCMMTransform(
+            C, info->transform, info->useCCMM, info->useLUT, clFalse, info->inPixels, info->outPixels, info->pixelCount);
+        if (info->collectStats) {
+            clImageStatsAccumulate(
+                C, &info->stats, info->outPixels, CL_PIXELFORMAT_F32, 32, info->firstPixel, info->pixelCount);
+            accumulateLightLevels(
+                C, info->lightCurve, info->outPixels, CL_PIXELFORMAT_F32, 32, info->pixelCount, &info->maxCLL, &info->lightSum);
+        }
+        return;
+    }
+
+    // Integer and half sides go through scratch buffers a chunk at a time, small enough to stay in cache
+    int srcChannelCount = clTransformFormatToChannelCount(C, info->transform->srcFormat);
+    int dstChannelCount = clTransformFormatToChannelCount(C, info->transform->dstFormat);
+    float srcScratch[CL_CHANNELS_PER_PIXEL * CL_TRANSFORM_CHUNK_PIXELS];
+    float dstScratch[CL_CHANNELS_PER_PIXEL * CL_TRANSFORM_CHUNK_PIXELS];
+    for (int chunkStart = 0; chunkStart < info->pixelCount; chunkStart += CL_TRANSFORM_CHUNK_PIXELS) {
+        int chunkCount = CL_MIN(info->pixelCount - chunkStart, CL_TRANSFORM_CHUNK_PIXELS);
+
+        float * chunkSrc = srcScratch;
+        if (info->inPixelFormat == CL_PIXELFORMAT_F32) {
+            chunkSrc = &((float *)info->inPixels)[chunkStart * srcChannelCount];
+        } else {
+            unpackPixels(info, chunkStart, chunkCount, srcScratch);
+        }
+        float * chunkDst = dstScratch;
+        if (info->outPixelFormat == CL_PIXELFORMAT_F32) {
+            chunkDst = &((float *)info->outPixels)[chunkStart * dstChannelCount];
+        }
+
+        clCCMMTransform(C, info->transform, info->useCCMM, info->useLUT, srcLinear, chunkSrc, chunkDst, chunkCount);
+
+        if (info->outPixelFormat == CL_PIXELFORMAT_F16) {
+            uint16_t * out = &((uint16_t *)info->outPixels)[chunkStart * CL_CHANNELS_PER_PIXEL];
+            clTransformFloatToHalf(C, dstScratch, out, chunkCount * CL_CHANNELS_PER_PIXEL);
+        } else if (info->outPixelFormat != CL_PIXELFORMAT_F32) {
+            int chunkOffset = chunkStart * CL_CHANNELS_PER_PIXEL;
+            void * out = (info->outPixelFormat == CL_PIXELFORMAT_U8) ? (void *)&((uint8_t *)info->outPixels)[chunkOffset]
+                                                                      : (void *)&((uint16_t *)info->outPixels)[chunkOffset];
+            clTransformQuantize(C, dstScratch, out, info->outPixelFormat, info->outDepth, chunkCount * CL_CHANNELS_PER_PIXEL);
+        }
+
+        if (info->collectStats) {
+            // Reduce what was actually stored (quantized or rounded to half), while the chunk is still in cache
+            const uint8_t * out = (const uint8_t *)info->outPixels;
+            out += (size_t)chunkStart * CL_BYTES_PER_PIXEL(info->outPixelFormat);
+            clImageStatsAccumulate(
+                C, &info->stats, out, info->outPixelFormat, info->outDepth, info->firstPixel + chunkStart, chunkCount);
+            accumulateLightLevels(
+                C, info->lightCurve, out, info->outPixelFormat, info->outDepth, chunkCount, &info->maxCLL, &info->lightSum);
+        }
+    }
 }
 
 void clTransformRun(struct clContext * C, clTransform * transform, float * srcPixels, float * dstPixels, int pixelCount)
+{
+    clTransformRunPixels(C, transform, srcPixels, CL_PIXELFORMAT_F32, 32, dstPixels, CL_PIXELFORMAT_F32, 32, pixelCount);
+}
+
+static int clampPixelDepth(clPixelFormat pixelFormat, int depth)
+{
+    switch (pixelFormat) {
+        case CL_PIXELFORMAT_U8:
+            return 8;
+        case CL_PIXELFORMAT_U16:
+            return CL_CLAMP(depth, 8, 16);
+        default:
+            break;
+    }
+    return 32;
+}
+
+void clTransformRunPixels(struct clContext * C,
+                          clTransform * transform,
+                          void * srcPixels,
+                          clPixelFormat srcPixelFormat,
+                          int srcDepth,
+                          void * dstPixels,
+                          clPixelFormat dstPixelFormat,
+                          int dstDepth,
+                          int pixelCount)
+{
+    clTransformRunPixelsWithStats(
+        C, transform, srcPixels, srcPixelFormat, srcDepth, dstPixels, dstPixelFormat, dstDepth, pixelCount, NULL);
+}
+
+void clTransformRunPixelsWithStats(struct clContext * C,
+                                   clTransform * transform,
+                                   void * srcPixels,
+                                   clPixelFormat srcPixelFormat,
+                                   int srcDepth,
+                                   void * dstPixels,
+                                   clPixelFormat dstPixelFormat,
+                                   int dstDepth,
+                                   int pixelCount,
+                                   struct clImageStats * dstStats)
 {
     int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
     int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
+    COLORIST_ASSERT((srcPixelFormat == CL_PIXELFORMAT_F32) || (transform->srcFormat == CL_XF_RGBA));
+    COLORIST_ASSERT((dstPixelFormat == CL_PIXELFORMAT_F32) || (transform->dstFormat == CL_XF_RGBA));
+    COLORIST_ASSERT(!dstStats || (transform->dstFormat == CL_XF_RGBA));
+    srcDepth = clampPixelDepth(srcPixelFormat, srcDepth);
+    dstDepth = clampPixelDepth(dstPixelFormat, dstDepth);
     clBool useCCMM = clTransformUsesCCMM(C, transform);
     int taskCount = C->jobs;
 
-    clTransformPrepare(C, transform);
+    // Everything lazily built on the transform is settled here, under its lock, before any tasks share it
+    clMutexLock(transform->lock);
+    prepareLocked(C, transform);
+
+    // Bake the LittleCMS conversion when the image is big enough to pay for it (or reuse an earlier bake). A
+    // grid of another size is left alone, since concurrent runs of this transform may be using it.
+    clBool useLUT = clFalse;
+    clBool bake = clFalse;
+    if (!useCCMM && (C->lutSize > 0) && !clTransformPlanHasOp(&transform->lcmsPlan, CL_XOP_COPY)) {
+        int64_t gridPoints = (int64_t)C->lutSize * C->lutSize * C->lutSize;
+        if (transform->lut) {
+            useLUT = (transform->lutSize == C->lutSize);
+        } else {
+            bake = ((int64_t)pixelCount >= (gridPoints * CL_TRANSFORM_LUT_BAKE_RATIO));
+        }
+    }
+
+    // Integer sources feed the CCMM matrix stage straight from a table
+    const float * srcTable = NULL;
+    clBool srcInteger = (srcPixelFormat == CL_PIXELFORMAT_U8) || (srcPixelFormat == CL_PIXELFORMAT_U16);
+    if (srcInteger && useCCMM && !clTransformPlanHasOp(&transform->ccmmPlan, CL_XOP_COPY)) {
+        srcTable = ccmmSrcTable(C, transform, srcDepth);
+    }
+    clMutexUnlock(transform->lock);
+
+    if (bake) {
+        useLUT = bakeLUT(C, transform, C->lutSize, clFalse);
+    }
+
+    // Light levels are measured on the stored destination values, in the nits the destination profile gives them
+    clLightLevelCurve lightCurve;
+    if (dstStats) {
+        deriveLightLevelCurve(C, transform->dstProfile, transform->dstLuminanceScale, transform->dstCurveScale, &lightCurve);
+    }
 
     if (taskCount > pixelCount) {
         // This is a dumb corner case I'm not too worried about.
         taskCount = pixelCount;
     }
+    if (taskCount < 1) {
+        taskCount = 1;
+    }
 
+    int pixelsPerTask = pixelCount / taskCount;
+    int lastTaskPixelCount = pixelCount - (pixelsPerTask * (taskCount - 1));
+    clTransformTask singleInfo;
+    clTransformTask * infos = (taskCount == 1) ? &singleInfo : clAllocate(taskCount * sizeof(clTransformTask));
+    for (int i = 0; i < taskCount; ++i) {
+        size_t inOffset = (size_t)i * pixelsPerTask * srcChannelCount * CL_BYTES_PER_CHANNEL[srcPixelFormat];
+        size_t outOffset = (size_t)i * pixelsPerTask * dstChannelCount * CL_BYTES_PER_CHANNEL[dstPixelFormat];
+        infos[i].C = C;
+        infos[i].transform = transform;
+        infos[i].inPixels = (uint8_t *)srcPixels + inOffset;
+        infos[i].outPixels = (uint8_t *)dstPixels + outOffset;
+        infos[i].pixelCount = (i == (taskCount - 1)) ? lastTaskPixelCount : pixelsPerTask;
+        infos[i].useCCMM = useCCMM;
+        infos[i].useLUT = useLUT;
+        infos[i].inPixelFormat = srcPixelFormat;
+        infos[i].inDepth = srcDepth;
+        infos[i].inTable = srcTable;
+        infos[i].outPixelFormat = dstPixelFormat;
+        infos[i].outDepth = dstDepth;
+        infos[i].firstPixel = i * pixelsPerTask;
+        infos[i].collectStats = (dstStats != NULL);
+        infos[i].lightCurve = &lightCurve;
+        infos[i].maxCLL = 0.0f;
+        infos[i].lightSum = 0.0;
+        if (dstStats) {
+            clImageStatsReset(&infos[i].stats);
+        }
+    }
     if (taskCount == 1) {
-        // Don't bother making any new threads
-        clTransformTask info;
-        info.C = C;
-        info.transform = transform;
-        info.inPixels = srcPixels;
-        info.outPixels = dstPixels;
-        info.pixelCount = pixelCount;
-        info.useCCMM = useCCMM;
-        transformTaskFunc(&info);
+        // Don't bother the task pool
+        transformTaskFunc(infos, 0);
     } else {
-        int pixelsPerTask = pixelCount / taskCount;
-        int lastTaskPixelCount = pixelCount - (pixelsPerTask * (taskCount - 1));
-        clTask ** tasks;
-        clTransformTask * infos;
-        int i;
+        clTaskParallelFor(C, taskCount, (clTaskIndexFunc)transformTaskFunc, infos);
+    }
 
-        tasks = clAllocate(taskCount * sizeof(clTask *));
-        infos = clAllocate(taskCount * sizeof(clTransformTask));
-        for (i = 0; i < taskCount; ++i) {
-            infos[i].C = C;
-            infos[i].transform = transform;
-            infos[i].inPixels = &srcPixels[i * pixelsPerTask * srcChannelCount];
-            infos[i].outPixels = &dstPixels[i * pixelsPerTask * dstChannelCount];
-            infos[i].pixelCount = (i == (taskCount - 1)) ? lastTaskPixelCount : pixelsPerTask;
-            infos[i].useCCMM = useCCMM;
-            tasks[i] = clTaskCreate(C, (clTaskFunc)transformTaskFunc, &infos[i]);
+    if (dstStats) {
+        clImageStatsReset(dstStats);
+        float maxCLL = 0.0f;
+        double lightSum = 0.0;
+        for (int i = 0; i < taskCount; ++i) {
+            clImageStatsMerge(dstStats, &infos[i].stats);
+            maxCLL = CL_MAX(maxCLL, infos[i].maxCLL);
+            lightSum += infos[i].lightSum;
         }
-
-        for (i = 0; i < taskCount; ++i) {
-            clTaskDestroy(C, tasks[i]);
+        dstStats->maxCLL = maxCLL;
+        dstStats->maxFALL = (pixelCount > 0) ? (float)(lightSum / pixelCount) : 0.0f;
+        if (pixelCount < 1) {
+            memset(dstStats->channelMin, 0, sizeof(dstStats->channelMin));
+            memset(dstStats->channelMax, 0, sizeof(dstStats->channelMax));
         }
-
-        clFree(tasks);
+    }
+    if (infos != &singleInfo) {
         clFree(infos);
     }
 }
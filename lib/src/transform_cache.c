@@ -0,0 +1,188 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "colorist/transform.h"
+
+#include "colorist/context.h"
+#include "colorist/profile.h"
+#include "colorist/task.h"
+
+#include <string.h>
+
+clTransformCache * clTransformCacheCreate(struct clContext * C, int capacity)
+{
+    clTransformCache * cache = clAllocateStruct(clTransformCache);
+    memset(cache, 0, sizeof(clTransformCache));
+    cache->capacity = (capacity > 0) ? capacity : 0;
+    if (cache->capacity > 0) {
+        cache->entries = clAllocate(sizeof(clTransformCacheEntry) * cache->capacity);
+    }
+    cache->lock = clMutexCreate(C);
+    return cache;
+}
+
+void clTransformCacheDestroy(struct clContext * C, clTransformCache * cache)
+{
+    for (int i = 0; i < cache->count; ++i) {
+        COLORIST_ASSERT(cache->entries[i].refCount == 0);
+        clTransformDestroy(C, cache->entries[i].transform);
+    }
+    if (cache->entries) {
+        clFree(cache->entries);
+    }
+    clMutexDestroy(C, cache->lock);
+    clFree(cache);
+}
+
+// Returns clFalse if the profile can't be keyed (created in memory and never packed)
+static clBool copySignature(uint8_t signature[16], struct clProfile * profile)
+{
+    memset(signature, 0, 16);
+    if (!profile) {
+        return clTrue; // XYZ
+    }
+    memcpy(signature, profile->signature, 16);
+    for (int i = 0; i < 16; ++i) {
+        if (signature[i] != 0) {
+            return clTrue;
+        }
+    }
+    return clFalse;
+}
+
+// Job contexts share their root's cache, which is created on first use
+static clTransformCache * rootCache(struct clContext * C, clBool create)
+{
+    clContext * root = C->parent ? C->parent : C;
+    clMutexLock(root->lock);
+    if (!root->transformCache && create) {
+        root->transformCache = clTransformCacheCreate(root, CL_TRANSFORM_CACHE_DEFAULT_CAPACITY);
+    }
+    clTransformCache * cache = root->transformCache;
+    clMutexUnlock(root->lock);
+    return cache;
+}
+
+static clBool keysMatch(const clTransformCacheEntry * a, const clTransformCacheEntry * b)
+{
+    return !memcmp(a->srcSignature, b->srcSignature, 16) && !memcmp(a->dstSignature, b->dstSignature, 16) &&
+           (a->srcFormat == b->srcFormat) && (a->dstFormat == b->dstFormat) && (a->tonemap == b->tonemap) &&
+           !memcmp(&a->tonemapParams, &b->tonemapParams, sizeof(clTonemapParams)) &&
+           (a->defaultLuminance == b->defaultLuminance);
+}
+
+clTransform * clTransformCacheAcquire(struct clContext * C,
+                                      struct clProfile * srcProfile,
+                                      clTransformFormat srcFormat,
+                                      struct clProfile * dstProfile,
+                                      clTransformFormat dstFormat,
+                                      clTonemap tonemap,
+                                      const clTonemapParams * tonemapParams)
+{
+    clTransformCache * cache = rootCache(C, clTrue);
+
+    clTransformCacheEntry key;
+    memset(&key, 0, sizeof(key));
+    clBool keyable = copySignature(key.srcSignature, srcProfile);
+    keyable = copySignature(key.dstSignature, dstProfile) && keyable;
+    key.srcFormat = srcFormat;
+    key.dstFormat = dstFormat;
+    key.tonemap = tonemap;
+    if (tonemapParams) {
+        key.tonemapParams = *tonemapParams;
+    } else {
+        clTonemapParamsSetDefaults(C, &key.tonemapParams);
+    }
+    key.defaultLuminance = C->defaultLuminance;
+
+    clMutexLock(cache->lock); // held across creation too, so concurrent misses on one key build it once
+    ++cache->clock;
+    if (keyable) {
+        for (int i = 0; i < cache->count; ++i) {
+            clTransformCacheEntry * entry = &cache->entries[i];
+            if (keysMatch(entry, &key)) {
+                ++cache->hits;
+                ++entry->refCount;
+                entry->lastUsed = cache->clock;
+                clTransformPrepare(C, entry->transform); // no-op unless the CMM choice changed (--ccmm)
+                clMutexUnlock(cache->lock);
+                return entry->transform;
+            }
+        }
+    }
+    ++cache->misses;
+
+    // Cached transforms own clones of their profiles, so they outlive the caller's copies
+    clProfile * srcClone = srcProfile ? clProfileClone(C, srcProfile) : NULL;
+    clProfile * dstClone = dstProfile ? clProfileClone(C, dstProfile) : NULL;
+    clTransform * transform;
+    if ((srcProfile && !srcClone) || (dstProfile && !dstClone)) {
+        // Couldn't clone, fall back to a private transform using the caller's profiles
+        if (srcClone) {
+            clProfileDestroy(C, srcClone);
+        }
+        if (dstClone) {
+            clProfileDestroy(C, dstClone);
+        }
+        transform = clTransformCreate(C, srcProfile, srcFormat, dstProfile, dstFormat, tonemap);
+        keyable = clFalse;
+    } else {
+        transform = clTransformCreate(C, srcClone, srcFormat, dstClone, dstFormat, tonemap);
+        transform->ownsProfiles = clTrue;
+    }
+    transform->tonemapParams = key.tonemapParams;
+    clTransformPrepare(C, transform);
+
+    if (keyable) {
+        // Find a slot: a free one, or the least recently used entry nobody is holding
+        clTransformCacheEntry * slot = NULL;
+        if (cache->count < cache->capacity) {
+            slot = &cache->entries[cache->count++];
+        } else {
+            for (int i = 0; i < cache->count; ++i) {
+                clTransformCacheEntry * entry = &cache->entries[i];
+                if ((entry->refCount == 0) && (!slot || (entry->lastUsed < slot->lastUsed))) {
+                    slot = entry;
+                }
+            }
+            if (slot) {
+                ++cache->evictions;
+                clTransformDestroy(C, slot->transform);
+            }
+        }
+
+        if (slot) {
+            *slot = key;
+            slot->transform = transform;
+            slot->refCount = 1;
+            slot->lastUsed = cache->clock;
+        }
+    }
+    clMutexUnlock(cache->lock);
+    return transform;
+}
+
+void clTransformCacheRelease(struct clContext * C, clTransform * transform)
+{
+    clTransformCache * cache = rootCache(C, clFalse);
+    if (cache) {
+        clMutexLock(cache->lock);
+        for (int i = 0; i < cache->count; ++i) {
+            clTransformCacheEntry * entry = &cache->entries[i];
+            if (entry->transform == transform) {
+                COLORIST_ASSERT(entry->refCount > 0);
+                --entry->refCount;
+                clMutexUnlock(cache->lock);
+                return;
+            }
+        }
+        clMutexUnlock(cache->lock);
+    }
+
+    // Never made it into the cache
+    clTransformDestroy(C, transform);
+}
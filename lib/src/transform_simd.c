@@ -0,0 +1,760 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "colorist/transform.h"
+
+#include "colorist/context.h"
+#include "colorist/profile.h"
+
+#include <math.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------------
+// Batched CCMM kernel, transfer functions, baked LUT interpolation and quantization
+//
+// clTransformRunCCMMBatch() mirrors colorConvert() in transform.c (keep them in
+// sync!), but works on CL_TRANSFORM_SIMD_WIDTH pixels at a time in
+// structure-of-arrays registers. Arithmetic is done in the same order as the
+// scalar code so linear values match; only the transcendentals differ
+// (polynomial log/exp below instead of libm). See CL_TRANSFORM_SIMD_TOLERANCE
+// in transform.h.
+//
+// C->curvePrecision picks the polynomials: CL_CURVEPRECISION_EXACT uses
+// Cephes-style natural log/exp (~1 ulp), CL_CURVEPRECISION_FAST uses short
+// minimax log2/exp2 fits. See CL_TRANSFORM_CURVE_TOLERANCE_* in transform.h.
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+// SMPTE ST.2084 / ARIB STD-B67 constants, see transform.c
+#define PQ_C1 0.8359375f
+#define PQ_C2 18.8515625f
+#define PQ_C3 18.6875f
+#define PQ_M1 0.1593017578125f
+#define PQ_M2 78.84375f
+#define HLG_A 0.17883277f
+#define HLG_B 0.28466892f
+#define HLG_C 0.55991072953f
+
+// Cephes-style natural log, ~1 ulp over all positive finite floats (including denormals).
+// Lanes <= 0 produce garbage; callers mask them.
+static inline __m256 simdLog(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    // Rescale denormals so the exponent extraction below stays valid
+    __m256 denormal = _mm256_cmp_ps(x, _mm256_set1_ps(1.17549435e-38f), _CMP_LT_OQ);
+    x = _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(8388608.0f)), denormal);
+    __m256 exponentBias = _mm256_blendv_ps(_mm256_set1_ps(126.0f), _mm256_set1_ps(149.0f), denormal);
+
+    // x = m * 2^e, m in [0.5, 1)
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 23)), exponentBias);
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                   _mm256_castps_si256(_mm256_set1_ps(0.5f))));
+
+    // Shift m into [sqrt(0.5), sqrt(2)) to keep the polynomial argument small
+    __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(one, small));
+    m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(m, small)), one);
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.1514610310e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.1676998740e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.2420140846e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.4249322787e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.6668057665e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(2.0000714765e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-2.4999993993e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(3.3333331174e-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, z), m);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+    y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+    return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), _mm256_add_ps(m, y));
+}
+
+// Cephes-style exp, ~1 ulp. Inputs are clamped to the representable range.
+static inline __m256 simdExp(__m256 x)
+{
+    x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.3365447504f)); // smallest normal result
+
+    __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+
+    __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+
+    __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+// log2(x) for normal positive floats: log2(1+t) = t*p(t), with p a degree 5 minimax fit for
+// t in [sqrt(0.5)-1, sqrt(2)-1]. Max absolute error ~2.2e-6. Denormals, zero and negatives produce
+// garbage; callers mask them.
+static inline __m256 simdLog2Fast(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    // x = m * 2^e, m in [1, 2)
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                   _mm256_castps_si256(one)));
+
+    // Shift m into [sqrt(0.5), sqrt(2))
+    __m256 large = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356237309505f), _CMP_GE_OQ);
+    e = _mm256_add_ps(e, _mm256_and_ps(one, large));
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), large);
+    __m256 t = _mm256_sub_ps(m, one);
+
+    __m256 p = _mm256_set1_ps(-2.065898891e-01f);
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(3.221543186e-01f));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(-3.674902527e-01f));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(4.793480640e-01f));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(-7.211318479e-01f));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(1.442713481e+00f));
+    return _mm256_fmadd_ps(p, t, e);
+}
+
+// 2^x: 2^n * p(f) with f in [-0.5, 0.5] and p a degree 4 minimax fit. Max relative error ~2.6e-6.
+static inline __m256 simdExp2Fast(__m256 x)
+{
+    x = _mm256_min_ps(x, _mm256_set1_ps(127.49f));
+    x = _mm256_max_ps(x, _mm256_set1_ps(-126.0f)); // smallest normal result
+
+    __m256 n = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 f = _mm256_sub_ps(x, n);
+
+    __m256 p = _mm256_set1_ps(9.570096670e-03f);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(5.591785991e-02f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(2.402474496e-01f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(6.931218148e-01f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(9.999992614e-01f));
+
+    __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2n));
+}
+
+static inline __m256 simdLogP(__m256 x, clCurvePrecision precision)
+{
+    if (precision == CL_CURVEPRECISION_FAST) {
+        return _mm256_mul_ps(simdLog2Fast(x), _mm256_set1_ps(0.693147180559945309f));
+    }
+    return simdLog(x);
+}
+
+static inline __m256 simdExpP(__m256 x, clCurvePrecision precision)
+{
+    if (precision == CL_CURVEPRECISION_FAST) {
+        return simdExp2Fast(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)));
+    }
+    return simdExp(x);
+}
+
+// e^x - 1, accurate near 0 (where simdExp(x) - 1 would cancel). Taylor series for |x| < 0.25.
+static inline __m256 simdExpm1(__m256 x, clCurvePrecision precision)
+{
+    __m256 y = _mm256_set1_ps(1.0f / 40320.0f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.0f / 5040.0f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.0f / 720.0f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.0f / 120.0f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.0f / 24.0f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.0f / 6.0f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(0.5f));
+    y = _mm256_fmadd_ps(_mm256_mul_ps(y, x), x, x);
+
+    __m256 large = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), x), _mm256_set1_ps(0.25f), _CMP_GE_OQ);
+    return _mm256_blendv_ps(y, _mm256_sub_ps(simdExpP(x, precision), _mm256_set1_ps(1.0f)), large);
+}
+
+// x^y for x >= 0 (lanes with x <= 0 return 0, matching powf(0, y > 0))
+static inline __m256 simdPow(__m256 x, __m256 y, clCurvePrecision precision)
+{
+    if (precision == CL_CURVEPRECISION_FAST) {
+        // Denormal bases flush to 0 here; simdLog2Fast() doesn't handle them
+        __m256 normal = _mm256_cmp_ps(x, _mm256_set1_ps(1.17549435e-38f), _CMP_GE_OQ);
+        __m256 result = simdExp2Fast(_mm256_mul_ps(y, simdLog2Fast(x)));
+        return _mm256_and_ps(result, normal);
+    }
+
+    __m256 positive = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 result = simdExp(_mm256_mul_ps(y, simdLog(x)));
+    return _mm256_and_ps(result, positive);
+}
+
+static inline __m256 simdClampZero(__m256 v)
+{
+    // max() returns the second operand when the first is NaN, so NaNs clamp to 0 like the scalar ternaries
+    return _mm256_max_ps(v, _mm256_setzero_ps());
+}
+
+static inline __m256 simdClampZeroOne(__m256 v)
+{
+    return _mm256_min_ps(simdClampZero(v), _mm256_set1_ps(1.0f));
+}
+
+typedef struct clSIMDCurveParams
+{
+    clTransformTransferFunction xtf;
+    __m256 gamma;        // CL_XTF_GAMMA (already inverted for OETFs)
+    clBool linear;       // CL_XTF_GAMMA with a gamma of exactly 1 (powf() is exact there, simdPow() isn't)
+    __m256 hlgExponent;  // CL_XTF_HLG OOTF exponent (inverted for OETFs)
+    clCurvePrecision precision;
+} clSIMDCurveParams;
+
+// gamma and hlgExponent are passed already inverted for OETFs
+static void simdCurveParamsInit(clSIMDCurveParams * curve,
+                                clTransformTransferFunction xtf,
+                                float gamma,
+                                float hlgExponent,
+                                clCurvePrecision precision)
+{
+    curve->xtf = xtf;
+    curve->gamma = _mm256_set1_ps(gamma);
+    curve->linear = (gamma == 1.0f);
+    curve->hlgExponent = _mm256_set1_ps(hlgExponent);
+    curve->precision = precision;
+}
+
+static inline __m256 simdEOTF(const clSIMDCurveParams * curve, __m256 v)
+{
+    switch (curve->xtf) {
+        case CL_XTF_NONE:
+            break;
+        case CL_XTF_GAMMA:
+            v = simdClampZero(v);
+            return curve->linear ? v : simdPow(v, curve->gamma, curve->precision);
+        case CL_XTF_SRGB: {
+            __m256 linear = _mm256_div_ps(v, _mm256_set1_ps(12.92f));
+            __m256 curved =
+                simdPow(_mm256_div_ps(_mm256_add_ps(v, _mm256_set1_ps(0.055f)), _mm256_set1_ps(1.055f)), _mm256_set1_ps(2.4f), curve->precision);
+            return _mm256_blendv_ps(curved, linear, _mm256_cmp_ps(v, _mm256_set1_ps(0.04045f), _CMP_LE_OQ));
+        }
+        case CL_XTF_HLG: {
+            v = simdClampZero(v);
+            __m256 low = _mm256_div_ps(_mm256_mul_ps(v, v), _mm256_set1_ps(3.0f));
+            __m256 high = simdExpP(_mm256_div_ps(_mm256_sub_ps(v, _mm256_set1_ps(HLG_C)), _mm256_set1_ps(HLG_A)), curve->precision);
+            high = _mm256_div_ps(_mm256_add_ps(high, _mm256_set1_ps(HLG_B)), _mm256_set1_ps(12.0f));
+            __m256 L = _mm256_blendv_ps(high, low, _mm256_cmp_ps(v, _mm256_set1_ps(0.5f), _CMP_LT_OQ));
+            return simdPow(L, curve->hlgExponent, curve->precision);
+        }
+        case CL_XTF_PQ: {
+            // N^(1/m2) sits just below 1 for most of the range, and both (N^(1/m2) - c1) and (c2 - c3*N^(1/m2))
+            // cancel badly there, so work with (N^(1/m2) - 1) directly. This is a little more accurate than
+            // the scalar powf() version; most of the difference between the two comes from the scalar side.
+            __m256 N1m2m1 = simdExpm1(_mm256_mul_ps(simdLogP(v, curve->precision), _mm256_set1_ps(1.0f / PQ_M2)), curve->precision);
+            N1m2m1 = _mm256_blendv_ps(N1m2m1, _mm256_set1_ps(-1.0f), _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LE_OQ));
+            __m256 N1m2c1 = simdClampZero(_mm256_add_ps(N1m2m1, _mm256_set1_ps(1.0f - PQ_C1)));
+            __m256 c2c3N1m2 = _mm256_fnmadd_ps(_mm256_set1_ps(PQ_C3), N1m2m1, _mm256_set1_ps(PQ_C2 - PQ_C3));
+            return simdPow(_mm256_div_ps(N1m2c1, c2c3N1m2), _mm256_set1_ps(1.0f / PQ_M1), curve->precision);
+        }
+    }
+    return v;
+}
+
+// v must already be clamped the way colorConvert() clamps it
+static inline __m256 simdOETF(const clSIMDCurveParams * curve, __m256 v)
+{
+    switch (curve->xtf) {
+        case CL_XTF_NONE:
+            break;
+        case CL_XTF_GAMMA:
+            v = simdClampZero(v);
+            return curve->linear ? v : simdPow(v, curve->gamma, curve->precision);
+        case CL_XTF_SRGB: {
+            __m256 linear = _mm256_mul_ps(v, _mm256_set1_ps(12.92f));
+            __m256 curved = _mm256_fmsub_ps(simdPow(v, _mm256_set1_ps(1.0f / 2.4f), curve->precision), _mm256_set1_ps(1.055f), _mm256_set1_ps(0.055f));
+            return _mm256_blendv_ps(curved, linear, _mm256_cmp_ps(v, _mm256_set1_ps(0.0031308f), _CMP_LE_OQ));
+        }
+        case CL_XTF_HLG: {
+            __m256 N = simdPow(simdClampZero(v), curve->hlgExponent, curve->precision);
+            __m256 low = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), N));
+            __m256 high = simdLogP(_mm256_fmsub_ps(_mm256_set1_ps(12.0f), N, _mm256_set1_ps(HLG_B)), curve->precision);
+            high = _mm256_fmadd_ps(_mm256_set1_ps(HLG_A), high, _mm256_set1_ps(HLG_C));
+            return _mm256_blendv_ps(high, low, _mm256_cmp_ps(N, _mm256_set1_ps(1.0f / 12.0f), _CMP_LE_OQ));
+        }
+        case CL_XTF_PQ: {
+            __m256 Lm1 = simdPow(simdClampZero(v), _mm256_set1_ps(PQ_M1), curve->precision);
+            __m256 num = _mm256_fmadd_ps(_mm256_set1_ps(PQ_C2), Lm1, _mm256_set1_ps(PQ_C1));
+            __m256 den = _mm256_fmadd_ps(_mm256_set1_ps(PQ_C3), Lm1, _mm256_set1_ps(1.0f));
+            return simdPow(_mm256_div_ps(num, den), _mm256_set1_ps(PQ_M2), curve->precision);
+        }
+    }
+    return v;
+}
+
+clBool clTransformRunCurveBatch(struct clContext * C,
+                                clTransformTransferFunction xtf,
+                                float param,
+                                clBool oetf,
+                                float * values,
+                                int count)
+{
+    clSIMDCurveParams curve;
+    if (oetf) {
+        float invGamma = (param != 0.0f) ? (1.0f / param) : 0.0f;
+        float invExponent = 1.0f / clTransformCalcHLGExponent(param);
+        simdCurveParamsInit(&curve, xtf, invGamma, invExponent, C->curvePrecision);
+    } else {
+        simdCurveParamsInit(&curve, xtf, param, clTransformCalcHLGExponent(param), C->curvePrecision);
+    }
+
+    int index = 0;
+    for (; index + CL_TRANSFORM_SIMD_WIDTH <= count; index += CL_TRANSFORM_SIMD_WIDTH) {
+        __m256 v = _mm256_loadu_ps(&values[index]);
+        _mm256_storeu_ps(&values[index], oetf ? simdOETF(&curve, v) : simdEOTF(&curve, v));
+    }
+    if (index < count) {
+        // Pad the tail out to a full register
+        float tail[CL_TRANSFORM_SIMD_WIDTH] = { 0 };
+        memcpy(tail, &values[index], sizeof(float) * (count - index));
+        __m256 v = _mm256_loadu_ps(tail);
+        _mm256_storeu_ps(tail, oetf ? simdOETF(&curve, v) : simdEOTF(&curve, v));
+        memcpy(&values[index], tail, sizeof(float) * (count - index));
+    }
+    return clTrue;
+}
+
+// Same operation order as gb_mat3_mul_vec3() (no FMA), so linear values match the scalar path exactly
+static inline void simdMatrixMultiply(const gbMat3 * m, __m256 * a, __m256 * b, __m256 * c)
+{
+    const float * e = m->e;
+    __m256 x = *a, y = *b, z = *c;
+    *a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[0]), x), _mm256_mul_ps(_mm256_set1_ps(e[1]), y)),
+                       _mm256_mul_ps(_mm256_set1_ps(e[2]), z));
+    *b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[3]), x), _mm256_mul_ps(_mm256_set1_ps(e[4]), y)),
+                       _mm256_mul_ps(_mm256_set1_ps(e[5]), z));
+    *c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[6]), x), _mm256_mul_ps(_mm256_set1_ps(e[7]), y)),
+                       _mm256_mul_ps(_mm256_set1_ps(e[8]), z));
+}
+
+clBool clTransformRunCCMMBatch(struct clContext * C,
+                               clTransform * transform,
+                               clBool srcLinear,
+                               const float * srcPixels,
+                               int srcChannelCount,
+                               float * dstPixels,
+                               int dstChannelCount,
+                               int pixelCount)
+{
+    const clCurvePrecision precision = C->curvePrecision;
+    clSIMDCurveParams srcCurve, dstCurve;
+    simdCurveParamsInit(&srcCurve,
+                        srcLinear ? CL_XTF_NONE : transform->ccmmSrcEOTF,
+                        transform->ccmmSrcGamma,
+                        transform->ccmmHLGExponent,
+                        precision);
+    simdCurveParamsInit(&dstCurve, transform->ccmmDstOETF, transform->ccmmDstInvGamma, 1.0f / transform->ccmmHLGExponent, precision);
+
+    const clTransformPlan * plan = &transform->ccmmPlan;
+    const clBool fusedMatrix = clTransformPlanHasOp(plan, CL_XOP_MATRIX);
+    const clBool viaXYZ = clTransformPlanHasOp(plan, CL_XOP_TO_XYZ);
+    const clBool scaleLuminance = clTransformPlanHasOp(plan, CL_XOP_LUMINANCE);
+    const clBool clampDst = clTransformPlanHasOp(plan, CL_XOP_CLAMP_DST);
+    const clBool tonemap = transform->tonemapEnabled;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 srcCurveScale = _mm256_set1_ps(transform->srcCurveScale);
+    const __m256 srcLuminanceScale = _mm256_set1_ps(transform->srcLuminanceScale);
+    const __m256 dstLuminanceScale = _mm256_set1_ps(transform->dstLuminanceScale);
+    const __m256 dstCurveScale = _mm256_set1_ps(transform->dstCurveScale);
+    const float contrast = transform->tonemapParams.contrast;
+    const float power = transform->tonemapParams.power;
+    const __m256 clipPoint = _mm256_set1_ps(transform->tonemapParams.clipPoint);
+    const __m256 speed = _mm256_set1_ps(transform->tonemapParams.speed);
+
+    // if tonemapping is necessary, luminance scale MUST be enabled
+    COLORIST_ASSERT(!tonemap || scaleLuminance);
+
+    for (int pixelIndex = 0; pixelIndex < pixelCount; pixelIndex += CL_TRANSFORM_SIMD_WIDTH) {
+        int batchCount = pixelCount - pixelIndex;
+        if (batchCount > CL_TRANSFORM_SIMD_WIDTH) {
+            batchCount = CL_TRANSFORM_SIMD_WIDTH;
+        }
+
+        // Deinterleave into SoA lanes (unused lanes in the final batch are zero filled)
+        float soa[4][CL_TRANSFORM_SIMD_WIDTH];
+        const float * srcPixel = &srcPixels[pixelIndex * srcChannelCount];
+        for (int i = 0; i < CL_TRANSFORM_SIMD_WIDTH; ++i) {
+            if (i < batchCount) {
+                soa[0][i] = srcPixel[0];
+                soa[1][i] = srcPixel[1];
+                soa[2][i] = srcPixel[2];
+                soa[3][i] = (srcChannelCount > 3) ? srcPixel[3] : 1.0f;
+                srcPixel += srcChannelCount;
+            } else {
+                soa[0][i] = 0.0f;
+                soa[1][i] = 0.0f;
+                soa[2][i] = 0.0f;
+                soa[3][i] = 1.0f;
+            }
+        }
+
+        __m256 r = simdEOTF(&srcCurve, _mm256_loadu_ps(soa[0]));
+        __m256 g = simdEOTF(&srcCurve, _mm256_loadu_ps(soa[1]));
+        __m256 b = simdEOTF(&srcCurve, _mm256_loadu_ps(soa[2]));
+
+        if (fusedMatrix) {
+            // Straight to dst linear, luminance scale included
+            simdMatrixMultiply(&plan->matrix, &r, &g, &b);
+        } else if (viaXYZ) {
+            // RGB -> XYZ
+            simdMatrixMultiply(&transform->ccmmSrcToXYZ, &r, &g, &b);
+        }
+
+        if (scaleLuminance) {
+            // xyY round trip, step for step with clTransformXYZToXYY() / clTransformXYYToXYZ(). Pixels with
+            // (X+Y+Z) <= 0 or a nonpositive scaled Y end up black.
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(r, g), b);
+            __m256 valid = _mm256_cmp_ps(sum, _mm256_setzero_ps(), _CMP_GT_OQ);
+            __m256 x = _mm256_div_ps(r, sum);
+            __m256 y = _mm256_div_ps(g, sum);
+            __m256 Y = _mm256_mul_ps(g, srcCurveScale);
+            Y = _mm256_mul_ps(Y, srcLuminanceScale);
+            Y = _mm256_div_ps(Y, dstLuminanceScale);
+            Y = _mm256_div_ps(Y, dstCurveScale);
+            if (tonemap) {
+                // reinhard tonemap, with additional tuning (see context.h for attribution)
+                __m256 z = simdClampZero(Y);
+                if (contrast != 1.0f) {
+                    z = simdPow(z, _mm256_set1_ps(contrast), precision);
+                }
+                __m256 zp = (power != 1.0f) ? simdPow(z, _mm256_set1_ps(power), precision) : z;
+                Y = _mm256_div_ps(z, _mm256_add_ps(_mm256_mul_ps(zp, clipPoint), speed));
+            }
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(Y, _mm256_setzero_ps(), _CMP_GT_OQ));
+            r = _mm256_and_ps(_mm256_div_ps(_mm256_mul_ps(x, Y), y), valid);
+            g = _mm256_and_ps(Y, valid);
+            b = _mm256_and_ps(_mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, x), y), Y), y), valid);
+        }
+
+        if (viaXYZ) {
+            // XYZ -> RGB
+            simdMatrixMultiply(&transform->ccmmXYZToDst, &r, &g, &b);
+        }
+
+        if (clampDst) { // don't clamp XYZ
+            if ((dstCurve.xtf == CL_XTF_HLG) || (dstCurve.xtf == CL_XTF_PQ)) {
+                r = simdClampZeroOne(r);
+                g = simdClampZeroOne(g);
+                b = simdClampZeroOne(b);
+            } else {
+                r = simdClampZero(r); // clamp (allow overranging)
+                g = simdClampZero(g);
+                b = simdClampZero(b);
+            }
+        }
+
+        _mm256_storeu_ps(soa[0], simdOETF(&dstCurve, r));
+        _mm256_storeu_ps(soa[1], simdOETF(&dstCurve, g));
+        _mm256_storeu_ps(soa[2], simdOETF(&dstCurve, b));
+
+        // Reinterleave (alpha is copied through, or set to full when the source has none)
+        float * dstPixel = &dstPixels[pixelIndex * dstChannelCount];
+        for (int i = 0; i < batchCount; ++i) {
+            dstPixel[0] = soa[0][i];
+            dstPixel[1] = soa[1][i];
+            dstPixel[2] = soa[2][i];
+            if (dstChannelCount > 3) {
+                dstPixel[3] = soa[3][i];
+            }
+            dstPixel += dstChannelCount;
+        }
+    }
+    return clTrue;
+}
+
+// Tetrahedral interpolation of transform->lut, 8 pixels per pass. Each pixel's cell is split into six
+// tetrahedra sharing the cell's black and white corners; the other two corners are found by walking
+// along the axes in order of decreasing fraction, and are gathered straight from the grid.
+clBool clTransformRunLUTBatch(struct clContext * C,
+                              clTransform * transform,
+                              const float * srcPixels,
+                              int srcChannelCount,
+                              float * dstPixels,
+                              int dstChannelCount,
+                              int pixelCount)
+{
+    COLORIST_UNUSED(C);
+
+    const float * lut = transform->lut;
+    const int size = transform->lutSize;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 maxIndex = _mm256_set1_ps((float)(size - 1));
+    const __m256i lastCell = _mm256_set1_epi32(size - 2);
+    const __m256i strideR = _mm256_set1_epi32(3);
+    const __m256i strideG = _mm256_set1_epi32(3 * size);
+    const __m256i strideB = _mm256_set1_epi32(3 * size * size);
+    const __m256i strideAll = _mm256_add_epi32(strideR, _mm256_add_epi32(strideG, strideB));
+
+    for (int pixelIndex = 0; pixelIndex < pixelCount; pixelIndex += CL_TRANSFORM_SIMD_WIDTH) {
+        int batchCount = pixelCount - pixelIndex;
+        if (batchCount > CL_TRANSFORM_SIMD_WIDTH) {
+            batchCount = CL_TRANSFORM_SIMD_WIDTH;
+        }
+
+        // Deinterleave into SoA lanes (unused lanes in the final batch are zero filled)
+        float soa[3][CL_TRANSFORM_SIMD_WIDTH];
+        const float * srcPixel = &srcPixels[pixelIndex * srcChannelCount];
+        for (int i = 0; i < CL_TRANSFORM_SIMD_WIDTH; ++i) {
+            if (i < batchCount) {
+                soa[0][i] = srcPixel[0];
+                soa[1][i] = srcPixel[1];
+                soa[2][i] = srcPixel[2];
+                srcPixel += srcChannelCount;
+            } else {
+                soa[0][i] = 0.0f;
+                soa[1][i] = 0.0f;
+                soa[2][i] = 0.0f;
+            }
+        }
+
+        __m256 r = _mm256_mul_ps(simdClampZeroOne(_mm256_loadu_ps(soa[0])), maxIndex);
+        __m256 g = _mm256_mul_ps(simdClampZeroOne(_mm256_loadu_ps(soa[1])), maxIndex);
+        __m256 b = _mm256_mul_ps(simdClampZeroOne(_mm256_loadu_ps(soa[2])), maxIndex);
+        __m256i ri = _mm256_min_epi32(_mm256_cvttps_epi32(r), lastCell);
+        __m256i gi = _mm256_min_epi32(_mm256_cvttps_epi32(g), lastCell);
+        __m256i bi = _mm256_min_epi32(_mm256_cvttps_epi32(b), lastCell);
+        __m256 fr = _mm256_sub_ps(r, _mm256_cvtepi32_ps(ri));
+        __m256 fg = _mm256_sub_ps(g, _mm256_cvtepi32_ps(gi));
+        __m256 fb = _mm256_sub_ps(b, _mm256_cvtepi32_ps(bi));
+
+        // Largest and smallest fraction pick the tetrahedron (ties pick distinct axes, and zero-weight corners)
+        __m256 rMax = _mm256_and_ps(_mm256_cmp_ps(fr, fg, _CMP_GE_OQ), _mm256_cmp_ps(fr, fb, _CMP_GE_OQ));
+        __m256 gMax = _mm256_andnot_ps(rMax, _mm256_cmp_ps(fg, fb, _CMP_GE_OQ));
+        __m256 bMin = _mm256_and_ps(_mm256_cmp_ps(fb, fg, _CMP_LE_OQ), _mm256_cmp_ps(fb, fr, _CMP_LE_OQ));
+        __m256 gMin = _mm256_andnot_ps(bMin, _mm256_cmp_ps(fg, fr, _CMP_LE_OQ));
+        __m256i offsetMax = _mm256_blendv_epi8(_mm256_blendv_epi8(strideB, strideG, _mm256_castps_si256(gMax)),
+                                               strideR,
+                                               _mm256_castps_si256(rMax));
+        __m256i offsetMin = _mm256_blendv_epi8(_mm256_blendv_epi8(strideR, strideG, _mm256_castps_si256(gMin)),
+                                               strideB,
+                                               _mm256_castps_si256(bMin));
+
+        __m256 f1 = _mm256_max_ps(fr, _mm256_max_ps(fg, fb));
+        __m256 f2 = _mm256_max_ps(_mm256_min_ps(fr, fg), _mm256_min_ps(_mm256_max_ps(fr, fg), fb));
+        __m256 f3 = _mm256_min_ps(fr, _mm256_min_ps(fg, fb));
+        __m256 w0 = _mm256_sub_ps(one, f1);
+        __m256 w1 = _mm256_sub_ps(f1, f2);
+        __m256 w2 = _mm256_sub_ps(f2, f3);
+
+        __m256i i0 = _mm256_add_epi32(_mm256_mullo_epi32(ri, strideR),
+                                      _mm256_add_epi32(_mm256_mullo_epi32(gi, strideG), _mm256_mullo_epi32(bi, strideB)));
+        __m256i i1 = _mm256_add_epi32(i0, offsetMax);
+        __m256i i2 = _mm256_add_epi32(i0, _mm256_sub_epi32(strideAll, offsetMin));
+        __m256i i3 = _mm256_add_epi32(i0, strideAll);
+        for (int channel = 0; channel < 3; ++channel) {
+            const float * lutChannel = lut + channel;
+            __m256 v = _mm256_mul_ps(f3, _mm256_i32gather_ps(lutChannel, i3, 4));
+            v = _mm256_fmadd_ps(w2, _mm256_i32gather_ps(lutChannel, i2, 4), v);
+            v = _mm256_fmadd_ps(w1, _mm256_i32gather_ps(lutChannel, i1, 4), v);
+            v = _mm256_fmadd_ps(w0, _mm256_i32gather_ps(lutChannel, i0, 4), v);
+            _mm256_storeu_ps(soa[channel], v);
+        }
+
+        float * dstPixel = &dstPixels[pixelIndex * dstChannelCount];
+        for (int i = 0; i < batchCount; ++i) {
+            dstPixel[0] = soa[0][i];
+            dstPixel[1] = soa[1][i];
+            dstPixel[2] = soa[2][i];
+            dstPixel += dstChannelCount;
+        }
+    }
+    return clTrue;
+}
+
+clBool clTransformRunQuantizeBatch(struct clContext * C,
+                                   const float * src,
+                                   void * dst,
+                                   clPixelFormat pixelFormat,
+                                   int depth,
+                                   int count)
+{
+    COLORIST_UNUSED(C);
+
+    // Same steps as the scalar loop: floor((v * max) + 0.5) without FMA, then clamp (NaN -> 0)
+    const float maxChannel = (float)((1 << depth) - 1);
+    const __m256 maxValue = _mm256_set1_ps(maxChannel);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    int i = 0;
+    for (; i + CL_TRANSFORM_SIMD_WIDTH <= count; i += CL_TRANSFORM_SIMD_WIDTH) {
+        __m256 v = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&src[i]), maxValue), half));
+        v = _mm256_min_ps(simdClampZero(v), maxValue);
+        __m256i q = _mm256_cvtps_epi32(v);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+        if (pixelFormat == CL_PIXELFORMAT_U8) {
+            _mm_storel_epi64((__m128i *)&((uint8_t *)dst)[i], _mm_packus_epi16(packed, packed));
+        } else {
+            _mm_storeu_si128((__m128i *)&((uint16_t *)dst)[i], packed);
+        }
+    }
+    for (; i < count; ++i) {
+        float v = floorf((src[i] * maxChannel) + 0.5f);
+        v = (v > 0.0f) ? ((v < maxChannel) ? v : maxChannel) : 0.0f;
+        if (pixelFormat == CL_PIXELFORMAT_U8) {
+            ((uint8_t *)dst)[i] = (uint8_t)v;
+        } else {
+            ((uint16_t *)dst)[i] = (uint16_t)v;
+        }
+    }
+    return clTrue;
+}
+
+#else /* if defined(__AVX2__) && defined(__FMA__) */
+
+clBool clTransformRunCCMMBatch(struct clContext * C,
+                               clTransform * transform,
+                               clBool srcLinear,
+                               const float * srcPixels,
+                               int srcChannelCount,
+                               float * dstPixels,
+                               int dstChannelCount,
+                               int pixelCount)
+{
+    // Not built with AVX2/FMA; the caller falls back to the scalar path
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(transform);
+    COLORIST_UNUSED(srcLinear);
+    COLORIST_UNUSED(srcPixels);
+    COLORIST_UNUSED(srcChannelCount);
+    COLORIST_UNUSED(dstPixels);
+    COLORIST_UNUSED(dstChannelCount);
+    COLORIST_UNUSED(pixelCount);
+    return clFalse;
+}
+
+clBool clTransformRunCurveBatch(struct clContext * C,
+                                clTransformTransferFunction xtf,
+                                float param,
+                                clBool oetf,
+                                float * values,
+                                int count)
+{
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(xtf);
+    COLORIST_UNUSED(param);
+    COLORIST_UNUSED(oetf);
+    COLORIST_UNUSED(values);
+    COLORIST_UNUSED(count);
+    return clFalse;
+}
+
+clBool clTransformRunLUTBatch(struct clContext * C,
+                              clTransform * transform,
+                              const float * srcPixels,
+                              int srcChannelCount,
+                              float * dstPixels,
+                              int dstChannelCount,
+                              int pixelCount)
+{
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(transform);
+    COLORIST_UNUSED(srcPixels);
+    COLORIST_UNUSED(srcChannelCount);
+    COLORIST_UNUSED(dstPixels);
+    COLORIST_UNUSED(dstChannelCount);
+    COLORIST_UNUSED(pixelCount);
+    return clFalse;
+}
+
+clBool clTransformRunQuantizeBatch(struct clContext * C,
+                                   const float * src,
+                                   void * dst,
+                                   clPixelFormat pixelFormat,
+                                   int depth,
+                                   int count)
+{
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(src);
+    COLORIST_UNUSED(dst);
+    COLORIST_UNUSED(pixelFormat);
+    COLORIST_UNUSED(depth);
+    COLORIST_UNUSED(count);
+    return clFalse;
+}
+
+#endif /* if defined(__AVX2__) && defined(__FMA__) */
+
+// ----------------------------------------------------------------------------
+// Half -> float expansion
+
+#if defined(__F16C__) && defined(__AVX__)
+
+#include <immintrin.h>
+
+clBool clTransformRunHalfToFloatBatch(struct clContext * C, const uint16_t * src, float * dst, int pixelCount, float rgbScale)
+{
+    COLORIST_UNUSED(C);
+
+    // Two pixels per batch, back to front like clTransformHalfToFloat(): each store only covers halves at or past
+    // the current batch (already loaded), so src may alias the start of dst.
+    const __m256 scale = _mm256_setr_ps(rgbScale, rgbScale, rgbScale, 1.0f, rgbScale, rgbScale, rgbScale, 1.0f);
+    const uint8_t * srcBytes = (const uint8_t *)src;
+    uint8_t * dstBytes = (uint8_t *)dst;
+    int i = pixelCount - 1;
+    if (pixelCount % 2) {
+        __m128 f = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(srcBytes + ((size_t)i * 4 * sizeof(uint16_t)))));
+        _mm_storeu_ps((float *)(dstBytes + ((size_t)i * 4 * sizeof(float))), _mm_mul_ps(f, _mm256_castps256_ps128(scale)));
+        --i;
+    }
+    for (i = i - 1; i >= 0; i -= 2) {
+        __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(srcBytes + ((size_t)i * 4 * sizeof(uint16_t)))));
+        _mm256_storeu_ps((float *)(dstBytes + ((size_t)i * 4 * sizeof(float))), _mm256_mul_ps(f, scale));
+    }
+    return clTrue;
+}
+
+clBool clTransformRunFloatToHalfBatch(struct clContext * C, const float * src, uint16_t * dst, int count)
+{
+    COLORIST_UNUSED(C);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128((__m128i *)&dst[i], _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT));
+    }
+    if (i < count) {
+        // Pad the tail through a small buffer rather than dropping to the scalar converter
+        float tail[8] = { 0 };
+        uint16_t tailHalves[8];
+        memcpy(tail, &src[i], sizeof(float) * (count - i));
+        _mm_storeu_si128((__m128i *)tailHalves, _mm256_cvtps_ph(_mm256_loadu_ps(tail), _MM_FROUND_TO_NEAREST_INT));
+        memcpy(&dst[i], tailHalves, sizeof(uint16_t) * (count - i));
+    }
+    return clTrue;
+}
+
+#else /* if defined(__F16C__) && defined(__AVX__) */
+
+clBool clTransformRunHalfToFloatBatch(struct clContext * C, const uint16_t * src, float * dst, int pixelCount, float rgbScale)
+{
+    // Not built with F16C; the caller falls back to the scalar path
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(src);
+    COLORIST_UNUSED(dst);
+    COLORIST_UNUSED(pixelCount);
+    COLORIST_UNUSED(rgbScale);
+    return clFalse;
+}
+
+clBool clTransformRunFloatToHalfBatch(struct clContext * C, const float * src, uint16_t * dst, int count)
+{
+    COLORIST_UNUSED(C);
+    COLORIST_UNUSED(src);
+    COLORIST_UNUSED(dst);
+    COLORIST_UNUSED(count);
+    return clFalse;
+}
+
+#endif /* if defined(__F16C__) && defined(__AVX__) */